@@ -0,0 +1,226 @@
+#include "BufferPool.h"
+#include <QMutexLocker>
+#include <QDebug>
+#include <cstdlib>
+
+#ifdef Q_OS_WIN
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// =====================================================================================
+// Seccion: Préstamo de buffers
+// =====================================================================================
+
+void BufferPool::Buffer::reset()
+{
+    if (m_data) {
+        BufferPool::instance().release(m_data);
+        m_data = nullptr;
+    }
+}
+
+BufferPool::ThreadCache::~ThreadCache()
+{
+    // Al terminar el hilo de la sesión sus bloques vuelven al pool global
+    for (int i = 0; i < count; ++i) {
+        BufferPool::instance().m_threadCached.fetch_sub(1, std::memory_order_relaxed);
+        BufferPool::instance().releaseToGlobal(blocks[i]);
+    }
+    count = 0;
+}
+
+BufferPool::ThreadCache &BufferPool::threadCache()
+{
+    thread_local ThreadCache cache;
+    return cache;
+}
+
+BufferPool::~BufferPool()
+{
+    QMutexLocker locker(&m_mutex);
+    for (char *block : m_freeBlocks) {
+        if (!m_arenaBlocks.contains(block)) {
+            freeBlock(block);
+        }
+    }
+    m_freeBlocks.clear();
+#ifdef Q_OS_LINUX
+    for (const Arena &arena : m_arenas) {
+        munmap(arena.base, arena.size);
+    }
+#endif
+    m_arenas.clear();
+    m_arenaBlocks.clear();
+}
+
+bool BufferPool::configure(qint64 blockSize, int maxBlocks, bool useHugePages)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_allocatedBlocks > 0) {
+        qWarning() << "BufferPool: configuración ignorada, el pool ya tiene bloques reservados";
+        return false;
+    }
+    if (blockSize < Alignment || maxBlocks <= 0) {
+        return false;
+    }
+
+    // Redondear al múltiplo de página para mantener la alineación de cada bloque
+    m_blockSize = (blockSize + Alignment - 1) / Alignment * Alignment;
+    m_maxBlocks = maxBlocks;
+    m_useHugePages = useHugePages;
+    qInfo() << QString("BufferPool configurado: bloques de %1 KB, máximo %2 bloques (%3 MB)%4")
+               .arg(m_blockSize / 1024)
+               .arg(m_maxBlocks)
+               .arg(m_blockSize * m_maxBlocks / (1024 * 1024))
+               .arg(m_useHugePages ? ", huge pages" : "");
+    return true;
+}
+
+BufferPool::Buffer BufferPool::acquire()
+{
+    m_acquisitions.fetch_add(1, std::memory_order_relaxed);
+
+    char *block = nullptr;
+    ThreadCache &cache = threadCache();
+    if (cache.count > 0) {
+        block = cache.blocks[--cache.count];
+        m_threadCached.fetch_sub(1, std::memory_order_relaxed);
+        m_threadCacheHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        QMutexLocker locker(&m_mutex);
+        if (!m_freeBlocks.isEmpty()) {
+            block = m_freeBlocks.takeLast();
+        } else if (m_allocatedBlocks < m_maxBlocks) {
+            block = allocateBlock();
+            if (block) {
+                ++m_allocatedBlocks;
+            }
+        }
+    }
+
+    if (!block) {
+        m_exhausted.fetch_add(1, std::memory_order_relaxed);
+        return Buffer();
+    }
+
+    int inUse = m_inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+    int peak = m_peakInUse.load(std::memory_order_relaxed);
+    while (inUse > peak && !m_peakInUse.compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) {
+    }
+    return Buffer(block);
+}
+
+void BufferPool::release(char *block)
+{
+    m_inUse.fetch_sub(1, std::memory_order_relaxed);
+
+    // Las cachés por hilo retienen como mucho una cuarta parte del pool, para que
+    // las sesiones inactivas no dejen sin bloques a las que están transfiriendo.
+    ThreadCache &cache = threadCache();
+    if (cache.count < ThreadCacheSize &&
+        m_threadCached.load(std::memory_order_relaxed) < m_maxBlocks / 4) {
+        cache.blocks[cache.count++] = block;
+        m_threadCached.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    releaseToGlobal(block);
+}
+
+void BufferPool::releaseToGlobal(char *block)
+{
+    QMutexLocker locker(&m_mutex);
+    m_freeBlocks.append(block);
+}
+
+void BufferPool::trim()
+{
+    // Los bloques de las zonas de huge pages no se pueden devolver sueltos: siguen libres en el pool
+    QMutexLocker locker(&m_mutex);
+    QVector<char *> kept;
+    for (char *block : m_freeBlocks) {
+        if (m_arenaBlocks.contains(block)) {
+            kept.append(block);
+            continue;
+        }
+        freeBlock(block);
+        --m_allocatedBlocks;
+    }
+    m_freeBlocks = kept;
+    m_freeBlocks.squeeze();
+}
+
+BufferPool::Stats BufferPool::stats() const
+{
+    Stats s;
+    {
+        QMutexLocker locker(&m_mutex);
+        s.blockSize = m_blockSize;
+        s.maxBlocks = m_maxBlocks;
+        s.allocatedBlocks = m_allocatedBlocks;
+        s.hugePages = m_useHugePages;
+    }
+    s.inUse = m_inUse.load(std::memory_order_relaxed);
+    s.peakInUse = m_peakInUse.load(std::memory_order_relaxed);
+    s.acquisitions = m_acquisitions.load(std::memory_order_relaxed);
+    s.threadCacheHits = m_threadCacheHits.load(std::memory_order_relaxed);
+    s.exhausted = m_exhausted.load(std::memory_order_relaxed);
+    return s;
+}
+
+// =====================================================================================
+// Seccion: Reserva de memoria (llamadas con m_mutex tomado)
+// =====================================================================================
+
+char *BufferPool::allocateBlock()
+{
+#ifdef Q_OS_WIN
+    return static_cast<char *>(_aligned_malloc(static_cast<size_t>(m_blockSize), Alignment));
+#else
+    const size_t size = static_cast<size_t>(m_blockSize);
+#ifdef Q_OS_LINUX
+    if (m_useHugePages) {
+        if (m_arenaLeft < m_blockSize) {
+            // Zona nueva: varias huge pages enteras (8 bloques de 256 KB por cada una de
+            // 2 MB), así el tope del pool sigue midiendo la memoria de verdad reservada
+            const qint64 pages = (qMax(m_blockSize, HugePageSize) + HugePageSize - 1) / HugePageSize;
+            const qint64 blocksPerArena = pages * HugePageSize / m_blockSize;
+            const qint64 wanted = qMin<qint64>(blocksPerArena, m_maxBlocks - m_allocatedBlocks);
+            const size_t arenaSize = static_cast<size_t>((wanted * m_blockSize + HugePageSize - 1)
+                                                         / HugePageSize * HugePageSize);
+            void *mapped = mmap(nullptr, arenaSize, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mapped != MAP_FAILED) {
+                m_arenas.append(Arena{static_cast<char *>(mapped), arenaSize});
+                m_arenaNext = static_cast<char *>(mapped);
+                m_arenaLeft = qint64(arenaSize);
+            }
+            // Sin huge pages reservadas: memoria normal para este bloque
+        }
+        if (m_arenaLeft >= m_blockSize) {
+            char *block = m_arenaNext;
+            m_arenaNext += m_blockSize;
+            m_arenaLeft -= m_blockSize;
+            m_arenaBlocks.insert(block);
+            return block;
+        }
+    }
+#endif
+    void *memory = nullptr;
+    if (posix_memalign(&memory, static_cast<size_t>(Alignment), size) != 0) {
+        qCritical() << "BufferPool: no se pudo reservar un bloque de" << m_blockSize << "bytes";
+        return nullptr;
+    }
+    return static_cast<char *>(memory);
+#endif
+}
+
+void BufferPool::freeBlock(char *block)
+{
+#ifdef Q_OS_WIN
+    _aligned_free(block);
+#else
+    free(block);    // Los de las zonas de huge pages no pasan por aquí
+#endif
+}
@@ -0,0 +1,127 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QtGlobal>
+#include <QMutex>
+#include <QVector>
+#include <QSet>
+#include <atomic>
+
+// Pool de buffers de transferencia compartido por todo el proceso.
+// Todos los bloques tienen el mismo tamaño y están alineados a página, de modo
+// que las transferencias los toman prestados y los devuelven sin pasar por el
+// heap en cada lectura. El número total de bloques tiene un tope fijo, así que
+// la memoria usada por las transferencias no crece con el número de sesiones.
+class BufferPool {
+public:
+    struct Stats {
+        qint64 blockSize = 0;
+        int maxBlocks = 0;
+        int allocatedBlocks = 0;   // Bloques reservados al sistema
+        int inUse = 0;             // Bloques prestados en este momento
+        int peakInUse = 0;
+        quint64 acquisitions = 0;
+        quint64 threadCacheHits = 0;
+        quint64 exhausted = 0;     // Peticiones rechazadas por alcanzar el tope
+        bool hugePages = false;
+    };
+
+    // Préstamo RAII de un bloque: se devuelve al pool al destruirse.
+    class Buffer {
+    public:
+        Buffer() = default;
+        ~Buffer() { reset(); }
+        Buffer(Buffer &&other) noexcept : m_data(other.m_data) { other.m_data = nullptr; }
+        Buffer &operator=(Buffer &&other) noexcept {
+            if (this != &other) {
+                reset();
+                m_data = other.m_data;
+                other.m_data = nullptr;
+            }
+            return *this;
+        }
+        Buffer(const Buffer &) = delete;
+        Buffer &operator=(const Buffer &) = delete;
+
+        bool isNull() const { return m_data == nullptr; }
+        char *data() const { return m_data; }
+        qint64 size() const { return BufferPool::instance().blockSize(); }
+        void reset();
+
+    private:
+        friend class BufferPool;
+        explicit Buffer(char *data) : m_data(data) {}
+        char *m_data = nullptr;
+    };
+
+    static BufferPool &instance() {
+        static BufferPool instance;
+        return instance;
+    }
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    // Solo tiene efecto antes de reservar el primer bloque.
+    bool configure(qint64 blockSize, int maxBlocks, bool useHugePages);
+
+    // Devuelve un buffer nulo si se alcanzó el tope; el llamador debe reintentar más tarde.
+    Buffer acquire();
+
+    // Libera al sistema los bloques libres del pool global.
+    void trim();
+
+    qint64 blockSize() const { return m_blockSize; }
+    Stats stats() const;
+
+    static constexpr qint64 DefaultBlockSize = 256 * 1024;
+    static constexpr int DefaultMaxBlocks = 512;
+    static constexpr int ThreadCacheSize = 4;
+    static constexpr qint64 Alignment = 4096;
+    // Huge page por defecto en x86-64 y arm64: mmap(MAP_HUGETLB) reserva y libera en múltiplos de ella
+    static constexpr qint64 HugePageSize = 2 * 1024 * 1024;
+
+private:
+    BufferPool() = default;
+    ~BufferPool();
+
+    struct ThreadCache {
+        char *blocks[ThreadCacheSize] = {};
+        int count = 0;
+        ~ThreadCache();
+    };
+    static ThreadCache &threadCache();
+
+    char *allocateBlock();
+    void freeBlock(char *block);
+    void release(char *block);
+    void releaseToGlobal(char *block);
+
+    qint64 m_blockSize = DefaultBlockSize;
+    int m_maxBlocks = DefaultMaxBlocks;
+    bool m_useHugePages = false;
+
+    mutable QMutex m_mutex;
+    QVector<char *> m_freeBlocks;
+    int m_allocatedBlocks = 0;
+
+    // Con huge pages los bloques se recortan de zonas de mmap(MAP_HUGETLB) de
+    // tamaño múltiplo de la huge page; la zona solo se devuelve al destruir el pool
+    struct Arena {
+        char *base = nullptr;
+        size_t size = 0;
+    };
+    QVector<Arena> m_arenas;
+    QSet<char *> m_arenaBlocks;    // Bloques recortados de una zona: trim() no los libera
+    char *m_arenaNext = nullptr;   // Siguiente bloque por recortar de la última zona
+    qint64 m_arenaLeft = 0;
+
+    std::atomic<int> m_threadCached{0};  // Bloques retenidos en cachés por hilo
+    std::atomic<int> m_inUse{0};
+    std::atomic<int> m_peakInUse{0};
+    std::atomic<quint64> m_acquisitions{0};
+    std::atomic<quint64> m_threadCacheHits{0};
+    std::atomic<quint64> m_exhausted{0};
+};
+
+#endif // BUFFERPOOL_H
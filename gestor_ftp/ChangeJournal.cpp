@@ -0,0 +1,478 @@
+#include "ChangeJournal.h"
+#include "DirectoryLister.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QDebug>
+#include <algorithm>
+#include <limits>
+
+namespace {
+// Tras anotar un cambio propio, sus eventos de inotify pueden llegar hasta este tiempo después
+constexpr qint64 OwnWindowMs = 5000;
+constexpr qint64 OwnInProgress = std::numeric_limits<qint64>::max();
+constexpr int MaxOwnEntries = 4096;
+
+QString segmentName(quint64 firstSequence)
+{
+    // Con ceros a la izquierda el orden alfabético es el de las secuencias
+    return QString("changes-%1.log").arg(firstSequence, 20, 10, QLatin1Char('0'));
+}
+
+quint64 sequenceOf(const QByteArray &line)
+{
+    const int space = line.indexOf(' ');
+    return space > 0 ? line.left(space).toULongLong() : 0;
+}
+} // namespace
+
+// =====================================================================================
+// Seccion: Configuración
+// =====================================================================================
+
+void ChangeJournal::configure(bool enabled, const QString &root, const QString &dir, qint64 maxBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_file.close();
+    m_segments.clear();
+    m_own.clear();
+    m_enabled = enabled;
+    m_root = QDir::cleanPath(QDir(root).absolutePath());
+    m_dir = dir.isEmpty() ? QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/journal" : dir;
+    m_maxBytes = qMax<qint64>(1024 * 1024, maxBytes);
+    m_segmentBytes = qMax<qint64>(1024 * 1024, m_maxBytes / 8);
+    m_lastSequence = 0;
+    if (!enabled) {
+        qInfo() << "Diario de cambios desactivado";
+        return;
+    }
+
+    // Solo se leen los nombres de los segmentos y la cola del último
+    QDir journalDir(m_dir);
+    journalDir.mkpath(".");
+    static const QRegularExpression pattern("^changes-(\\d{20})\\.log$");
+    const QStringList names = journalDir.entryList({"changes-*.log"}, QDir::Files, QDir::Name);
+    for (const QString &name : names) {
+        const QRegularExpressionMatch match = pattern.match(name);
+        if (!match.hasMatch()) {
+            continue;
+        }
+        SegmentInfo segment;
+        segment.firstSequence = match.captured(1).toULongLong();
+        segment.path = journalDir.filePath(name);
+        segment.size = QFileInfo(segment.path).size();
+        m_segments.push_back(segment);
+    }
+    if (!m_segments.empty()) {
+        m_lastSequence = lastSequenceIn(m_segments.back().path);
+        if (m_lastSequence == 0) {
+            m_lastSequence = m_segments.back().firstSequence - 1; // Segmento vacío
+        }
+    }
+    if (!openSegmentLocked(m_segments.empty() ? 1 : m_segments.back().firstSequence)) {
+        return;
+    }
+
+    // Diario de otra raíz: lo anterior ya no describe este árbol
+    QFile rootFile(journalDir.filePath("root"));
+    QString storedRoot;
+    if (rootFile.open(QIODevice::ReadOnly)) {
+        storedRoot = QString::fromUtf8(rootFile.readAll()).trimmed();
+        rootFile.close();
+    }
+    if (storedRoot != m_root) {
+        if (rootFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            rootFile.write(m_root.toUtf8());
+        }
+        if (!storedRoot.isEmpty() || m_lastSequence > 0) {
+            appendLocked(Kind::Rescan, m_root, true, QString());
+        }
+    }
+    qInfo() << "Diario de cambios en" << m_dir << "- última secuencia" << m_lastSequence;
+}
+
+void ChangeJournal::setRoot(const QString &root)
+{
+    QString dir;
+    qint64 maxBytes = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_enabled || QDir::cleanPath(QDir(root).absolutePath()) == m_root) {
+            return;
+        }
+        dir = m_dir;
+        maxBytes = m_maxBytes;
+    }
+    configure(true, root, dir, maxBytes);
+}
+
+bool ChangeJournal::isEnabled() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_enabled;
+}
+
+// =====================================================================================
+// Seccion: Escritura
+// =====================================================================================
+
+bool ChangeJournal::openSegmentLocked(quint64 firstSequence)
+{
+    m_file.close();
+    const QString path = QDir(m_dir).filePath(segmentName(firstSequence));
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCritical() << "No se pudo abrir el diario de cambios" << path << m_file.errorString();
+        m_enabled = false;
+        return false;
+    }
+    if (m_segments.empty() || m_segments.back().path != path) {
+        m_segments.push_back(SegmentInfo{firstSequence, path, m_file.size()});
+    }
+    return true;
+}
+
+void ChangeJournal::pruneLocked()
+{
+    qint64 total = 0;
+    for (const SegmentInfo &segment : m_segments) {
+        total += segment.size;
+    }
+    // El segmento actual no se borra nunca
+    while (m_segments.size() > 1 && total > m_maxBytes) {
+        total -= m_segments.front().size;
+        if (!QFile::remove(m_segments.front().path)) {
+            break; // Abierto por una consulta (Windows): se reintenta en la próxima rotación
+        }
+        m_segments.erase(m_segments.begin());
+    }
+}
+
+QString ChangeJournal::relativeLocked(const QString &path) const
+{
+    const QString clean = QDir::cleanPath(path);
+    if (clean == m_root) {
+        return QStringLiteral("/");
+    }
+    if (!clean.startsWith(m_root) || clean.at(m_root.size()) != QLatin1Char('/')) {
+        return QString();
+    }
+    return clean.mid(m_root.size());
+}
+
+void ChangeJournal::appendLocked(Kind kind, const QString &path, bool isDir, const QString &newPath)
+{
+    const QString relative = relativeLocked(path);
+    const QString newRelative = newPath.isEmpty() ? QString() : relativeLocked(newPath);
+    if (relative.isEmpty() || (!newPath.isEmpty() && newRelative.isEmpty())) {
+        return; // Fuera de la raíz
+    }
+
+    const quint64 sequence = m_lastSequence + 1;
+    if (m_file.size() >= m_segmentBytes) {
+        if (!openSegmentLocked(sequence)) {
+            return;
+        }
+        pruneLocked();
+    }
+
+    QByteArray line = QByteArray::number(sequence);
+    line += ' ';
+    line += DirectoryLister::timeVal(QDateTime::currentSecsSinceEpoch());
+    line += ' ';
+    line += kindName(kind);
+    line += isDir ? " dir " : " file ";
+    line += relative.toUtf8();
+    if (!newRelative.isEmpty()) {
+        line += '\t';
+        line += newRelative.toUtf8();
+    }
+    line += "\r\n";
+
+    // Una línea por escritura: una consulta nunca ve media línea
+    if (m_file.write(line) != line.size() || !m_file.flush()) {
+        qWarning() << "Error escribiendo en el diario de cambios:" << m_file.errorString();
+        return;
+    }
+    m_lastSequence = sequence;
+    m_segments.back().size = m_file.size();
+    m_recorded++;
+}
+
+void ChangeJournal::record(Kind kind, const QString &path, bool isDir, const QString &newPath)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_enabled) {
+        return;
+    }
+    appendLocked(kind, path, isDir, newPath);
+
+    // Los eventos de inotify de este cambio llegarán después: no repetirlos. Un alta
+    // llega como IN_CREATE y luego IN_CLOSE_WRITE, y el recorrido del índice puede
+    // verla como alta o como modificación; un renombrado sin pareja, como borrado y alta
+    const qint64 until = QDateTime::currentMSecsSinceEpoch() + OwnWindowMs;
+    const quint8 written = kindBit(Kind::Create) | kindBit(Kind::Modify);
+    switch (kind) {
+    case Kind::Create:
+    case Kind::Modify:
+        ownLocked(path, written, false, until);
+        break;
+    case Kind::Delete:
+        ownLocked(path, kindBit(Kind::Delete), isDir, until);
+        break;
+    case Kind::Rename:
+        ownLocked(path, kindBit(Kind::Rename) | kindBit(Kind::Delete), false, until);
+        ownLocked(newPath, kindBit(Kind::Rename) | written, false, until);
+        break;
+    case Kind::Rescan:
+        break;
+    }
+}
+
+void ChangeJournal::beginOwn(const QString &path, quint8 kinds, bool deletesBelow)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_enabled) {
+        return;
+    }
+    ownLocked(path, kinds, deletesBelow, OwnInProgress);
+}
+
+void ChangeJournal::endOwn(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_own.find(QDir::cleanPath(path));
+    // Si ya pasó por record() tiene su propia ventana
+    if (it != m_own.end() && it->until == OwnInProgress) {
+        it->until = QDateTime::currentMSecsSinceEpoch() + OwnWindowMs;
+    }
+}
+
+void ChangeJournal::ownLocked(const QString &path, quint8 kinds, bool deletesBelow, qint64 until)
+{
+    if (path.isEmpty()) {
+        return;
+    }
+    // Se suman a lo que ya se esperaba (RMD: beginOwn y después record)
+    Own &own = m_own[QDir::cleanPath(path)];
+    const bool live = own.until >= QDateTime::currentMSecsSinceEpoch();
+    own.kinds = live ? quint8(own.kinds | kinds) : kinds;
+    own.deletesBelow = live ? (own.deletesBelow || deletesBelow) : deletesBelow;
+    own.until = until;
+}
+
+bool ChangeJournal::ownedLocked(const QString &path, Kind kind, qint64 nowMs)
+{
+    if (m_own.isEmpty()) {
+        return false;
+    }
+    if (m_own.size() > MaxOwnEntries) {
+        m_own.removeIf([nowMs](QHash<QString, Own>::iterator it) { return it->until < nowMs; });
+    }
+    // La misma ruta y la misma clase de cambio
+    QString current = QDir::cleanPath(path);
+    const auto exact = m_own.constFind(current);
+    if (exact != m_own.constEnd() && exact->until >= nowMs && (exact->kinds & kindBit(kind))) {
+        return true;
+    }
+    if (kind != Kind::Delete) {
+        return false;
+    }
+    // Borrado dentro de una carpeta que el servidor está borrando o acaba de borrar
+    while (current.size() > m_root.size()) {
+        const int slash = current.lastIndexOf(QLatin1Char('/'));
+        if (slash <= 0) {
+            break;
+        }
+        current.truncate(slash);
+        const auto it = m_own.constFind(current);
+        if (it != m_own.constEnd() && it->until >= nowMs && it->deletesBelow) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ChangeJournal::recordExternal(Kind kind, const QString &path, bool isDir, const QString &newPath)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_enabled) {
+        return;
+    }
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (kind != Kind::Rescan && (ownedLocked(path, kind, now) || (!newPath.isEmpty() && ownedLocked(newPath, kind, now)))) {
+        m_suppressed++;
+        return;
+    }
+    appendLocked(kind, path, isDir, newPath);
+    m_external++;
+}
+
+QByteArray ChangeJournal::kindName(Kind kind)
+{
+    switch (kind) {
+    case Kind::Create: return QByteArrayLiteral("create");
+    case Kind::Modify: return QByteArrayLiteral("modify");
+    case Kind::Delete: return QByteArrayLiteral("delete");
+    case Kind::Rename: return QByteArrayLiteral("rename");
+    case Kind::Rescan: return QByteArrayLiteral("rescan");
+    }
+    return QByteArray();
+}
+
+// =====================================================================================
+// Seccion: Consultas
+// =====================================================================================
+
+quint64 ChangeJournal::lastSequenceIn(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return 0;
+    }
+    // La última línea completa está en la cola del archivo
+    const qint64 tail = qMin<qint64>(file.size(), 8192);
+    file.seek(file.size() - tail);
+    const QByteArray data = file.read(tail);
+    const int end = data.lastIndexOf('\n');
+    if (end < 0) {
+        return 0;
+    }
+    const int start = data.lastIndexOf('\n', end - 1) + 1;
+    return sequenceOf(data.mid(start, end - start));
+}
+
+qint64 ChangeJournal::offsetAfter(QFile &file, qint64 end, quint64 since)
+{
+    // Búsqueda binaria por líneas: 'low' siempre está al principio de una línea con secuencia <= since o en 0
+    qint64 low = 0;
+    qint64 high = end;
+    while (high - low > 4096) {
+        const qint64 middle = low + (high - low) / 2;
+        file.seek(middle);
+        file.readLine(); // Resto de la línea a medias
+        const qint64 lineStart = file.pos();
+        if (lineStart >= high) {
+            high = middle;
+            continue;
+        }
+        if (sequenceOf(file.readLine()) <= since) {
+            low = lineStart;
+        } else {
+            high = middle;
+        }
+    }
+    // Tramo final lineal
+    file.seek(low);
+    while (file.pos() < end) {
+        const qint64 lineStart = file.pos();
+        const QByteArray line = file.readLine();
+        if (line.isEmpty()) {
+            break;
+        }
+        if (sequenceOf(line) > since) {
+            return lineStart;
+        }
+    }
+    return end;
+}
+
+std::unique_ptr<ChangeJournal::Reader> ChangeJournal::openReader(quint64 since)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_enabled || m_segments.empty()) {
+        return nullptr;
+    }
+    m_queries++;
+    const quint64 first = m_segments.front().firstSequence;
+    if (since + 1 < first || since > m_lastSequence) {
+        return nullptr; // Ya se borró, o de otro diario: hace falta un recorrido completo
+    }
+
+    auto reader = std::make_unique<Reader>();
+    reader->m_lastSequence = m_lastSequence;
+    // Segmentos que pueden tener secuencias > since; el actual, hasta lo escrito ahora
+    for (size_t i = 0; i < m_segments.size(); ++i) {
+        const bool last = i + 1 == m_segments.size();
+        if (!last && m_segments[i + 1].firstSequence <= since + 1) {
+            continue;
+        }
+        Reader::Segment segment;
+        segment.path = m_segments[i].path;
+        segment.end = m_segments[i].size;
+        reader->m_segments.push_back(segment);
+    }
+    locker.unlock();
+
+    // Solo el primero empieza a mitad
+    if (!reader->m_segments.empty()) {
+        Reader::Segment &head = reader->m_segments.front();
+        QFile file(head.path);
+        if (file.open(QIODevice::ReadOnly)) {
+            head.start = offsetAfter(file, head.end, since);
+        }
+    }
+    return reader;
+}
+
+qint64 ChangeJournal::Reader::next(QByteArray &out, qint64 maxBytes)
+{
+    const qint64 before = out.size();
+    while (!atEnd() && out.size() - before < maxBytes) {
+        Segment &segment = m_segments[m_index];
+        if (!m_file.isOpen()) {
+            m_file.setFileName(segment.path);
+            if (!m_file.open(QIODevice::ReadOnly) || !m_file.seek(segment.start)) {
+                qWarning() << "No se pudo leer el segmento del diario" << segment.path;
+                m_file.close();
+                m_index++;
+                continue;
+            }
+        }
+        const qint64 wanted = qMin(maxBytes - (out.size() - before), segment.end - m_file.pos());
+        if (wanted > 0) {
+            const QByteArray data = m_file.read(wanted);
+            out.append(data);
+            if (data.size() == wanted) {
+                continue;
+            }
+        }
+        // Segmento terminado (o más corto de lo esperado)
+        m_file.close();
+        m_index++;
+    }
+    return out.size() - before;
+}
+
+quint64 ChangeJournal::firstSequence() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_segments.empty() ? 0 : m_segments.front().firstSequence;
+}
+
+quint64 ChangeJournal::lastSequence() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_lastSequence;
+}
+
+ChangeJournal::Stats ChangeJournal::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    Stats s;
+    s.enabled = m_enabled;
+    s.firstSequence = m_segments.empty() ? 0 : m_segments.front().firstSequence;
+    s.lastSequence = m_lastSequence;
+    s.segments = int(m_segments.size());
+    for (const SegmentInfo &segment : m_segments) {
+        s.bytes += segment.size;
+    }
+    s.recorded = m_recorded;
+    s.external = m_external;
+    s.suppressed = m_suppressed;
+    s.queries = m_queries;
+    return s;
+}
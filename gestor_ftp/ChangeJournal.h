@@ -0,0 +1,143 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QFile>
+#include <QMutex>
+#include <memory>
+#include <vector>
+
+// Diario de cambios del árbol servido, solo de añadir, para sincronizaciones
+// incrementales ("qué cambió desde la secuencia N").
+//
+// Cada cambio lleva un número de secuencia creciente y se escribe como una línea:
+//   <secuencia> <YYYYMMDDHHMMSS> <create|modify|delete|rename|rescan> <file|dir> <ruta>[\t<ruta nueva>]
+// con rutas relativas a la raíz. "rescan" indica que se perdieron cambios (cola
+// de inotify desbordada, otra raíz) y que el cliente debe recorrer el árbol entero.
+//
+// Lo alimentan STOR, DELE, MKD y RMD y, si el índice de metadatos está activo,
+// inotify a través de él (los cambios de fuera del servidor), sin duplicar lo que
+// el servidor ya anotó. El diario se guarda en segmentos con el número de la
+// primera secuencia en el nombre; al superar el tope se borran los más antiguos.
+// SITE CHANGES <n> localiza la primera línea posterior con una búsqueda binaria
+// en el segmento y copia los bytes tal cual, así que el coste depende de los
+// cambios enviados y no del tamaño del árbol.
+class ChangeJournal {
+public:
+    enum class Kind : quint8 { Create, Modify, Delete, Rename, Rescan };
+
+    // Eventos de inotify que se esperan de una operación propia, uno por bit
+    static constexpr quint8 kindBit(Kind kind) { return quint8(1u << quint8(kind)); }
+    static constexpr quint8 AnyKind = 0x0F;     // Todos salvo Rescan
+
+    struct Stats {
+        bool enabled = false;
+        quint64 firstSequence = 0;     // La más antigua que aún se conserva
+        quint64 lastSequence = 0;
+        int segments = 0;
+        qint64 bytes = 0;
+        quint64 recorded = 0;          // Desde el arranque
+        quint64 external = 0;          // De ellos, vistos por inotify
+        quint64 suppressed = 0;        // Eventos de inotify que repetían un cambio propio
+        quint64 queries = 0;
+    };
+
+    // Copia en orden las líneas de una consulta, hasta la última secuencia que había al abrirla
+    class Reader {
+    public:
+        qint64 next(QByteArray &out, qint64 maxBytes = 64 * 1024);
+        bool atEnd() const { return m_index >= m_segments.size(); }
+        quint64 lastSequence() const { return m_lastSequence; }
+
+    private:
+        friend class ChangeJournal;
+        struct Segment {
+            QString path;
+            qint64 start = 0;
+            qint64 end = 0;
+        };
+        std::vector<Segment> m_segments;
+        size_t m_index = 0;
+        QFile m_file;
+        quint64 m_lastSequence = 0;
+    };
+
+    static constexpr qint64 DefaultMaxBytes = 256LL * 1024 * 1024;
+
+    static ChangeJournal& instance() {
+        static ChangeJournal instance;
+        return instance;
+    }
+
+    ChangeJournal(const ChangeJournal &) = delete;
+    ChangeJournal &operator=(const ChangeJournal &) = delete;
+
+    // dir vacío: <AppData>/journal
+    void configure(bool enabled, const QString &root, const QString &dir = QString(),
+                   qint64 maxBytes = DefaultMaxBytes);
+    void setRoot(const QString &root);
+    bool isEnabled() const;
+
+    // Cambio hecho por el servidor. Los eventos de inotify que provoca (la misma ruta y
+    // la misma clase de cambio, y los borrados de lo que había dentro de una carpeta
+    // borrada) no se vuelven a anotar; lo demás, aunque sea de la misma carpeta, sí
+    void record(Kind kind, const QString &path, bool isDir, const QString &newPath = QString());
+    // Operación del servidor en curso sobre la ruta: se ignoran los eventos 'kinds' de
+    // esa ruta exacta y, con 'deletesBelow', los borrados de lo que cuelga de ella (RMD)
+    void beginOwn(const QString &path, quint8 kinds, bool deletesBelow = false);
+    // Fin de una operación de beginOwn que no llega a record() (falló o se abortó):
+    // sus últimos eventos de inotify se siguen ignorando durante unos segundos
+    void endOwn(const QString &path);
+    // Cambio visto por inotify
+    void recordExternal(Kind kind, const QString &path, bool isDir, const QString &newPath = QString());
+
+    // nullptr si 'since' ya no está en el diario (o es posterior a la última)
+    std::unique_ptr<Reader> openReader(quint64 since);
+
+    quint64 firstSequence() const;
+    quint64 lastSequence() const;
+    Stats stats() const;
+
+    static QByteArray kindName(Kind kind);
+
+private:
+    ChangeJournal() = default;
+
+    struct SegmentInfo {
+        quint64 firstSequence = 0;
+        QString path;
+        qint64 size = 0;
+    };
+
+    void appendLocked(Kind kind, const QString &path, bool isDir, const QString &newPath);
+    bool openSegmentLocked(quint64 firstSequence);
+    void pruneLocked();
+    void ownLocked(const QString &path, quint8 kinds, bool deletesBelow, qint64 until);
+    bool ownedLocked(const QString &path, Kind kind, qint64 nowMs);
+    QString relativeLocked(const QString &path) const;
+    static qint64 offsetAfter(QFile &file, qint64 end, quint64 since);
+    static quint64 lastSequenceIn(const QString &path);
+
+    mutable QMutex m_mutex;
+    bool m_enabled = false;
+    QString m_root;
+    QString m_dir;
+    qint64 m_maxBytes = DefaultMaxBytes;
+    qint64 m_segmentBytes = 0;
+    std::vector<SegmentInfo> m_segments;    // De la más antigua a la actual
+    QFile m_file;                           // Segmento actual, abierto para añadir
+    quint64 m_lastSequence = 0;
+
+    // Rutas tocadas por el servidor -> qué eventos de inotify ignorar y hasta cuándo
+    struct Own {
+        qint64 until = 0;               // OwnInProgress mientras dura la operación
+        quint8 kinds = 0;               // kindBit() de los eventos de la propia ruta
+        bool deletesBelow = false;      // Borrados de lo que cuelga de ella
+    };
+    QHash<QString, Own> m_own;
+
+    quint64 m_recorded = 0;
+    quint64 m_external = 0;
+    quint64 m_suppressed = 0;
+    quint64 m_queries = 0;
+};
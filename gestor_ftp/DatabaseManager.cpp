@@ -49,6 +49,22 @@ void DatabaseManager::createTables(QSqlDatabase &db) {
                "username TEXT PRIMARY KEY CHECK(length(username) BETWEEN 4 AND 20), "
                "password TEXT NOT NULL CHECK(length(password) = 64),"  // Longitud exacta para SHA-256
                "salt TEXT NOT NULL CHECK(length(salt) = 8))");         // Salt de 8 caracteres
+    // Cuotas de espacio: por usuario (sobre su directorio de inicio) y por carpeta (relativa a la raíz)
+    query.exec("CREATE TABLE IF NOT EXISTS user_quotas ("
+               "username TEXT PRIMARY KEY REFERENCES users(username) ON DELETE CASCADE, "
+               "max_bytes INTEGER NOT NULL CHECK(max_bytes > 0))");
+    query.exec("CREATE TABLE IF NOT EXISTS directory_quotas ("
+               "path TEXT PRIMARY KEY CHECK(substr(path, 1, 1) = '/'), "
+               "max_bytes INTEGER NOT NULL CHECK(max_bytes > 0))");
+    // Carpeta personal y reglas de permisos por usuario; se compilan al iniciar sesión (UserRules)
+    query.exec("CREATE TABLE IF NOT EXISTS user_homes ("
+               "username TEXT PRIMARY KEY REFERENCES users(username) ON DELETE CASCADE, "
+               "home TEXT NOT NULL CHECK(substr(home, 1, 1) = '/'))");
+    query.exec("CREATE TABLE IF NOT EXISTS user_permissions ("
+               "username TEXT NOT NULL REFERENCES users(username) ON DELETE CASCADE, "
+               "path TEXT NOT NULL CHECK(substr(path, 1, 1) = '/'), "
+               "perms TEXT NOT NULL, "
+               "PRIMARY KEY (username, path))");
 }
 
 DatabaseManager::~DatabaseManager() {
@@ -100,7 +116,15 @@ bool DatabaseManager::removeUser(const QString &username) {
         qWarning() << "Error eliminando usuario:" << query.lastError().text();
         return false;
     }
-    return query.numRowsAffected() > 0;
+    const bool removed = query.numRowsAffected() > 0;
+    // Las claves foráneas no están activadas en estas conexiones: cuota, carpeta personal
+    // y permisos se borran a mano
+    for (const char *table : {"user_quotas", "user_homes", "user_permissions"}) {
+        query.prepare(QString("DELETE FROM %1 WHERE username = :user").arg(table));
+        query.bindValue(":user", username);
+        query.exec();
+    }
+    return removed;
 }
 
 QHash<QString, QString> DatabaseManager::getAllUsers() {
@@ -206,3 +230,202 @@ bool DatabaseManager::updateUser(const QString &username, const QString &newPass
     qDebug() << "Usuario actualizado:" << username;
     return true;
 }
+
+bool DatabaseManager::setUserQuota(const QString &username, qint64 maxBytes) {
+    QMutexLocker locker(&dbMutex);
+
+    QSqlDatabase db = getDatabaseForThread(dbPath);
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "Error abriendo BD en setUserQuota:" << db.lastError().text();
+        return false;
+    }
+
+    QSqlQuery query(db);
+    if (maxBytes <= 0) {
+        query.prepare("DELETE FROM user_quotas WHERE username = :user");
+        query.bindValue(":user", username);
+    } else {
+        // Solo para usuarios existentes
+        query.prepare("INSERT OR REPLACE INTO user_quotas (username, max_bytes) "
+                      "SELECT username, :bytes FROM users WHERE username = :user");
+        query.bindValue(":user", username);
+        query.bindValue(":bytes", maxBytes);
+    }
+    if (!query.exec()) {
+        qWarning() << "Error guardando cuota de usuario:" << query.lastError().text();
+        return false;
+    }
+    return maxBytes <= 0 || query.numRowsAffected() > 0;
+}
+
+bool DatabaseManager::setDirectoryQuota(const QString &path, qint64 maxBytes) {
+    QMutexLocker locker(&dbMutex);
+
+    QSqlDatabase db = getDatabaseForThread(dbPath);
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "Error abriendo BD en setDirectoryQuota:" << db.lastError().text();
+        return false;
+    }
+
+    QSqlQuery query(db);
+    if (maxBytes <= 0) {
+        query.prepare("DELETE FROM directory_quotas WHERE path = :path");
+        query.bindValue(":path", path);
+    } else {
+        query.prepare("INSERT OR REPLACE INTO directory_quotas (path, max_bytes) VALUES (:path, :bytes)");
+        query.bindValue(":path", path);
+        query.bindValue(":bytes", maxBytes);
+    }
+    if (!query.exec()) {
+        qWarning() << "Error guardando cuota de carpeta:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+QHash<QString, qint64> DatabaseManager::getUserQuotas() {
+    QMutexLocker locker(&dbMutex);
+    QHash<QString, qint64> quotas;
+
+    QSqlDatabase db = getDatabaseForThread(dbPath);
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "Error abriendo BD en getUserQuotas:" << db.lastError().text();
+        return quotas;
+    }
+
+    QSqlQuery query(db);
+    query.exec("SELECT username, max_bytes FROM user_quotas");
+    while (query.next()) {
+        quotas.insert(query.value(0).toString(), query.value(1).toLongLong());
+    }
+    return quotas;
+}
+
+QHash<QString, qint64> DatabaseManager::getDirectoryQuotas() {
+    QMutexLocker locker(&dbMutex);
+    QHash<QString, qint64> quotas;
+
+    QSqlDatabase db = getDatabaseForThread(dbPath);
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "Error abriendo BD en getDirectoryQuotas:" << db.lastError().text();
+        return quotas;
+    }
+
+    QSqlQuery query(db);
+    query.exec("SELECT path, max_bytes FROM directory_quotas");
+    while (query.next()) {
+        quotas.insert(query.value(0).toString(), query.value(1).toLongLong());
+    }
+    return quotas;
+}
+
+bool DatabaseManager::setUserHome(const QString &username, const QString &home) {
+    QMutexLocker locker(&dbMutex);
+
+    QSqlDatabase db = getDatabaseForThread(dbPath);
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "Error abriendo BD en setUserHome:" << db.lastError().text();
+        return false;
+    }
+
+    const bool clear = home.isEmpty() || home == "/";
+    QSqlQuery query(db);
+    if (clear) {
+        query.prepare("DELETE FROM user_homes WHERE username = :user");
+        query.bindValue(":user", username);
+    } else {
+        query.prepare("INSERT OR REPLACE INTO user_homes (username, home) "
+                      "SELECT username, :home FROM users WHERE username = :user");
+        query.bindValue(":user", username);
+        query.bindValue(":home", home);
+    }
+    if (!query.exec()) {
+        qWarning() << "Error guardando carpeta personal:" << query.lastError().text();
+        return false;
+    }
+    return clear || query.numRowsAffected() > 0;
+}
+
+QString DatabaseManager::getUserHome(const QString &username) {
+    QMutexLocker locker(&dbMutex);
+
+    QSqlDatabase db = getDatabaseForThread(dbPath);
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "Error abriendo BD en getUserHome:" << db.lastError().text();
+        return QString("/");
+    }
+
+    QSqlQuery query(db);
+    query.prepare("SELECT home FROM user_homes WHERE username = :user");
+    query.bindValue(":user", username);
+    if (query.exec() && query.next()) {
+        return query.value(0).toString();
+    }
+    return QString("/");
+}
+
+QHash<QString, QString> DatabaseManager::getUserHomes() {
+    QMutexLocker locker(&dbMutex);
+    QHash<QString, QString> homes;
+
+    QSqlDatabase db = getDatabaseForThread(dbPath);
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "Error abriendo BD en getUserHomes:" << db.lastError().text();
+        return homes;
+    }
+
+    QSqlQuery query(db);
+    query.exec("SELECT username, home FROM user_homes");
+    while (query.next()) {
+        homes.insert(query.value(0).toString(), query.value(1).toString());
+    }
+    return homes;
+}
+
+bool DatabaseManager::setUserPermission(const QString &username, const QString &path, const QString &perms) {
+    QMutexLocker locker(&dbMutex);
+
+    QSqlDatabase db = getDatabaseForThread(dbPath);
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "Error abriendo BD en setUserPermission:" << db.lastError().text();
+        return false;
+    }
+
+    QSqlQuery query(db);
+    if (perms.isEmpty()) {
+        query.prepare("DELETE FROM user_permissions WHERE username = :user AND path = :path");
+        query.bindValue(":user", username);
+        query.bindValue(":path", path);
+    } else {
+        query.prepare("INSERT OR REPLACE INTO user_permissions (username, path, perms) "
+                      "SELECT username, :path, :perms FROM users WHERE username = :user");
+        query.bindValue(":user", username);
+        query.bindValue(":path", path);
+        query.bindValue(":perms", perms);
+    }
+    if (!query.exec()) {
+        qWarning() << "Error guardando permisos:" << query.lastError().text();
+        return false;
+    }
+    return perms.isEmpty() || query.numRowsAffected() > 0;
+}
+
+QHash<QString, QString> DatabaseManager::getUserPermissions(const QString &username) {
+    QMutexLocker locker(&dbMutex);
+    QHash<QString, QString> rules;
+
+    QSqlDatabase db = getDatabaseForThread(dbPath);
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "Error abriendo BD en getUserPermissions:" << db.lastError().text();
+        return rules;
+    }
+
+    QSqlQuery query(db);
+    query.prepare("SELECT path, perms FROM user_permissions WHERE username = :user");
+    query.bindValue(":user", username);
+    query.exec();
+    while (query.next()) {
+        rules.insert(query.value(0).toString(), query.value(1).toString());
+    }
+    return rules;
+}
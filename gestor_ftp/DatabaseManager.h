@@ -32,6 +32,20 @@ public:
     bool isValid() const;
 
     bool validateUser(const QString &username, const QString &passwordHash);
+
+    // Cuotas de espacio; maxBytes <= 0 la elimina. Las carpetas van relativas a la raíz ("/publico")
+    bool setUserQuota(const QString &username, qint64 maxBytes);
+    bool setDirectoryQuota(const QString &path, qint64 maxBytes);
+    QHash<QString, qint64> getUserQuotas();
+    QHash<QString, qint64> getDirectoryQuotas();
+
+    // Carpeta personal (relativa a la raíz, "/clientes/ana"); "/" o vacía la elimina
+    bool setUserHome(const QString &username, const QString &home);
+    QString getUserHome(const QString &username);   // "/" si no tiene
+    QHash<QString, QString> getUserHomes();
+    // Permisos por carpeta ("rwdm": leer, escribir, borrar, crear carpetas); vacío elimina la regla
+    bool setUserPermission(const QString &username, const QString &path, const QString &perms);
+    QHash<QString, QString> getUserPermissions(const QString &username);
     const QString& getDatabasePath() const { return dbPath; }
 
     explicit DatabaseManager(QObject *parent = nullptr);
@@ -0,0 +1,623 @@
+#include "DirSizeIndex.h"
+#include <QThread>
+#include <QObject>
+#include <QTimer>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QDebug>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+namespace {
+// Un recorrido que vio cambiar su subárbol mientras leía se repite hasta este número de veces
+constexpr int MaxWalkAttempts = 3;
+
+QString parentOf(const QString &path)
+{
+    const int slash = path.lastIndexOf(QLatin1Char('/'));
+    return slash <= 0 ? QStringLiteral("/") : path.left(slash);
+}
+
+QString nameOf(const QString &path)
+{
+    return path.mid(path.lastIndexOf(QLatin1Char('/')) + 1);
+}
+
+// Archivos directos (tamaño y número) y subdirectorios de 'dir'; los enlaces no cuentan
+bool readDirectory(const QString &dir, DirSizeIndex::Totals &own, QStringList &children)
+{
+#ifdef Q_OS_LINUX
+    DIR *handle = ::opendir(QFile::encodeName(dir).constData());
+    if (!handle) {
+        return false;
+    }
+    const int fd = ::dirfd(handle);
+    while (const struct dirent *entry = ::readdir(handle)) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        if (entry->d_type == DT_DIR) {
+            children.append(QFile::decodeName(name));
+            continue;
+        }
+        if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN) {
+            continue;
+        }
+        struct stat st;
+        if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            children.append(QFile::decodeName(name));
+        } else if (S_ISREG(st.st_mode)) {
+            own.bytes += st.st_size;
+            own.files++;
+        }
+    }
+    ::closedir(handle);
+    return true;
+#else
+    const QFileInfo info(dir);
+    if (!info.isDir()) {
+        return false;
+    }
+    QDirIterator it(dir, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo entry = it.fileInfo();
+        if (entry.isSymLink()) {
+            continue;
+        }
+        if (entry.isDir()) {
+            children.append(entry.fileName());
+        } else if (entry.isFile()) {
+            own.bytes += entry.size();
+            own.files++;
+        }
+    }
+    return true;
+#endif
+}
+
+void lowerIoPriority()
+{
+    // La reconciliación no debe competir con las transferencias por el disco
+#ifdef Q_OS_LINUX
+    constexpr int IoprioWhoProcess = 1;     // Con who = 0, el hilo que llama
+    constexpr int IoprioClassIdle = 3;
+    ::syscall(SYS_ioprio_set, IoprioWhoProcess, 0, IoprioClassIdle << 13);
+#elif defined(Q_OS_WIN)
+    ::SetThreadPriority(::GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+}
+} // namespace
+
+// =====================================================================================
+// Seccion: Configuración
+// =====================================================================================
+
+void DirSizeIndex::configure(bool enabled, const QString &root, int reconcileMinutes)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_root = QDir::cleanPath(QDir(root).absolutePath());
+        m_dirs.clear();
+        m_ready = false;
+        m_resolvedQuotas.clear();
+        for (auto it = m_directoryQuotas.constBegin(); it != m_directoryQuotas.constEnd(); ++it) {
+            m_resolvedQuotas.insert(QDir::cleanPath(m_root + QLatin1Char('/') + it.key()), it.value());
+        }
+    }
+    m_enabled.store(enabled);
+    m_reconcileMinutes.store(qMax(0, reconcileMinutes));
+    if (!enabled) {
+        qInfo() << "Índice de tamaños de directorio desactivado";
+        return;
+    }
+    startThread();
+    QMetaObject::invokeMethod(m_context, [this]() {
+        m_passQueue.clear();
+        if (m_reconcileMinutes.load() > 0) {
+            m_passTimer->start(m_reconcileMinutes.load() * 60 * 1000);
+        } else {
+            m_passTimer->stop();
+        }
+    }, Qt::QueuedConnection);
+    refresh(root);
+    qInfo() << "Índice de tamaños de directorio para" << root;
+}
+
+void DirSizeIndex::setRoot(const QString &root)
+{
+    const QString clean = QDir::cleanPath(QDir(root).absolutePath());
+    {
+        QMutexLocker locker(&m_mutex);
+        if (clean == m_root) {
+            return;
+        }
+    }
+    configure(m_enabled.load(), root, m_reconcileMinutes.load());
+}
+
+bool DirSizeIndex::isReady() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_ready;
+}
+
+void DirSizeIndex::setQuotas(const QHash<QString, qint64> &users, const QHash<QString, qint64> &directories)
+{
+    QMutexLocker locker(&m_mutex);
+    m_userQuotas = users;
+    m_directoryQuotas = directories;
+    m_resolvedQuotas.clear();
+    for (auto it = directories.constBegin(); it != directories.constEnd(); ++it) {
+        m_resolvedQuotas.insert(QDir::cleanPath(m_root + QLatin1Char('/') + it.key()), it.value());
+    }
+}
+
+void DirSizeIndex::startThread()
+{
+    if (m_thread) {
+        return;
+    }
+    // El hilo y su contexto viven lo mismo que el proceso
+    m_thread = new QThread;
+    m_thread->setObjectName(QStringLiteral("DirSizeIndex"));
+    m_context = new QObject;
+    m_context->moveToThread(m_thread);
+    m_thread->start(QThread::LowestPriority);
+
+    QMetaObject::invokeMethod(m_context, [this]() {
+        lowerIoPriority();
+        m_passTimer = new QTimer(m_context);
+        QObject::connect(m_passTimer, &QTimer::timeout, m_context, [this]() {
+            if (m_passQueue.empty()) {
+                beginPass();
+            }
+        });
+    }, Qt::QueuedConnection);
+}
+
+// =====================================================================================
+// Seccion: Recorridos y reconciliación (hilo del índice)
+// =====================================================================================
+
+bool DirSizeIndex::walkTree(const QString &path, QHash<QString, Node> &found)
+{
+    struct Frame {
+        QString path;
+        Node node;
+        int next = 0;
+    };
+    Frame first;
+    first.path = path;
+    if (!readDirectory(path, first.node.own, first.node.children)) {
+        return false;
+    }
+    // Recorrido en profundidad sin recursión: cada directorio suma a su padre al cerrarse
+    std::vector<Frame> stack;
+    stack.push_back(std::move(first));
+    while (!stack.empty()) {
+        Frame &top = stack.back();
+        if (top.next < top.node.children.size()) {
+            Frame frame;
+            frame.path = top.path + QLatin1Char('/') + top.node.children.at(top.next);
+            if (!readDirectory(frame.path, frame.node.own, frame.node.children)) {
+                top.node.children.removeAt(top.next); // Desapareció mientras tanto
+                continue;
+            }
+            top.next++;
+            stack.push_back(std::move(frame));
+            continue;
+        }
+        Frame done = std::move(stack.back());
+        stack.pop_back();
+        done.node.total += done.node.own;
+        if (!stack.empty()) {
+            Totals &parent = stack.back().node.total;
+            parent += done.node.total;
+            parent.dirs += 1;
+        }
+        found.insert(done.path, std::move(done.node));
+    }
+    return true;
+}
+
+void DirSizeIndex::walk(const QString &requested, int attempt)
+{
+    QString path;
+    bool seeding = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!insideRootLocked(requested)) {
+            return;
+        }
+        seeding = !m_ready;
+        if (seeding && requested != m_root) {
+            return; // La siembra en curso lo verá
+        }
+        // mkpath puede haber creado varios niveles: se recorre desde el primero que falte
+        path = requested;
+        while (path != m_root && !m_dirs.contains(parentOf(path))) {
+            path = parentOf(path);
+        }
+        m_scanning = path;
+        m_scanningTree = true;
+        m_scanTouched = false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QHash<QString, Node> found;
+    const bool exists = walkTree(path, found);
+
+    QMutexLocker locker(&m_mutex);
+    m_scanning.clear();
+    if (seeding ? path != m_root : !m_ready) {
+        return; // Se reconfiguró mientras se leía: ya hay otra siembra en cola
+    }
+    if (seeding) {
+        m_dirs = std::move(found);
+        m_ready = true;
+        const Totals total = m_dirs.value(m_root).total;
+        qInfo() << "Índice de tamaños sembrado en" << timer.elapsed() << "ms:" << m_dirs.size()
+                << "directorios," << total.files << "archivos," << total.bytes << "bytes";
+        return;
+    }
+    if (m_scanTouched && attempt + 1 < MaxWalkAttempts) {
+        // Cambió algo dentro mientras se leía: repetir más tarde
+        QMetaObject::invokeMethod(m_context, [this, path, attempt]() { walk(path, attempt + 1); },
+                                  Qt::QueuedConnection);
+        return;
+    }
+    if (!exists) {
+        if (path != m_root) {
+            removeTreeLocked(path);
+        }
+        return;
+    }
+
+    const auto known = m_dirs.constFind(path);
+    const bool isNew = known == m_dirs.constEnd();
+    const Totals old = isNew ? Totals() : known->total;
+    eraseLocked(path);
+    const Totals now = found.value(path).total;
+    for (auto it = found.begin(); it != found.end(); ++it) {
+        m_dirs.insert(it.key(), std::move(it.value()));
+    }
+    if (path != m_root) {
+        Totals delta = now - old;
+        if (isNew) {
+            delta.dirs += 1;
+            m_dirs[parentOf(path)].children.append(nameOf(path));
+        }
+        propagateLocked(parentOf(path), delta);
+        m_corrected.fetch_add(qAbs(delta.bytes), std::memory_order_relaxed);
+    }
+}
+
+void DirSizeIndex::beginPass()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_ready) {
+        return;
+    }
+    m_passQueue.assign(m_dirs.keyBegin(), m_dirs.keyEnd());
+    m_passStartMs = QDateTime::currentMSecsSinceEpoch();
+    QMetaObject::invokeMethod(m_context, [this]() { reconcileNext(); }, Qt::QueuedConnection);
+}
+
+void DirSizeIndex::reconcileNext()
+{
+    if (m_passQueue.empty()) {
+        return;
+    }
+    // Un directorio por vuelta del bucle de eventos: los avisos de las sesiones no esperan
+    const QString dir = m_passQueue.front();
+    m_passQueue.pop_front();
+    reconcileDirectory(dir);
+    if (m_passQueue.empty()) {
+        m_passes.fetch_add(1);
+        m_lastPassMs.store(QDateTime::currentMSecsSinceEpoch() - m_passStartMs);
+        return;
+    }
+    QMetaObject::invokeMethod(m_context, [this]() { reconcileNext(); }, Qt::QueuedConnection);
+}
+
+void DirSizeIndex::reconcileDirectory(const QString &dir)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_dirs.contains(dir)) {
+            return;
+        }
+        m_scanning = dir;
+        m_scanningTree = false;
+        m_scanTouched = false;
+    }
+    Totals own;
+    QStringList children;
+    const bool exists = readDirectory(dir, own, children);
+
+    QStringList added;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_scanning.clear();
+        if (m_scanTouched) {
+            m_passQueue.push_back(dir); // Se vuelve a mirar al final de la pasada
+            return;
+        }
+        auto it = m_dirs.find(dir);
+        if (it == m_dirs.end()) {
+            return;
+        }
+        m_reconciled.fetch_add(1, std::memory_order_relaxed);
+        if (!exists) {
+            if (dir != m_root) {
+                m_corrected.fetch_add(it->total.bytes, std::memory_order_relaxed);
+                removeTreeLocked(dir);
+            }
+            return;
+        }
+        const Totals delta = own - it->own;
+        if (!delta.isZero()) {
+            it->own = own;
+            propagateLocked(dir, delta);
+            m_corrected.fetch_add(qAbs(delta.bytes), std::memory_order_relaxed);
+        }
+        // Subdirectorios creados o borrados por fuera del servidor
+        const QStringList known = it->children;
+        const QSet<QString> current(children.cbegin(), children.cend());
+        const QSet<QString> previous(known.cbegin(), known.cend());
+        for (const QString &name : known) {
+            if (!current.contains(name)) {
+                const QString child = dir + QLatin1Char('/') + name;
+                m_corrected.fetch_add(m_dirs.value(child).total.bytes, std::memory_order_relaxed);
+                removeTreeLocked(child);
+            }
+        }
+        for (const QString &name : children) {
+            if (!previous.contains(name)) {
+                added.append(dir + QLatin1Char('/') + name);
+            }
+        }
+    }
+    for (const QString &path : std::as_const(added)) {
+        walk(path, 0);
+    }
+}
+
+// =====================================================================================
+// Seccion: Cambios del servidor (hilos de las sesiones)
+// =====================================================================================
+
+bool DirSizeIndex::insideRootLocked(const QString &path) const
+{
+    if (path == m_root) {
+        return true;
+    }
+    const QString prefix = m_root.endsWith(QLatin1Char('/')) ? m_root : m_root + QLatin1Char('/');
+    return path.startsWith(prefix);
+}
+
+void DirSizeIndex::propagateLocked(const QString &dir, const Totals &delta)
+{
+    // El directorio y todos sus antecesores hasta la raíz
+    for (QString current = dir;; current = parentOf(current)) {
+        auto it = m_dirs.find(current);
+        if (it != m_dirs.end()) {
+            it->total += delta;
+        }
+        if (current == m_root || current.size() <= m_root.size()) {
+            break;
+        }
+    }
+}
+
+void DirSizeIndex::eraseLocked(const QString &dir)
+{
+    // El directorio y lo que cuelga de él; la lista del padre no se toca
+    std::vector<QString> stack{dir};
+    while (!stack.empty()) {
+        const QString current = std::move(stack.back());
+        stack.pop_back();
+        const auto it = m_dirs.constFind(current);
+        if (it == m_dirs.constEnd()) {
+            continue;
+        }
+        for (const QString &name : it->children) {
+            stack.push_back(current + QLatin1Char('/') + name);
+        }
+        m_dirs.erase(it);
+    }
+}
+
+void DirSizeIndex::removeTreeLocked(const QString &dir)
+{
+    const auto it = m_dirs.constFind(dir);
+    if (it == m_dirs.constEnd() || dir == m_root) {
+        return;
+    }
+    Totals delta;
+    delta.bytes = -it->total.bytes;
+    delta.files = -it->total.files;
+    delta.dirs = -(it->total.dirs + 1);
+    eraseLocked(dir);
+    const QString parent = parentOf(dir);
+    auto parentIt = m_dirs.find(parent);
+    if (parentIt != m_dirs.end()) {
+        parentIt->children.removeOne(nameOf(dir));
+    }
+    propagateLocked(parent, delta);
+}
+
+void DirSizeIndex::touchLocked(const QString &dir)
+{
+    if (m_scanning.isEmpty()) {
+        return;
+    }
+    const QString scanning = m_scanning + QLatin1Char('/');
+    if (dir == m_scanning || scanning.startsWith(dir + QLatin1Char('/')) ||
+        (m_scanningTree && dir.startsWith(scanning))) {
+        m_scanTouched = true;
+    }
+}
+
+void DirSizeIndex::fileChanged(const QString &path, qint64 oldSize, qint64 newSize)
+{
+    if (!m_enabled.load()) {
+        return;
+    }
+    const QString parent = parentOf(QDir::cleanPath(path));
+    Totals delta;
+    delta.bytes = qMax<qint64>(0, newSize) - qMax<qint64>(0, oldSize);
+    delta.files = (newSize >= 0 ? 1 : 0) - (oldSize >= 0 ? 1 : 0);
+    if (delta.isZero()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_ready || !insideRootLocked(parent)) {
+        return;
+    }
+    auto it = m_dirs.find(parent);
+    if (it == m_dirs.end()) {
+        return; // Directorio aún no visto: su recorrido ya lo contará
+    }
+    it->own += delta;
+    propagateLocked(parent, delta);
+    touchLocked(parent);
+    m_updates.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DirSizeIndex::directoryRemoved(const QString &path)
+{
+    if (!m_enabled.load()) {
+        return;
+    }
+    const QString clean = QDir::cleanPath(path);
+    QMutexLocker locker(&m_mutex);
+    if (!m_ready || !insideRootLocked(clean)) {
+        return;
+    }
+    touchLocked(clean);
+    removeTreeLocked(clean);
+    m_updates.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DirSizeIndex::refresh(const QString &path)
+{
+    if (!m_enabled.load() || !m_context) {
+        return;
+    }
+    const QString clean = QDir::cleanPath(QDir(path).absolutePath());
+    {
+        QMutexLocker locker(&m_mutex);
+        touchLocked(clean);
+    }
+    QMetaObject::invokeMethod(m_context, [this, clean]() { walk(clean, 0); }, Qt::QueuedConnection);
+}
+
+// =====================================================================================
+// Seccion: Consultas y cuotas
+// =====================================================================================
+
+bool DirSizeIndex::totals(const QString &dir, Totals &out) const
+{
+    if (!m_enabled.load()) {
+        return false;
+    }
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_dirs.constFind(QDir::cleanPath(dir));
+    if (!m_ready || it == m_dirs.constEnd()) {
+        return false;
+    }
+    out = it->total;
+    return true;
+}
+
+qint64 DirSizeIndex::directoryQuota(const QString &dir) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_resolvedQuotas.value(QDir::cleanPath(dir), 0);
+}
+
+DirSizeIndex::Headroom DirSizeIndex::headroom(const QString &path, const QString &user, const QString &home) const
+{
+    Headroom result;
+    if (!m_enabled.load()) {
+        return result;
+    }
+    const QString clean = QDir::cleanPath(path);
+    QMutexLocker locker(&m_mutex);
+    // Hasta terminar la siembra no se sabe cuánto ocupa nada: no se limita
+    if (!m_ready || !insideRootLocked(clean) || (m_resolvedQuotas.isEmpty() && m_userQuotas.isEmpty())) {
+        return result;
+    }
+    auto consider = [&](const QString &dir, qint64 limit, const QString &scope) {
+        const auto it = m_dirs.constFind(dir);
+        const qint64 used = it != m_dirs.constEnd() ? it->total.bytes : 0;
+        const qint64 room = qMax<qint64>(0, limit - used);
+        if (result.bytes < 0 || room < result.bytes) {
+            result.bytes = room;
+            result.limit = limit;
+            result.scope = scope;
+        }
+    };
+
+    if (!m_resolvedQuotas.isEmpty()) {
+        for (QString dir = parentOf(clean);; dir = parentOf(dir)) {
+            const auto quota = m_resolvedQuotas.constFind(dir);
+            if (quota != m_resolvedQuotas.constEnd()) {
+                consider(dir, quota.value(), dir == m_root ? QStringLiteral("/") : dir.mid(m_root.size()));
+            }
+            if (dir == m_root || dir.size() <= m_root.size()) {
+                break;
+            }
+        }
+    }
+    const qint64 userLimit = m_userQuotas.value(user, 0);
+    const QString cleanHome = QDir::cleanPath(home);
+    if (userLimit > 0 && (clean.startsWith(cleanHome + QLatin1Char('/')) || cleanHome == m_root)) {
+        consider(cleanHome, userLimit, QStringLiteral("usuario ") + user);
+    }
+    return result;
+}
+
+DirSizeIndex::Stats DirSizeIndex::stats() const
+{
+    Stats stats;
+    stats.enabled = m_enabled.load();
+    {
+        QMutexLocker locker(&m_mutex);
+        stats.ready = m_ready;
+        stats.directories = m_dirs.size();
+        stats.root = m_dirs.value(m_root).total;
+        stats.userQuotas = m_userQuotas.size();
+        stats.directoryQuotas = m_directoryQuotas.size();
+    }
+    stats.updates = m_updates.load();
+    stats.reconciledDirectories = m_reconciled.load();
+    stats.passes = m_passes.load();
+    stats.lastPassSeconds = m_lastPassMs.load() / 1000.0;
+    stats.correctedBytes = m_corrected.load();
+    stats.rejections = m_rejections.load();
+    return stats;
+}
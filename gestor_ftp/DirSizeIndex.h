@@ -0,0 +1,150 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMutex>
+#include <atomic>
+#include <deque>
+
+class QThread;
+class QObject;
+class QTimer;
+
+// Tamaño acumulado de cada directorio del árbol servido, para SITE DU y las cuotas.
+//
+// Guarda por directorio lo que ocupan sus archivos directos y el total de su
+// subárbol, así que consultar el tamaño de cualquier carpeta es una búsqueda en
+// una tabla hash. Un recorrido en segundo plano lo siembra al arrancar; después
+// STOR, DELE, RMD, MKD y SITE UNTAR lo actualizan con la diferencia, que sube por
+// los antecesores. Una reconciliación periódica vuelve a leer cada directorio (sin
+// bajar) con prioridad de E/S mínima y corrige lo que haya cambiado por fuera.
+//
+// Las cuotas se aplican a la suma de un directorio: las de directorio a la carpeta
+// configurada y las de usuario a su directorio de inicio. STOR consulta el margen
+// antes de aceptar datos y corta la subida si lo supera.
+class DirSizeIndex {
+public:
+    struct Totals {
+        qint64 bytes = 0;
+        qint64 files = 0;
+        qint64 dirs = 0;
+
+        Totals &operator+=(const Totals &other) {
+            bytes += other.bytes;
+            files += other.files;
+            dirs += other.dirs;
+            return *this;
+        }
+        Totals operator-(const Totals &other) const {
+            return {bytes - other.bytes, files - other.files, dirs - other.dirs};
+        }
+        bool isZero() const { return bytes == 0 && files == 0 && dirs == 0; }
+    };
+
+    // Margen para una subida: la cuota más estricta que la afecta
+    struct Headroom {
+        qint64 bytes = -1;             // -1: sin límite
+        qint64 limit = 0;
+        QString scope;                 // Carpeta (relativa a la raíz) o "usuario <nombre>"
+    };
+
+    struct Stats {
+        bool enabled = false;
+        bool ready = false;
+        qint64 directories = 0;
+        Totals root;
+        quint64 updates = 0;           // Cambios aplicados por operaciones del servidor
+        quint64 reconciledDirectories = 0;
+        quint64 passes = 0;            // Reconciliaciones completas
+        double lastPassSeconds = 0.0;
+        qint64 correctedBytes = 0;     // Diferencia corregida por las reconciliaciones
+        quint64 rejections = 0;        // Subidas rechazadas o cortadas por cuota
+        int userQuotas = 0;
+        int directoryQuotas = 0;
+    };
+
+    static DirSizeIndex& instance() {
+        static DirSizeIndex instance;
+        return instance;
+    }
+
+    DirSizeIndex(const DirSizeIndex &) = delete;
+    DirSizeIndex &operator=(const DirSizeIndex &) = delete;
+
+    // reconcileMinutes: cada cuánto se revisa el árbol entero (0 nunca)
+    void configure(bool enabled, const QString &root, int reconcileMinutes = 30);
+    void setRoot(const QString &root);
+    bool isEnabled() const { return m_enabled.load(); }
+    bool isReady() const;
+
+    // Usuario -> bytes; carpeta relativa a la raíz ("/publico") -> bytes
+    void setQuotas(const QHash<QString, qint64> &users, const QHash<QString, qint64> &directories);
+
+    // Un archivo pasó de oldSize a newSize bytes (-1: no existía / ya no existe)
+    void fileChanged(const QString &path, qint64 oldSize, qint64 newSize);
+    // El directorio y su contenido se borraron (RMD)
+    void directoryRemoved(const QString &path);
+    // El directorio cambió de forma desconocida (MKD, SITE UNTAR, RMD a medias): se vuelve a recorrer
+    void refresh(const QString &path);
+
+    bool totals(const QString &dir, Totals &out) const;
+    // Cuota de un directorio concreto (0 si no tiene)
+    qint64 directoryQuota(const QString &dir) const;
+    Headroom headroom(const QString &path, const QString &user, const QString &home) const;
+    void recordRejection() { m_rejections.fetch_add(1, std::memory_order_relaxed); }
+
+    Stats stats() const;
+
+private:
+    DirSizeIndex() = default;
+
+    struct Node {
+        Totals total;       // Todo el subárbol (sin contar el propio directorio)
+        Totals own;         // Solo los archivos directos
+        QStringList children;
+    };
+
+    // Hilo del índice
+    void startThread();
+    static bool walkTree(const QString &path, QHash<QString, Node> &found);
+    void walk(const QString &path, int attempt);
+    void beginPass();
+    void reconcileNext();
+    void reconcileDirectory(const QString &dir);
+
+    // Con m_mutex tomado
+    bool insideRootLocked(const QString &path) const;
+    void propagateLocked(const QString &dir, const Totals &delta);
+    void eraseLocked(const QString &dir);
+    void removeTreeLocked(const QString &dir);
+    void touchLocked(const QString &dir);
+
+    std::atomic<bool> m_enabled{false};
+    std::atomic<int> m_reconcileMinutes{30};
+    mutable QMutex m_mutex;
+    QString m_root;
+    bool m_ready = false;
+    QHash<QString, Node> m_dirs;
+    QHash<QString, qint64> m_userQuotas;
+    QHash<QString, qint64> m_directoryQuotas;        // Relativas a la raíz
+    QHash<QString, qint64> m_resolvedQuotas;         // Las mismas, con la ruta absoluta
+
+    // Lectura en curso sin el cerrojo: si cambia algo dentro, el resultado no vale
+    QString m_scanning;
+    bool m_scanningTree = false;
+    bool m_scanTouched = false;
+
+    // Solo en el hilo del índice
+    QThread *m_thread = nullptr;
+    QObject *m_context = nullptr;
+    QTimer *m_passTimer = nullptr;
+    std::deque<QString> m_passQueue;
+    qint64 m_passStartMs = 0;
+
+    std::atomic<quint64> m_updates{0};
+    std::atomic<quint64> m_reconciled{0};
+    std::atomic<quint64> m_passes{0};
+    std::atomic<qint64> m_lastPassMs{0};
+    std::atomic<qint64> m_corrected{0};
+    std::atomic<quint64> m_rejections{0};
+};
@@ -0,0 +1,520 @@
+#include "DirectIo.h"
+#include "IoScheduler.h"
+#include <QThreadPool>
+#include <QThread>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QDebug>
+#include <cstring>
+#include <cerrno>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Pool propio: las lecturas y escrituras bloqueantes no deben ocupar el pool global
+QThreadPool &directIoPool()
+{
+    static QThreadPool *pool = []() {
+        QThreadPool *p = new QThreadPool;
+        p->setMaxThreadCount(qBound(4, QThread::idealThreadCount() * 2, 32));
+        return p;
+    }();
+    return *pool;
+}
+
+constexpr qint64 alignDown(qint64 value)
+{
+    return value & ~(DirectIoPolicy::Alignment - 1);
+}
+
+constexpr qint64 alignUp(qint64 value)
+{
+    return alignDown(value + DirectIoPolicy::Alignment - 1);
+}
+
+// Llamadas al sistema; fuera de Linux no hay O_DIRECT y todo falla con ENOTSUP
+int openDirect(const QString &path, bool forWriting, bool truncate)
+{
+#ifdef Q_OS_LINUX
+    int flags = O_DIRECT | O_CLOEXEC;
+    flags |= forWriting ? (O_RDWR | O_CREAT) : O_RDONLY;
+    if (truncate) {
+        flags |= O_TRUNC;
+    }
+    int fd;
+    do {
+        fd = ::open(QFile::encodeName(path).constData(), flags, 0666);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+#else
+    Q_UNUSED(path);
+    Q_UNUSED(forWriting);
+    Q_UNUSED(truncate);
+    return -1;
+#endif
+}
+
+qint64 readAt(int fd, char *data, qint64 length, qint64 offset, int &error)
+{
+#ifdef Q_OS_LINUX
+    ssize_t n;
+    do {
+        n = ::pread(fd, data, size_t(length), off_t(offset));
+    } while (n < 0 && errno == EINTR);
+    error = n < 0 ? errno : 0;
+    return n;
+#else
+    Q_UNUSED(fd); Q_UNUSED(data); Q_UNUSED(length); Q_UNUSED(offset);
+    error = ENOTSUP;
+    return -1;
+#endif
+}
+
+qint64 writeAt(int fd, const char *data, qint64 length, qint64 offset, int &error)
+{
+#ifdef Q_OS_LINUX
+    ssize_t n;
+    do {
+        n = ::pwrite(fd, data, size_t(length), off_t(offset));
+    } while (n < 0 && errno == EINTR);
+    error = n < 0 ? errno : (n != length ? EIO : 0);
+    return n;
+#else
+    Q_UNUSED(fd); Q_UNUSED(data); Q_UNUSED(length); Q_UNUSED(offset);
+    error = ENOTSUP;
+    return -1;
+#endif
+}
+
+// Con 'truncateTo' >= 0 recorta antes el archivo a ese tamaño
+int closeDescriptor(int fd, qint64 truncateTo = -1)
+{
+#ifdef Q_OS_LINUX
+    int error = 0;
+    if (truncateTo >= 0 && ::ftruncate(fd, off_t(truncateTo)) != 0) {
+        error = errno;
+    }
+    if (::close(fd) != 0 && error == 0) {
+        error = errno;
+    }
+    return error;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(truncateTo);
+    return ENOTSUP;
+#endif
+}
+
+// Lo ya escrito por la caché de páginas se vuelca y se retira de ella
+void dropCachedRange(int fd, qint64 length)
+{
+#ifdef Q_OS_LINUX
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, off_t(length), POSIX_FADV_DONTNEED);
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(length);
+#endif
+}
+} // namespace
+
+// =====================================================================================
+// Seccion: Política
+// =====================================================================================
+
+void DirectIoPolicy::configure(qint64 thresholdBytes, const QStringList &paths, int queueDepth)
+{
+    QStringList cleaned;
+    for (const QString &path : paths) {
+        QString clean = QDir::cleanPath(path.trimmed());
+        while (clean.size() > 1 && clean.endsWith('/')) {
+            clean.chop(1);
+        }
+        if (!clean.isEmpty() && clean != ".") {
+            cleaned.append(clean);
+        }
+    }
+    {
+        QWriteLocker locker(&m_lock);
+        m_paths = cleaned;
+    }
+    m_threshold.store(qMax<qint64>(0, thresholdBytes));
+    m_queueDepth.store(qBound(1, queueDepth, 64));
+
+    if (!isSupported()) {
+        qInfo() << "E/S directa no disponible en este sistema: las transferencias usan la caché de páginas";
+        return;
+    }
+    qInfo() << "E/S directa: archivos desde" << m_threshold.load() / (1024 * 1024) << "MB,"
+            << cleaned.size() << "rutas, profundidad" << m_queueDepth.load();
+}
+
+bool DirectIoPolicy::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool DirectIoPolicy::matchesPath(const QString &absolutePath) const
+{
+    if (!isSupported()) {
+        return false;
+    }
+    QReadLocker locker(&m_lock);
+    for (const QString &prefix : m_paths) {
+        if (absolutePath == prefix || absolutePath.startsWith(prefix + '/')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DirectIoPolicy::shouldUse(const QString &absolutePath, qint64 size) const
+{
+    const qint64 threshold = m_threshold.load();
+    return isSupported() && ((threshold > 0 && size >= threshold) || matchesPath(absolutePath));
+}
+
+DirectIoPolicy::Stats DirectIoPolicy::stats() const
+{
+    Stats s;
+    s.thresholdBytes = m_threshold.load();
+    s.queueDepth = m_queueDepth.load();
+    s.reads = m_reads.load(std::memory_order_relaxed);
+    s.writes = m_writes.load(std::memory_order_relaxed);
+    s.bytesRead = m_bytesRead.load(std::memory_order_relaxed);
+    s.bytesWritten = m_bytesWritten.load(std::memory_order_relaxed);
+    s.fallbacks = m_fallbacks.load(std::memory_order_relaxed);
+    QReadLocker locker(&m_lock);
+    s.paths = m_paths;
+    return s;
+}
+
+// =====================================================================================
+// Seccion: Lectura
+// =====================================================================================
+
+// Descriptor y contexto de aviso compartidos con las lecturas en vuelo
+struct DirectFileReader::Shared {
+    int fd = -1;
+    QString device;
+    QMutex mutex;
+    QObject *context = nullptr;
+    std::function<void()> callback;
+
+    ~Shared() {
+        if (fd >= 0) {
+            closeDescriptor(fd);
+        }
+    }
+};
+
+struct DirectFileReader::Request {
+    BufferPool::Buffer buffer;
+    qint64 offset = 0;
+    qint64 length = 0;
+    qint64 result = 0;
+    int error = 0;
+    std::atomic<bool> done{false};
+};
+
+DirectFileReader::DirectFileReader(QObject *context, std::function<void()> onDataReady)
+    : m_shared(std::make_shared<Shared>())
+{
+    m_shared->context = context;
+    m_shared->callback = std::move(onDataReady);
+}
+
+DirectFileReader::~DirectFileReader()
+{
+    // Las lecturas en curso terminan solas y cierran el descriptor con la última referencia
+    QMutexLocker locker(&m_shared->mutex);
+    m_shared->context = nullptr;
+}
+
+bool DirectFileReader::open(const QString &path, qint64 size)
+{
+    m_shared->fd = openDirect(path, false, false);
+    if (m_shared->fd < 0) {
+        // tmpfs y algunos sistemas de archivos de red no admiten O_DIRECT
+        DirectIoPolicy::instance().countFallback();
+        return false;
+    }
+    m_shared->device = IoScheduler::deviceFor(m_shared->fd, path);
+    m_size = size;
+    m_nextOffset = 0;
+    DirectIoPolicy::instance().countReadTransfer();
+    submit();
+    return true;
+}
+
+void DirectFileReader::submit()
+{
+    const int depth = DirectIoPolicy::instance().queueDepth();
+    while (int(m_requests.size()) < depth && m_nextOffset < m_size) {
+        BufferPool::Buffer buffer = BufferPool::instance().acquire();
+        const qint64 length = alignDown(buffer.size());
+        if (buffer.isNull() || length == 0) {
+            return; // Pool agotado: se reintentará en la siguiente llamada a next()
+        }
+
+        auto request = std::make_shared<Request>();
+        request->buffer = std::move(buffer);
+        request->offset = m_nextOffset;
+        request->length = length;
+        m_nextOffset += length;
+        m_requests.push_back(request);
+
+        std::shared_ptr<Shared> shared = m_shared;
+        directIoPool().start([request, shared]() {
+            IoScheduler::Ticket io = IoScheduler::instance().acquire(shared->device, IoScheduler::Kind::Read);
+            request->result = readAt(shared->fd, request->buffer.data(), request->length,
+                                     request->offset, request->error);
+            io.release();
+            request->done.store(true, std::memory_order_release);
+            QMutexLocker locker(&shared->mutex);
+            if (shared->context) {
+                QMetaObject::invokeMethod(shared->context, shared->callback, Qt::QueuedConnection);
+            }
+        });
+    }
+}
+
+DirectFileReader::Status DirectFileReader::next(BufferPool::Buffer &buffer, qint64 &length)
+{
+    if (m_requests.empty()) {
+        if (m_nextOffset >= m_size) {
+            return Status::Failed; // No queda nada por leer
+        }
+        submit();
+        return Status::Pending;
+    }
+
+    std::shared_ptr<Request> request = m_requests.front();
+    if (!request->done.load(std::memory_order_acquire)) {
+        submit();
+        return Status::Pending;
+    }
+    m_requests.pop_front();
+
+    const qint64 expected = qMin(request->length, m_size - request->offset);
+    if (request->result < expected) {
+        qWarning() << "Lectura directa incompleta en" << request->offset << ":"
+                   << (request->error ? qt_error_string(request->error) : QString("fin de archivo inesperado"));
+        return Status::Failed;
+    }
+
+    buffer = std::move(request->buffer);
+    length = expected;
+    DirectIoPolicy::instance().recordRead(expected);
+    submit();
+    return Status::Ready;
+}
+
+// =====================================================================================
+// Seccion: Escritura
+// =====================================================================================
+
+struct DirectFileWriter::Shared {
+    int fd = -1;
+    QString device;
+    QMutex mutex;
+    QWaitCondition completed;
+    int inFlight = 0;
+    int error = 0;
+
+    ~Shared() {
+        if (fd >= 0) {
+            closeDescriptor(fd);
+        }
+    }
+};
+
+// Bloque alineado: del pool si hay, propio si el pool está agotado
+struct DirectFileWriter::Block {
+    BufferPool::Buffer pooled;
+    char *own = nullptr;
+
+    char *data() const { return own ? own : pooled.data(); }
+    ~Block() {
+        if (own) {
+            qFreeAligned(own);
+        }
+    }
+};
+
+DirectFileWriter::DirectFileWriter(int queueDepth)
+    : m_shared(std::make_shared<Shared>()),
+      m_queueDepth(qMax(1, queueDepth))
+{
+}
+
+DirectFileWriter::~DirectFileWriter()
+{
+    if (!m_finished) {
+        // Subida abandonada: las escrituras en vuelo terminan solas
+        m_current.reset();
+    }
+}
+
+bool DirectFileWriter::open(const QString &path, qint64 startOffset)
+{
+    m_blockCapacity = alignDown(BufferPool::instance().blockSize());
+    if (m_blockCapacity == 0) {
+        m_blockCapacity = DirectIoPolicy::Alignment;
+    }
+
+    m_shared->fd = openDirect(path, true, startOffset == 0);
+    if (m_shared->fd < 0) {
+        DirectIoPolicy::instance().countFallback();
+        return false;
+    }
+
+    m_shared->device = IoScheduler::deviceFor(m_shared->fd, path);
+
+    // Continuar desde 'startOffset': recuperar el principio del bloque alineado ya escrito
+    if (startOffset > 0) {
+        dropCachedRange(m_shared->fd, startOffset);
+    }
+    m_blockOffset = alignDown(startOffset);
+    m_blockFill = startOffset - m_blockOffset;
+    m_logicalSize = startOffset;
+    if (m_blockFill > 0) {
+        if (!acquireBlock()) {
+            return false;
+        }
+        int error = 0;
+        if (readAt(m_shared->fd, m_current->data(), DirectIoPolicy::Alignment, m_blockOffset, error) < m_blockFill) {
+            qWarning() << "No se pudo recuperar el final del archivo para continuar sin caché:" << qt_error_string(error);
+            return false;
+        }
+    }
+    DirectIoPolicy::instance().countWriteTransfer();
+    return true;
+}
+
+bool DirectFileWriter::acquireBlock()
+{
+    for (;;) {
+        BufferPool::Buffer buffer = BufferPool::instance().acquire();
+        if (!buffer.isNull() && buffer.size() >= m_blockCapacity) {
+            m_current = std::make_unique<Block>();
+            m_current->pooled = std::move(buffer);
+            return true;
+        }
+        int inFlight;
+        {
+            QMutexLocker locker(&m_shared->mutex);
+            inFlight = m_shared->inFlight;
+        }
+        if (inFlight == 0) {
+            // Nadie va a devolver bloques al pool: usar memoria alineada propia
+            m_current = std::make_unique<Block>();
+            m_current->own = static_cast<char *>(qMallocAligned(size_t(m_blockCapacity), size_t(DirectIoPolicy::Alignment)));
+            return m_current->own != nullptr;
+        }
+        if (!waitForSlot(inFlight - 1)) {
+            return false;
+        }
+    }
+}
+
+bool DirectFileWriter::waitForSlot(int maxInFlight)
+{
+    QMutexLocker locker(&m_shared->mutex);
+    while (m_shared->inFlight > maxInFlight) {
+        m_shared->completed.wait(&m_shared->mutex);
+    }
+    return m_shared->error == 0;
+}
+
+bool DirectFileWriter::submitCurrent(qint64 length)
+{
+    if (!waitForSlot(m_queueDepth - 1)) {
+        return false;
+    }
+    {
+        QMutexLocker locker(&m_shared->mutex);
+        m_shared->inFlight++;
+    }
+
+    std::shared_ptr<Block> block(std::move(m_current));
+    std::shared_ptr<Shared> shared = m_shared;
+    const qint64 offset = m_blockOffset;
+    directIoPool().start([block, shared, offset, length]() {
+        int error = 0;
+        {
+            IoScheduler::Ticket io = IoScheduler::instance().acquire(shared->device, IoScheduler::Kind::Write);
+            writeAt(shared->fd, block->data(), length, offset, error);
+        }
+        if (error == 0) {
+            DirectIoPolicy::instance().recordWrite(length);
+        }
+        QMutexLocker locker(&shared->mutex);
+        if (error != 0 && shared->error == 0) {
+            shared->error = error;
+        }
+        shared->inFlight--;
+        shared->completed.wakeAll();
+    });
+
+    m_blockOffset += length;
+    m_blockFill = 0;
+    return true;
+}
+
+bool DirectFileWriter::write(const char *data, qint64 length)
+{
+    while (length > 0) {
+        if (!m_current && !acquireBlock()) {
+            return false;
+        }
+        const qint64 chunk = qMin(length, m_blockCapacity - m_blockFill);
+        std::memcpy(m_current->data() + m_blockFill, data, size_t(chunk));
+        m_blockFill += chunk;
+        m_logicalSize += chunk;
+        data += chunk;
+        length -= chunk;
+        if (m_blockFill == m_blockCapacity && !submitCurrent(m_blockCapacity)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DirectFileWriter::finish()
+{
+    m_finished = true;
+    bool ok = true;
+    if (m_current && m_blockFill > 0) {
+        // O_DIRECT solo escribe longitudes alineadas: rellenar con ceros y recortar después
+        const qint64 padded = alignUp(m_blockFill);
+        std::memset(m_current->data() + m_blockFill, 0, size_t(padded - m_blockFill));
+        ok = submitCurrent(padded);
+    }
+    m_current.reset();
+    ok = waitForSlot(0) && ok;
+
+    QMutexLocker locker(&m_shared->mutex);
+    if (m_shared->fd >= 0) {
+        const int error = closeDescriptor(m_shared->fd, m_logicalSize);
+        m_shared->fd = -1;
+        if (error != 0 && m_shared->error == 0) {
+            m_shared->error = error;
+        }
+    }
+    return ok && m_shared->error == 0;
+}
+
+QString DirectFileWriter::errorString() const
+{
+    QMutexLocker locker(&m_shared->mutex);
+    return m_shared->error ? qt_error_string(m_shared->error) : QString();
+}
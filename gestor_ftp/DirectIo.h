@@ -0,0 +1,153 @@
+#ifndef DIRECTIO_H
+#define DIRECTIO_H
+
+#include <QString>
+#include <QStringList>
+#include <QObject>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QWaitCondition>
+#include <memory>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include "BufferPool.h"
+
+// Transferencias con O_DIRECT para archivos muy grandes.
+//
+// Una copia de seguridad de cientos de GB que pasa por la caché de páginas
+// expulsa de ella todo lo que usan los demás usuarios. Los archivos que superan
+// el umbral configurado, o que están bajo una de las rutas configuradas, se leen
+// y escriben saltándose la caché: bloques alineados del BufferPool y varias
+// operaciones en vuelo en un pool de hilos propio para mantener el caudal sin
+// la lectura anticipada del kernel. Solo Linux; en otros sistemas las
+// transferencias siguen por la ruta normal.
+class DirectIoPolicy {
+public:
+    struct Stats {
+        qint64 thresholdBytes = 0;
+        QStringList paths;
+        int queueDepth = 0;
+        quint64 reads = 0;         // Descargas con O_DIRECT
+        quint64 writes = 0;        // Subidas con O_DIRECT
+        quint64 bytesRead = 0;
+        quint64 bytesWritten = 0;
+        quint64 fallbacks = 0;     // El sistema de archivos no admite O_DIRECT
+    };
+
+    static constexpr qint64 DefaultThreshold = 4LL * 1024 * 1024 * 1024;
+    static constexpr int DefaultQueueDepth = 4;
+    // Alineación exigida a direcciones, desplazamientos y longitudes
+    static constexpr qint64 Alignment = BufferPool::Alignment;
+
+    static DirectIoPolicy &instance() {
+        static DirectIoPolicy instance;
+        return instance;
+    }
+
+    DirectIoPolicy(const DirectIoPolicy &) = delete;
+    DirectIoPolicy &operator=(const DirectIoPolicy &) = delete;
+
+    // Umbral 0 y sin rutas desactiva el modo directo
+    void configure(qint64 thresholdBytes, const QStringList &paths, int queueDepth);
+
+    static bool isSupported();
+    bool matchesPath(const QString &absolutePath) const;
+    // Descargas: por ruta o por tamaño
+    bool shouldUse(const QString &absolutePath, qint64 size) const;
+    qint64 threshold() const { return m_threshold.load(); }
+    int queueDepth() const { return m_queueDepth.load(); }
+
+    void recordRead(qint64 bytes) { m_bytesRead.fetch_add(bytes, std::memory_order_relaxed); }
+    void recordWrite(qint64 bytes) { m_bytesWritten.fetch_add(bytes, std::memory_order_relaxed); }
+    void countReadTransfer() { m_reads.fetch_add(1, std::memory_order_relaxed); }
+    void countWriteTransfer() { m_writes.fetch_add(1, std::memory_order_relaxed); }
+    void countFallback() { m_fallbacks.fetch_add(1, std::memory_order_relaxed); }
+
+    Stats stats() const;
+
+private:
+    DirectIoPolicy() = default;
+
+    mutable QReadWriteLock m_lock;
+    QStringList m_paths;           // Prefijos absolutos, sin barra final
+    std::atomic<qint64> m_threshold{DefaultThreshold};
+    std::atomic<int> m_queueDepth{DefaultQueueDepth};
+    std::atomic<quint64> m_reads{0};
+    std::atomic<quint64> m_writes{0};
+    std::atomic<quint64> m_bytesRead{0};
+    std::atomic<quint64> m_bytesWritten{0};
+    std::atomic<quint64> m_fallbacks{0};
+};
+
+// Lectura secuencial con O_DIRECT y varias lecturas en vuelo. Pertenece al hilo de
+// la sesión; las lecturas se hacen en el pool de E/S directa y avisan con
+// 'onDataReady' en el hilo de 'context' al completarse.
+class DirectFileReader {
+public:
+    enum class Status { Ready, Pending, Failed };
+
+    DirectFileReader(QObject *context, std::function<void()> onDataReady);
+    ~DirectFileReader();
+
+    DirectFileReader(const DirectFileReader &) = delete;
+    DirectFileReader &operator=(const DirectFileReader &) = delete;
+
+    // false si el archivo no se puede abrir con O_DIRECT
+    bool open(const QString &path, qint64 size);
+
+    // Siguiente bloque en orden. Con Pending se avisará al completar una lectura,
+    // salvo que no haya ninguna en vuelo (pool agotado): el llamador debe reintentar.
+    Status next(BufferPool::Buffer &buffer, qint64 &length);
+    int inFlight() const { return int(m_requests.size()); }
+
+private:
+    struct Shared;
+    struct Request;
+
+    void submit();
+
+    std::shared_ptr<Shared> m_shared;
+    std::deque<std::shared_ptr<Request>> m_requests;   // En orden de desplazamiento
+    qint64 m_size = 0;
+    qint64 m_nextOffset = 0;
+};
+
+// Escritura secuencial con O_DIRECT: acumula en bloques alineados y los escribe
+// con varias escrituras en vuelo. El último bloque se completa con ceros y el
+// archivo se recorta a su tamaño real al terminar.
+class DirectFileWriter {
+public:
+    explicit DirectFileWriter(int queueDepth);
+    ~DirectFileWriter();
+
+    DirectFileWriter(const DirectFileWriter &) = delete;
+    DirectFileWriter &operator=(const DirectFileWriter &) = delete;
+
+    // Con 'startOffset' > 0 continúa un archivo ya escrito hasta ese punto sin caché
+    bool open(const QString &path, qint64 startOffset = 0);
+    bool write(const char *data, qint64 length);
+    bool finish();
+
+    qint64 size() const { return m_logicalSize; }
+    QString errorString() const;
+
+private:
+    struct Shared;
+    struct Block;
+
+    bool acquireBlock();
+    bool submitCurrent(qint64 length);
+    bool waitForSlot(int maxInFlight);
+
+    std::shared_ptr<Shared> m_shared;
+    std::unique_ptr<Block> m_current;
+    qint64 m_blockCapacity = 0;    // Tamaño de bloque alineado
+    qint64 m_blockOffset = 0;      // Desplazamiento en el archivo del bloque actual
+    qint64 m_blockFill = 0;
+    qint64 m_logicalSize = 0;
+    int m_queueDepth;
+    bool m_finished = false;
+};
+
+#endif // DIRECTIO_H
@@ -0,0 +1,395 @@
+#include "DirectoryCache.h"
+#include <QMutexLocker>
+#include <QThread>
+#include <QObject>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <QSocketNotifier>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#else
+#include <QFileSystemWatcher>
+#endif
+
+namespace {
+#ifdef Q_OS_LINUX
+// Todo lo que puede cambiar el contenido de un listado LIST/MLSD
+constexpr quint32 WatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY |
+                              IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF;
+#endif
+
+QString normalized(const QString &dir)
+{
+    return QDir::cleanPath(dir);
+}
+} // namespace
+
+DirectoryCache::DirectoryCache()
+{
+    startWatcherThread();
+}
+
+// =====================================================================================
+// Seccion: Vigilancia de directorios
+// =====================================================================================
+
+void DirectoryCache::startWatcherThread()
+{
+    // El hilo y su contexto viven lo mismo que el proceso
+    m_watchThread = new QThread;
+    m_watchThread->setObjectName(QStringLiteral("DirectoryCacheWatcher"));
+    m_watchContext = new QObject;
+    m_watchContext->moveToThread(m_watchThread);
+    m_watchThread->start();
+
+#ifdef Q_OS_LINUX
+    m_inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0) {
+        qWarning() << "inotify no disponible, no se cachearán listados:" << qt_error_string(errno);
+        return;
+    }
+    // Los eventos que lleguen antes de crear el notificador esperan en el descriptor
+    QMetaObject::invokeMethod(m_watchContext, [this]() {
+        auto *notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, m_watchContext);
+        QObject::connect(notifier, &QSocketNotifier::activated, m_watchContext, [this]() { readEvents(); });
+    }, Qt::QueuedConnection);
+#else
+    QFileSystemWatcher *watcher = nullptr;
+    QMetaObject::invokeMethod(m_watchContext, [this, &watcher]() {
+        watcher = new QFileSystemWatcher(m_watchContext);
+        QObject::connect(watcher, &QFileSystemWatcher::directoryChanged, m_watchContext,
+                         [this](const QString &dir) { onDirectoryChanged(dir); });
+    }, Qt::BlockingQueuedConnection);
+    m_fallbackWatcher = watcher;
+#endif
+}
+
+bool DirectoryCache::startWatch(const QString &dir, QMutexLocker<QMutex> &locker)
+{
+#ifdef Q_OS_LINUX
+    Q_UNUSED(locker);
+    if (m_inotifyFd < 0) {
+        return false;
+    }
+    const int wd = ::inotify_add_watch(m_inotifyFd, QFile::encodeName(dir).constData(), WatchMask);
+    if (wd < 0) {
+        return false;
+    }
+    // El mismo inodo por otra ruta (enlace simbólico) comparte descriptor: solo
+    // se puede invalidar una de las dos, así que la segunda no se cachea
+    const QString owner = m_watchPaths.value(wd);
+    if (!owner.isEmpty() && owner != dir) {
+        return false;
+    }
+    m_watchPaths.insert(wd, dir);
+    Watch &watch = m_watches[dir];
+    watch.id = wd;
+    watch.active = true;
+    return true;
+#else
+    auto *watcher = static_cast<QFileSystemWatcher *>(m_fallbackWatcher);
+    if (!watcher) {
+        return false;
+    }
+    // addPath se ejecuta en el hilo del vigilante; soltar el mutex evita un
+    // interbloqueo con un aviso de cambio que esté esperándolo
+    bool added = false;
+    locker.unlock();
+    QMetaObject::invokeMethod(m_watchContext, [watcher, dir, &added]() {
+        added = watcher->addPath(dir) || watcher->directories().contains(dir);
+    }, Qt::BlockingQueuedConnection);
+    locker.relock();
+    if (!added) {
+        return false;
+    }
+    m_watches[dir].active = true;
+    return true;
+#endif
+}
+
+void DirectoryCache::stopWatchLocked(const QString &dir, const Watch &watch)
+{
+#ifdef Q_OS_LINUX
+    Q_UNUSED(dir);
+    if (watch.id >= 0) {
+        ::inotify_rm_watch(m_inotifyFd, watch.id);
+        m_watchPaths.remove(watch.id);
+    }
+#else
+    if (watch.active && m_fallbackWatcher) {
+        auto *watcher = static_cast<QFileSystemWatcher *>(m_fallbackWatcher);
+        QMetaObject::invokeMethod(m_watchContext, [watcher, dir]() { watcher->removePath(dir); },
+                                  Qt::QueuedConnection);
+    }
+#endif
+}
+
+void DirectoryCache::pruneWatchesLocked()
+{
+    // Dejar de vigilar directorios que ya no tienen nada en caché
+    if (m_watches.size() < MaxWatches) {
+        return;
+    }
+    for (auto it = m_watches.begin(); it != m_watches.end() && m_watches.size() > MaxWatches * 3 / 4;) {
+        if (it->variants.isEmpty()) {
+            stopWatchLocked(it.key(), it.value());
+            it = m_watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DirectoryCache::readEvents()
+{
+#ifdef Q_OS_LINUX
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    QSet<int> changed;
+    bool overflow = false;
+
+    for (;;) {
+        const ssize_t length = ::read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break; // EAGAIN: no quedan eventos
+        }
+        for (char *p = buffer; p < buffer + length;) {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(p);
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+            } else {
+                changed.insert(event->wd);
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (overflow) {
+        // Se han perdido eventos: no se puede saber qué sigue siendo válido
+        qWarning() << "Desbordamiento de la cola de inotify, se vacía la caché de listados";
+        for (auto it = m_watches.begin(); it != m_watches.end(); ++it) {
+            invalidateLocked(it.key());
+        }
+        return;
+    }
+    for (int wd : std::as_const(changed)) {
+        const QString dir = m_watchPaths.value(wd);
+        if (dir.isEmpty()) {
+            continue;
+        }
+        invalidateLocked(dir);
+        // Si el directorio se borró o se movió, el kernel ya retiró el descriptor
+        if (!QFileInfo(dir).isDir()) {
+            m_watchPaths.remove(wd);
+            m_watches.remove(dir);
+        }
+    }
+#endif
+}
+
+void DirectoryCache::onDirectoryChanged(const QString &dir)
+{
+    QMutexLocker locker(&m_mutex);
+    invalidateLocked(dir);
+    if (!QFileInfo(dir).isDir()) {
+        m_watches.remove(dir); // QFileSystemWatcher ya dejó de vigilarlo
+    }
+}
+
+// =====================================================================================
+// Seccion: Consultas e inserciones
+// =====================================================================================
+
+quint32 DirectoryCache::variantFor(Format format, quint32 flags)
+{
+    return (quint32(format) << 24) | (flags & 0xFFFFFF);
+}
+
+void DirectoryCache::configure(qint64 capacityBytes)
+{
+    m_capacity.store(qMax<qint64>(0, capacityBytes));
+    {
+        QMutexLocker locker(&m_mutex);
+        evictLocked(0);
+    }
+    if (capacityBytes <= 0) {
+        qInfo() << "Caché de listados desactivada";
+        return;
+    }
+    qInfo() << "Caché de listados:" << capacityBytes / (1024 * 1024) << "MB";
+}
+
+bool DirectoryCache::lookup(const QString &dir, Format format, quint32 flags, QByteArray &payload)
+{
+    if (m_capacity.load() <= 0) {
+        return false;
+    }
+    const Key key{normalized(dir), variantFor(format, flags)};
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->position);
+    payload = it->payload; // Copia superficial
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+quint64 DirectoryCache::beginRender(const QString &dir)
+{
+    if (m_capacity.load() <= 0) {
+        return 0;
+    }
+    const QString path = normalized(dir);
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_watches.constFind(path);
+    if (it != m_watches.constEnd() && it->active) {
+        return it->generation;
+    }
+    pruneWatchesLocked();
+    if (m_watches.size() >= MaxWatches) {
+        return 0; // Todos los vigilados tienen listados en caché
+    }
+    if (!startWatch(path, locker)) {
+        return 0;
+    }
+    return m_watches.value(path).generation;
+}
+
+void DirectoryCache::insert(const QString &dir, Format format, quint32 flags, const QByteArray &payload, quint64 generation)
+{
+    const qint64 capacity = m_capacity.load();
+    if (generation == 0 || capacity <= 0 || payload.size() > maxEntryBytes()) {
+        return;
+    }
+    const Key key{normalized(dir), variantFor(format, flags)};
+
+    QMutexLocker locker(&m_mutex);
+    auto watch = m_watches.find(key.dir);
+    if (watch == m_watches.end() || !watch->active || watch->generation != generation) {
+        // El directorio cambió mientras se leía: el listado ya no es fiable
+        m_staleRenders.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto existing = m_entries.find(key);
+    if (existing != m_entries.end()) {
+        removeNodeLocked(existing);
+    }
+    evictLocked(payload.size());
+
+    m_lru.push_front(key);
+    m_entries.insert(key, Node{payload, m_lru.begin()});
+    m_usedBytes += payload.size();
+    // evictLocked puede haber reordenado la tabla de vigilancia
+    m_watches[key.dir].variants.append(key.variant);
+    m_insertions.fetch_add(1, std::memory_order_relaxed);
+}
+
+// =====================================================================================
+// Seccion: Invalidación y expulsión
+// =====================================================================================
+
+void DirectoryCache::invalidate(const QString &dir)
+{
+    QMutexLocker locker(&m_mutex);
+    invalidateLocked(normalized(dir));
+}
+
+void DirectoryCache::invalidateTree(const QString &dir)
+{
+    const QString root = normalized(dir);
+    const QString prefix = root.endsWith(QLatin1Char('/')) ? root : root + QLatin1Char('/');
+
+    QMutexLocker locker(&m_mutex);
+    const QStringList watched = m_watches.keys();
+    for (const QString &path : watched) {
+        if (path == root || path.startsWith(prefix)) {
+            invalidateLocked(path);
+        }
+    }
+}
+
+void DirectoryCache::invalidateLocked(const QString &dir)
+{
+    auto watch = m_watches.find(dir);
+    if (watch == m_watches.end()) {
+        return;
+    }
+    // Una generación nueva descarta también los listados que se estén generando
+    watch->generation++;
+    const QList<quint32> variants = watch->variants;
+    for (quint32 variant : variants) {
+        auto it = m_entries.find(Key{dir, variant});
+        if (it != m_entries.end()) {
+            removeNodeLocked(it);
+            m_invalidations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void DirectoryCache::removeNodeLocked(QHash<Key, Node>::iterator it)
+{
+    m_usedBytes -= it->payload.size();
+    m_lru.erase(it->position);
+    auto watch = m_watches.find(it.key().dir);
+    if (watch != m_watches.end()) {
+        watch->variants.removeOne(it.key().variant);
+    }
+    m_entries.erase(it);
+}
+
+void DirectoryCache::evictLocked(qint64 neededBytes)
+{
+    const qint64 capacity = m_capacity.load();
+    while (!m_lru.empty() && m_usedBytes + neededBytes > capacity) {
+        auto it = m_entries.find(m_lru.back());
+        if (it == m_entries.end()) {
+            m_lru.pop_back();
+            continue;
+        }
+        removeNodeLocked(it);
+        m_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void DirectoryCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_watches.constBegin(); it != m_watches.constEnd(); ++it) {
+        stopWatchLocked(it.key(), it.value());
+    }
+    m_watches.clear();
+    m_watchPaths.clear();
+    m_entries.clear();
+    m_lru.clear();
+    m_usedBytes = 0;
+}
+
+DirectoryCache::Stats DirectoryCache::stats() const
+{
+    Stats s;
+    s.capacityBytes = m_capacity.load();
+    s.watcherActive = m_inotifyFd >= 0 || m_fallbackWatcher != nullptr;
+    s.hits = m_hits.load(std::memory_order_relaxed);
+    s.misses = m_misses.load(std::memory_order_relaxed);
+    s.insertions = m_insertions.load(std::memory_order_relaxed);
+    s.invalidations = m_invalidations.load(std::memory_order_relaxed);
+    s.evictions = m_evictions.load(std::memory_order_relaxed);
+    s.staleRenders = m_staleRenders.load(std::memory_order_relaxed);
+
+    QMutexLocker locker(&m_mutex);
+    s.usedBytes = m_usedBytes;
+    s.entries = m_entries.size();
+    s.watchedDirectories = m_watches.size();
+    return s;
+}
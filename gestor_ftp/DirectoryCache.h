@@ -1,35 +1,127 @@
 #pragma once
-#include <QCache>
-#include <QFileInfoList>
-#include <QDateTime>
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QList>
 #include <QMutex>
-#include <QMutexLocker>
+#include <list>
+#include <atomic>
 
+class QThread;
+class QObject;
+
+// Caché de listados de directorio ya renderizados (los bytes exactos de LIST/MLSD).
+//
+// La clave es (directorio, formato, opciones) y el valor el listado tal como se
+// envía por el socket de datos, así que repetir el listado de un directorio grande
+// se reduce a copiar bytes. Las entradas no caducan por tiempo: cada directorio
+// cacheado se vigila (inotify en Linux, QFileSystemWatcher en el resto) desde un
+// hilo propio, y cualquier cambio lo invalida. Las operaciones del propio servidor
+// (STOR, DELE, MKD, RMD...) invalidan además de forma explícita. El total de bytes
+// tiene un tope con expulsión LRU.
 class DirectoryCache {
 public:
+    enum class Format : quint8 { List = 0, Mlsd = 1 };
+    // Opciones que cambian el contenido del listado
+    enum Flag : quint32 { ShowHidden = 0x1 };
+
+    struct Stats {
+        qint64 capacityBytes = 0;
+        qint64 usedBytes = 0;
+        int entries = 0;
+        int watchedDirectories = 0;
+        bool watcherActive = false;
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 insertions = 0;
+        quint64 invalidations = 0;   // Entradas descartadas por cambios en disco o propios
+        quint64 evictions = 0;
+        quint64 staleRenders = 0;    // Listados no guardados porque el directorio cambió mientras se generaban
+        double hitRatio() const { return hits + misses ? double(hits) / (hits + misses) : 0.0; }
+    };
+
+    static constexpr qint64 DefaultCapacity = 32 * 1024 * 1024;
+    static constexpr int MaxWatches = 4096;
+
     static DirectoryCache& instance() {
         static DirectoryCache instance;
         return instance;
     }
 
-    QFileInfoList getContents(const QString& path) {
-        QMutexLocker locker(&mutex);
-        if(cache.contains(path)) {
-            QPair<QFileInfoList, QDateTime>* cached = cache[path];
-            if(cached && QDateTime::currentDateTime().secsTo(cached->second) < 5) {
-                return cached->first;
-            }
-        }
-        return QFileInfoList();
-    }
+    DirectoryCache(const DirectoryCache &) = delete;
+    DirectoryCache &operator=(const DirectoryCache &) = delete;
 
-    void updateCache(const QString& path, const QFileInfoList& contents) {
-        QMutexLocker locker(&mutex);
-        cache.insert(path, new QPair<QFileInfoList, QDateTime>(contents, QDateTime::currentDateTime()));
-    }
+    // Capacidad 0 desactiva la caché
+    void configure(qint64 capacityBytes);
+
+    // Un listado más grande que esto no se guarda (vaciaría media caché)
+    qint64 maxEntryBytes() const { return m_capacity.load() / 4; }
+
+    bool lookup(const QString &dir, Format format, quint32 flags, QByteArray &payload);
+
+    // Antes de leer el directorio: empieza a vigilarlo y devuelve su generación actual.
+    // Devuelve 0 si no se puede vigilar (el listado no se guardará).
+    quint64 beginRender(const QString &dir);
+    // Guarda el listado solo si el directorio no cambió desde beginRender()
+    void insert(const QString &dir, Format format, quint32 flags, const QByteArray &payload, quint64 generation);
+
+    void invalidate(const QString &dir);
+    // El directorio y todo lo que cuelga de él (RMD, SITE UNTAR)
+    void invalidateTree(const QString &dir);
+    void clear();
+
+    Stats stats() const;
 
 private:
-    QCache<QString, QPair<QFileInfoList, QDateTime>> cache;
-    QMutex mutex;
-    DirectoryCache() : cache(1000) {} // Caché para 1000 directorios
+    DirectoryCache();
+
+    struct Key {
+        QString dir;
+        quint32 variant = 0;    // Formato en los bits altos, opciones en los bajos
+        bool operator==(const Key &other) const { return variant == other.variant && dir == other.dir; }
+        friend size_t qHash(const Key &key, size_t seed = 0) { return qHashMulti(seed, key.dir, key.variant); }
+    };
+
+    struct Node {
+        QByteArray payload;
+        std::list<Key>::iterator position;
+    };
+
+    struct Watch {
+        int id = -1;               // Descriptor de inotify (-1 con QFileSystemWatcher)
+        bool active = false;
+        quint64 generation = 1;
+        QList<quint32> variants;   // Variantes cacheadas de este directorio
+    };
+
+    static quint32 variantFor(Format format, quint32 flags);
+    bool startWatch(const QString &dir, QMutexLocker<QMutex> &locker);
+    void stopWatchLocked(const QString &dir, const Watch &watch);
+    void pruneWatchesLocked();
+    void invalidateLocked(const QString &dir);
+    void removeNodeLocked(QHash<Key, Node>::iterator it);
+    void evictLocked(qint64 neededBytes);
+    void startWatcherThread();
+    void readEvents();
+    void onDirectoryChanged(const QString &dir);
+
+    mutable QMutex m_mutex;
+    QHash<Key, Node> m_entries;
+    std::list<Key> m_lru;                 // Más reciente al principio
+    QHash<QString, Watch> m_watches;
+    QHash<int, QString> m_watchPaths;     // Descriptor de inotify -> directorio
+    qint64 m_usedBytes = 0;
+
+    QThread *m_watchThread = nullptr;     // Recibe los avisos de cambios
+    QObject *m_watchContext = nullptr;    // Vive en m_watchThread
+    QObject *m_fallbackWatcher = nullptr; // QFileSystemWatcher fuera de Linux
+    int m_inotifyFd = -1;
+
+    std::atomic<qint64> m_capacity{DefaultCapacity};
+    std::atomic<quint64> m_hits{0};
+    std::atomic<quint64> m_misses{0};
+    std::atomic<quint64> m_insertions{0};
+    std::atomic<quint64> m_invalidations{0};
+    std::atomic<quint64> m_evictions{0};
+    std::atomic<quint64> m_staleRenders{0};
 };
@@ -0,0 +1,499 @@
+#include "DirectoryLister.h"
+#include "MetadataIndex.h"
+#include <QDirIterator>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDebug>
+#include <cstdio>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <cerrno>
+#include <ctime>
+#endif
+
+namespace {
+// Peso de cada muestra nueva en las medias móviles
+constexpr double SampleWeight = 0.1;
+
+struct ListingCounters {
+    QMutex mutex;
+    DirectoryLister::Stats stats;
+};
+
+ListingCounters &counters()
+{
+    static ListingCounters instance;
+    return instance;
+}
+
+double smooth(double average, double sample)
+{
+    return average == 0.0 ? sample : average + SampleWeight * (sample - average);
+}
+
+// "Mmm dd hh:mm" en hora local, como el formato "MMM dd hh:mm" de QDateTime
+int formatDate(qint64 mtimeSecs, char *out, size_t size)
+{
+#ifdef Q_OS_LINUX
+    static const char *const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                         "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    const time_t t = time_t(mtimeSecs);
+    struct tm local;
+    if (!localtime_r(&t, &local)) {
+        return std::snprintf(out, size, "Jan 01 00:00");
+    }
+    return std::snprintf(out, size, "%s %02d %02d:%02d", months[local.tm_mon], local.tm_mday,
+                         local.tm_hour, local.tm_min);
+#else
+    const QByteArray date = QDateTime::fromSecsSinceEpoch(mtimeSecs).toString("MMM dd hh:mm").toUtf8();
+    return std::snprintf(out, size, "%s", date.constData());
+#endif
+}
+
+#ifdef Q_OS_LINUX
+// Registro que devuelve getdents64 (no lo declara glibc)
+struct LinuxDirent64 {
+    quint64 d_ino;
+    qint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+#endif
+} // namespace
+
+DirectoryLister::DirectoryLister() = default;
+
+DirectoryLister::~DirectoryLister()
+{
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+#endif
+}
+
+// =====================================================================================
+// Seccion: Recorrido
+// =====================================================================================
+
+bool DirectoryLister::open(const QString &path, bool showHidden, Format format)
+{
+    m_path = path;
+    // MLSD siempre incluye los ocultos (RFC 3659) y nunca "." ni ".."
+    m_showHidden = showHidden || format == Format::Mlsd;
+    m_showDots = showHidden && format == Format::List;
+    m_format = format;
+    m_entries = 0;
+    m_error.clear();
+
+    // LIST -a necesita "." y "..", que el índice no guarda
+    m_indexed.clear();
+    m_indexedPos = 0;
+    m_fromIndex = !m_showDots && MetadataIndex::instance().listDirectory(path, m_indexed);
+    if (m_fromIndex) {
+        m_atEnd = false;
+        return true;
+    }
+
+#ifdef Q_OS_LINUX
+    m_fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m_fd < 0) {
+        m_error = qt_error_string(errno);
+        return false;
+    }
+    m_dents.reset(new char[DentsBufferSize]);
+    m_dentsLength = 0;
+    m_dentsPos = 0;
+#else
+    QDir::Filters filters = QDir::AllEntries | QDir::NoDotAndDotDot;
+    if (m_showHidden) {
+        filters |= QDir::Hidden;
+    }
+    if (m_showDots) {
+        filters &= ~QDir::NoDotAndDotDot;
+    }
+    if (!QFileInfo(path).isDir()) {
+        m_error = QStringLiteral("No es un directorio");
+        return false;
+    }
+    m_iterator = std::make_unique<QDirIterator>(path, filters);
+#endif
+    m_atEnd = false;
+    return true;
+}
+
+void DirectoryLister::openSource(EntrySource source, bool showHidden, Format format)
+{
+    m_path.clear();
+    m_showHidden = showHidden || format == Format::Mlsd;
+    m_showDots = false;
+    m_format = format;
+    m_entries = 0;
+    m_error.clear();
+    m_fromIndex = false;
+    m_indexed.clear();
+    m_indexedPos = 0;
+    m_source = std::move(source);
+    m_atEnd = false;
+}
+
+int DirectoryLister::next(QByteArray &out, qint64 maxBytes)
+{
+    if (m_fromIndex) {
+        return nextIndexed(out, maxBytes);
+    }
+    if (m_source) {
+        return nextFromSource(out, maxBytes);
+    }
+
+    int produced = 0;
+    Entry entry;
+
+#ifdef Q_OS_LINUX
+    while (!m_atEnd && out.size() < maxBytes) {
+        if (m_dentsPos >= m_dentsLength) {
+            const long length = ::syscall(SYS_getdents64, m_fd, m_dents.get(), DentsBufferSize);
+            if (length <= 0) {
+                if (length < 0) {
+                    m_error = qt_error_string(errno);
+                    qWarning() << "Error leyendo el directorio" << m_path << m_error;
+                }
+                m_atEnd = true;
+                break;
+            }
+            m_dentsLength = int(length);
+            m_dentsPos = 0;
+        }
+
+        const auto *dirent = reinterpret_cast<const LinuxDirent64 *>(m_dents.get() + m_dentsPos);
+        m_dentsPos += dirent->d_reclen;
+
+        const char *name = dirent->d_name;
+        if (name[0] == '.') {
+            const bool dots = name[1] == '\0' || (name[1] == '.' && name[2] == '\0');
+            if (dots ? !m_showDots : !m_showHidden) {
+                continue; // "." y ".." solo con LIST -a; ocultos con -a y en MLSD
+            }
+        }
+        if (!statEntry(m_fd, name, entry)) {
+            continue; // Borrado mientras se listaba, enlace roto o archivo especial
+        }
+        if (m_directories && entry.isDir) {
+            // Solo hace falta saber si es un enlace cuando se va a descender
+            struct stat link;
+            entry.isLink = dirent->d_type == DT_LNK ||
+                (dirent->d_type == DT_UNKNOWN && ::fstatat(m_fd, name, &link, AT_SYMLINK_NOFOLLOW) == 0 &&
+                 S_ISLNK(link.st_mode));
+        }
+        const int nameLength = int(std::strlen(name));
+#else
+    while (!m_atEnd && out.size() < maxBytes) {
+        if (!m_iterator->hasNext()) {
+            m_atEnd = true;
+            break;
+        }
+        m_iterator->next();
+        const QFileInfo info = m_iterator->fileInfo();
+        if (!m_showHidden && info.fileName().startsWith('.')) {
+            continue;
+        }
+        entry = entryFromInfo(info);
+        const QByteArray nameBytes = info.fileName().toUtf8();
+        const char *name = nameBytes.constData();
+        const int nameLength = nameBytes.size();
+#endif
+        appendEntry(out, entry, name, nameLength);
+        produced++;
+    }
+
+    m_entries += produced;
+    return produced;
+}
+
+int DirectoryLister::nextIndexed(QByteArray &out, qint64 maxBytes)
+{
+    int produced = 0;
+    while (m_indexedPos < m_indexed.size() && out.size() < maxBytes) {
+        const NamedEntry &indexed = m_indexed[m_indexedPos++];
+        if (indexed.name.startsWith('.') && !m_showHidden) {
+            continue; // LIST sin -a no muestra los ocultos
+        }
+        appendEntry(out, indexed.entry, indexed.name.constData(), int(indexed.name.size()));
+        produced++;
+    }
+    if (m_indexedPos >= m_indexed.size()) {
+        m_atEnd = true;
+        m_indexed = std::vector<NamedEntry>();
+    }
+    m_entries += produced;
+    return produced;
+}
+
+int DirectoryLister::nextFromSource(QByteArray &out, qint64 maxBytes)
+{
+    // Tandas pequeñas: el origen puede tener millones de entradas
+    constexpr int SourceBatch = 256;
+    int produced = 0;
+    while (!m_atEnd && out.size() < maxBytes) {
+        if (m_indexedPos >= m_indexed.size()) {
+            m_indexed.clear();
+            m_indexedPos = 0;
+            if (m_source(m_indexed, SourceBatch) <= 0) {
+                m_atEnd = true;
+                m_source = nullptr;
+                break;
+            }
+        }
+        const NamedEntry &named = m_indexed[m_indexedPos++];
+        if (named.name.startsWith('.') && !m_showHidden) {
+            continue;
+        }
+        appendEntry(out, named.entry, named.name.constData(), int(named.name.size()));
+        produced++;
+    }
+    m_entries += produced;
+    return produced;
+}
+
+void DirectoryLister::appendEntry(QByteArray &out, const Entry &entry, const char *name, int nameLength)
+{
+    if (m_directories && entry.isDir && !entry.isLink &&
+        std::strcmp(name, ".") != 0 && std::strcmp(name, "..") != 0) {
+        m_directories->append(QByteArray(name, nameLength));
+    }
+    if (m_format == Format::Mlsd) {
+        appendFacts(out, entry);
+        out.append(' ');
+        out.append(m_namePrefix);
+        out.append(name, nameLength);
+        out.append("\r\n", 2);
+    } else {
+        appendListLine(out, entry, name, nameLength);
+    }
+}
+
+#ifdef Q_OS_LINUX
+bool DirectoryLister::statEntry(int dirFd, const char *name, Entry &entry)
+{
+    // Solo los campos que se muestran; se siguen los enlaces como hace QFileInfo
+    mode_t mode = 0;
+#ifdef STATX_BASIC_STATS
+    struct statx stx;
+    if (::statx(dirFd, name, AT_STATX_SYNC_AS_STAT,
+                STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME | STATX_INO, &stx) != 0) {
+        return false;
+    }
+    mode = stx.stx_mode;
+    entry.size = qint64(stx.stx_size);
+    entry.mtimeSecs = stx.stx_mtime.tv_sec;
+    entry.device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    entry.inode = stx.stx_ino;
+#else
+    struct stat st;
+    if (::fstatat(dirFd, name, &st, 0) != 0) {
+        return false;
+    }
+    mode = st.st_mode;
+    entry.size = qint64(st.st_size);
+    entry.mtimeSecs = st.st_mtime;
+    entry.device = st.st_dev;
+    entry.inode = st.st_ino;
+#endif
+    // Como QDir::AllEntries: ni sockets, ni dispositivos, ni tuberías
+    if (!S_ISDIR(mode) && !S_ISREG(mode)) {
+        return false;
+    }
+    entry.isDir = S_ISDIR(mode);
+    entry.isLink = false;
+    entry.mode = mode & 0777;
+    return true;
+}
+#else
+DirectoryLister::Entry DirectoryLister::entryFromInfo(const QFileInfo &info)
+{
+    static const QFileDevice::Permission bits[] = {
+        QFileDevice::ReadOwner, QFileDevice::WriteOwner, QFileDevice::ExeOwner,
+        QFileDevice::ReadGroup, QFileDevice::WriteGroup, QFileDevice::ExeGroup,
+        QFileDevice::ReadOther, QFileDevice::WriteOther, QFileDevice::ExeOther};
+    Entry entry;
+    entry.isDir = info.isDir();
+    entry.isLink = info.isSymLink();
+    const QFileDevice::Permissions permissions = info.permissions();
+    for (int i = 0; i < 9; ++i) {
+        if (permissions.testFlag(bits[i])) {
+            entry.mode |= 0400 >> i;
+        }
+    }
+    entry.size = info.size();
+    entry.mtimeSecs = info.lastModified().toSecsSinceEpoch();
+    // Sin inodo accesible: la ruta absoluta identifica el archivo
+    entry.inode = qHash(info.absoluteFilePath());
+    return entry;
+}
+#endif
+
+// =====================================================================================
+// Seccion: Formato de las líneas
+// =====================================================================================
+
+void DirectoryLister::appendListLine(QByteArray &out, const Entry &entry, const char *name, int nameLength)
+{
+    char perms[11];
+    perms[0] = entry.isDir ? 'd' : '-';
+    const char symbols[] = "rwxrwxrwx";
+    for (int i = 0; i < 9; ++i) {
+        perms[i + 1] = (entry.mode & (0400 >> i)) ? symbols[i] : '-';
+    }
+    perms[10] = '\0';
+
+    char date[32];
+    formatDate(entry.mtimeSecs, date, sizeof(date));
+    char head[128];
+    const int length = std::snprintf(head, sizeof(head), "%s 1 owner group %10lld %s ",
+                                     perms, static_cast<long long>(entry.size), date);
+    out.append(head, qMin<int>(length, int(sizeof(head)) - 1));
+    out.append(name, nameLength);
+    out.append("\r\n", 2);
+}
+
+void DirectoryLister::appendFacts(QByteArray &out, const Entry &entry)
+{
+    // perm según los bits del propietario (la cuenta del servidor):
+    // archivos r=RETR, w=STOR, d=DELE; carpetas e=CWD, l=LIST, c=STOR, m=MKD, p=DELE dentro, d=RMD
+    const bool readable = entry.mode & 0400;
+    const bool writable = entry.mode & 0200;
+    const bool searchable = entry.mode & 0100;
+    QByteArray perm;
+    if (entry.isDir) {
+        if (searchable) {
+            perm += 'e';
+        }
+        if (readable && searchable) {
+            perm += 'l';
+        }
+        if (writable && searchable) {
+            perm += "cmpd";
+        }
+    } else {
+        if (readable) {
+            perm += 'r';
+        }
+        if (writable) {
+            perm += "wd";
+        }
+    }
+
+    char facts[160];
+    const int length = std::snprintf(facts, sizeof(facts), "type=%s;", entry.isDir ? "dir" : "file");
+    out.append(facts, length);
+    if (!entry.isDir) {
+        out.append(facts, std::snprintf(facts, sizeof(facts), "size=%lld;", static_cast<long long>(entry.size)));
+    }
+    out.append("modify=", 7);
+    out.append(timeVal(entry.mtimeSecs));
+    out.append(";perm=", 6);
+    out.append(perm);
+    out.append(facts, std::snprintf(facts, sizeof(facts), ";unique=%llxU%llx;",
+                                    static_cast<unsigned long long>(entry.device),
+                                    static_cast<unsigned long long>(entry.inode)));
+}
+
+QByteArray DirectoryLister::timeVal(qint64 mtimeSecs)
+{
+#ifdef Q_OS_LINUX
+    const time_t t = time_t(mtimeSecs);
+    struct tm utc;
+    char buffer[32];
+    if (!gmtime_r(&t, &utc)) {
+        return QByteArray("19700101000000");
+    }
+    const int length = std::snprintf(buffer, sizeof(buffer), "%04d%02d%02d%02d%02d%02d",
+                                     utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                                     utc.tm_hour, utc.tm_min, utc.tm_sec);
+    return QByteArray(buffer, length);
+#else
+    return QDateTime::fromSecsSinceEpoch(mtimeSecs, Qt::UTC).toString("yyyyMMddHHmmss").toLatin1();
+#endif
+}
+
+bool DirectoryLister::statPath(const QString &path, Entry &entry)
+{
+#ifdef Q_OS_LINUX
+    return statEntry(AT_FDCWD, QFile::encodeName(path).constData(), entry);
+#else
+    const QFileInfo info(path);
+    if (!info.exists()) {
+        return false;
+    }
+    entry = entryFromInfo(info);
+    return true;
+#endif
+}
+
+bool DirectoryLister::factsFor(const QString &path, QByteArray &facts)
+{
+    // Primero el índice: tras un reinicio evita tocar metadatos fríos del disco
+    Entry entry;
+    if (!MetadataIndex::instance().lookup(path, entry) && !statPath(path, entry)) {
+        return false;
+    }
+    appendFacts(facts, entry);
+    return true;
+}
+
+bool DirectoryLister::sizeAndTime(const QString &path, qint64 &size, qint64 &mtimeSecs, bool &isDir)
+{
+    Entry entry;
+    if (!MetadataIndex::instance().lookup(path, entry) && !statPath(path, entry)) {
+        return false;
+    }
+    size = entry.size;
+    mtimeSecs = entry.mtimeSecs;
+    isDir = entry.isDir;
+    return true;
+}
+
+// =====================================================================================
+// Seccion: Estadísticas
+// =====================================================================================
+
+void DirectoryLister::recordFirstByte(double elapsedMs, bool fromCache)
+{
+    ListingCounters &c = counters();
+    QMutexLocker locker(&c.mutex);
+    if (fromCache) {
+        c.stats.cachedListings++;
+        c.stats.avgCachedFirstByteMs = smooth(c.stats.avgCachedFirstByteMs, elapsedMs);
+    } else {
+        c.stats.listings++;
+        c.stats.avgFirstByteMs = smooth(c.stats.avgFirstByteMs, elapsedMs);
+    }
+    c.stats.maxFirstByteMs = qMax(c.stats.maxFirstByteMs, elapsedMs);
+}
+
+void DirectoryLister::recordEntries(qint64 entries)
+{
+    ListingCounters &c = counters();
+    QMutexLocker locker(&c.mutex);
+    c.stats.entries += quint64(entries);
+}
+
+DirectoryLister::Stats DirectoryLister::stats()
+{
+    ListingCounters &c = counters();
+    QMutexLocker locker(&c.mutex);
+    Stats s = c.stats;
+    c.stats.maxFirstByteMs = 0.0; // Máximo por intervalo de consulta
+    return s;
+}
@@ -0,0 +1,147 @@
+#ifndef DIRECTORYLISTER_H
+#define DIRECTORYLISTER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QList>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class QDirIterator;
+class QFileInfo;
+
+// Lectura de un directorio por tandas para LIST.
+//
+// En lugar de construir un QFileInfoList completo y un único QString con todo el
+// listado, el directorio se recorre por bloques de entradas (getdents64 en Linux,
+// QDirIterator en el resto) y de cada una se piden solo los campos que aparecen en
+// la línea (statx: tipo, permisos, tamaño y fecha). Cada llamada a next() añade
+// líneas ya formateadas hasta un tope de bytes, así que la memoria no depende del
+// tamaño del directorio y el primer byte sale en cuanto se ha leído la primera tanda.
+// Las entradas salen en el orden del sistema de archivos, sin ordenar. Si el índice
+// de metadatos (MetadataIndex) tiene el directorio completo y al día, las entradas
+// salen de él sin tocar el disco.
+//
+// Los montajes no locales del sistema de archivos virtual (Vfs) entregan sus
+// entradas por tandas a través de openSource(), con el mismo formato de salida.
+//
+// El mismo recorrido genera las líneas de MLSD (RFC 3659), con los hechos type,
+// size, modify, perm y unique, para que un cliente de sincronización no tenga que
+// interpretar LIST ni pedir SIZE/MDTM archivo por archivo.
+class DirectoryLister {
+public:
+    enum class Format { List, Mlsd };
+
+    // Hechos de MLSD/MLST, en el orden en que se envían
+    static constexpr const char *MlstFacts = "type*;size*;modify*;perm*;unique*;";
+
+    // Tope de bytes formateados por llamada a next()
+    static constexpr qint64 BatchBytes = 64 * 1024;
+
+    struct Stats {
+        quint64 listings = 0;          // Listados leídos del disco
+        quint64 cachedListings = 0;    // Servidos desde la caché de listados
+        quint64 entries = 0;
+        double avgFirstByteMs = 0.0;        // Desde la orden LIST hasta el primer byte (media móvil)
+        double avgCachedFirstByteMs = 0.0;
+        double maxFirstByteMs = 0.0;        // Desde la última consulta
+    };
+
+    // Lo que se muestra de cada entrada
+    struct Entry {
+        bool isDir = false;
+        bool isLink = false;
+        quint32 mode = 0;       // Bits rwx de propietario, grupo y otros
+        qint64 size = 0;
+        qint64 mtimeSecs = 0;
+        quint64 device = 0;
+        quint64 inode = 0;
+    };
+
+    struct NamedEntry {
+        QByteArray name;        // Bytes del sistema de archivos
+        Entry entry;
+    };
+
+    // Rellena 'out' con hasta maxEntries entradas; 0 al terminar
+    using EntrySource = std::function<int(std::vector<NamedEntry> &out, int maxEntries)>;
+
+    DirectoryLister();
+    ~DirectoryLister();
+    DirectoryLister(const DirectoryLister &) = delete;
+    DirectoryLister &operator=(const DirectoryLister &) = delete;
+
+    // showHidden: incluir los ocultos y también "." y ".." (LIST -a). MLSD siempre
+    // incluye los ocultos y nunca "." ni ".."
+    bool open(const QString &path, bool showHidden, Format format = Format::List);
+    // Entradas de otro origen (un backend del Vfs); sin "." ni ".."
+    void openSource(EntrySource source, bool showHidden, Format format = Format::List);
+    // Añade a 'out' líneas hasta superar 'maxBytes'; devuelve cuántas entradas
+    int next(QByteArray &out, qint64 maxBytes = BatchBytes);
+    bool atEnd() const { return m_atEnd; }
+
+    // Para los recorridos recursivos: prefijo de cada nombre ("sub/" en MLSD -R) y
+    // lista donde anotar los subdirectorios encontrados (sin enlaces simbólicos)
+    void setNamePrefix(const QByteArray &prefix) { m_namePrefix = prefix; }
+    void setDirectorySink(QList<QByteArray> *directories) { m_directories = directories; }
+
+    qint64 entryCount() const { return m_entries; }
+    QString errorString() const { return m_error; }
+
+    // Hechos de una sola ruta para MLST ("type=file;size=...;"), tamaño y fecha para
+    // SIZE y MDTM. Devuelven false si la ruta no existe.
+    static bool factsFor(const QString &path, QByteArray &facts);
+    // Lo mismo para una entrada ya leída (montajes no locales)
+    static void factsOf(const Entry &entry, QByteArray &facts) { appendFacts(facts, entry); }
+    static bool sizeAndTime(const QString &path, qint64 &size, qint64 &mtimeSecs, bool &isDir);
+    // Siempre del disco, sin pasar por el índice (lo usa el propio índice)
+    static bool statPath(const QString &path, Entry &entry);
+    // "YYYYMMDDHHMMSS" en UTC (MDTM y el hecho modify)
+    static QByteArray timeVal(qint64 mtimeSecs);
+
+    static void recordFirstByte(double elapsedMs, bool fromCache);
+    static void recordEntries(qint64 entries);
+    static Stats stats();
+
+private:
+#ifdef Q_OS_LINUX
+    static bool statEntry(int dirFd, const char *name, Entry &entry);
+#else
+    static Entry entryFromInfo(const QFileInfo &info);
+#endif
+    static void appendListLine(QByteArray &out, const Entry &entry, const char *name, int nameLength);
+    static void appendFacts(QByteArray &out, const Entry &entry);
+    void appendEntry(QByteArray &out, const Entry &entry, const char *name, int nameLength);
+    int nextIndexed(QByteArray &out, qint64 maxBytes);
+    int nextFromSource(QByteArray &out, qint64 maxBytes);
+
+    QString m_path;
+    bool m_showHidden = false;
+    bool m_showDots = false;        // "." y ".."
+    Format m_format = Format::List;
+    QByteArray m_namePrefix;
+    QList<QByteArray> *m_directories = nullptr;
+    bool m_atEnd = true;
+    qint64 m_entries = 0;
+    QString m_error;
+
+    // Entradas servidas desde el índice de metadatos
+    bool m_fromIndex = false;
+    std::vector<NamedEntry> m_indexed;
+    size_t m_indexedPos = 0;
+    // Entradas de un backend del Vfs, leídas en m_indexed por tandas
+    EntrySource m_source;
+
+#ifdef Q_OS_LINUX
+    static constexpr int DentsBufferSize = 32 * 1024;
+    int m_fd = -1;
+    std::unique_ptr<char[]> m_dents;   // Registros de getdents64 pendientes de procesar
+    int m_dentsLength = 0;
+    int m_dentsPos = 0;
+#else
+    std::unique_ptr<QDirIterator> m_iterator;
+#endif
+};
+
+#endif // DIRECTORYLISTER_H
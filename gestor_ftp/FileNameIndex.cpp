@@ -0,0 +1,779 @@
+#include "FileNameIndex.h"
+#include "IoScheduler.h"
+#include "MetadataIndex.h"
+#include <QThread>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QObject>
+#include <QTimer>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QVarLengthArray>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+// Las bajas se acumulan hasta esta proporción de los nodos antes de reconstruir
+constexpr qint64 MinDeletedForRebuild = 10000;
+
+// Trozos mínimos por hilo en las búsquedas (por debajo no compensa repartir)
+constexpr quint32 MinChunk = 64 * 1024;
+
+QByteArray nameBytes(const QString &name)
+{
+#ifdef Q_OS_LINUX
+    return QFile::encodeName(name);
+#else
+    return name.toUtf8();
+#endif
+}
+
+inline char fold(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c;
+}
+
+inline quint32 hashBytes(const char *data, int length)
+{
+    // FNV-1a
+    quint32 hash = 2166136261u;
+    for (int i = 0; i < length; ++i) {
+        hash ^= quint8(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+inline quint32 hashChild(quint32 parent, quint32 name)
+{
+    quint64 key = (quint64(parent) << 32) | name;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return quint32(key);
+}
+
+// Un elemento de un comodín ([...], ? o un carácter) contra un byte
+bool matchOne(const char *&p, const char *pe, char c)
+{
+    if (*p == '?') {
+        ++p;
+        return true;
+    }
+    if (*p == '[') {
+        const char *q = p + 1;
+        const bool negate = q < pe && (*q == '!' || *q == '^');
+        if (negate) {
+            ++q;
+        }
+        bool matched = false;
+        bool first = true;
+        const char folded = fold(c);
+        while (q < pe && (*q != ']' || first)) {
+            first = false;
+            if (q + 2 < pe && q[1] == '-' && q[2] != ']') {
+                matched |= folded >= fold(q[0]) && folded <= fold(q[2]);
+                q += 3;
+            } else {
+                matched |= fold(*q) == folded;
+                ++q;
+            }
+        }
+        if (q < pe) {
+            p = q + 1;
+            return matched != negate;
+        }
+        // Corchete sin cerrar: literal
+    }
+    const bool matched = fold(*p) == fold(c);
+    ++p;
+    return matched;
+}
+
+bool globMatch(const char *p, const char *pe, const char *s, const char *se)
+{
+    const char *starP = nullptr;
+    const char *starS = nullptr;
+    while (s < se) {
+        if (p < pe && *p == '*') {
+            starP = ++p;
+            starS = s;
+            continue;
+        }
+        if (p < pe) {
+            const bool any = *p == '?';
+            const char *next = p;
+            if (matchOne(next, pe, *s)) {
+                p = next;
+                ++s;
+                // '?' es un carácter, no un byte
+                while (any && s < se && (quint8(*s) & 0xC0) == 0x80) {
+                    ++s;
+                }
+                continue;
+            }
+        }
+        if (!starP) {
+            return false;
+        }
+        p = starP;
+        s = ++starS;
+    }
+    while (p < pe && *p == '*') {
+        ++p;
+    }
+    return p == pe;
+}
+
+// 'needle' ya viene en minúsculas
+bool containsFolded(const char *s, int length, const QByteArray &needle)
+{
+    const int m = int(needle.size());
+    if (m == 0) {
+        return true;
+    }
+    const char first = needle.at(0);
+    const char *n = needle.constData();
+    for (int i = 0; i + m <= length; ++i) {
+        if (fold(s[i]) != first) {
+            continue;
+        }
+        int j = 1;
+        while (j < m && fold(s[i + j]) == n[j]) {
+            ++j;
+        }
+        if (j == m) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Entradas de un directorio (nombre y si es un directorio al que bajar)
+template <typename Callback>
+void forEachEntry(const QString &path, Callback callback)
+{
+#ifdef Q_OS_LINUX
+    DIR *dir = ::opendir(QFile::encodeName(path).constData());
+    if (!dir) {
+        return;
+    }
+    while (const struct dirent *entry = ::readdir(dir)) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        bool isDir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = ::fstatat(::dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+        callback(QByteArray::fromRawData(name, int(std::strlen(name))), isDir);
+    }
+    ::closedir(dir);
+#else
+    QDirIterator it(path, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        callback(nameBytes(info.fileName()), info.isDir() && !info.isSymLink());
+    }
+#endif
+}
+
+QThreadPool *searchPool()
+{
+    static QThreadPool *pool = [] {
+        auto *p = new QThreadPool;
+        p->setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+        return p;
+    }();
+    return pool;
+}
+
+// Reparte [0, count) en trozos y espera a que terminen todos
+template <typename Function>
+void parallelFor(quint32 count, Function function)
+{
+    const quint32 threads = quint32(searchPool()->maxThreadCount());
+    const quint32 chunks = qMax(1u, qMin(threads, count / MinChunk));
+    if (chunks == 1) {
+        function(0u, 0u, count);
+        return;
+    }
+    QSemaphore done;
+    const quint32 step = (count + chunks - 1) / chunks;
+    for (quint32 c = 0; c < chunks; ++c) {
+        const quint32 begin = c * step;
+        const quint32 end = qMin(count, begin + step);
+        searchPool()->start([&function, &done, c, begin, end]() {
+            function(c, begin, end);
+            done.release();
+        });
+    }
+    done.acquire(int(chunks));
+}
+} // namespace
+
+// =====================================================================================
+// Seccion: Estructura en memoria
+// =====================================================================================
+
+FileNameIndex::Data::Data()
+{
+    nameStart.push_back(0);
+    nameSlots.assign(1024, 0);
+    childSlots.assign(1024, 0);
+    // Raíz: nombre vacío y sin padre
+    nodes.push_back({NoNode, internName("", 0) | DirBit});
+    live = 1;
+}
+
+qint64 FileNameIndex::Data::memory() const
+{
+    return qint64(names.capacity()) + qint64(nameStart.capacity()) * 4 + qint64(nameSlots.size()) * 4 +
+           qint64(nodes.capacity()) * qint64(sizeof(Node)) + qint64(childSlots.size()) * 4;
+}
+
+quint32 FileNameIndex::Data::findName(const char *name, int length) const
+{
+    const quint32 mask = quint32(nameSlots.size() - 1);
+    for (quint32 slot = hashBytes(name, length) & mask;; slot = (slot + 1) & mask) {
+        const quint32 value = nameSlots[slot];
+        if (value == 0) {
+            return NoNode;
+        }
+        const quint32 id = value - 1;
+        const quint32 start = nameStart[id];
+        if (nameStart[id + 1] - start == quint32(length) &&
+            std::memcmp(names.constData() + start, name, size_t(length)) == 0) {
+            return id;
+        }
+    }
+}
+
+quint32 FileNameIndex::Data::internName(const char *name, int length)
+{
+    const quint32 existing = findName(name, length);
+    if (existing != NoNode) {
+        return existing;
+    }
+    if ((nameCount() + 1) * 10 >= nameSlots.size() * 7) {
+        growNames();
+    }
+    const quint32 id = nameCount();
+    names.append(name, length);
+    nameStart.push_back(quint32(names.size()));
+    const quint32 mask = quint32(nameSlots.size() - 1);
+    quint32 slot = hashBytes(name, length) & mask;
+    while (nameSlots[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    nameSlots[slot] = id + 1;
+    return id;
+}
+
+void FileNameIndex::Data::growNames()
+{
+    std::vector<quint32> slots(nameSlots.size() * 2, 0);
+    const quint32 mask = quint32(slots.size() - 1);
+    for (quint32 id = 0; id < nameCount(); ++id) {
+        const quint32 start = nameStart[id];
+        quint32 slot = hashBytes(names.constData() + start, int(nameStart[id + 1] - start)) & mask;
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id + 1;
+    }
+    nameSlots.swap(slots);
+}
+
+quint32 FileNameIndex::Data::findChild(quint32 parent, quint32 name) const
+{
+    const quint32 mask = quint32(childSlots.size() - 1);
+    for (quint32 slot = hashChild(parent, name) & mask;; slot = (slot + 1) & mask) {
+        const quint32 value = childSlots[slot];
+        if (value == 0) {
+            return NoNode;
+        }
+        const Node &node = nodes[value - 1];
+        // Los nodos borrados siguen en la tabla hasta reconstruir, pero no cuentan
+        if (node.parent == parent && (node.name & (NameMask | DeletedBit)) == name) {
+            return value - 1;
+        }
+    }
+}
+
+quint32 FileNameIndex::Data::addChild(quint32 parent, quint32 name, bool isDir)
+{
+    if ((nodes.size() + 1) * 10 >= childSlots.size() * 7) {
+        growChildren();
+    }
+    const quint32 id = quint32(nodes.size());
+    nodes.push_back({parent, name | (isDir ? DirBit : 0)});
+    const quint32 mask = quint32(childSlots.size() - 1);
+    quint32 slot = hashChild(parent, name) & mask;
+    while (childSlots[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    childSlots[slot] = id + 1;
+    live++;
+    return id;
+}
+
+void FileNameIndex::Data::growChildren()
+{
+    std::vector<quint32> slots(childSlots.size() * 2, 0);
+    const quint32 mask = quint32(slots.size() - 1);
+    for (quint32 id = 1; id < nodes.size(); ++id) {
+        const Node &node = nodes[id];
+        if (node.name & DeletedBit) {
+            continue;
+        }
+        quint32 slot = hashChild(node.parent, node.name & NameMask) & mask;
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id + 1;
+    }
+    childSlots.swap(slots);
+}
+
+void FileNameIndex::appendPath(const Data &data, quint32 node, QByteArray &out)
+{
+    // Se recogen los nombres hacia arriba y se escriben al revés
+    QVarLengthArray<quint32, 64> chain;
+    for (quint32 id = node; id != 0; id = data.nodes[id].parent) {
+        chain.append(id);
+    }
+    if (chain.isEmpty()) {
+        out.append('/');
+    }
+    for (qsizetype i = chain.size() - 1; i >= 0; --i) {
+        const quint32 name = data.nodes[chain[i]].name & NameMask;
+        const quint32 start = data.nameStart[name];
+        out.append('/');
+        out.append(data.names.constData() + start, qsizetype(data.nameStart[name + 1] - start));
+    }
+}
+
+// =====================================================================================
+// Seccion: Configuración
+// =====================================================================================
+
+void FileNameIndex::configure(bool enabled, const QString &root, qint64 capacityBytes, int maxResults,
+                              int rebuildMinutes)
+{
+    {
+        QWriteLocker locker(&m_lock);
+        m_root = QDir::cleanPath(QDir(root).absolutePath());
+        m_data.reset();
+    }
+    m_capacity.store(qMax<qint64>(16 * 1024 * 1024, capacityBytes));
+    m_maxResults.store(qMax(1, maxResults));
+    m_enabled.store(enabled);
+    if (!enabled) {
+        qInfo() << "Índice de nombres desactivado";
+        return;
+    }
+    startThread();
+    QMetaObject::invokeMethod(m_context, [this, rebuildMinutes]() {
+        m_rebuildMinutes = qMax(0, rebuildMinutes);
+        if (m_rebuildMinutes > 0) {
+            m_rebuildTimer->start(m_rebuildMinutes * 60 * 1000);
+        } else {
+            m_rebuildTimer->stop();
+        }
+    }, Qt::QueuedConnection);
+    rebuild();
+    qInfo() << "Índice de nombres para" << root << "con un tope de" << capacityBytes / (1024 * 1024) << "MB";
+}
+
+void FileNameIndex::setRoot(const QString &root)
+{
+    const QString clean = QDir::cleanPath(QDir(root).absolutePath());
+    {
+        QWriteLocker locker(&m_lock);
+        if (clean == m_root) {
+            return;
+        }
+        m_root = clean;
+        m_data.reset();
+    }
+    if (m_enabled.load()) {
+        rebuild();
+    }
+}
+
+bool FileNameIndex::isReady() const
+{
+    QReadLocker locker(&m_lock);
+    return m_data != nullptr;
+}
+
+void FileNameIndex::startThread()
+{
+    if (m_thread) {
+        return;
+    }
+    // El hilo y su contexto viven lo mismo que el proceso
+    m_thread = new QThread;
+    m_thread->setObjectName(QStringLiteral("FileNameIndex"));
+    m_context = new QObject;
+    m_context->moveToThread(m_thread);
+    m_thread->start();
+
+    QMetaObject::invokeMethod(m_context, [this]() {
+        m_rebuildTimer = new QTimer(m_context);
+        QObject::connect(m_rebuildTimer, &QTimer::timeout, m_context, [this]() {
+            // Con inotify vigilando todo el árbol no hace falta
+            const MetadataIndex::Stats index = MetadataIndex::instance().stats();
+            if (!index.enabled || !index.watcherActive || index.watchLimitReached) {
+                rebuild();
+            }
+        });
+    }, Qt::QueuedConnection);
+}
+
+// =====================================================================================
+// Seccion: Construcción y cambios (hilo del índice)
+// =====================================================================================
+
+void FileNameIndex::rebuild()
+{
+    if (!m_enabled.load() || !m_context) {
+        return;
+    }
+    QMetaObject::invokeMethod(m_context, [this]() {
+        if (m_buildQueued) {
+            return;
+        }
+        m_buildQueued = true;
+        // Detrás de lo que ya esté en cola
+        QMetaObject::invokeMethod(m_context, [this]() {
+            m_buildQueued = false;
+            build();
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void FileNameIndex::build()
+{
+    if (!m_enabled.load()) {
+        return;
+    }
+    QString root;
+    {
+        QReadLocker locker(&m_lock);
+        root = m_root;
+    }
+    m_building.store(true);
+    QElapsedTimer timer;
+    timer.start();
+
+    // Se construye aparte; las búsquedas siguen con el índice anterior hasta el cambio.
+    // Los avisos que lleguen mientras tanto esperan en la cola del hilo y se aplican
+    // después sobre el nuevo.
+    auto data = std::make_unique<Data>();
+    walk(*data, 0, root, m_capacity.load());
+
+    const qint64 entries = data->live;
+    const bool truncated = data->truncated;
+    {
+        QWriteLocker locker(&m_lock);
+        if (root != m_root || !m_enabled.load()) {
+            m_building.store(false);
+            return; // Cambió la raíz (ya hay otra construcción en cola) o se desactivó
+        }
+        m_data = std::move(data);
+    }
+    m_building.store(false);
+    m_lastBuildMs.store(timer.elapsed());
+    qInfo() << "Índice de nombres construido:" << entries << "entradas en" << timer.elapsed() << "ms"
+            << (truncated ? "(incompleto: tope de memoria alcanzado)" : "");
+}
+
+void FileNameIndex::walk(Data &data, quint32 node, const QString &path, qint64 capacity)
+{
+    // Recorrido iterativo: los árboles profundos no agotan la pila
+    std::vector<std::pair<quint32, QString>> stack;
+    stack.emplace_back(node, path);
+    while (!stack.empty() && !data.truncated) {
+        const quint32 dirNode = stack.back().first;
+        const QString dirPath = std::move(stack.back().second);
+        stack.pop_back();
+
+        IoScheduler::Ticket io = IoScheduler::instance().acquire(IoScheduler::deviceFor(-1, dirPath),
+                                                                 IoScheduler::Kind::Metadata);
+        forEachEntry(dirPath, [&](const QByteArray &name, bool isDir) {
+            if (data.truncated) {
+                return;
+            }
+            const quint32 nameId = data.internName(name.constData(), int(name.size()));
+            quint32 child = data.findChild(dirNode, nameId);
+            if (child == NoNode) {
+                child = data.addChild(dirNode, nameId, isDir);
+            }
+            if (isDir) {
+                stack.emplace_back(child, dirPath + QLatin1Char('/') + QFile::decodeName(name));
+            }
+            if ((data.live & 0xFFF) == 0 && data.memory() > capacity) {
+                data.truncated = true;
+            }
+        });
+    }
+    if (data.truncated && !stack.empty()) {
+        qWarning() << "Índice de nombres: tope de memoria alcanzado, SITE FIND no verá todo el árbol";
+    }
+}
+
+void FileNameIndex::refresh(const QString &path)
+{
+    if (!m_enabled.load() || !m_context) {
+        return;
+    }
+    const QString clean = QDir::cleanPath(path);
+    QMetaObject::invokeMethod(m_context, [this, clean]() { applyRefresh(clean); }, Qt::QueuedConnection);
+}
+
+quint32 FileNameIndex::lookupLocked(const Data &data, const QString &relative, bool create, bool isDir,
+                                    Data *mutableData)
+{
+    // 'create' añade lo que falte (los intermedios como directorios) en 'mutableData'
+    quint32 node = 0;
+    const QStringList parts = relative.split(QLatin1Char('/'), Qt::SkipEmptyParts);
+    for (int i = 0; i < parts.size(); ++i) {
+        const QByteArray name = nameBytes(parts.at(i));
+        const bool last = i == parts.size() - 1;
+        quint32 nameId = data.findName(name.constData(), int(name.size()));
+        quint32 child = nameId == NoNode ? NoNode : data.findChild(node, nameId);
+        if (child == NoNode) {
+            if (!create) {
+                return NoNode;
+            }
+            nameId = mutableData->internName(name.constData(), int(name.size()));
+            child = mutableData->addChild(node, nameId, last ? isDir : true);
+        }
+        node = child;
+    }
+    return node;
+}
+
+QString FileNameIndex::relativeOf(const QString &path) const
+{
+    // Con m_lock tomado; vacío si está fuera de la raíz
+    if (path == m_root) {
+        return QStringLiteral("/");
+    }
+    const QString prefix = m_root.endsWith(QLatin1Char('/')) ? m_root : m_root + QLatin1Char('/');
+    return path.startsWith(prefix) ? path.mid(prefix.size() - 1) : QString();
+}
+
+void FileNameIndex::applyRefresh(const QString &path)
+{
+    const QFileInfo info(path);
+    const bool exists = info.exists() || info.isSymLink();
+    const bool isDir = exists && info.isDir() && !info.isSymLink();
+
+    // Lo que cuelga de un directorio (nuevo, movido desde fuera, SITE UNTAR) se lee
+    // aparte, sin bloquear las búsquedas, y luego se funde
+    std::unique_ptr<Data> subtree;
+    if (isDir) {
+        subtree = std::make_unique<Data>();
+        walk(*subtree, 0, path, m_capacity.load());
+    }
+
+    QWriteLocker locker(&m_lock);
+    if (!m_data) {
+        return; // La construcción en curso lo verá
+    }
+    Data &data = *m_data;
+    const QString relative = relativeOf(path);
+    if (relative.isEmpty() || relative == QLatin1String("/")) {
+        return;
+    }
+    m_updates.fetch_add(1, std::memory_order_relaxed);
+
+    quint32 node = lookupLocked(data, relative, false, false);
+    if (node != NoNode) {
+        const bool wasDir = data.nodes[node].name & DirBit;
+        if (exists && !isDir && !wasDir) {
+            return; // Cambió el contenido, no el nombre
+        }
+        // Baja, cambio de tipo o directorio que se vuelve a leer: el nodo se marca y lo
+        // que colgaba de él queda inalcanzable; el directorio se da de alta de nuevo.
+        // Lo que había debajo se estima por lo que hay ahora.
+        data.nodes[node].name |= DeletedBit;
+        data.live--;
+        data.deleted += 1 + (subtree && wasDir ? subtree->live - 1 : 0);
+        node = NoNode;
+    }
+    if (exists && !data.truncated) {
+        if (node == NoNode) {
+            node = lookupLocked(data, relative, true, isDir, &data);
+        }
+        if (subtree) {
+            merge(data, node, *subtree);
+        }
+        if (data.memory() > m_capacity.load()) {
+            data.truncated = true;
+        }
+    }
+
+    if (data.deleted >= MinDeletedForRebuild && data.deleted * 4 >= data.live) {
+        locker.unlock();
+        rebuild();
+    }
+}
+
+void FileNameIndex::merge(Data &into, quint32 at, const Data &from)
+{
+    // En 'from' cada nodo va detrás de su padre, así que basta una pasada
+    std::vector<quint32> mapped(from.nodes.size(), NoNode);
+    mapped[0] = at;
+    for (quint32 id = 1; id < from.nodes.size(); ++id) {
+        const Node &node = from.nodes[id];
+        const quint32 parent = mapped[node.parent];
+        const quint32 name = node.name & NameMask;
+        const quint32 start = from.nameStart[name];
+        const quint32 nameId = into.internName(from.names.constData() + start,
+                                               int(from.nameStart[name + 1] - start));
+        quint32 child = into.findChild(parent, nameId);
+        if (child == NoNode) {
+            child = into.addChild(parent, nameId, node.name & DirBit);
+        }
+        mapped[id] = child;
+    }
+}
+
+// =====================================================================================
+// Seccion: Búsqueda (hilos de las sesiones)
+// =====================================================================================
+
+FileNameIndex::Result FileNameIndex::search(const QString &pattern, const QString &scope, int maxResults)
+{
+    Result result;
+    QElapsedTimer timer;
+    timer.start();
+    if (maxResults <= 0) {
+        maxResults = m_maxResults.load();
+    }
+
+    QReadLocker locker(&m_lock);
+    if (!m_data) {
+        return result;
+    }
+    const Data &data = *m_data;
+
+    const QByteArray needle = nameBytes(pattern);
+    const bool isGlob = needle.contains('*') || needle.contains('?') || needle.contains('[');
+    QByteArray folded = needle;
+    for (char &c : folded) {
+        c = fold(c);
+    }
+
+    const QString relativeScope = relativeOf(QDir::cleanPath(scope));
+    if (relativeScope.isEmpty()) {
+        return result;
+    }
+    const quint32 scopeNode = lookupLocked(data, relativeScope, false, false);
+    if (scopeNode == NoNode) {
+        return result;
+    }
+
+    // 1. Nombres distintos que encajan
+    const quint32 nameCount = data.nameCount();
+    std::vector<quint8> matched(nameCount, 0);
+    parallelFor(nameCount, [&](quint32, quint32 begin, quint32 end) {
+        for (quint32 id = begin; id < end; ++id) {
+            const quint32 start = data.nameStart[id];
+            const char *name = data.names.constData() + start;
+            const int length = int(data.nameStart[id + 1] - start);
+            matched[id] = isGlob ? globMatch(needle.constData(), needle.constData() + needle.size(), name,
+                                             name + length)
+                                 : containsFolded(name, length, folded);
+        }
+    });
+
+    // 2. Nodos vivos con esos nombres bajo el ámbito, en orden de inserción
+    const quint32 nodeCount = quint32(data.nodes.size());
+    const quint32 chunks = qMax(1u, qMin(quint32(searchPool()->maxThreadCount()), nodeCount / MinChunk));
+    std::vector<std::vector<quint32>> found(chunks);
+    const size_t limit = size_t(maxResults) + 1;
+    parallelFor(nodeCount, [&](quint32 chunk, quint32 begin, quint32 end) {
+        std::vector<quint32> &out = found[chunk];
+        for (quint32 id = qMax(begin, 1u); id < end && out.size() < limit; ++id) {
+            const quint32 name = data.nodes[id].name;
+            if ((name & DeletedBit) || !matched[name & NameMask]) {
+                continue;
+            }
+            // Alcanzable (ningún antecesor borrado) y dentro del ámbito
+            bool inScope = scopeNode == 0;
+            bool reachable = true;
+            for (quint32 up = data.nodes[id].parent; up != NoNode; up = data.nodes[up].parent) {
+                if (data.nodes[up].name & DeletedBit) {
+                    reachable = false;
+                    break;
+                }
+                inScope |= up == scopeNode;
+            }
+            if (reachable && inScope) {
+                out.push_back(id);
+            }
+        }
+    });
+
+    for (const std::vector<quint32> &chunk : found) {
+        for (quint32 id : chunk) {
+            if (result.matches == maxResults) {
+                result.truncated = true;
+                break;
+            }
+            appendPath(data, id, result.lines);
+            if (data.nodes[id].name & DirBit) {
+                result.lines.append('/');
+            }
+            result.lines.append("\r\n", 2);
+            result.matches++;
+        }
+    }
+    result.truncated |= data.truncated;
+
+    m_queries.fetch_add(1, std::memory_order_relaxed);
+    m_queryNs.fetch_add(timer.nsecsElapsed(), std::memory_order_relaxed);
+    return result;
+}
+
+FileNameIndex::Stats FileNameIndex::stats() const
+{
+    Stats stats;
+    stats.enabled = m_enabled.load();
+    stats.building = m_building.load();
+    stats.capacityBytes = m_capacity.load();
+    {
+        QReadLocker locker(&m_lock);
+        if (m_data) {
+            stats.ready = true;
+            stats.truncated = m_data->truncated;
+            stats.entries = m_data->live - 1; // Sin la raíz
+            stats.uniqueNames = m_data->nameCount();
+            stats.memoryBytes = m_data->memory();
+        }
+    }
+    stats.lastBuildSeconds = m_lastBuildMs.load() / 1000.0;
+    stats.updates = m_updates.load();
+    stats.queries = m_queries.load();
+    stats.avgQueryMs = stats.queries ? m_queryNs.load() / 1e6 / double(stats.queries) : 0.0;
+    return stats;
+}
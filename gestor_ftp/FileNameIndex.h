@@ -0,0 +1,140 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QReadWriteLock>
+#include <memory>
+#include <vector>
+#include <atomic>
+
+class QThread;
+class QObject;
+class QTimer;
+
+// Índice en memoria de los nombres del árbol servido para SITE FIND.
+//
+// Cada entrada ocupa un nodo de 8 bytes (padre y nombre) y los nombres se guardan
+// una sola vez aunque se repitan en miles de carpetas ("index.html", "thumbs.db"),
+// así que diez millones de entradas caben en unos 150 MB. Una búsqueda recorre en
+// paralelo primero los nombres distintos y luego los nodos, y solo reconstruye la
+// ruta de los que coinciden. El total de memoria tiene un tope: al alcanzarlo se
+// deja de indexar y las búsquedas avisan de que el resultado puede estar incompleto.
+//
+// Se construye con un recorrido en un hilo propio y se mantiene con los avisos de
+// las operaciones del servidor y, si el índice de metadatos está activo, con sus
+// eventos de inotify. Las bajas dejan el nodo marcado; cuando hay muchas, se
+// reconstruye en segundo plano sin dejar de responder con el índice anterior.
+class FileNameIndex {
+public:
+    struct Stats {
+        bool enabled = false;
+        bool ready = false;
+        bool building = false;
+        bool truncated = false;        // Se alcanzó el tope de memoria
+        qint64 entries = 0;
+        qint64 uniqueNames = 0;
+        qint64 memoryBytes = 0;
+        qint64 capacityBytes = 0;
+        double lastBuildSeconds = 0.0;
+        quint64 updates = 0;
+        quint64 queries = 0;
+        double avgQueryMs = 0.0;
+    };
+
+    struct Result {
+        QByteArray lines;              // "/ruta/relativa\r\n" (las carpetas terminan en '/')
+        int matches = 0;
+        bool truncated = false;        // Más coincidencias que maxResults, o índice incompleto
+    };
+
+    static constexpr qint64 DefaultCapacity = 512LL * 1024 * 1024;
+    static constexpr int DefaultMaxResults = 100000;
+
+    static FileNameIndex& instance() {
+        static FileNameIndex instance;
+        return instance;
+    }
+
+    FileNameIndex(const FileNameIndex &) = delete;
+    FileNameIndex &operator=(const FileNameIndex &) = delete;
+
+    // rebuildMinutes: reconstrucción periódica si no hay vigilancia de inotify (0 nunca)
+    void configure(bool enabled, const QString &root, qint64 capacityBytes = DefaultCapacity,
+                   int maxResults = DefaultMaxResults, int rebuildMinutes = 60);
+    void setRoot(const QString &root);
+    bool isEnabled() const { return m_enabled.load(); }
+    bool isReady() const;
+
+    // La ruta apareció, cambió o desapareció (se comprueba en disco en el hilo del índice)
+    void refresh(const QString &path);
+    // Se perdieron eventos: reconstruir
+    void rebuild();
+
+    // Nombres bajo 'scope' que contienen 'pattern' o, si lleva * ? o [, que encajan
+    // con él como comodín. Sin distinguir mayúsculas en ASCII. maxResults 0: el configurado.
+    Result search(const QString &pattern, const QString &scope, int maxResults = 0);
+
+    Stats stats() const;
+
+private:
+    FileNameIndex() = default;
+
+    struct Node {
+        quint32 parent;
+        quint32 name;       // Índice del nombre con DirBit y DeletedBit en los bits altos
+    };
+    static constexpr quint32 NoNode = 0xFFFFFFFFu;
+    static constexpr quint32 DeletedBit = 0x80000000u;
+    static constexpr quint32 DirBit = 0x40000000u;
+    static constexpr quint32 NameMask = 0x3FFFFFFFu;
+
+    struct Data {
+        QByteArray names;                   // Nombres distintos, uno tras otro
+        std::vector<quint32> nameStart;     // Inicio de cada nombre (+ centinela al final)
+        std::vector<quint32> nameSlots;     // Tabla hash de nombres: id + 1 (0 libre)
+        std::vector<Node> nodes;            // El 0 es la raíz
+        std::vector<quint32> childSlots;    // Tabla hash (padre, nombre) -> nodo + 1
+        qint64 live = 0;
+        qint64 deleted = 0;
+        bool truncated = false;
+
+        Data();
+        qint64 memory() const;
+        quint32 nameCount() const { return quint32(nameStart.size() - 1); }
+        quint32 findName(const char *name, int length) const;
+        quint32 internName(const char *name, int length);
+        quint32 findChild(quint32 parent, quint32 name) const;
+        quint32 addChild(quint32 parent, quint32 name, bool isDir);
+        void growChildren();
+        void growNames();
+    };
+
+    void startThread();
+    void build();
+    void applyRefresh(const QString &path);
+    void walk(Data &data, quint32 node, const QString &path, qint64 capacity);
+    static void merge(Data &into, quint32 at, const Data &from);
+    quint32 lookupLocked(const Data &data, const QString &relative, bool create, bool isDir,
+                         Data *mutableData = nullptr);
+    QString relativeOf(const QString &path) const;
+    static void appendPath(const Data &data, quint32 node, QByteArray &out);
+
+    std::atomic<bool> m_enabled{false};
+    mutable QReadWriteLock m_lock;
+    std::unique_ptr<Data> m_data;           // Nulo hasta la primera construcción
+    QString m_root;                         // Protegido por m_lock
+    std::atomic<qint64> m_capacity{DefaultCapacity};
+    std::atomic<int> m_maxResults{DefaultMaxResults};
+    int m_rebuildMinutes = 60;
+
+    // Solo en el hilo del índice
+    QThread *m_thread = nullptr;
+    QObject *m_context = nullptr;
+    QTimer *m_rebuildTimer = nullptr;
+    bool m_buildQueued = false;
+
+    std::atomic<bool> m_building{false};
+    std::atomic<qint64> m_lastBuildMs{0};
+    std::atomic<quint64> m_updates{0};
+    std::atomic<quint64> m_queries{0};
+    std::atomic<qint64> m_queryNs{0};
+};
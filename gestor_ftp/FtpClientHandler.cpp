@@ -11,13 +11,20 @@
 #include <QRegularExpression>
 #include <QCryptographicHash>
 #include <QTimer>
+#include <QDirIterator>
+#include <QSet>
 #include <stdexcept>
 #include <cstring>
+#include <atomic>
 #include <QDebug>
 #include <iostream>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QTimer>
+#include <cstdio>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
 
 // =====================================================================================
 // Seccion: Logging Dual (GUI + Consola)
@@ -40,6 +47,61 @@ void logDual(const QString &level, const QString &message) {
     }
 }
 
+// =====================================================================================
+// Seccion: Sockets de datos
+// =====================================================================================
+
+namespace {
+// Con SSL los sockets de datos son QSslSocket desde el principio, para poder
+// cifrarlos después de PROT P sin tener que reabrir la conexión.
+QTcpSocket *newDataSocket(QObject *parent)
+{
+#ifdef HAVE_SSL
+    return new QSslSocket(parent);
+#else
+    return new QTcpSocket(parent);
+#endif
+}
+
+// Canal de control de todas las sesiones (stats io)
+std::atomic<quint64> s_commands{0};
+std::atomic<quint64> s_replies{0};
+std::atomic<quint64> s_replyFlushes{0};
+
+// Sufijo de los archivos temporales de STOR, único en todo el proceso
+std::atomic<quint64> s_storSerial{0};
+
+// Sustituye 'to' por 'from' de una vez: quien lea 'to' ve la versión anterior o la nueva
+bool replaceFile(const QString &from, const QString &to)
+{
+#ifdef Q_OS_WIN
+    return MoveFileExW(reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(from).utf16()),
+                       reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(to).utf16()),
+                       MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#endif
+}
+
+// Servidor pasivo que entrega sockets de datos creados con newDataSocket()
+class DataConnectionServer : public QTcpServer
+{
+public:
+    using QTcpServer::QTcpServer;
+
+protected:
+    void incomingConnection(qintptr descriptor) override
+    {
+        QTcpSocket *connection = newDataSocket(this);
+        if (connection->setSocketDescriptor(descriptor)) {
+            addPendingConnection(connection);
+        } else {
+            delete connection;
+        }
+    }
+};
+} // namespace
+
 // =====================================================================================
 // Seccion: Constructor y Destructor
 // =====================================================================================
@@ -60,13 +122,22 @@ FtpClientHandler::FtpClientHandler(qintptr socketDescriptor, FtpServer *server,
 FtpClientHandler::~FtpClientHandler()
 {
     // DESTRUCTOR ULTRA-SIMPLE - Solo limpiar referencias
+#ifdef HAVE_SSL
+    releaseHandshakeSlot();  // El turno de handshake es global: no puede perderse
+#endif
+    endStorOwnership();      // El diario es global: un STOR cortado no puede dejar la ruta marcada
+    discardStorPartial();
     dataSocket = nullptr;
     passiveServer = nullptr;
     socket = nullptr;
 }
 
 void FtpClientHandler::process() {
+#ifdef HAVE_SSL
+    socket = new QSslSocket();
+#else
     socket = new QTcpSocket();
+#endif
     if (!socket->setSocketDescriptor(socketDescriptor)) {
         logDual("ERROR", "Error al establecer el descriptor del socket.");
         emit finished("");
@@ -77,7 +148,7 @@ void FtpClientHandler::process() {
     
     // Inicializar directorio actual al directorio raíz del servidor
     if (m_server) {
-        currentDir = m_server->getRootDir();
+        enterHome();
         logDual("INFO", QString("Directorio raíz del servidor: '%1'").arg(currentDir));
         logDual("INFO", QString("Directorio actual inicializado a: '%1'").arg(currentDir));
     }
@@ -117,46 +188,92 @@ void FtpClientHandler::process() {
 
 void FtpClientHandler::onReadyRead()
 {
+    // Cada línea se lee en el mismo buffer y se analiza ahí mismo
     while (socket->canReadLine()) {
-        processCommand(QString::fromUtf8(socket->readLine()).trimmed());
+        const qint64 length = socket->readLine(m_line.data(), m_line.size());
+        if (length <= 0) {
+            break;
+        }
+        if (m_line[length - 1] != '\n') {
+            // No cabe: se descarta hasta el salto de línea y se responde una sola vez
+            m_lineTooLong = true;
+            continue;
+        }
+        if (m_lineTooLong) {
+            m_lineTooLong = false;
+            sendResponse("500 Línea de comando demasiado larga.");
+            continue;
+        }
+        processCommand(m_line.data(), int(length));
     }
 }
 
-void FtpClientHandler::processCommand(const QString &line)
+void FtpClientHandler::processCommand(const char *data, int length)
 {
-    qInfo() << (QString("Comando recibido: %1").arg(line));
-    QString command = line.section(' ', 0, 0).toUpper();
-    QString arg = line.section(' ', 1);
+    s_commands.fetch_add(1, std::memory_order_relaxed);
+    FtpCommand::Line line;
+    FtpCommand::parse(data, length, line);
+    qInfo("Comando recibido: %.*s %.*s", line.verbLength, line.verb, line.argLength, line.arg ? line.arg : "");
 
-    if (!loggedIn && command != "USER" && command != "PASS" && command != "QUIT" && command != "FEAT" && command != "AUTH") {
+    const FtpCommand::Entry &command = FtpCommand::lookup(line.code);
+    if (!loggedIn && !(command.flags & FtpCommand::BeforeLogin)) {
         sendResponse("530 Por favor, inicie sesión.");
         return;
     }
 
-    if (command == "USER") handleUser(arg);
-    else if (command == "PASS") handlePass(arg);
-    else if (command == "QUIT") handleQuit();
-    else if (command == "FEAT") handleFeat();
-    else if (command == "TYPE") handleType(arg);
-    else if (command == "PWD") handlePwd();
-    else if (command == "CWD") handleCwd(arg);
-    else if (command == "CDUP") handleCdup();
-    else if (command == "LIST" || command == "NLST") handleList(arg);
-    else if (command == "RETR") handleRetr(arg);
-    else if (command == "STOR") handleStor(arg);
-    else if (command == "RMD") handleRmd(arg);
-    else if (command == "DELE") handleDele(arg);
-    else if (command == "PORT") handlePort(arg);
-    else if (command == "PASV") handlePasv();
-    else if (command == "SYST") handleSyst();
-    else if (command == "OPTS") {
-        handleOpts(arg);
+    // RNTO tiene que ir justo después de RNFR
+    if (command.id != FtpCommand::Id::Rnto) {
+        m_renameFrom = Vfs::Target();
+    }
+
+    // Solo las órdenes con argumento crean una cadena
+    const QString arg = line.argLength > 0 ? QString::fromUtf8(line.arg, line.argLength) : QString();
+
+    using FtpCommand::Id;
+    switch (command.id) {
+    case Id::User: handleUser(arg); break;
+    case Id::Pass: handlePass(arg); break;
+    case Id::Quit: handleQuit(); break;
+    case Id::Feat: handleFeat(); break;
+    case Id::Type: handleType(arg); break;
+    case Id::Pwd: handlePwd(); break;
+    case Id::Cwd: handleCwd(arg); break;
+    case Id::Cdup: handleCdup(); break;
+    case Id::List:
+    case Id::Nlst: handleList(arg); break;
+    case Id::Mlsd: handleMlsd(arg); break;
+    case Id::Mlst: handleMlst(arg); break;
+    case Id::Size: handleSize(arg); break;
+    case Id::Mdtm: handleMdtm(arg); break;
+    case Id::Retr: handleRetr(arg); break;
+    case Id::Stor: handleStor(arg); break;
+    case Id::Rmd: handleRmd(arg); break;
+    case Id::Dele: handleDele(arg); break;
+    case Id::Mkd:
+    case Id::Xmkd: handleMkd(arg); break;
+    case Id::Rnfr: handleRnfr(arg); break;
+    case Id::Rnto: handleRnto(arg); break;
+    case Id::Port: handlePort(arg); break;
+    case Id::Pasv: handlePasv(); break;
+    case Id::Syst: handleSyst(); break;
+#ifdef HAVE_SSL
+    case Id::Auth: handleAuth(arg); break;
+    case Id::Pbsz: handlePbsz(arg); break;
+    case Id::Prot: handleProt(arg); break;
+#endif
+    case Id::Site: handleSite(arg); break;
+    case Id::Opts: handleOpts(arg); break;
+    case Id::Allo: handleAllo(arg); break;
+    default: sendResponse("500 Comando no reconocido."); break;
     }
-    else sendResponse("500 Comando no reconocido.");
 }
 
 void FtpClientHandler::onDisconnected()
 {
+#ifdef HAVE_SSL
+    releaseHandshakeSlot();
+#endif
+    TlsSessionCache::instance().removeSession(clientInfo);
     emit finished(clientInfo);
 }
 
@@ -187,11 +304,30 @@ void FtpClientHandler::handlePass(const QString &password)
     QByteArray passwordHash = QCryptographicHash::hash((password + salt).toUtf8(), QCryptographicHash::Sha256).toHex();
 
     if (DatabaseManager::instance().validateUser(currentUser, passwordHash)) {
+        // Carpeta personal y permisos: una sola lectura de la base de datos por sesión
+        std::shared_ptr<const UserRules> rules = UserRules::load(currentUser);
+        const Vfs::Target home = Vfs::instance().resolve(rules->home());
+        VfsBackend::Entry entry;
+        const bool homeExists = home.isLocal() ? QFileInfo(home.local).isDir()
+                                               : home.isValid() && home.backend->stat(home.path, entry) && entry.isDir;
+        if (!homeExists) {
+            loggedIn = false;
+            m_rules = std::make_shared<const UserRules>();
+            sendResponse("530 La carpeta personal del usuario no existe.");
+            logDual("WARNING", QString("%1 - Carpeta personal de '%2' no encontrada: '%3'")
+                                   .arg(clientInfo, currentUser, rules->home()));
+            return;
+        }
+        m_rules = std::move(rules);
+        enterHome();
         loggedIn = true;
         sendResponse("230 Autenticación exitosa.");
-        qInfo() << (QString("%1 - Usuario '%2' autenticado.").arg(clientInfo).arg(currentUser));
+        qInfo() << (QString("%1 - Usuario '%2' autenticado (carpeta '%3', %4 reglas de permisos).")
+                        .arg(clientInfo).arg(currentUser).arg(m_rules->home()).arg(m_rules->ruleCount()));
     } else {
         loggedIn = false;
+        m_rules = std::make_shared<const UserRules>();
+        enterHome();
         sendResponse("530 Credenciales inválidas.");
         qInfo() << (QString("%1 - Fallo de autenticación para '%2'.").arg(clientInfo).arg(currentUser));
     }
@@ -200,6 +336,7 @@ void FtpClientHandler::handlePass(const QString &password)
 void FtpClientHandler::handleQuit()
 {
     sendResponse("221 Adiós.");
+    flushResponses();
     socket->disconnectFromHost();
 }
 
@@ -210,6 +347,7 @@ void FtpClientHandler::handleFeat()
     sendResponse(" PORT");
     sendResponse(" SIZE");
     sendResponse(" MDTM");
+    sendResponse(QString(" MLST ") + DirectoryLister::MlstFacts);
     sendResponse(" UTF8");
     sendResponse(" EPRT");
     sendResponse(" EPSV");
@@ -230,11 +368,27 @@ void FtpClientHandler::handleSyst()
     sendResponse("215 UNIX Type: L8");
 }
 
+void FtpClientHandler::handleAllo(const QString &arg)
+{
+    // "ALLO <bytes> [R <registro>]": solo interesa el tamaño, para la cuota del próximo STOR
+    bool ok = false;
+    const qint64 bytes = arg.section(' ', 0, 0, QString::SectionSkipEmpty).toLongLong(&ok);
+    if (!ok || bytes < 0) {
+        sendResponse("501 Tamaño no válido.");
+        return;
+    }
+    m_storAllocated = bytes;
+    sendResponse("200 Espacio anotado para la próxima subida.");
+}
+
 void FtpClientHandler::handleOpts(const QString &arg)
 {
     QStringList parts = arg.split(' ', Qt::SkipEmptyParts);
     if (parts.size() >= 2 && parts[0].toUpper() == "UTF8" && parts[1].toUpper() == "ON") {
         sendResponse("200 UTF8 set to on");
+    } else if (!parts.isEmpty() && parts[0].toUpper() == "MLST") {
+        // Siempre se envían todos los hechos: la respuesta indica cuáles quedan activos
+        sendResponse(QString("200 MLST OPTS %1").arg(QString(DirectoryLister::MlstFacts).remove('*')));
     } else {
         sendResponse("501 Opción no soportada.");
     }
@@ -243,39 +397,45 @@ void FtpClientHandler::handleOpts(const QString &arg)
 // --- Navegación de Directorios ---
 void FtpClientHandler::handlePwd()
 {
-    QString currentPath = QDir(m_server->getRootDir()).relativeFilePath(currentDir);
-    sendResponse("257 \"/" + currentPath + "\" es el directorio actual.");
+    sendResponse("257 \"" + m_currentVirtual + "\" es el directorio actual.");
 }
 
 void FtpClientHandler::handleCwd(const QString &path)
 {
-    logDual("DEBUG", QString("%1 - Cambiando directorio de '%2' a '%3'").arg(clientInfo).arg(currentDir).arg(path));
+    logDual("DEBUG", QString("%1 - Cambiando directorio de '%2' a '%3'").arg(clientInfo).arg(m_currentVirtual).arg(path));
     
-    QString newPath;
-    
-    // Manejar rutas especiales
+    // Rutas especiales: "/" o vacío es la raíz, ".." no pasa de ella
+    QString virtualPath;
     if (path == "/" || path.isEmpty()) {
-        newPath = m_server->getRootDir();
+        virtualPath = "/";
     } else if (path == "..") {
-        QDir dir(currentDir);
-        if (dir.cdUp() && dir.absolutePath().startsWith(m_server->getRootDir())) {
-            newPath = dir.absolutePath();
+        virtualPath = m_currentVirtual == "/" ? QString("/") : QFileInfo(m_currentVirtual).path();
+    } else {
+        virtualPath = PathResolver::normalize(path, m_currentVirtual);
+    }
+
+    Vfs::Target target;
+    if (!virtualPath.isEmpty() && resolveVirtual(virtualPath, target)) {
+        VfsBackend::Entry entry;
+        if (target.backend->stat(target.path, entry) && entry.isDir) {
+            changeDirectory(virtualPath, QString(), target);
+            sendResponse(QString("250 Directorio cambiado a \"%1\".").arg(m_currentVirtual));
         } else {
-            newPath = m_server->getRootDir();
+            sendResponse("550 El directorio no existe.");
         }
-    } else {
-        newPath = validateFilePath(path, true);
+        return;
     }
+    const QString newPath = virtualPath.isEmpty() ? QString() : validateFilePath(virtualPath, true, target);
     
     if (!newPath.isEmpty()) {
         // Verificar que el directorio realmente existe
         QDir testDir(newPath);
         if (testDir.exists()) {
-            QString oldDir = currentDir;
-            currentDir = newPath;
+            QString oldDir = m_currentVirtual;
+            changeDirectory(virtualPath, newPath, target);
             
-            logDual("INFO", QString("%1 - Directorio cambiado de '%2' a '%3'").arg(clientInfo).arg(oldDir).arg(currentDir));
-            sendResponse(QString("250 Directorio cambiado a \"%1\".").arg(currentDir));
+            logDual("INFO", QString("%1 - Directorio cambiado de '%2' a '%3' (%4)").arg(clientInfo).arg(oldDir).arg(m_currentVirtual).arg(currentDir));
+            sendResponse(QString("250 Directorio cambiado a \"%1\".").arg(m_currentVirtual));
         } else {
             logDual("WARNING", QString("%1 - Directorio no existe: '%2'").arg(clientInfo).arg(newPath));
             sendResponse("550 El directorio no existe.");
@@ -300,29 +460,84 @@ void FtpClientHandler::handleCwd(const QString &path)
 
 void FtpClientHandler::handleCdup()
 {
-    logDual("DEBUG", QString("%1 - CDUP desde directorio: '%2'").arg(clientInfo).arg(currentDir));
+    logDual("DEBUG", QString("%1 - CDUP desde directorio: '%2'").arg(clientInfo).arg(m_currentVirtual));
     
-    QDir dir(currentDir);
-    if (dir.cdUp() && dir.absolutePath().startsWith(m_server->getRootDir())) {
-        QString oldDir = currentDir;
-        currentDir = dir.absolutePath();
+    const QString parent = m_currentVirtual == "/" ? QString("/") : QFileInfo(m_currentVirtual).path();
+    Vfs::Target target;
+    VfsBackend::Entry entry;
+    if (resolveVirtual(parent, target) && target.backend->stat(target.path, entry) && entry.isDir) {
+        changeDirectory(parent, QString(), target);
+        sendResponse(QString("250 Directorio cambiado a \"%1\".").arg(m_currentVirtual));
+        return;
+    }
+    const QString parentPath = validateFilePath(parent, true, target);
+    if (!parentPath.isEmpty()) {
+        QString oldDir = m_currentVirtual;
+        changeDirectory(parent, parentPath, target);
         
-        logDual("INFO", QString("%1 - CDUP exitoso de '%2' a '%3'").arg(clientInfo).arg(oldDir).arg(currentDir));
-        sendResponse(QString("250 Directorio cambiado a \"%1\".").arg(currentDir));
+        logDual("INFO", QString("%1 - CDUP exitoso de '%2' a '%3'").arg(clientInfo).arg(oldDir).arg(m_currentVirtual));
+        sendResponse(QString("250 Directorio cambiado a \"%1\".").arg(m_currentVirtual));
     } else {
         // Si no se puede subir más, ir al directorio raíz
-        QString oldDir = currentDir;
-        currentDir = m_server->getRootDir();
+        QString oldDir = m_currentVirtual;
+        target = resolveSession("/");
+        changeDirectory("/", target.isVirtual() ? QString() : target.local, target);
         
         logDual("INFO", QString("%1 - CDUP al directorio raíz desde '%2'").arg(clientInfo).arg(oldDir));
-        sendResponse(QString("250 Directorio cambiado a \"%1\".").arg(currentDir));
+        sendResponse(QString("250 Directorio cambiado a \"%1\".").arg(m_currentVirtual));
+    }
+}
+
+void FtpClientHandler::changeDirectory(const QString &virtualPath, const QString &localPath, const Vfs::Target &target)
+{
+    currentDir = localPath;
+    m_currentVirtual = virtualPath;
+    m_currentTarget = target;
+    m_currentRoot = target.isLocal() ? confinementRoot(target) : m_server->getRootDir();
+    m_paths.sync(m_currentRoot, currentDir);
+}
+
+Vfs::Target FtpClientHandler::resolveSession(const QString &virtualPath) const
+{
+    return Vfs::instance().resolve(m_rules->serverPath(virtualPath));
+}
+
+QString FtpClientHandler::confinementRoot(const Vfs::Target &target) const
+{
+    if (m_rules->confined() && !m_homeLocal.isEmpty() && PathResolver::isInside(m_homeLocal, target.local)) {
+        return m_homeLocal;
     }
+    return target.backend->localRoot();
+}
+
+void FtpClientHandler::enterHome()
+{
+    const Vfs::Target home = resolveSession("/");
+    m_homeLocal = home.isLocal() ? home.local : m_server->getRootDir();
+    changeDirectory("/", home.isVirtual() ? QString() : home.local, home);
+}
+
+bool FtpClientHandler::permitted(const QString &path, UserRules::Perm perm)
+{
+    // Sin reglas no hay nada que comprobar; con ellas, solo memoria de la sesión
+    if (m_rules->ruleCount() == 0) {
+        return true;
+    }
+    const QString virtualPath = PathResolver::normalize(path, m_currentVirtual);
+    if (virtualPath.isEmpty() || m_rules->allows(virtualPath, perm)) {
+        return true;    // Una ruta inválida la rechaza después la validación normal
+    }
+    logDual("WARNING", QString("%1 - Permiso '%2' denegado a '%3' sobre '%4'")
+                           .arg(clientInfo, UserRules::permsString(perm), currentUser, virtualPath));
+    sendResponse("550 Permiso denegado.");
+    return false;
 }
 
 // --- Operaciones de Archivos y Directorios ---
 void FtpClientHandler::handleList(const QString &args)
 {
     qDebug() << QString("%1 - Procesando comando LIST: '%2'").arg(clientInfo).arg(args);
+    m_listTimer.start(); // Tiempo hasta el primer byte del listado
     
     // SOLUCION SIMPLE: Verificar si hay conexión de datos disponible
     if (!dataSocket || !dataSocket->isValid() || dataSocket->state() != QAbstractSocket::ConnectedState) {
@@ -350,6 +565,7 @@ void FtpClientHandler::handleList(const QString &args)
     QStringList parts = args.split(' ', Qt::SkipEmptyParts);
     QString pathString;
     QDir::Filters filters = QDir::AllEntries | QDir::NoDotAndDotDot; // Filtros por defecto
+    bool recursive = false;
 
     int pathStartIndex = 0;
     bool pathStarted = false;
@@ -361,7 +577,10 @@ void FtpClientHandler::handleList(const QString &args)
                 filters |= QDir::Hidden;
                 filters &= ~QDir::NoDotAndDotDot; // Mostrar . y ..
             }
-            // Aquí se pueden manejar otros flags como -l, -R, etc.
+            if (part.contains('R')) {
+                recursive = true;
+            }
+            // Aquí se pueden manejar otros flags como -l, etc.
             pathStartIndex = i + 1;
         } else {
             // El primer argumento que no es un flag inicia la ruta
@@ -373,6 +592,17 @@ void FtpClientHandler::handleList(const QString &args)
         pathString = parts.mid(pathStartIndex).join(' ');
     }
 
+    if (!permitted(pathString, UserRules::Read)) {
+        closeDataConnection();
+        return;
+    }
+
+    Vfs::Target target;
+    if (resolveVirtual(pathString.isEmpty() ? QString(".") : pathString, target)) {
+        startVirtualListing(target, DirectoryLister::Format::List, filters.testFlag(QDir::Hidden));
+        return;
+    }
+
     QString targetPath = pathString.isEmpty() ? currentDir : validateFilePath(pathString, true);
     if (targetPath.isEmpty()) {
         qWarning() << QString("%1 - Intento de listar directorio inválido. Path: '%2', Dir actual: '%3'")
@@ -383,7 +613,13 @@ void FtpClientHandler::handleList(const QString &args)
     }
     
     qInfo() << QString("%1 - Listando directorio: '%2'").arg(clientInfo).arg(targetPath);
+    startListing(targetPath, PathResolver::normalize(pathString, m_currentVirtual), DirectoryLister::Format::List,
+                 filters.testFlag(QDir::Hidden), recursive);
+}
 
+void FtpClientHandler::startListing(const QString &targetPath, const QString &virtualPath,
+                                    DirectoryLister::Format format, bool showHidden, bool recursive)
+{
     // Verificar que el directorio existe y es accesible
     QDir dir(targetPath);
     if (!dir.exists()) {
@@ -393,261 +629,1898 @@ void FtpClientHandler::handleList(const QString &args)
         return;
     }
 
+    // Árbol completo: se lee en paralelo y no pasa por la caché de listados
+    if (recursive) {
+        sendResponse("150 Abriendo conexión de datos para el listado recursivo.");
+        if (!ensureDataProtection()) {
+            return;
+        }
+        m_listFormat = format == DirectoryLister::Format::Mlsd ? DirectoryCache::Format::Mlsd : DirectoryCache::Format::List;
+        m_listCacheable = false;
+        m_listPayload.clear();
+        m_listFirstByte = false;
+        // Las subcarpetas sin permiso de lectura no se recorren. Las reglas son
+        // inmutables: los hilos del recorrido las consultan por su propia copia
+        TreeWalker::DescendFilter canDescend;
+        if (m_rules->ruleCount() > 0) {
+            canDescend = [rules = m_rules, virtualPath](const QString &relative) {
+                const QString path = virtualPath == QLatin1String("/") ? QLatin1Char('/') + relative
+                                                                        : virtualPath + QLatin1Char('/') + relative;
+                return rules->allows(path, UserRules::Read);
+            };
+        }
+        m_treeWalker = std::make_unique<TreeWalker>(targetPath, format, showHidden, TreeWalker::defaultLimits(),
+                                                    this, [this]() { pumpList(); }, std::move(canDescend));
+        bytesTransferred = 0;
+        transferActive = true;
+        transferTimer.start();
+
+        connect(dataSocket, &QTcpSocket::bytesWritten, this, &FtpClientHandler::onBytesWritten);
+        connect(dataSocket, &QTcpSocket::disconnected, this, [this]() {
+            transferActive = false;
+            pendingDataCommand = Command::None;
+            if (!m_treeWalker) {
+                sendResponse("226 Transferencia completa.");
+                closeDataConnection();
+                return;
+            }
+            const bool complete = m_treeWalker->atEnd();
+            const bool truncated = m_treeWalker->truncated();
+            DirectoryLister::recordEntries(m_treeWalker->entryCount());
+            logDual("INFO", QString("%1 - Listado recursivo enviado: %2 directorios, %3 entradas, %4 bytes")
+                       .arg(clientInfo).arg(m_treeWalker->directoryCount())
+                       .arg(m_treeWalker->entryCount()).arg(bytesTransferred));
+            m_treeWalker.reset();
+            if (!complete) {
+                sendResponse("426 Listado interrumpido.");
+            } else if (truncated) {
+                sendResponse("226 Listado truncado: se alcanzó el límite de profundidad o de entradas.");
+            } else {
+                sendResponse("226 Transferencia completa.");
+            }
+            closeDataConnection();
+        });
+
+        pendingDataCommand = Command::List;
+        pumpList();
+        return;
+    }
+
+    // Listado ya renderizado de este directorio con el mismo formato y opciones
+    DirectoryCache &listingCache = DirectoryCache::instance();
+    const DirectoryCache::Format cacheFormat = format == DirectoryLister::Format::Mlsd
+        ? DirectoryCache::Format::Mlsd : DirectoryCache::Format::List;
+    const quint32 cacheFlags = showHidden ? quint32(DirectoryCache::ShowHidden) : 0;
+    QByteArray cached;
+    if (listingCache.lookup(targetPath, cacheFormat, cacheFlags, cached)) {
+        sendResponse("150 Abriendo conexión de datos para la lista de directorios.");
+        if (!ensureDataProtection()) {
+            return;
+        }
+        logDual("INFO", QString("%1 - Listado servido desde caché: %2 bytes").arg(clientInfo).arg(cached.size()));
+        bytesTransferred = 0;
+        transferActive = true;
+        transferTimer.start();
+        connect(dataSocket, &QTcpSocket::bytesWritten, this, &FtpClientHandler::onBytesWritten);
+        connect(dataSocket, &QTcpSocket::disconnected, this, [this]() {
+            transferActive = false;
+            sendResponse("226 Transferencia completa.");
+            closeDataConnection();
+        });
+        DirectoryLister::recordFirstByte(m_listTimer.nsecsElapsed() / 1e6, true);
+        dataSocket->write(cached);
+        dataSocket->disconnectFromHost();
+        return;
+    }
+
+    // La generación se toma antes de leer: si el directorio cambia mientras
+    // tanto, el listado se envía pero no se guarda
+    const quint64 generation = listingCache.beginRender(targetPath);
+    auto lister = std::make_unique<DirectoryLister>();
+    if (!lister->open(targetPath, showHidden, format)) {
+        qWarning() << QString("%1 - No se pudo abrir el directorio '%2': %3")
+                      .arg(clientInfo).arg(targetPath).arg(lister->errorString());
+        sendResponse("550 No se pudo leer el directorio.");
+        closeDataConnection();
+        return;
+    }
+
     sendResponse("150 Abriendo conexión de datos para la lista de directorios.");
+    if (!ensureDataProtection()) {
+        return;
+    }
+    beginListing(std::move(lister), targetPath, format, cacheFlags, generation);
+}
 
-    QFileInfoList list;
-    try {
-        list = dir.entryInfoList(filters, QDir::Name | QDir::DirsFirst);
-    } catch (const std::exception& e) {
-        qCritical() << QString("%1 - Error al listar directorio: %2").arg(clientInfo).arg(e.what());
-        sendResponse("550 Error interno al listar directorio.");
+void FtpClientHandler::beginListing(std::unique_ptr<DirectoryLister> lister, const QString &targetPath,
+                                    DirectoryLister::Format format, quint32 cacheFlags, quint64 generation)
+{
+    m_lister = std::move(lister);
+    m_listPath = targetPath;
+    m_listFormat = format == DirectoryLister::Format::Mlsd ? DirectoryCache::Format::Mlsd : DirectoryCache::Format::List;
+    m_listFlags = cacheFlags;
+    m_listGeneration = generation;
+    m_listCacheable = generation != 0;
+    m_listPayload.clear();
+    m_listFirstByte = false;
+    // Sin ruta en disco (montaje no local) no hay dispositivo que planificar
+    m_ioDevice = targetPath.isEmpty() ? QString() : IoScheduler::deviceFor(-1, targetPath);
+    bytesTransferred = 0;
+    transferActive = true;
+    transferTimer.start();
+
+    connect(dataSocket, &QTcpSocket::bytesWritten, this, &FtpClientHandler::onBytesWritten);
+    connect(dataSocket, &QTcpSocket::disconnected, this, [this]() {
+        transferActive = false;
+        pendingDataCommand = Command::None;
+        if (!m_lister) {
+            sendResponse("226 Transferencia completa.");
+            closeDataConnection();
+            return;
+        }
+        const bool complete = m_lister->atEnd() && m_lister->errorString().isEmpty();
+        DirectoryLister::recordEntries(m_lister->entryCount());
+        logDual("INFO", QString("%1 - Listado enviado: %2 entradas, %3 bytes")
+                   .arg(clientInfo).arg(m_lister->entryCount()).arg(bytesTransferred));
+        if (complete && m_listCacheable) {
+            DirectoryCache::instance().insert(m_listPath, m_listFormat, m_listFlags,
+                                              m_listPayload, m_listGeneration);
+        }
+        m_lister.reset();
+        m_listPayload = QByteArray();
+        sendResponse(complete ? "226 Transferencia completa." : "426 Listado interrumpido.");
         closeDataConnection();
+    });
+
+    // Enviar el listado por tandas a medida que el socket se vacía
+    pendingDataCommand = Command::List;
+    pumpList();
+}
+
+void FtpClientHandler::pumpList()
+{
+    if (pendingDataCommand != Command::List || !dataSocket || (!m_lister && !m_treeWalker && !m_changeReader && !m_findResult)) {
         return;
     }
 
-    auto permsString = [](const QFileInfo &fi) -> QString {
-        QString s;
-        s += fi.isDir() ? 'd' : '-';
-        // Los permisos no se obtienen fácilmente en Windows, se muestra uno genérico
-        s += "rwxr-xr-x"; // placeholder
-        return s;
-    };
+    if (m_findResult) {
+        // Las coincidencias ya están en memoria: solo se reparten al ritmo del socket
+        const QByteArray &lines = m_findResult->lines;
+        while (m_findOffset < lines.size() && dataSocket->bytesToWrite() < RetrWriteHighWater) {
+            const qint64 length = qMin<qint64>(DirectoryLister::BatchBytes, lines.size() - m_findOffset);
+            writeListChunk(QByteArray::fromRawData(lines.constData() + m_findOffset, length));
+            m_findOffset += length;
+        }
+        if (m_findOffset >= lines.size()) {
+            pendingDataCommand = Command::None;
+            dataSocket->disconnectFromHost();
+        }
+        return;
+    }
 
-    QString listing;
-    int fileCount = 0;
-    for (const QFileInfo &info : list) {
-        try {
-            // Filtrar archivos ocultos del sistema en Windows (solo si no se usa -a)
-            if (!(filters & QDir::Hidden) && info.fileName().startsWith('.') && 
-                info.fileName() != "." && info.fileName() != "..") {
-                continue; // Saltar archivos ocultos a menos que se solicite con -a
+    if (m_changeReader) {
+        while (!m_changeReader->atEnd() && dataSocket->bytesToWrite() < RetrWriteHighWater) {
+            m_listBuffer.resize(0);
+            if (m_changeReader->next(m_listBuffer) > 0) {
+                writeListChunk(m_listBuffer);
             }
-            
-            listing += QString("%1 1 owner group %2 %3 %4\r\n")
-                           .arg(permsString(info))
-                           .arg(info.size(), 10)
-                           .arg(info.lastModified().toString("MMM dd hh:mm"))
-                           .arg(info.fileName());
-            fileCount++;
-        } catch (const std::exception& e) {
-            qWarning() << QString("%1 - Error procesando archivo: %2 - %3")
-                          .arg(clientInfo).arg(info.fileName()).arg(e.what());
-            continue; // Saltar este archivo y continuar
         }
+        if (m_changeReader->atEnd()) {
+            pendingDataCommand = Command::None;
+            dataSocket->disconnectFromHost();
+        }
+        return;
     }
-    
-    qInfo() << QString("%1 - Preparando listado de %2 elementos").arg(clientInfo).arg(fileCount);
 
-    // ENVIO SIMPLE Y SEGURO CON PROTECCIONES ANTI-CRASH
-    try {
-        QByteArray payload = listing.toUtf8();
-        logDual("INFO", QString("%1 - Enviando listado: %2 archivos, %3 bytes")
-                   .arg(clientInfo).arg(fileCount).arg(payload.size()));
-        
-        if (payload.isEmpty()) {
-            payload = "total 0\r\n"; // Listado vacío pero válido
-            logDual("WARNING", QString("%1 - Listado vacío, enviando respuesta por defecto").arg(clientInfo));
+    if (m_treeWalker) {
+        // Los directorios se leen en el pool; aquí solo se copian los que ya tocan
+        while (!m_treeWalker->atEnd() && dataSocket->bytesToWrite() < RetrWriteHighWater) {
+            m_listBuffer.resize(0);
+            if (m_treeWalker->next(m_listBuffer) == 0) {
+                break; // Avisará cuando termine el siguiente directorio
+            }
+            writeListChunk(m_listBuffer);
         }
-        
-        // Verificar socket antes de escribir
-        if (!dataSocket || !dataSocket->isValid()) {
-            logDual("ERROR", QString("%1 - Socket de datos inválido antes de escribir").arg(clientInfo));
-            sendResponse("426 Error de conexión de datos.");
+        if (m_treeWalker->atEnd()) {
+            pendingDataCommand = Command::None;
+            dataSocket->disconnectFromHost();
+        }
+        return;
+    }
+
+    while (!m_lister->atEnd() && dataSocket->bytesToWrite() < RetrWriteHighWater) {
+        m_listBuffer.resize(0); // Conserva la capacidad entre tandas
+        {
+            IoScheduler::Ticket io = IoScheduler::instance().acquire(m_ioDevice, IoScheduler::Kind::Metadata);
+            m_lister->next(m_listBuffer);
+        }
+        if (m_listFormat == DirectoryCache::Format::List && m_lister->atEnd() &&
+            m_lister->entryCount() == 0 && m_lister->errorString().isEmpty()) {
+            m_listBuffer = "total 0\r\n"; // Listado vacío pero válido (MLSD vacío no lleva nada)
+        }
+        if (m_listBuffer.isEmpty()) {
+            continue;
+        }
+        writeListChunk(m_listBuffer);
+    }
+
+    if (m_lister->atEnd()) {
+        pendingDataCommand = Command::None;
+        dataSocket->disconnectFromHost();
+    }
+}
+
+void FtpClientHandler::writeListChunk(const QByteArray &chunk)
+{
+    if (!m_listFirstByte) {
+        m_listFirstByte = true;
+        DirectoryLister::recordFirstByte(m_listTimer.nsecsElapsed() / 1e6, false);
+    }
+    // Copia para la caché mientras quepa en una entrada; si no, se renuncia a guardarlo
+    if (m_listCacheable) {
+        if (m_listPayload.size() + chunk.size() <= DirectoryCache::instance().maxEntryBytes()) {
+            m_listPayload.append(chunk);
+        } else {
+            m_listCacheable = false;
+            m_listPayload = QByteArray();
+        }
+    }
+    dataSocket->write(chunk.constData(), chunk.size());
+}
+
+// --- Listados para máquinas (RFC 3659) ---
+void FtpClientHandler::handleMlsd(const QString &path)
+{
+    if (!dataSocket || !dataSocket->isValid() || dataSocket->state() != QAbstractSocket::ConnectedState) {
+        sendResponse("425 No se puede abrir conexión de datos.");
+        return;
+    }
+    if (dataSocket->bytesToWrite() > 0) {
+        sendResponse("425 Transferencia en curso, intente más tarde.");
+        return;
+    }
+    m_listTimer.start();
+
+    // Extensión propia: "MLSD -R [ruta]" recorre el árbol con nombres relativos
+    QString dirPath = path;
+    bool recursive = false;
+    if (dirPath == "-R" || dirPath.startsWith("-R ")) {
+        recursive = true;
+        dirPath = dirPath.mid(2).trimmed();
+    }
+
+    if (!permitted(dirPath, UserRules::Read)) {
+        closeDataConnection();
+        return;
+    }
+
+    // En un montaje no local -R no se aplica: se lista solo el directorio
+    Vfs::Target target;
+    if (resolveVirtual(dirPath.isEmpty() ? QString(".") : dirPath, target)) {
+        startVirtualListing(target, DirectoryLister::Format::Mlsd, false);
+        return;
+    }
+
+    const QString targetPath = dirPath.isEmpty() ? currentDir : validateFilePath(dirPath, true);
+    if (targetPath.isEmpty()) {
+        sendResponse("550 Directorio no encontrado o sin acceso.");
+        closeDataConnection();
+        return;
+    }
+    if (!QFileInfo(targetPath).isDir()) {
+        sendResponse("501 MLSD solo admite directorios.");
+        closeDataConnection();
+        return;
+    }
+    startListing(targetPath, PathResolver::normalize(dirPath, m_currentVirtual), DirectoryLister::Format::Mlsd,
+                 false, recursive);
+}
+
+void FtpClientHandler::handleMlst(const QString &path)
+{
+    if (!permitted(path, UserRules::Read)) {
+        return;
+    }
+    // MLST admite archivos y carpetas
+    const QString shown = path.isEmpty() ? m_currentVirtual : path;
+    Vfs::Target target;
+    if (resolveVirtual(path.isEmpty() ? QString(".") : path, target)) {
+        VfsBackend::Entry entry;
+        if (!target.backend->stat(target.path, entry)) {
+            sendResponse("550 Archivo o directorio no encontrado.");
             return;
         }
-        
-        // Enviar datos de forma simple
-        qint64 written = dataSocket->write(payload);
-        
-        if (written == -1) {
-            logDual("ERROR", QString("%1 - Error escribiendo al socket: %2").arg(clientInfo).arg(dataSocket->errorString()));
-            sendResponse("426 Error de transferencia.");
-        } else if (written != payload.size()) {
-            logDual("WARNING", QString("%1 - Escritura parcial: %2/%3 bytes").arg(clientInfo).arg(written).arg(payload.size()));
-            sendResponse("226 Transferencia parcial completada.");
+        QByteArray facts;
+        DirectoryLister::factsOf(entry, facts);
+        sendResponse("250-Listado de " + shown);
+        sendResponse(" " + QString::fromUtf8(facts) + " " + shown);
+        sendResponse("250 Fin");
+        return;
+    }
+
+    QString targetPath = currentDir;
+    if (!path.isEmpty()) {
+        targetPath = validateFilePath(path, false);
+        if (targetPath.isEmpty()) {
+            targetPath = validateFilePath(path, true);
+        }
+    }
+    QByteArray facts;
+    if (targetPath.isEmpty() || !DirectoryLister::factsFor(targetPath, facts)) {
+        sendResponse("550 Archivo o directorio no encontrado.");
+        return;
+    }
+    sendResponse("250-Listado de " + shown);
+    sendResponse(" " + QString::fromUtf8(facts) + " " + shown);
+    sendResponse("250 Fin");
+}
+
+void FtpClientHandler::handleSize(const QString &fileName)
+{
+    if (!permitted(fileName, UserRules::Read)) {
+        return;
+    }
+    qint64 size = 0;
+    qint64 mtime = 0;
+    bool isDir = false;
+    Vfs::Target target;
+    if (resolveVirtual(fileName, target)) {
+        VfsBackend::Entry entry;
+        if (!target.backend->stat(target.path, entry) || entry.isDir) {
+            sendResponse("550 Archivo no encontrado.");
         } else {
-            logDual("INFO", QString("%1 - Listado enviado exitosamente (%2 bytes)").arg(clientInfo).arg(written));
-            sendResponse("226 Transferencia completa.");
+            sendResponse(QString("213 %1").arg(entry.size));
         }
-        
-        // Flush con verificación
-        if (dataSocket && dataSocket->isValid()) {
-            dataSocket->flush();
+        return;
+    }
+    const QString filePath = validateFilePath(fileName, false);
+    if (filePath.isEmpty() || !DirectoryLister::sizeAndTime(filePath, size, mtime, isDir) || isDir) {
+        sendResponse("550 Archivo no encontrado.");
+        return;
+    }
+    sendResponse(QString("213 %1").arg(size));
+}
+
+void FtpClientHandler::handleMdtm(const QString &fileName)
+{
+    if (!permitted(fileName, UserRules::Read)) {
+        return;
+    }
+    qint64 size = 0;
+    qint64 mtime = 0;
+    bool isDir = false;
+    Vfs::Target target;
+    if (resolveVirtual(fileName, target)) {
+        VfsBackend::Entry entry;
+        if (!target.backend->stat(target.path, entry) || entry.isDir) {
+            sendResponse("550 Archivo no encontrado.");
+        } else {
+            sendResponse("213 " + QString::fromLatin1(DirectoryLister::timeVal(entry.mtimeSecs)));
         }
-        
-    } catch (const std::exception& e) {
-        logDual("ERROR", QString("%1 - Excepción enviando listado: %2").arg(clientInfo).arg(e.what()));
-        sendResponse("426 Error interno de transferencia.");
-    } catch (...) {
-        logDual("ERROR", QString("%1 - Error desconocido enviando listado").arg(clientInfo));
-        sendResponse("426 Error desconocido de transferencia.");
+        return;
     }
-    
-    // LIMPIEZA INMEDIATA Y SIMPLE
-    if (dataSocket) {
-        logDual("DEBUG", QString("%1 - Limpieza inmediata del socket").arg(clientInfo));
-        
-        // Solo limpiar la referencia inmediatamente
-        dataSocket = nullptr;
-        
-        logDual("DEBUG", QString("%1 - Socket limpiado").arg(clientInfo));
+    const QString filePath = validateFilePath(fileName, false);
+    if (filePath.isEmpty() || !DirectoryLister::sizeAndTime(filePath, size, mtime, isDir) || isDir) {
+        sendResponse("550 Archivo no encontrado.");
+        return;
+    }
+    sendResponse("213 " + QString::fromLatin1(DirectoryLister::timeVal(mtime)));
+}
+
+void FtpClientHandler::handleRetr(const QString &fileName)
+{
+    if (!setupDataConnection()) return;
+    if (!permitted(fileName, UserRules::Read)) {
+        closeDataConnection();
+        return;
+    }
+
+    Vfs::Target target;
+    if (resolveVirtual(fileName, target)) {
+        startVirtualRetr(target);
+        return;
+    }
+
+    QString filePath = validateFilePath(fileName, false);
+    if (filePath.isEmpty()) {
+        sendResponse("550 Archivo no encontrado.");
+        closeDataConnection();
+        return;
+    }
+
+    // "RETR carpeta.tar" de una carpeta sin archivo con ese nombre: descargarla empaquetada
+    if (!QFileInfo::exists(filePath) && fileName.endsWith(".tar", Qt::CaseInsensitive)) {
+        QString dirPath = validateFilePath(fileName.chopped(4), true);
+        if (!dirPath.isEmpty() && QFileInfo(dirPath).isDir()) {
+            startBatchRetr(QStringList() << fileName.chopped(4));
+            return;
+        }
+    }
+
+    // Archivos pequeños y populares: servir desde la caché compartida sin tocar el disco
+    QByteArray cached;
+    if (HotFileCache::instance().fetch(filePath, cached)) {
+        startMemoryRetr(cached);
+        return;
+    }
+
+    // Limpiar archivo anterior si existe
+    if (file) {
+        file->close();
+        file->deleteLater();
+        file = nullptr;
+    }
+
+    file = new QFile(filePath, this);
+    if (!file->open(QIODevice::ReadOnly)) {
+        sendResponse("550 No se pudo abrir el archivo.");
+        file->deleteLater();
+        file = nullptr;
+        closeDataConnection();
+        return;
+    }
+
+    // Inicializar variables de transferencia
+    bytesTransferred = 0;
+    bytesRemaining = file->size();
+    m_ioDevice = IoScheduler::deviceFor(file->handle(), filePath);
+    transferActive = true;
+    transferTimer.start();
+
+    // Copias de seguridad enormes: leerlas sin pasar por la caché de páginas
+    m_directReader.reset();
+    if (DirectIoPolicy::instance().shouldUse(filePath, file->size())) {
+        m_directReader = std::make_unique<DirectFileReader>(this, [this]() { pumpRetr(); });
+        if (!m_directReader->open(filePath, file->size())) {
+            m_directReader.reset();
+        }
+    }
+    if (!m_directReader) {
+        m_readAhead.start(file->handle(), filePath, file->size());
+    }
+
+    sendResponse("150 Abriendo conexión de datos para la transferencia de archivos.");
+    if (!ensureDataProtection()) {
+        transferActive = false;
+        m_readAhead.stop();
+        m_directReader.reset();
+        file->close();
+        file->deleteLater();
+        file = nullptr;
+        return;
+    }
+
+    // Sin datos pendientes en Qt, sendfile() puede escribir directamente al descriptor
+    retrOffset = 0;
+    m_retrThrottled = false;
+    m_retrFailed = false;
+    retrZeroCopy = !m_directReader && file->handle() >= 0 && ZeroCopySend::canSendFileDirectly(dataSocket);
+
+    // Descargas simultáneas del mismo archivo grande: leerlo del disco una sola vez.
+    // Con sendfile() la caché de páginas del kernel ya cumple esa función.
+    m_sharedRead.reset();
+    if (!retrZeroCopy && !m_directReader) {
+        m_sharedRead = SharedReadRegistry::instance().subscribe(filePath);
+        if (m_sharedRead) {
+            m_readAhead.stop(); // El lector compartido declara su propio acceso secuencial
+        }
+    }
+
+    connect(dataSocket, &QTcpSocket::bytesWritten, this, &FtpClientHandler::onBytesWritten);
+
+    connect(dataSocket, &QTcpSocket::disconnected, this, [this]() {
+        transferActive = false;
+        pendingDataCommand = Command::None;
+        releaseRetrNotifier();
+        m_readAhead.stop();
+        m_sharedRead.reset();
+        m_directReader.reset();
+        const bool failed = m_retrFailed;
+        m_retrFailed = false;
+        if (file) {
+            file->close();
+            qInfo() << QString("%1 - Archivo %2: %3 bytes transferidos")
+                       .arg(clientInfo)
+                       .arg(failed ? "cortado por un error de lectura" : "enviado")
+                       .arg(bytesTransferred);
+            file->deleteLater();
+            file = nullptr;
+        }
+        sendResponse(failed ? "451 Error de lectura en el servidor." : "226 Transferencia completa.");
+        closeDataConnection();
+    });
+
+    // Enviar el archivo por bloques del pool a medida que el socket se vacía
+    pendingDataCommand = Command::Retr;
+    pumpRetr();
+}
+
+void FtpClientHandler::startMemoryRetr(const QByteArray &content)
+{
+    if (file) {
+        file->close();
+        file->deleteLater();
+        file = nullptr;
+    }
+    bytesTransferred = 0;
+    bytesRemaining = 0;
+    transferActive = true;
+    transferTimer.start();
+
+    sendResponse("150 Abriendo conexión de datos para la transferencia de archivos.");
+    if (!ensureDataProtection()) {
+        transferActive = false;
+        return;
+    }
+
+    connect(dataSocket, &QTcpSocket::bytesWritten, this, &FtpClientHandler::onBytesWritten);
+    connect(dataSocket, &QTcpSocket::disconnected, this, [this]() {
+        transferActive = false;
+        qInfo() << QString("%1 - Archivo enviado desde caché: %2 bytes transferidos")
+                   .arg(clientInfo)
+                   .arg(bytesTransferred);
+        sendResponse("226 Transferencia completa.");
+        closeDataConnection();
+    });
+
+    // El búfer de escritura del socket guarda una referencia al contenido compartido
+    dataSocket->write(content);
+    dataSocket->disconnectFromHost();
+}
+
+void FtpClientHandler::pumpRetr()
+{
+    if (pendingDataCommand != Command::Retr || !dataSocket) {
+        return;
+    }
+    if (m_vfsSource) {
+        pumpRetrVirtual();
+        return;
+    }
+    if (!file || m_retrThrottled) {
+        return;
+    }
+    const int delayMs = applySpeedLimit();
+    if (delayMs > 0) {
+        // Por encima del límite: reanudar cuando la media vuelva a estar por debajo
+        m_retrThrottled = true;
+        QTimer::singleShot(delayMs, this, [this]() {
+            m_retrThrottled = false;
+            pumpRetr();
+        });
+        return;
+    }
+    if (retrZeroCopy) {
+        pumpRetrZeroCopy();
+        return;
+    }
+
+    if (m_directReader) {
+        pumpRetrDirect();
+    } else if (m_sharedRead) {
+        pumpRetrShared();
+    }
+    if (pendingDataCommand != Command::Retr || !file) {
+        return;     // Falló la lectura y la transferencia ya se cerró
+    }
+
+    while (!m_directReader && !m_sharedRead && bytesRemaining > 0 && dataSocket->bytesToWrite() < RetrWriteHighWater) {
+        BufferPool::Buffer buffer = BufferPool::instance().acquire();
+        if (buffer.isNull()) {
+            // Pool agotado: reintentar cuando otras transferencias devuelvan bloques
+            QTimer::singleShot(10, this, &FtpClientHandler::pumpRetr);
+            return;
+        }
+
+        IoScheduler::Ticket io = IoScheduler::instance().acquire(m_ioDevice, IoScheduler::Kind::Read);
+        qint64 bytesRead = file->read(buffer.data(), qMin(buffer.size(), bytesRemaining));
+        io.release();
+        if (bytesRead <= 0) {
+            qWarning() << QString("%1 - Error leyendo archivo para RETR: %2").arg(clientInfo).arg(file->errorString());
+            failRetr();
+            return;
+        }
+
+        dataSocket->write(buffer.data(), bytesRead);
+        bytesRemaining -= bytesRead;
+        m_readAhead.consumed(file->pos(), bytesRead);
+    }
+
+    if (bytesRemaining == 0) {
+        pendingDataCommand = Command::None;
+        dataSocket->disconnectFromHost(); // Cierra cuando se haya vaciado el buffer de escritura
+    }
+}
+
+void FtpClientHandler::pumpRetrDirect()
+{
+    while (bytesRemaining > 0 && dataSocket->bytesToWrite() < RetrWriteHighWater) {
+        BufferPool::Buffer buffer;
+        qint64 length = 0;
+        switch (m_directReader->next(buffer, length)) {
+        case DirectFileReader::Status::Pending:
+            if (m_directReader->inFlight() == 0) {
+                // Pool agotado y ninguna lectura que vaya a avisar: reintentar más tarde
+                QTimer::singleShot(10, this, &FtpClientHandler::pumpRetr);
+            }
+            return;
+        case DirectFileReader::Status::Failed:
+            qWarning() << QString("%1 - Error en la lectura directa para RETR").arg(clientInfo);
+            failRetr();
+            return;
+        case DirectFileReader::Status::Ready:
+            break;
+        }
+        length = qMin(length, bytesRemaining);
+        dataSocket->write(buffer.data(), length);
+        bytesRemaining -= length;
+    }
+}
+
+void FtpClientHandler::pumpRetrShared()
+{
+    while (bytesRemaining > 0 && dataSocket->bytesToWrite() < RetrWriteHighWater) {
+        const qint64 index = retrOffset / SharedFileReader::BlockSize;
+        QByteArray block;
+        if (!m_sharedRead->block(index, block)) {
+            // Se quedó más de una ventana por detrás o falló la lectura compartida:
+            // seguir con lecturas propias (si también fallan, failRetr responde 451)
+            logDual("INFO", QString("%1 - RETR desenganchado de la lectura compartida en el byte %2")
+                                .arg(clientInfo).arg(retrOffset));
+            m_sharedRead.reset();
+            file->seek(retrOffset);
+            m_readAhead.start(file->handle(), file->fileName(), file->size(), retrOffset);
+            return;
+        }
+
+        const qint64 skip = retrOffset - index * SharedFileReader::BlockSize;
+        const qint64 length = qMin<qint64>(block.size() - skip, bytesRemaining);
+        if (length <= 0) {
+            qWarning() << QString("%1 - Error leyendo archivo compartido para RETR").arg(clientInfo);
+            failRetr();
+            return;
+        }
+        dataSocket->write(block.constData() + skip, length);
+        retrOffset += length;
+        bytesRemaining -= length;
+    }
+}
+
+void FtpClientHandler::pumpRetrZeroCopy()
+{
+    // Nunca mezclar con datos que Qt aún tenga en su buffer de escritura
+    if (dataSocket->bytesToWrite() > 0) {
+        return; // bytesWritten volverá a llamar a pumpRetr()
+    }
+
+    qint64 sentThisRound = 0;
+    while (bytesRemaining > 0 && sentThisRound < ZeroCopySlice) {
+        IoScheduler::Ticket io = IoScheduler::instance().acquire(m_ioDevice, IoScheduler::Kind::Read);
+        qint64 sent = ZeroCopySend::sendFile(dataSocket->socketDescriptor(), file->handle(), retrOffset,
+                                            qMin(bytesRemaining, ZeroCopySlice - sentThisRound));
+        io.release();
+        if (sent < 0) {
+            // Seguir por la ruta con buffers desde donde se quedó sendfile()
+            logDual("WARNING", QString("%1 - sendfile no disponible, usando buffers").arg(clientInfo));
+            releaseRetrNotifier();
+            retrZeroCopy = false;
+            file->seek(retrOffset);
+            pumpRetr();
+            return;
+        }
+        if (sent == 0) {
+            // Buffer del socket lleno: seguir cuando el kernel avise de que hay hueco.
+            // Qt no vigila la escritura mientras su propio buffer está vacío, así que
+            // el aviso no compite con el de QTcpSocket.
+            if (!m_retrWritable) {
+                m_retrWritable = std::make_unique<QSocketNotifier>(dataSocket->socketDescriptor(),
+                                                                    QSocketNotifier::Write);
+                connect(m_retrWritable.get(), &QSocketNotifier::activated, this, [this]() {
+                    m_retrWritable->setEnabled(false);
+                    pumpRetr();
+                });
+            }
+            m_retrWritable->setEnabled(true);
+            return;
+        }
+        retrOffset += sent;
+        bytesRemaining -= sent;
+        bytesTransferred += sent;
+        sentThisRound += sent;
+        m_readAhead.consumed(retrOffset, sent);
+    }
+
+    if (bytesRemaining == 0) {
+        pendingDataCommand = Command::None;
+        releaseRetrNotifier();
+        dataSocket->disconnectFromHost();
+        return;
+    }
+    // Devolver el control al bucle de eventos entre tramos (comandos de control, ABOR)
+    QTimer::singleShot(0, this, &FtpClientHandler::pumpRetr);
+}
+
+void FtpClientHandler::failRetr()
+{
+    // El archivo no se pudo leer entero: se corta la conexión en lugar de cerrarla
+    // limpia, para que el cliente no tome lo recibido por el archivo completo.
+    // abort() emite disconnected en el acto y allí se responde 451
+    m_retrFailed = true;
+    pendingDataCommand = Command::None;
+    bytesRemaining = 0;
+    releaseRetrNotifier();
+    if (dataSocket) {
+        dataSocket->abort();
+    }
+}
+
+void FtpClientHandler::releaseRetrNotifier()
+{
+    if (m_retrWritable) {
+        // Puede estar emitiendo activated(): borrarlo al volver al bucle de eventos
+        m_retrWritable->setEnabled(false);
+        m_retrWritable.release()->deleteLater();
+    }
+}
+
+// =====================================================================================
+// Seccion: Descarga por lotes (SITE MRETR)
+// =====================================================================================
+
+void FtpClientHandler::handleSite(const QString &arg)
+{
+    const QString subCommand = arg.section(' ', 0, 0).toUpper();
+    const QString subArg = arg.section(' ', 1).trimmed();
+
+    // Trabajan con rutas de disco relativas al directorio actual
+    if (currentDir.isEmpty() && subCommand != "CHANGES") {
+        sendResponse("550 Orden no disponible en un montaje virtual.");
+        return;
+    }
+
+    if (subCommand == "MRETR") {
+        handleSiteMretr(subArg);
+    } else if (subCommand == "UNTAR") {
+        handleSiteUntar(subArg);
+    } else if (subCommand == "CHANGES") {
+        handleSiteChanges(subArg);
+    } else if (subCommand == "FIND") {
+        handleSiteFind(subArg);
+    } else if (subCommand == "DU") {
+        handleSiteDu(subArg);
+    } else {
+        sendResponse("504 Comando SITE no soportado.");
+    }
+}
+
+void FtpClientHandler::handleSiteMretr(const QString &arg)
+{
+    // Varias rutas o patrones separados por ';' (los nombres pueden llevar espacios)
+    QStringList patterns;
+    for (const QString &part : arg.split(';', Qt::SkipEmptyParts)) {
+        if (!part.trimmed().isEmpty()) {
+            patterns << part.trimmed();
+        }
+    }
+    if (patterns.isEmpty()) {
+        sendResponse("501 Uso: SITE MRETR <ruta|patrón>[;<ruta|patrón>...]");
+        return;
+    }
+    if (!setupDataConnection()) return;
+    startBatchRetr(patterns);
+}
+
+bool FtpClientHandler::collectBatchEntries(const QStringList &patterns, QList<TarBatchStream::Entry> &entries)
+{
+    const QDir base(currentDir);
+    QSet<QString> seen;
+
+    auto addEntry = [&](const QFileInfo &info) {
+        const QString path = info.absoluteFilePath();
+        if (seen.contains(path) || entries.size() >= BatchMaxFiles) {
+            return;
+        }
+        seen.insert(path);
+        // Lo que el usuario no puede leer no entra en el paquete
+        if (m_rules->ruleCount() > 0 && !m_rules->allows(m_rules->clientPath(Vfs::instance().virtualPathOf(path)),
+                                                         UserRules::Read)) {
+            return;
+        }
+        TarBatchStream::Entry entry;
+        entry.absolutePath = path;
+        // Nombres relativos al directorio actual; lo que quede fuera, relativo a la carpeta personal
+        entry.archiveName = base.relativeFilePath(path);
+        if (entry.archiveName.startsWith("..")) {
+            entry.archiveName = m_rules->clientPath(Vfs::instance().virtualPathOf(path)).mid(1);
+        }
+        entry.isDir = info.isDir();
+        entry.size = entry.isDir ? 0 : info.size();
+        entry.mtime = info.lastModified().toSecsSinceEpoch();
+        entry.permissions = info.permissions();
+        entries.append(entry);
+    };
+
+    auto addTree = [&](const QFileInfo &info) {
+        addEntry(info);
+        if (!info.isDir()) {
+            return;
+        }
+        QDirIterator it(info.absoluteFilePath(), QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden,
+                        QDirIterator::Subdirectories);
+        while (it.hasNext() && entries.size() < BatchMaxFiles) {
+            it.next();
+            const QFileInfo child = it.fileInfo();
+            if (child.isSymLink()) {
+                continue; // No seguir enlaces: podrían salir de la raíz
+            }
+            addEntry(child);
+        }
+    };
+
+    for (const QString &pattern : patterns) {
+        const QString fileName = QFileInfo(pattern).fileName();
+        const bool isGlob = fileName.contains('*') || fileName.contains('?') || fileName.contains('[');
+        if (!isGlob) {
+            QString path = validateFilePath(pattern, true);
+            if (path.isEmpty()) {
+                path = validateFilePath(pattern, false);
+            }
+            if (path.isEmpty() || !QFileInfo::exists(path)) {
+                logDual("WARNING", QString("%1 - SITE MRETR: ruta no válida '%2'").arg(clientInfo).arg(pattern));
+                continue;
+            }
+            addTree(QFileInfo(path));
+            continue;
+        }
+
+        // Patrón: solo se admiten comodines en el último componente
+        QString parent = pattern.left(pattern.size() - fileName.size());
+        QString dirPath = validateFilePath(parent.isEmpty() ? QString(".") : parent, true);
+        if (dirPath.isEmpty() || !QFileInfo(dirPath).isDir()) {
+            logDual("WARNING", QString("%1 - SITE MRETR: directorio no válido en '%2'").arg(clientInfo).arg(pattern));
+            continue;
+        }
+        const QFileInfoList matches = QDir(dirPath).entryInfoList(QStringList() << fileName,
+            QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::NoSymLinks, QDir::Name);
+        for (const QFileInfo &match : matches) {
+            addTree(match);
+        }
+    }
+
+    if (entries.size() >= BatchMaxFiles) {
+        logDual("WARNING", QString("%1 - SITE MRETR: lote truncado a %2 entradas").arg(clientInfo).arg(BatchMaxFiles));
+    }
+    return !entries.isEmpty();
+}
+
+void FtpClientHandler::startBatchRetr(const QStringList &patterns)
+{
+    QList<TarBatchStream::Entry> entries;
+    if (!collectBatchEntries(patterns, entries)) {
+        sendResponse("550 Ningún archivo coincide.");
+        closeDataConnection();
+        return;
+    }
+
+    qint64 totalBytes = 0;
+    for (const TarBatchStream::Entry &entry : entries) {
+        totalBytes += entry.size;
+    }
+
+    m_batchStream = std::make_unique<TarBatchStream>(entries, TarBatchStream::Limits(), this,
+                                                     [this]() { pumpBatch(); });
+    bytesTransferred = 0;
+    transferActive = true;
+    transferTimer.start();
+
+    sendResponse(QString("150 Enviando %1 entradas (%2 bytes) como archivo tar.")
+                     .arg(entries.size()).arg(totalBytes));
+    if (!ensureDataProtection()) {
+        transferActive = false;
+        m_batchStream.reset();
+        return;
+    }
+
+    connect(dataSocket, &QTcpSocket::bytesWritten, this, &FtpClientHandler::onBytesWritten);
+    connect(dataSocket, &QTcpSocket::disconnected, this, [this]() {
+        transferActive = false;
+        pendingDataCommand = Command::None;
+        if (m_batchStream) {
+            qInfo() << QString("%1 - Lote enviado: %2 archivos, %3 bytes (%4 con errores)")
+                       .arg(clientInfo)
+                       .arg(m_batchStream->fileCount())
+                       .arg(bytesTransferred)
+                       .arg(m_batchStream->failedFiles());
+            m_batchStream.reset();
+        }
+        sendResponse("226 Transferencia completa.");
+        closeDataConnection();
+    });
+
+    pendingDataCommand = Command::BatchRetr;
+    pumpBatch();
+}
+
+void FtpClientHandler::pumpBatch()
+{
+    if (pendingDataCommand != Command::BatchRetr || !dataSocket || !m_batchStream) {
+        return;
+    }
+
+    while (!m_batchStream->atEnd() && dataSocket->bytesToWrite() < RetrWriteHighWater) {
+        BufferPool::Buffer buffer = BufferPool::instance().acquire();
+        if (buffer.isNull()) {
+            QTimer::singleShot(10, this, &FtpClientHandler::pumpBatch);
+            return;
+        }
+        qint64 produced = m_batchStream->read(buffer.data(), buffer.size());
+        if (produced == 0) {
+            break; // Esperando la lectura anticipada; avisará al terminar
+        }
+        dataSocket->write(buffer.data(), produced);
+    }
+
+    if (m_batchStream->atEnd()) {
+        pendingDataCommand = Command::None;
+        dataSocket->disconnectFromHost();
+    }
+}
+
+// =====================================================================================
+// Seccion: Subida por lotes (SITE UNTAR + STOR)
+// =====================================================================================
+
+void FtpClientHandler::handleSiteUntar(const QString &arg)
+{
+    const QString dir = arg.isEmpty() ? QString(".") : arg;
+    if (!permitted(dir, UserRules::Write)) {
+        return;
+    }
+    QString dirPath = validateFilePath(dir, true);
+    if (dirPath.isEmpty() || (QFileInfo::exists(dirPath) && !QFileInfo(dirPath).isDir())) {
+        sendResponse("550 Carpeta de destino inválida.");
+        return;
+    }
+    if (!QDir().mkpath(dirPath)) {
+        sendResponse("550 No se pudo crear la carpeta de destino.");
+        return;
+    }
+    DirectoryCache::instance().invalidate(QFileInfo(dirPath).absolutePath());
+    MetadataIndex::instance().refresh(dirPath);
+    FileNameIndex::instance().refresh(dirPath);
+    DirSizeIndex::instance().refresh(dirPath);
+    m_untarTarget = dirPath;
+    sendResponse(QString("200 El próximo STOR se extraerá como tar en \"%1\".").arg(dir));
+}
+
+void FtpClientHandler::startUntarStor()
+{
+    const QString target = m_untarTarget;
+    m_untarTarget.clear(); // Solo afecta al STOR siguiente
+
+    // Cada entrada pasa por las mismas reglas que cualquier ruta FTP y, además,
+    // tiene que quedar dentro de la carpeta de destino
+    const QString virtualTarget = m_rules->clientPath(Vfs::instance().virtualPathOf(target));
+    m_tarExtractor = std::make_unique<TarExtractor>([this, target, virtualTarget](const QString &name, bool isDir) {
+        if (name.startsWith('/') || name.split('/').contains("..")) {
+            return QString();
+        }
+        if (!m_rules->allows(QDir::cleanPath(virtualTarget + "/" + name), isDir ? UserRules::Mkdir : UserRules::Write)) {
+            return QString();
+        }
+        QString path = validateFilePath(virtualTarget + "/" + name, isDir);
+        if (path.isEmpty() || (path != target && !path.startsWith(target + "/"))) {
+            return QString();
+        }
+        return path;
+    });
+
+    // El tar ocupa algo más que lo que contiene: limitarlo a la cuota es conservador
+    const DirSizeIndex::Headroom room =
+        DirSizeIndex::instance().headroom(QDir(target).filePath(QStringLiteral("tar")), currentUser, m_homeLocal);
+    if (room.bytes == 0) {
+        m_tarExtractor.reset();
+        DirSizeIndex::instance().recordRejection();
+        sendResponse(QString("552 Cuota de espacio agotada (%1, límite %2 bytes).").arg(room.scope).arg(room.limit));
+        closeDataConnection();
+        return;
+    }
+    m_storLimit = room.bytes;
+    m_storQuotaExceeded = false;
+
+    bytesTransferred = 0;
+    transferActive = true;
+    transferTimer.start();
+
+    sendResponse("150 Listo para recibir el archivo tar.");
+    if (!ensureDataProtection()) {
+        transferActive = false;
+        m_tarExtractor.reset();
+        return;
+    }
+
+    connect(dataSocket, &QTcpSocket::readyRead, this, &FtpClientHandler::onDataReadyRead);
+    connect(dataSocket, &QTcpSocket::disconnected, this, [this, target]() {
+        transferActive = false;
+        if (!m_tarExtractor) {
+            return; // Ya se respondió con un error
+        }
+        onDataReadyRead(); // Lo que quedara en el buffer del socket
+        if (!m_tarExtractor) {
+            return;
+        }
+        const bool quotaExceeded = m_storQuotaExceeded;
+        m_storQuotaExceeded = false;
+        m_storLimit = -1;
+
+        // El 226 solo sale cuando todo está escrito en disco
+        TarExtractor::Result result = m_tarExtractor->finish();
+        m_tarExtractor.reset();
+        DirectoryCache::instance().invalidateTree(target);
+        MetadataIndex::instance().refresh(target);
+        FileNameIndex::instance().refresh(target);
+        DirSizeIndex::instance().refresh(target);
+        ChangeJournal::instance().record(ChangeJournal::Kind::Modify, target, true);
+        qInfo() << QString("%1 - Tar recibido: %2 archivos, %3 carpetas, %4 omitidos, %5 errores, %6 bytes")
+                   .arg(clientInfo).arg(result.files).arg(result.directories)
+                   .arg(result.skipped).arg(result.errors).arg(bytesTransferred);
+        if (quotaExceeded) {
+            // Lo ya extraído se queda: cuenta para la cuota como cualquier otro archivo
+            DirSizeIndex::instance().recordRejection();
+            sendResponse(QString("552 Cuota de espacio superada; extraídos %1 archivos antes del corte.")
+                             .arg(result.files));
+        } else if (result.errors > 0) {
+            sendResponse(QString("451 Extracción con %1 errores: %2").arg(result.errors).arg(result.firstError));
+        } else if (!result.complete) {
+            sendResponse("426 Conexión cerrada antes del final del archivo tar.");
+        } else {
+            sendResponse(QString("226 Extraídos %1 archivos y %2 carpetas (%3 omitidos).")
+                             .arg(result.files).arg(result.directories).arg(result.skipped));
+        }
+        closeDataConnection();
+    });
+}
+
+// =====================================================================================
+// Seccion: Diario de cambios (SITE CHANGES)
+// =====================================================================================
+
+void FtpClientHandler::handleSiteChanges(const QString &arg)
+{
+    ChangeJournal &journal = ChangeJournal::instance();
+    if (!journal.isEnabled()) {
+        sendResponse("502 El diario de cambios no está activo.");
+        return;
+    }
+    // El diario cubre todo el árbol: no se enseña a quien está limitado a su carpeta
+    if (m_rules->confined()) {
+        sendResponse("550 SITE CHANGES no está disponible para usuarios con carpeta personal.");
+        return;
+    }
+    // Sin argumento: la secuencia actual, para empezar a sincronizar desde ella
+    if (arg.isEmpty()) {
+        sendResponse(QString("200 Secuencia actual %1 (la más antigua disponible es %2).")
+                         .arg(journal.lastSequence()).arg(journal.firstSequence()));
+        return;
+    }
+    bool ok = false;
+    const quint64 since = arg.toULongLong(&ok);
+    if (!ok) {
+        sendResponse("501 Uso: SITE CHANGES [secuencia]");
+        return;
+    }
+    std::unique_ptr<ChangeJournal::Reader> reader = journal.openReader(since);
+    if (!reader) {
+        sendResponse(QString("550 La secuencia %1 ya no está en el diario (disponible desde %2 hasta %3); "
+                             "hace falta un recorrido completo.")
+                         .arg(since).arg(journal.firstSequence()).arg(journal.lastSequence()));
+        return;
+    }
+    if (!setupDataConnection()) return;
+
+    sendResponse(QString("150 Enviando los cambios posteriores a %1.").arg(since));
+    if (!ensureDataProtection()) {
+        return;
+    }
+    m_changeReader = std::move(reader);
+    m_listCacheable = false;
+    m_listFirstByte = true;
+    bytesTransferred = 0;
+    transferActive = true;
+    transferTimer.start();
+
+    connect(dataSocket, &QTcpSocket::bytesWritten, this, &FtpClientHandler::onBytesWritten);
+    connect(dataSocket, &QTcpSocket::disconnected, this, [this]() {
+        transferActive = false;
+        pendingDataCommand = Command::None;
+        if (!m_changeReader) {
+            sendResponse("226 Transferencia completa.");
+            closeDataConnection();
+            return;
+        }
+        const bool complete = m_changeReader->atEnd();
+        const quint64 last = m_changeReader->lastSequence();
+        m_changeReader.reset();
+        logDual("INFO", QString("%1 - Cambios enviados hasta la secuencia %2: %3 bytes")
+                   .arg(clientInfo).arg(last).arg(bytesTransferred));
+        sendResponse(complete ? QString("226 Cambios enviados hasta la secuencia %1.").arg(last)
+                              : QString("426 Envío de cambios interrumpido."));
+        closeDataConnection();
+    });
+
+    pendingDataCommand = Command::List;
+    pumpList();
+}
+
+// =====================================================================================
+// Seccion: Búsqueda por nombre (SITE FIND)
+// =====================================================================================
+
+void FtpClientHandler::handleSiteFind(const QString &arg)
+{
+    FileNameIndex &index = FileNameIndex::instance();
+    if (!index.isEnabled()) {
+        sendResponse("502 El índice de nombres no está activo.");
+        return;
+    }
+    if (arg.isEmpty()) {
+        sendResponse("501 Uso: SITE FIND <texto|comodín>");
+        return;
+    }
+    if (!index.isReady()) {
+        sendResponse("450 El índice de nombres aún se está construyendo; inténtelo más tarde.");
+        return;
+    }
+    if (!setupDataConnection()) return;
+
+    // Se busca bajo el directorio actual; las rutas salen relativas a la raíz
+    auto result = std::make_unique<FileNameIndex::Result>(index.search(arg, currentDir));
+    if (m_rules->confined() || m_rules->ruleCount() > 0) {
+        // Las rutas salen relativas a la raíz del servidor: se dejan relativas a la
+        // carpeta personal y se quitan las que el usuario no puede leer
+        QByteArray lines;
+        lines.reserve(result->lines.size());
+        int matches = 0;
+        for (const QByteArray &line : result->lines.split('\n')) {
+            const QString path = m_rules->clientPath(QString::fromUtf8(line.chopped(line.endsWith('\r') ? 1 : 0)));
+            if (path.isEmpty()) {
+                continue;
+            }
+            const bool isDir = path.size() > 1 && path.endsWith(QLatin1Char('/'));
+            if (!m_rules->allows(isDir ? path.chopped(1) : path, UserRules::Read)) {
+                continue;
+            }
+            lines += path.toUtf8() + "\r\n";
+            ++matches;
+        }
+        result->lines = lines;
+        result->matches = matches;
+    }
+    sendResponse(QString("150 %1 coincidencias para \"%2\".").arg(result->matches).arg(arg));
+    if (!ensureDataProtection()) {
+        return;
+    }
+    m_findResult = std::move(result);
+    m_findOffset = 0;
+    m_listCacheable = false;
+    m_listFirstByte = true;
+    bytesTransferred = 0;
+    transferActive = true;
+    transferTimer.start();
+
+    connect(dataSocket, &QTcpSocket::bytesWritten, this, &FtpClientHandler::onBytesWritten);
+    connect(dataSocket, &QTcpSocket::disconnected, this, [this, arg]() {
+        transferActive = false;
+        pendingDataCommand = Command::None;
+        if (!m_findResult) {
+            sendResponse("226 Transferencia completa.");
+            closeDataConnection();
+            return;
+        }
+        const bool complete = m_findOffset >= m_findResult->lines.size();
+        const int matches = m_findResult->matches;
+        const bool truncated = m_findResult->truncated;
+        m_findResult.reset();
+        logDual("INFO", QString("%1 - SITE FIND \"%2\": %3 coincidencias").arg(clientInfo, arg).arg(matches));
+        if (!complete) {
+            sendResponse("426 Envío de resultados interrumpido.");
+        } else if (truncated) {
+            sendResponse(QString("226 %1 coincidencias (resultado incompleto: acote la búsqueda).").arg(matches));
+        } else {
+            sendResponse(QString("226 %1 coincidencias.").arg(matches));
+        }
+        closeDataConnection();
+    });
+
+    pendingDataCommand = Command::List;
+    pumpList();
+}
+
+// =====================================================================================
+// Seccion: Tamaño de carpetas (SITE DU)
+// =====================================================================================
+
+void FtpClientHandler::handleSiteDu(const QString &arg)
+{
+    DirSizeIndex &index = DirSizeIndex::instance();
+    if (!index.isEnabled()) {
+        sendResponse("502 El índice de tamaños no está activo.");
+        return;
+    }
+    if (!permitted(arg, UserRules::Read)) {
+        return;
+    }
+    const QString dirPath = arg.isEmpty() ? currentDir : validateFilePath(arg, true);
+    if (dirPath.isEmpty()) {
+        sendResponse("550 Directorio no encontrado.");
+        return;
+    }
+    // Sin recorrer nada: el total ya está acumulado
+    DirSizeIndex::Totals totals;
+    if (!index.totals(dirPath, totals)) {
+        sendResponse("450 El tamaño de esta carpeta aún no está calculado; inténtelo más tarde.");
+        return;
+    }
+    QString reply = QString("200 %1 bytes en %2 archivos y %3 carpetas")
+                        .arg(totals.bytes).arg(totals.files).arg(totals.dirs);
+    const qint64 quota = index.directoryQuota(dirPath);
+    if (quota > 0) {
+        reply += QString(" (cuota de %1 bytes, %2% usado)").arg(quota).arg(100.0 * totals.bytes / quota, 0, 'f', 1);
+    }
+    sendResponse(reply + ".");
+}
+
+void FtpClientHandler::handleStor(const QString &fileName)
+{
+    const qint64 allocated = m_storAllocated;   // ALLO vale solo para este STOR
+    m_storAllocated = -1;
+    if (!setupDataConnection()) return;
+
+    if (!m_untarTarget.isEmpty()) {
+        startUntarStor();
+        return;
+    }
+    if (!permitted(fileName, UserRules::Write)) {
+        closeDataConnection();
+        return;
+    }
+
+    Vfs::Target target;
+    if (resolveVirtual(fileName, target)) {
+        startVirtualStor(target);
+        return;
+    }
+
+    QString filePath = validateFilePath(fileName, false); // false para archivos
+    if (filePath.isEmpty()) {
+        sendResponse("550 Nombre de archivo inválido.");
+        closeDataConnection();
+        return;
+    }
+    // Para el diario de cambios: alta o modificación; inotify no debe anotarlo aparte
+    const QFileInfo previous(filePath);
+    const bool existed = previous.exists();
+    const qint64 oldSize = existed ? previous.size() : -1;
+
+    // Cuotas: se decide antes de aceptar un solo byte. Lo que ocupaba el archivo
+    // que se sobrescribe queda libre. Si el cliente anunció el tamaño con ALLO,
+    // una subida que no cabe se rechaza aquí en lugar de cortarse a medias.
+    const DirSizeIndex::Headroom room = DirSizeIndex::instance().headroom(filePath, currentUser, m_homeLocal);
+    const qint64 available = room.bytes < 0 ? -1 : room.bytes + qMax<qint64>(0, oldSize);
+    if (available == 0 || (available > 0 && allocated > available)) {
+        DirSizeIndex::instance().recordRejection();
+        sendResponse(QString("552 Cuota de espacio %1 (%2, límite %3 bytes).")
+                         .arg(available == 0 ? "agotada" : "insuficiente").arg(room.scope).arg(room.limit));
+        closeDataConnection();
+        return;
+    }
+    m_storLimit = available;
+    m_storQuotaExceeded = false;
+    m_storFailed = false;
+
+    // Se escribe en un temporal oculto del mismo directorio y se renombra al
+    // terminar: una subida cortada nunca deja el archivo anterior a medias
+    const QString parentDir = QFileInfo(filePath).absolutePath();
+    const QString partialPath = parentDir + "/." + QFileInfo(filePath).fileName()
+                                + ".part-" + QString::number(++s_storSerial);
+    endStorOwnership();
+    discardStorPartial();
+    // El destino solo cambia con el renombrado final; el temporal es solo del servidor
+    ChangeJournal::instance().beginOwn(filePath, ChangeJournal::kindBit(ChangeJournal::Kind::Create)
+                                                     | ChangeJournal::kindBit(ChangeJournal::Kind::Modify));
+    ChangeJournal::instance().beginOwn(partialPath, ChangeJournal::AnyKind);
+    m_storOwned = QStringList{filePath, partialPath};
+    m_storPartial = partialPath;
+
+    // Limpiar archivo anterior si existe
+    if (file) {
+        file->close();
+        file->deleteLater();
+        file = nullptr;
+    }
+
+    // Rutas configuradas para E/S directa: escribir sin caché desde el principio
+    m_directWriter.reset();
+    if (DirectIoPolicy::instance().matchesPath(filePath)) {
+        m_directWriter = std::make_unique<DirectFileWriter>(DirectIoPolicy::instance().queueDepth());
+        if (!m_directWriter->open(partialPath)) {
+            m_directWriter.reset();
+        }
+    }
+
+    if (!m_directWriter) {
+        file = new QFile(partialPath, this);
+        if (!file->open(QIODevice::WriteOnly)) {
+            sendResponse("550 No se pudo crear el archivo.");
+            file->deleteLater();
+            file = nullptr;
+            discardStorPartial();
+            endStorOwnership();
+            closeDataConnection();
+            return;
+        }
+    }
+
+    // Inicializar variables de transferencia
+    bytesTransferred = 0;
+    transferActive = true;
+    transferTimer.start();
+    m_ioDevice = IoScheduler::deviceFor(file ? file->handle() : -1, partialPath);
+
+    sendResponse("150 Listo para recibir datos.");
+    if (!ensureDataProtection()) {
+        transferActive = false;
+        m_directWriter.reset();
+        if (file) {
+            file->close();
+            file->deleteLater();
+            file = nullptr;
+        }
+        discardStorPartial();
+        endStorOwnership();
+        return;
+    }
+
+    // Conectar la función onDataReadyRead para manejar los datos entrantes
+    connect(dataSocket, &QTcpSocket::readyRead, this, &FtpClientHandler::onDataReadyRead);
+
+    connect(dataSocket, &QTcpSocket::disconnected, this, [this, parentDir, filePath, partialPath, existed, oldSize]() {
+        transferActive = false;
+        m_storLimit = -1;
+        if (m_storFailed) {
+            // Error de escritura: el 426 ya salió; el temporal a medias no sustituye a nada
+            m_storFailed = false;
+            m_directWriter.reset();
+            if (file) {
+                file->close();
+                file->deleteLater();
+                file = nullptr;
+            }
+            discardStorPartial();
+            endStorOwnership();
+            logDual("WARNING", QString("%1 - Subida fallida tras %2 bytes; se descarta: %3")
+                       .arg(clientInfo).arg(bytesTransferred).arg(filePath));
+            return;
+        }
+        if (m_storQuotaExceeded) {
+            // Cuota superada a mitad de subida: se descarta el temporal y el
+            // archivo anterior, si lo había, sigue intacto
+            m_storQuotaExceeded = false;
+            m_directWriter.reset();
+            if (file) {
+                file->close();
+                file->deleteLater();
+                file = nullptr;
+            }
+            discardStorPartial();
+            endStorOwnership();
+            DirSizeIndex::instance().recordRejection();
+            logDual("WARNING", QString("%1 - Subida cortada por cuota tras %2 bytes: %3")
+                       .arg(clientInfo).arg(bytesTransferred).arg(filePath));
+            sendResponse(existed ? "552 Cuota de espacio superada durante la subida; se conserva la versión anterior."
+                                 : "552 Cuota de espacio superada durante la subida; archivo descartado.");
+            closeDataConnection();
+            return;
+        }
+        if (m_directWriter) {
+            onDataReadyRead(); // Lo que quede en el socket antes de cerrar el archivo
+        }
+        if (m_storFailed || m_storQuotaExceeded) {
+            // Lo último que quedaba en el socket falló o no cabía: ya no se sustituye el archivo
+            const bool quota = m_storQuotaExceeded;
+            m_storFailed = false;
+            m_storQuotaExceeded = false;
+            m_directWriter.reset();
+            discardStorPartial();
+            endStorOwnership();
+            if (quota) {
+                DirSizeIndex::instance().recordRejection();
+                sendResponse("552 Cuota de espacio superada durante la subida; archivo descartado.");
+            }
+            closeDataConnection();
+            return;
+        }
+        if (m_directWriter) {
+            std::unique_ptr<DirectFileWriter> writer = std::move(m_directWriter);
+            if (!writer->finish()) {
+                discardStorPartial();
+                endStorOwnership();
+                qWarning() << QString("%1 - Error en la escritura directa: %2").arg(clientInfo).arg(writer->errorString());
+                sendResponse("451 Error de escritura en el servidor.");
+                closeDataConnection();
+                return;
+            }
+            qInfo() << QString("%1 - Archivo recibido sin caché: %2 bytes transferidos")
+                       .arg(clientInfo)
+                       .arg(bytesTransferred);
+        }
+        if (file) {
+            const bool flushed = file->flush();    // Lo que quede en el buffer de QFile
+            file->close();
+            if (!flushed) {
+                file->deleteLater();
+                file = nullptr;
+                discardStorPartial();
+                endStorOwnership();
+                sendResponse("451 Error de escritura en el servidor.");
+                closeDataConnection();
+                return;
+            }
+            qInfo() << QString("%1 - Archivo recibido: %2 bytes transferidos")
+                       .arg(clientInfo)
+                       .arg(bytesTransferred);
+            file->deleteLater();
+            file = nullptr;
+        }
+
+        // El archivo nuevo conserva los permisos del que sustituye
+        if (existed) {
+            QFile::setPermissions(partialPath, QFile::permissions(filePath));
+        }
+        if (!replaceFile(partialPath, filePath)) {
+            discardStorPartial();
+            endStorOwnership();
+            qWarning() << QString("%1 - No se pudo renombrar la subida a %2").arg(clientInfo).arg(filePath);
+            sendResponse("451 No se pudo guardar el archivo en el servidor.");
+            closeDataConnection();
+            return;
+        }
+        m_storPartial.clear();
+        endStorOwnership();     // Lo que se anote abajo lleva su propia ventana
+
+        DirectoryCache::instance().invalidate(parentDir); // Tamaño y fecha definitivos
+        MetadataIndex::instance().refresh(filePath);
+        FileNameIndex::instance().refresh(filePath);
+        ChangeJournal::instance().record(existed ? ChangeJournal::Kind::Modify : ChangeJournal::Kind::Create,
+                                         filePath, false);
+        DirSizeIndex::instance().fileChanged(filePath, oldSize, QFileInfo(filePath).size());
+        sendResponse("226 Transferencia completa.");
+        closeDataConnection();
+    });
+}
+
+bool FtpClientHandler::switchStorToDirect()
+{
+    // La subida ha superado el umbral: seguir escribiendo sin caché desde donde va
+    if (!file->flush()) {
+        return false;
+    }
+    auto writer = std::make_unique<DirectFileWriter>(DirectIoPolicy::instance().queueDepth());
+    if (!writer->open(file->fileName(), file->size())) {
+        return false;
+    }
+    logDual("INFO", QString("%1 - STOR pasa a E/S directa tras %2 bytes").arg(clientInfo).arg(file->size()));
+    file->close();
+    file->deleteLater();
+    file = nullptr;
+    m_directWriter = std::move(writer);
+    return true;
+}
+
+void FtpClientHandler::endStorOwnership()
+{
+    if (!m_storOwned.isEmpty()) {
+        for (const QString &path : std::as_const(m_storOwned)) {
+            ChangeJournal::instance().endOwn(path);
+        }
+        m_storOwned.clear();
+    }
+}
+
+void FtpClientHandler::discardStorPartial()
+{
+    // El temporal de un STOR que no llegó a renombrarse
+    if (!m_storPartial.isEmpty()) {
+        QFile::remove(m_storPartial);
+        m_storPartial.clear();
+    }
+}
+
+void FtpClientHandler::handleMkd(const QString &path)
+{
+    if (!permitted(path, UserRules::Mkdir)) {
+        return;
+    }
+    Vfs::Target target;
+    if (resolveVirtual(path, target)) {
+        sendResponse(target.backend->mkdir(target.path) ? "257 Directorio creado." : "550 No se pudo crear el directorio.");
+        return;
+    }
+
+    QString newDirPath = validateFilePath(path, true);
+    if (newDirPath.isEmpty()) {
+        sendResponse("550 Ruta inválida.");
+        return;
+    }
+
+    QDir dir;
+    if (dir.mkpath(newDirPath)) {
+        // mkpath puede haber creado también carpetas intermedias
+        DirectoryCache::instance().invalidate(QFileInfo(newDirPath).absolutePath());
+        DirectoryCache::instance().invalidateTree(newDirPath);
+        MetadataIndex::instance().refresh(newDirPath);
+        FileNameIndex::instance().refresh(newDirPath);
+        DirSizeIndex::instance().refresh(newDirPath);
+        ChangeJournal::instance().record(ChangeJournal::Kind::Create, newDirPath, true);
+        sendResponse("257 Directorio creado.");
+    } else {
+        sendResponse("550 No se pudo crear el directorio.");
+    }
+}
+
+void FtpClientHandler::handleRmd(const QString &path)
+{
+    if (!permitted(path, UserRules::Delete)) {
+        return;
+    }
+    // Ni la raíz ni un punto de montaje
+    Vfs::Target target;
+    if (resolveVirtual(path, target)) {
+        VfsBackend::Entry entry;
+        if (target.path.isEmpty() || !target.backend->stat(target.path, entry) || !entry.isDir) {
+            sendResponse("550 No se puede eliminar este directorio.");
+        } else if (target.backend->rmdir(target.path)) {
+            sendResponse("250 Directorio eliminado.");
+        } else {
+            sendResponse("550 No se pudo eliminar el directorio.");
+        }
+        return;
+    }
+    QString dirPath = validateFilePath(path, true, target);
+    if (dirPath.isEmpty() || target.path.isEmpty()) {
+        sendResponse("550 No se puede eliminar este directorio.");
+        return;
+    }
+
+    QDir dir(dirPath);
+    ChangeJournal::instance().beginOwn(dirPath, ChangeJournal::kindBit(ChangeJournal::Kind::Delete), true);
+    const bool removed = dir.removeRecursively();
+    // Aunque falle a medias puede haber borrado parte del contenido
+    DirectoryCache::instance().invalidateTree(dirPath);
+    DirectoryCache::instance().invalidate(QFileInfo(dirPath).absolutePath());
+    MetadataIndex::instance().refresh(dirPath);
+    FileNameIndex::instance().refresh(dirPath);
+    if (removed) {
+        DirSizeIndex::instance().directoryRemoved(dirPath);
+    } else {
+        DirSizeIndex::instance().refresh(dirPath);
+    }
+    // Borrado a medias: el cliente tiene que volver a listar lo que queda
+    ChangeJournal::instance().record(removed ? ChangeJournal::Kind::Delete : ChangeJournal::Kind::Modify,
+                                     dirPath, true);
+    if (removed) {
+        sendResponse("250 Directorio eliminado.");
+    } else {
+        sendResponse("550 No se pudo eliminar el directorio.");
+    }
+}
+
+void FtpClientHandler::handleDele(const QString &fileName)
+{
+    if (!permitted(fileName, UserRules::Delete)) {
+        return;
+    }
+    Vfs::Target target;
+    if (resolveVirtual(fileName, target)) {
+        VfsBackend::Entry entry;
+        if (!target.backend->stat(target.path, entry) || entry.isDir) {
+            sendResponse("550 Archivo no encontrado.");
+        } else {
+            sendResponse(target.backend->unlink(target.path) ? "250 Archivo eliminado." : "550 No se pudo eliminar el archivo.");
+        }
+        return;
+    }
+
+    QString filePath = validateFilePath(fileName, false);
+    if (filePath.isEmpty()) {
+        sendResponse("550 Archivo no encontrado.");
+        return;
+    }
+
+    const qint64 size = QFileInfo(filePath).size();
+    if (QFile::remove(filePath)) {
+        DirectoryCache::instance().invalidate(QFileInfo(filePath).absolutePath());
+        MetadataIndex::instance().refresh(filePath);
+        FileNameIndex::instance().refresh(filePath);
+        DirSizeIndex::instance().fileChanged(filePath, size, -1);
+        ChangeJournal::instance().record(ChangeJournal::Kind::Delete, filePath, false);
+        sendResponse("250 Archivo eliminado.");
+    } else {
+        sendResponse("550 No se pudo eliminar el archivo.");
+    }
+}
+
+void FtpClientHandler::handleRnfr(const QString &path)
+{
+    // Renombrar quita la entrada de su sitio: hace falta poder borrarla
+    if (!permitted(path, UserRules::Delete)) {
+        return;
+    }
+    Vfs::Target target;
+    if (resolveVirtual(path, target)) {
+        VfsBackend::Entry entry;
+        if (target.path.isEmpty() || !target.backend->stat(target.path, entry)) {
+            sendResponse("550 Archivo o directorio no encontrado.");
+            return;
+        }
+        m_renameFrom = target;
+        m_renameFromLocal.clear();
+        m_renameFromIsDir = entry.isDir;
+        sendResponse("350 Listo para RNTO.");
+        return;
+    }
+    QString fromPath = validateFilePath(path, false, target);
+    if (fromPath.isEmpty()) {
+        fromPath = validateFilePath(path, true, target);
+    }
+    const QFileInfo info(fromPath);
+    // Un punto de montaje no se puede mover
+    if (fromPath.isEmpty() || target.path.isEmpty() || !(info.exists() || info.isSymLink())) {
+        sendResponse("550 Archivo o directorio no encontrado.");
+        return;
+    }
+    m_renameFrom = target;
+    m_renameFromLocal = fromPath;
+    m_renameFromIsDir = info.isDir() && !info.isSymLink();
+    sendResponse("350 Listo para RNTO.");
+}
+
+void FtpClientHandler::handleRnto(const QString &path)
+{
+    if (!m_renameFrom.isValid()) {
+        sendResponse("503 Envíe RNFR primero.");
+        return;
+    }
+    const Vfs::Target from = m_renameFrom;
+    const QString fromPath = m_renameFromLocal;
+    const bool isDir = m_renameFromIsDir;
+    m_renameFrom = Vfs::Target();
+    if (!permitted(path, isDir ? UserRules::Mkdir : UserRules::Write)) {
+        return;
+    }
+    if (from.isVirtual()) {
+        renameVirtual(from, isDir, path);
+        return;
+    }
+
+    Vfs::Target target;
+    const QString toPath = validateFilePath(path, isDir, target);
+    // Cada montaje es un sistema de archivos aparte
+    if (target.isValid() && target.backend != from.backend) {
+        sendResponse("553 No se puede renombrar entre montajes distintos.");
+        return;
+    }
+    if (toPath.isEmpty() || target.path.isEmpty()) {
+        sendResponse("553 Nombre de destino no válido.");
+        return;
+    }
+    // Una carpeta dentro de sí misma, o encima de otra carpeta
+    if ((isDir && PathResolver::isInside(fromPath, toPath)) || (isDir && QFileInfo::exists(toPath))) {
+        sendResponse("553 El destino no es válido para esta carpeta.");
+        return;
+    }
+
+    const qint64 size = isDir ? 0 : QFileInfo(fromPath).size();
+    const QFileInfo replaced(toPath);
+    const qint64 replacedSize = !isDir && replaced.isFile() ? replaced.size() : -1;
+    if (!target.backend->rename(from.path, target.path)) {
+        logDual("WARNING", QString("%1 - No se pudo renombrar '%2' a '%3'").arg(clientInfo).arg(fromPath).arg(toPath));
+        sendResponse("550 No se pudo renombrar.");
+        return;
+    }
+
+    DirectoryCache::instance().invalidate(QFileInfo(fromPath).absolutePath());
+    DirectoryCache::instance().invalidate(QFileInfo(toPath).absolutePath());
+    if (isDir) {
+        DirectoryCache::instance().invalidateTree(fromPath);
+        DirectoryCache::instance().invalidateTree(toPath);
+    }
+    MetadataIndex::instance().refresh(fromPath);
+    MetadataIndex::instance().refresh(toPath);
+    FileNameIndex::instance().refresh(fromPath);
+    FileNameIndex::instance().refresh(toPath);
+    if (isDir) {
+        DirSizeIndex::instance().directoryRemoved(fromPath);
+        DirSizeIndex::instance().refresh(toPath);
+    } else {
+        DirSizeIndex::instance().fileChanged(fromPath, size, -1);
+        DirSizeIndex::instance().fileChanged(toPath, replacedSize, size);
+    }
+    ChangeJournal::instance().record(ChangeJournal::Kind::Rename, fromPath, isDir, toPath);
+    logDual("INFO", QString("%1 - Renombrado '%2' a '%3'").arg(clientInfo).arg(fromPath).arg(toPath));
+    sendResponse("250 Renombrado.");
+}
+
+// =====================================================================================
+// Seccion: Montajes no locales
+// =====================================================================================
+
+bool FtpClientHandler::resolveVirtual(const QString &path, Vfs::Target &target)
+{
+    const QString virtualPath = PathResolver::normalize(path, m_currentVirtual);
+    if (virtualPath.isEmpty()) {
+        return false;
     }
+    target = resolveSession(virtualPath);
+    return target.isVirtual();
 }
 
-void FtpClientHandler::handleRetr(const QString &fileName)
+void FtpClientHandler::startVirtualListing(const Vfs::Target &target, DirectoryLister::Format format, bool showHidden)
 {
-    if (!setupDataConnection()) return;
-
-    QString filePath = validateFilePath(fileName, false);
-    if (filePath.isEmpty()) {
-        sendResponse("550 Archivo no encontrado.");
+    // Sin caché de listados ni -R: el backend ya lo tiene en memoria o lo calcula
+    std::shared_ptr<VfsBackend::Lister> source = target.backend->list(target.path);
+    if (!source) {
+        sendResponse("550 Directorio no existe.");
         closeDataConnection();
         return;
     }
+    auto lister = std::make_unique<DirectoryLister>();
+    // El backend sigue vivo mientras dure el listado aunque se desmonte
+    std::shared_ptr<VfsBackend> backend = target.backend;
+    lister->openSource([backend, source](std::vector<DirectoryLister::NamedEntry> &out, int maxEntries) {
+        return source->next(out, maxEntries);
+    }, showHidden, format);
 
-    // Limpiar archivo anterior si existe
-    if (file) {
-        file->close();
-        file->deleteLater();
-        file = nullptr;
+    sendResponse("150 Abriendo conexión de datos para la lista de directorios.");
+    if (!ensureDataProtection()) {
+        return;
     }
+    beginListing(std::move(lister), QString(), format, 0, 0);
+}
 
-    file = new QFile(filePath, this);
-    if (!file->open(QIODevice::ReadOnly)) {
-        sendResponse("550 No se pudo abrir el archivo.");
-        file->deleteLater();
-        file = nullptr;
+void FtpClientHandler::startVirtualRetr(const Vfs::Target &target)
+{
+    m_vfsSource = target.backend->openSource(target.path);
+    if (!m_vfsSource) {
+        sendResponse("550 Archivo no encontrado.");
         closeDataConnection();
         return;
     }
 
-    // Inicializar variables de transferencia
     bytesTransferred = 0;
-    bytesRemaining = file->size();
+    bytesRemaining = m_vfsSource->size();
+    retrOffset = 0;
     transferActive = true;
     transferTimer.start();
 
     sendResponse("150 Abriendo conexión de datos para la transferencia de archivos.");
+    if (!ensureDataProtection()) {
+        transferActive = false;
+        m_vfsSource.reset();
+        return;
+    }
 
     connect(dataSocket, &QTcpSocket::bytesWritten, this, &FtpClientHandler::onBytesWritten);
-
     connect(dataSocket, &QTcpSocket::disconnected, this, [this]() {
         transferActive = false;
-        if (file) {
-            file->close();
-            qInfo() << QString("%1 - Archivo enviado: %2 bytes transferidos")
-                       .arg(clientInfo)
-                       .arg(bytesTransferred);
-            file->deleteLater();
-            file = nullptr;
-        }
-        sendResponse("226 Transferencia completa.");
+        pendingDataCommand = Command::None;
+        const bool complete = bytesRemaining == 0;
+        m_vfsSource.reset();
+        qInfo() << QString("%1 - Archivo enviado desde un montaje virtual: %2 bytes transferidos")
+                   .arg(clientInfo)
+                   .arg(bytesTransferred);
+        sendResponse(complete ? "226 Transferencia completa." : "426 Transferencia interrumpida.");
         closeDataConnection();
     });
 
-    // Enviar archivo en chunks para permitir control de velocidad
-    QByteArray fileData = file->readAll();
-    dataSocket->write(fileData);
-    dataSocket->disconnectFromHost(); // Iniciar el cierre
+    pendingDataCommand = Command::Retr;
+    pumpRetr();
 }
 
-void FtpClientHandler::handleStor(const QString &fileName)
+void FtpClientHandler::pumpRetrVirtual()
 {
-    if (!setupDataConnection()) return;
-
-    QString filePath = validateFilePath(fileName, false); // false para archivos
-    if (filePath.isEmpty()) {
-        sendResponse("550 Nombre de archivo inválido.");
-        closeDataConnection();
-        return;
+    // Los bloques vienen de la memoria del backend: sin pool ni planificador de E/S
+    bool failed = false;
+    while (bytesRemaining > 0 && dataSocket->bytesToWrite() < RetrWriteHighWater) {
+        const char *data = nullptr;
+        const qint64 length = m_vfsSource->map(retrOffset, qMin(bytesRemaining, RetrWriteHighWater), &data);
+        if (length <= 0) {
+            qWarning() << QString("%1 - Error leyendo del montaje virtual para RETR").arg(clientInfo);
+            failed = true;  // Se cierra con bytes pendientes: 426
+            break;
+        }
+        dataSocket->write(data, length);
+        retrOffset += length;
+        bytesRemaining -= length;
     }
 
-    // Limpiar archivo anterior si existe
-    if (file) {
-        file->close();
-        file->deleteLater();
-        file = nullptr;
+    if (bytesRemaining == 0 || failed) {
+        pendingDataCommand = Command::None;
+        dataSocket->disconnectFromHost();
     }
+}
 
-    file = new QFile(filePath, this);
-    if (!file->open(QIODevice::WriteOnly)) {
+void FtpClientHandler::startVirtualStor(const Vfs::Target &target)
+{
+    m_vfsSink = target.backend->openSink(target.path, 0);
+    if (!m_vfsSink) {
         sendResponse("550 No se pudo crear el archivo.");
-        file->deleteLater();
-        file = nullptr;
         closeDataConnection();
         return;
     }
 
-    // Inicializar variables de transferencia
+    // Las cuotas solo cuentan la carpeta raíz en disco
+    m_storLimit = -1;
+    m_storQuotaExceeded = false;
     bytesTransferred = 0;
     transferActive = true;
     transferTimer.start();
 
     sendResponse("150 Listo para recibir datos.");
+    if (!ensureDataProtection()) {
+        transferActive = false;
+        m_vfsSink.reset();
+        return;
+    }
 
-    // Conectar la función onDataReadyRead para manejar los datos entrantes
     connect(dataSocket, &QTcpSocket::readyRead, this, &FtpClientHandler::onDataReadyRead);
-
     connect(dataSocket, &QTcpSocket::disconnected, this, [this]() {
         transferActive = false;
-        if (file) {
-            file->close();
-            qInfo() << QString("%1 - Archivo recibido: %2 bytes transferidos")
-                       .arg(clientInfo)
-                       .arg(bytesTransferred);
-            file->deleteLater();
-            file = nullptr;
+        if (m_vfsSink) {
+            onDataReadyRead(); // Lo que quede en el socket
+        }
+        std::unique_ptr<VfsBackend::Sink> sink = std::move(m_vfsSink);
+        if (!sink) {
+            closeDataConnection(); // El fallo de escritura ya se respondió
+            return;
+        }
+        if (!sink->finish()) {
+            sendResponse("451 Error de escritura en el servidor.");
+            closeDataConnection();
+            return;
         }
+        qInfo() << QString("%1 - Archivo recibido en un montaje virtual: %2 bytes transferidos")
+                   .arg(clientInfo)
+                   .arg(bytesTransferred);
         sendResponse("226 Transferencia completa.");
         closeDataConnection();
     });
 }
 
-void FtpClientHandler::handleMkd(const QString &path)
+void FtpClientHandler::renameVirtual(const Vfs::Target &from, bool isDir, const QString &path)
 {
-    QString newDirPath = validateFilePath(path, true);
-    if (newDirPath.isEmpty()) {
-        sendResponse("550 Ruta inválida.");
+    Vfs::Target target;
+    if (!resolveVirtual(path, target) || target.path.isEmpty()) {
+        sendResponse(target.isValid() && target.backend != from.backend
+                     ? "553 No se puede renombrar entre montajes distintos." : "553 Nombre de destino no válido.");
         return;
     }
-
-    QDir dir;
-    if (dir.mkpath(newDirPath)) {
-        sendResponse("257 Directorio creado.");
-    } else {
-        sendResponse("550 No se pudo crear el directorio.");
-    }
-}
-
-void FtpClientHandler::handleRmd(const QString &path)
-{
-    QString dirPath = validateFilePath(path, true);
-    if (dirPath.isEmpty() || dirPath == m_server->getRootDir()) {
-        sendResponse("550 No se puede eliminar este directorio.");
+    if (target.backend != from.backend) {
+        sendResponse("553 No se puede renombrar entre montajes distintos.");
         return;
     }
-
-    QDir dir(dirPath);
-    if (dir.removeRecursively()) {
-        sendResponse("250 Directorio eliminado.");
-    } else {
-        sendResponse("550 No se pudo eliminar el directorio.");
-    }
-}
-
-void FtpClientHandler::handleDele(const QString &fileName)
-{
-    QString filePath = validateFilePath(fileName, false);
-    if (filePath.isEmpty()) {
-        sendResponse("550 Archivo no encontrado.");
+    VfsBackend::Entry existing;
+    if (isDir && (target.path.startsWith(from.path + "/") || target.backend->stat(target.path, existing))) {
+        sendResponse("553 El destino no es válido para esta carpeta.");
         return;
     }
-
-    if (QFile::remove(filePath)) {
-        sendResponse("250 Archivo eliminado.");
-    } else {
-        sendResponse("550 No se pudo eliminar el archivo.");
+    if (!target.backend->rename(from.path, target.path)) {
+        sendResponse("550 No se pudo renombrar.");
+        return;
     }
+    logDual("INFO", QString("%1 - Renombrado '%2' a '%3' en %4")
+               .arg(clientInfo).arg(from.path).arg(target.path).arg(from.mountPoint));
+    sendResponse("250 Renombrado.");
 }
 
 // =====================================================================================
@@ -698,7 +2571,7 @@ void FtpClientHandler::handlePasv()
     }
     
     // Crear nuevo servidor pasivo
-    passiveServer = new QTcpServer(this);
+    passiveServer = new DataConnectionServer(this);
     connect(passiveServer, &QTcpServer::newConnection, this, &FtpClientHandler::onNewDataConnection);
 
     // Intentar escuchar en un puerto disponible
@@ -758,6 +2631,8 @@ void FtpClientHandler::handlePasv()
 
 bool FtpClientHandler::setupDataConnection()
 {
+    // Puede esperar al cliente, que a su vez puede estar esperando una respuesta (227)
+    flushResponses();
     qDebug() << QString("%1 - Configurando conexión de datos. Modo: %2")
                 .arg(clientInfo)
                 .arg(dataSocketIp.isEmpty() ? "PASIVO" : "ACTIVO");
@@ -835,7 +2710,7 @@ bool FtpClientHandler::setupDataConnection()
             dataSocket = nullptr;
         }
         
-        dataSocket = new QTcpSocket(this);
+        dataSocket = newDataSocket(this);
         dataSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
         
         qInfo() << QString("%1 - INTENTO 1: Conexión directa").arg(clientInfo);
@@ -851,7 +2726,7 @@ bool FtpClientHandler::setupDataConnection()
         dataSocket = nullptr;
         
         // INTENTO 2: Con bind explícito
-        dataSocket = new QTcpSocket(this);
+        dataSocket = newDataSocket(this);
         QString serverIp = socket->localAddress().toString();
         if (serverIp.startsWith("::ffff:")) {
             serverIp = serverIp.mid(7);
@@ -876,7 +2751,7 @@ bool FtpClientHandler::setupDataConnection()
         
         for (int i = 0; i < 5; i++) {
             quint16 testPort = dataSocketPort + i;
-            dataSocket = new QTcpSocket(this);
+            dataSocket = newDataSocket(this);
             
             qDebug() << QString("%1 - Probando puerto %2").arg(clientInfo).arg(testPort);
             dataSocket->connectToHost(QHostAddress(dataSocketIp), testPort);
@@ -969,31 +2844,104 @@ void FtpClientHandler::onDataReadyRead()
         qWarning() << "onDataReadyRead: dataSocket no está disponible";
         return;
     }
+    if (m_storQuotaExceeded || m_storFailed) {
+        dataSocket->readAll(); // Se descarta hasta que se cierre
+        return;
+    }
 
     // Esta función se usa principalmente para operaciones STOR (subida de archivos)
     // donde el cliente envía datos al servidor
     
-    QByteArray data = dataSocket->readAll();
-    if (data.isEmpty()) {
+    if (dataSocket->bytesAvailable() <= 0) {
         return;
     }
 
-    bytesTransferred += data.size();
-    
-    // Aplicar límite de velocidad si está configurado
-    applySpeedLimit();
-    
-    // Si hay un archivo abierto para escritura (comando STOR)
-    if (file && file->isOpen() && file->isWritable()) {
-        qint64 written = file->write(data);
-        if (written != data.size()) {
-            qWarning() << "Error escribiendo datos al archivo. Esperado:" << data.size() << "Escrito:" << written;
-            sendResponse("426 Error de transferencia: fallo al escribir archivo.");
-            closeDataConnection();
+    // Leer por bloques del pool en lugar de reservar un QByteArray nuevo por lectura
+    while (dataSocket && dataSocket->bytesAvailable() > 0) {
+        BufferPool::Buffer buffer = BufferPool::instance().acquire();
+        QByteArray fallback;
+        char *chunk = buffer.data();
+        qint64 chunkSize = buffer.size();
+        if (buffer.isNull()) {
+            // Pool agotado: no se pueden dejar datos sin leer, usar memoria temporal
+            fallback.resize(BufferPool::instance().blockSize());
+            chunk = fallback.data();
+            chunkSize = fallback.size();
+        }
+
+        qint64 bytesRead = dataSocket->read(chunk, chunkSize);
+        if (bytesRead <= 0) {
+            break;
+        }
+        bytesTransferred += bytesRead;
+
+        // Cuota superada: lo que llegue ya no se escribe y la subida se corta
+        if (m_storLimit >= 0 && bytesTransferred > m_storLimit) {
+            m_storQuotaExceeded = true;
+            dataSocket->disconnectFromHost();
             return;
         }
+
+        // SITE UNTAR: el flujo es un tar que se extrae sobre la marcha
+        if (m_tarExtractor) {
+            if (!m_tarExtractor->feed(chunk, bytesRead)) {
+                m_tarExtractor->finish();
+                m_tarExtractor.reset();
+                sendResponse("451 El flujo recibido no es un archivo tar válido.");
+                closeDataConnection();
+                return;
+            }
+            continue;
+        }
+
+        if (m_vfsSink) {
+            if (m_vfsSink->write(chunk, bytesRead) != bytesRead) {
+                m_vfsSink.reset();
+                sendResponse("426 Error de transferencia: fallo al escribir archivo.");
+                closeDataConnection();
+                return;
+            }
+            continue;
+        }
+
+        if (m_directWriter) {
+            if (!m_directWriter->write(chunk, bytesRead)) {
+                qWarning() << "Error en la escritura directa:" << m_directWriter->errorString();
+                m_directWriter.reset();
+                m_storFailed = true;    // El disconnected del STOR descarta el temporal
+                sendResponse("426 Error de transferencia: fallo al escribir archivo.");
+                closeDataConnection();
+                return;
+            }
+            continue;
+        }
+
+        // Si hay un archivo abierto para escritura (comando STOR)
+        if (file && file->isOpen() && file->isWritable()) {
+            IoScheduler::Ticket io = IoScheduler::instance().acquire(m_ioDevice, IoScheduler::Kind::Write);
+            qint64 written = file->write(chunk, bytesRead);
+            io.release();
+            if (written != bytesRead) {
+                qWarning() << "Error escribiendo datos al archivo. Esperado:" << bytesRead << "Escrito:" << written;
+                m_storFailed = true;    // El disconnected del STOR descarta el temporal
+                sendResponse("426 Error de transferencia: fallo al escribir archivo.");
+                closeDataConnection();
+                return;
+            }
+            const qint64 threshold = DirectIoPolicy::instance().threshold();
+            if (threshold > 0 && DirectIoPolicy::isSupported() &&
+                file->pos() >= threshold && file->pos() - bytesRead < threshold) {
+                switchStorToDirect(); // Si falla, la subida sigue por la caché de páginas
+            }
+        }
+    }
+
+    if (file && file->isOpen() && file->isWritable()) {
         file->flush(); // Asegurar que los datos se escriban al disco
     }
+
+    // Solo registra la velocidad: el límite frena los envíos de RETR
+    applySpeedLimit();
     
     // Emitir progreso de transferencia
     emit transferProgress(bytesTransferred, bytesRemaining > 0 ? bytesRemaining : bytesTransferred);
@@ -1011,7 +2959,9 @@ void FtpClientHandler::onDataReadyRead()
 void FtpClientHandler::onBytesWritten(qint64 bytesWritten)
 {
     bytesTransferred += bytesWritten;
-    applySpeedLimit();
+    pumpRetr();
+    pumpBatch();
+    pumpList();
 }
 
 void FtpClientHandler::onDataConnectionClosed()
@@ -1024,6 +2974,7 @@ void FtpClientHandler::onDataConnectionClosed()
 
 void FtpClientHandler::closeDataConnection()
 {
+    releaseRetrNotifier();  // Su descriptor deja de ser válido al cerrar el socket
     if (dataSocket && dataSocket->isOpen()) {
         dataSocket->close();
     }
@@ -1032,11 +2983,21 @@ void FtpClientHandler::closeDataConnection()
     }
     dataSocketIp.clear();
     dataSocketPort = 0;
+#ifdef HAVE_SSL
+    m_secureData = false;
+#endif
 }
 
 void FtpClientHandler::forceDisconnect()
 {
+    // Desde la consola u otro hilo: m_replies y el socket son de la sesión, así que
+    // el cierre se encola en su hilo (si la sesión ya no existe, no se ejecuta)
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this]() { forceDisconnect(); }, Qt::QueuedConnection);
+        return;
+    }
     if (socket) {
+        flushResponses();   // El 421 tiene que llegar antes del cierre
         socket->disconnectFromHost();
     }
 }
@@ -1048,61 +3009,254 @@ void FtpClientHandler::closeDataSocket()
     }
 }
 
-void FtpClientHandler::applySpeedLimit()
+int FtpClientHandler::applySpeedLimit()
 {
     // Si no hay límite de velocidad configurado, no hacer nada
     if (speedLimit <= 0) {
-        return;
+        return 0;
     }
     
     // Calcular el tiempo transcurrido desde el inicio de la transferencia
     qint64 elapsedMs = transferTimer.elapsed();
     if (elapsedMs <= 0) {
-        // Si es la primera vez, iniciar el timer
-        transferTimer.start();
-        return;
+        return 0;
     }
     
     // Calcular la velocidad actual (bytes por segundo)
     double currentSpeed = (double)bytesTransferred / (elapsedMs / 1000.0);
     
-    // Si la velocidad actual excede el límite, pausar la transferencia
-    if (currentSpeed > speedLimit) {
-        // Calcular cuánto tiempo debemos esperar para mantener el límite
-        double targetTimeSeconds = (double)bytesTransferred / speedLimit;
-        double actualTimeSeconds = elapsedMs / 1000.0;
-        double delaySeconds = targetTimeSeconds - actualTimeSeconds;
-        
-        if (delaySeconds > 0) {
-            // Convertir a milisegundos y limitar el delay máximo a 100ms
-            int delayMs = qMin(static_cast<int>(delaySeconds * 1000), 100);
-            
-            if (delayMs > 0) {
-                // Pausar la transferencia usando un timer de un solo disparo
-                QTimer::singleShot(delayMs, this, [this, delayMs]() {
-                    // Reanudar la transferencia si el socket aún está activo
-                    if (dataSocket && dataSocket->isOpen() && transferActive) {
-                        // El socket continuará procesando datos automáticamente
-                        qDebug() << QString("%1 - Límite de velocidad aplicado: pausa de %2ms")
-                                    .arg(clientInfo)
-                                    .arg(delayMs);
-                    }
-                });
-            }
-        }
-    }
-    
     // Log de velocidad cada 5 segundos
     static qint64 lastSpeedLog = 0;
     if (elapsedMs - lastSpeedLog >= 5000) {
-        double speedKBps = currentSpeed / 1024.0;
-        double limitKBps = speedLimit / 1024.0;
-        qInfo() << QString("%1 - Velocidad actual: %.2f KB/s (límite: %.2f KB/s)")
+        qInfo() << QString("%1 - Velocidad actual: %2 KB/s (límite: %3 KB/s)")
                    .arg(clientInfo)
-                   .arg(speedKBps)
-                   .arg(limitKBps);
+                   .arg(currentSpeed / 1024.0, 0, 'f', 2)
+                   .arg(speedLimit / 1024.0, 0, 'f', 2);
         lastSpeedLog = elapsedMs;
     }
+
+    if (currentSpeed <= speedLimit) {
+        return 0;
+    }
+
+    // Esperar hasta que lo enviado corresponda al límite, como mucho 100 ms seguidos
+    // para que ABOR y los cierres no tarden en atenderse
+    const double targetMs = (double)bytesTransferred * 1000.0 / speedLimit;
+    return qBound(1, static_cast<int>(targetMs - elapsedMs), 100);
+}
+
+// =====================================================================================
+// Seccion: FTPS (AUTH TLS, PBSZ, PROT)
+// =====================================================================================
+
+#ifdef HAVE_SSL
+void FtpClientHandler::handleAuth(const QString &arg)
+{
+    if (!m_server->isSslEnabled()) {
+        sendResponse("534 SSL/TLS no está configurado en el servidor.");
+        return;
+    }
+    if (m_secureControl) {
+        sendResponse("503 La conexión de control ya está cifrada.");
+        return;
+    }
+    if (!m_server->handleAuthCommand(this, arg)) {
+        sendResponse("504 Mecanismo AUTH no soportado.");
+        return;
+    }
+    // La sesión cifrada ocupa su entrada hasta que se cierre: sin sitio no se admite
+    if (!TlsSessionCache::instance().hasRoom()) {
+        TlsSessionCache::instance().recordRefusedAuth();
+        logDual("WARNING", QString("%1 - AUTH rechazado: registro de sesiones TLS lleno").arg(clientInfo));
+        sendResponse("431 Demasiadas sesiones cifradas; inténtelo más tarde.");
+        return;
+    }
+
+    if (m_handshakeTicket != 0) {
+        sendResponse("503 Negociación TLS ya en curso.");
+        return;
+    }
+
+    // El handshake espera turno en el planificador global; el 234 solo se envía
+    // cuando lo obtiene, así el ClientHello no llega mientras seguimos leyendo comandos
+    TlsHandshakeScheduler &scheduler = TlsHandshakeScheduler::instance();
+    m_handshakeTicket = scheduler.request(this, [this]() {
+        // La respuesta 234 debe salir en claro antes de empezar el handshake
+        sendResponse("234 Iniciando negociación TLS.");
+        if (!startSecureControl(m_server->getSslConfiguration())) {
+            logDual("ERROR", QString("%1 - No se pudo iniciar TLS en el canal de control").arg(clientInfo));
+            releaseHandshakeSlot();
+            forceDisconnect();
+        }
+    });
+    if (m_handshakeTicket == 0) {
+        logDual("WARNING", QString("%1 - Cola de handshakes TLS llena").arg(clientInfo));
+        sendResponse("421 Servidor ocupado, inténtelo más tarde.");
+        forceDisconnect();
+        return;
+    }
+
+    const quint64 ticket = m_handshakeTicket;
+    QTimer::singleShot(scheduler.queueTimeoutMs(), this, [this, ticket]() {
+        if (m_handshakeTicket == ticket && TlsHandshakeScheduler::instance().cancel(ticket)) {
+            m_handshakeTicket = 0;
+            logDual("WARNING", QString("%1 - Tiempo de espera agotado para el handshake TLS").arg(clientInfo));
+            sendResponse("421 Servidor ocupado, inténtelo más tarde.");
+            forceDisconnect();
+        }
+    });
+}
+
+void FtpClientHandler::releaseHandshakeSlot()
+{
+    if (m_handshakeTicket != 0) {
+        TlsHandshakeScheduler::instance().release(m_handshakeTicket);
+        m_handshakeTicket = 0;
+    }
+}
+
+void FtpClientHandler::handlePbsz(const QString &arg)
+{
+    if (!m_secureControl) {
+        sendResponse("503 Use AUTH TLS primero.");
+        return;
+    }
+    if (!m_server->handlePbszCommand(this, arg)) {
+        sendResponse("501 Valor PBSZ inválido.");
+        return;
+    }
+    m_pbszReceived = true;
+    sendResponse("200 PBSZ=0");
+}
+
+void FtpClientHandler::handleProt(const QString &arg)
+{
+    if (!m_pbszReceived) {
+        sendResponse("503 Use PBSZ primero.");
+        return;
+    }
+    if (!m_server->handleProtCommand(this, arg)) {
+        sendResponse("504 Nivel de protección no soportado.");
+        return;
+    }
+    m_protPrivate = arg.toUpper() == "P";
+    sendResponse(m_protPrivate ? "200 Canal de datos protegido." : "200 Canal de datos sin cifrar.");
+}
+
+bool FtpClientHandler::startSecureControl(const QSslConfiguration &config)
+{
+    QSslSocket *sslSocket = qobject_cast<QSslSocket *>(socket);
+    if (!sslSocket) {
+        return false;
+    }
+
+    connect(sslSocket, &QSslSocket::encrypted, this, [this, sslSocket]() {
+        m_secureControl = true;
+        releaseHandshakeSlot();
+        const qint64 elapsed = m_controlHandshakeTimer.elapsed();
+        // Las conexiones de datos de esta sesión se validan y configuran a partir de esta
+        TlsSessionCache::instance().storeControlSession(clientInfo, sslSocket->peerAddress(),
+                                                        sslSocket->sslConfiguration(), elapsed);
+        logDual("INFO", QString("%1 - Canal de control cifrado (%2, %3 ms)")
+                   .arg(clientInfo).arg(sslSocket->sessionCipher().name()).arg(elapsed));
+    }, Qt::SingleShotConnection);
+    // Un handshake fallido también devuelve el turno
+    connect(sslSocket, &QAbstractSocket::errorOccurred, this, [this]() {
+        releaseHandshakeSlot();
+    });
+    sslSocket->setSslConfiguration(config);
+    m_controlHandshakeTimer.start();
+    flushResponses();   // El 234 sale en claro, antes del handshake
+    sslSocket->startServerEncryption();
+
+    // Un cliente que no completa el handshake no puede quedarse con el turno
+    QTimer::singleShot(HandshakeTimeoutMs, this, [this]() {
+        if (!m_secureControl) {
+            logDual("WARNING", QString("%1 - Handshake TLS de control sin completar en %2 ms")
+                       .arg(clientInfo).arg(HandshakeTimeoutMs));
+            releaseHandshakeSlot();
+            if (socket) {
+                socket->abort();    // A mitad de handshake no hay forma de responder
+            }
+        }
+    });
+    return true;
+}
+
+bool FtpClientHandler::startSecureData(const QSslConfiguration &config)
+{
+    QSslSocket *sslData = qobject_cast<QSslSocket *>(dataSocket);
+    if (!sslData) {
+        return false;
+    }
+
+    if (!sslData->isEncrypted()) {
+        if (sslData->mode() == QSslSocket::UnencryptedMode) {
+            // Reutilizar la sesión del canal de control: la conexión de datos tiene
+            // que venir del mismo cliente que la negoció
+            TlsSessionCache &cache = TlsSessionCache::instance();
+            QSslConfiguration sessionConfig;
+            if (cache.lookupForData(clientInfo, sslData->peerAddress(), sessionConfig)) {
+                sslData->setSslConfiguration(sessionConfig);
+            } else if (cache.requireReuse()) {
+                cache.recordRejected();
+                logDual("WARNING", QString("%1 - Conexión de datos TLS rechazada: no reutiliza la sesión de control (%2)")
+                           .arg(clientInfo).arg(sslData->peerAddress().toString()));
+                return false;
+            } else {
+                sslData->setSslConfiguration(config);
+            }
+            // Este hilo ya bloquea hasta terminar el handshake, así que también espera turno
+            // aquí; con prioridad sobre los AUTH en cola y poco tiempo, para no dejar la
+            // sesión sin atender: si no hay turno, el cliente recibe 522 y puede reintentar
+            TlsHandshakeScheduler &scheduler = TlsHandshakeScheduler::instance();
+            m_dataHandshakeTicket = scheduler.acquireBlocking(qMin(scheduler.queueTimeoutMs(),
+                                                                   DataHandshakeQueueMs));
+            if (m_dataHandshakeTicket == 0) {
+                logDual("WARNING", QString("%1 - Sin turno para el handshake TLS de datos").arg(clientInfo));
+                return false;
+            }
+            m_dataHandshakeTimer.start();
+            sslData->startServerEncryption();
+        }
+        // El cliente inicia el handshake de datos después de recibir la respuesta 150
+        const bool encrypted = sslData->waitForEncrypted(HandshakeTimeoutMs);
+        TlsHandshakeScheduler::instance().release(m_dataHandshakeTicket);
+        m_dataHandshakeTicket = 0;
+        if (!encrypted) {
+            logDual("WARNING", QString("%1 - Fallo en el handshake TLS de datos: %2")
+                       .arg(clientInfo).arg(sslData->errorString()));
+            return false;
+        }
+        TlsSessionCache::instance().recordDataHandshake(m_dataHandshakeTimer.elapsed());
+    }
+
+    m_secureData = true;
+    logDual("INFO", QString("%1 - Canal de datos cifrado (%2)")
+               .arg(clientInfo)
+               .arg(sslData->sessionCipher().name()));
+    return true;
+}
+#endif
+
+bool FtpClientHandler::ensureDataProtection()
+{
+    // Siempre justo después del 150: sale antes que los datos y antes del handshake
+    // de datos, que el cliente solo empieza al recibirlo
+    flushResponses();
+#ifdef HAVE_SSL
+    if (!m_protPrivate) {
+        return true;
+    }
+    if (startSecureData(m_server->getSslConfiguration())) {
+        return true;
+    }
+    sendResponse("522 No se pudo negociar TLS en la conexión de datos.");
+    closeDataConnection();
+    return false;
+#else
+    return true;
+#endif
 }
 
 // =====================================================================================
@@ -1111,40 +3265,90 @@ void FtpClientHandler::applySpeedLimit()
 
 void FtpClientHandler::sendResponse(const QString &response)
 {
+    if (!socket || !socket->isOpen()) {
+        return;
+    }
+    // Las respuestas de todas las órdenes de una misma lectura (y las líneas de una
+    // respuesta de varias, como FEAT) salen en una sola escritura
+    m_replies += response.toUtf8();
+    m_replies += "\r\n";
+    ++m_pendingReplies;
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, &FtpClientHandler::flushResponses, Qt::QueuedConnection);
+    }
+}
+
+void FtpClientHandler::flushResponses()
+{
+    m_flushScheduled = false;
+    if (m_replies.isEmpty()) {
+        return;
+    }
     if (socket && socket->isOpen()) {
-        socket->write((response + "\r\n").toUtf8());
+        socket->write(m_replies);
         socket->flush();
+        s_replies.fetch_add(m_pendingReplies, std::memory_order_relaxed);
+        s_replyFlushes.fetch_add(1, std::memory_order_relaxed);
     }
+    m_replies.clear();
+    m_pendingReplies = 0;
+}
+
+FtpClientHandler::ControlStats FtpClientHandler::controlStats()
+{
+    ControlStats stats;
+    stats.commands = s_commands.load(std::memory_order_relaxed);
+    stats.replies = s_replies.load(std::memory_order_relaxed);
+    stats.flushes = s_replyFlushes.load(std::memory_order_relaxed);
+    return stats;
 }
 
 QString FtpClientHandler::validateFilePath(const QString &path, bool isDir)
 {
-    qDebug() << QString("Validando ruta: '%1' (es directorio: %2), Directorio actual: '%3'").arg(path).arg(isDir).arg(currentDir);
-    QString resolvedPath;
-    if (path.startsWith('/')) {
-        resolvedPath = QDir::cleanPath(m_server->getRootDir() + "/" + path);
-    } else {
-        resolvedPath = QDir::cleanPath(currentDir + "/" + path);
-    }
+    Vfs::Target target;
+    return validateFilePath(path, isDir, target);
+}
 
-    if (!resolvedPath.startsWith(m_server->getRootDir())) {
+QString FtpClientHandler::validateFilePath(const QString &path, bool isDir, Vfs::Target &target)
+{
+    qDebug() << QString("Validando ruta: '%1' (es directorio: %2), Directorio actual: '%3'").arg(path).arg(isDir).arg(m_currentVirtual);
+    const QString virtualPath = PathResolver::normalize(path, m_currentVirtual);
+    if (virtualPath.isEmpty()) {
         return QString(); // Fuera del directorio raíz
     }
 
-    QFileInfo fileInfo(resolvedPath);
-    if (fileInfo.exists() && (isDir ? fileInfo.isDir() : fileInfo.isFile())) {
-        return resolvedPath;
+    // Montaje de la ruta; con uno local se sigue trabajando con la ruta en disco
+    target = resolveSession(virtualPath);
+    if (!target.isLocal()) {
+        return QString();
     }
-    
-    // Para nuevos archivos/directorios, solo valida la ruta base
-    if (!fileInfo.exists()) {
-        return resolvedPath;
+    const QString resolvedPath = target.local;
+
+    // Si el índice de metadatos conoce la ruta no hace falta tocar el disco.
+    // Los enlaces se comprueban siempre: pueden apuntar fuera de la raíz o,
+    // con carpeta personal, fuera de ella aunque sigan dentro del montaje
+    DirectoryLister::Entry indexed;
+    if (MetadataIndex::instance().lookup(resolvedPath, indexed) && !indexed.isLink) {
+        return indexed.isDir == isDir ? resolvedPath : QString();
     }
 
-    return QString();
-}
+    PathResolver::Kind kind;
+    m_paths.sync(m_currentRoot, currentDir);
+    if (!m_paths.inspect(confinementRoot(target), resolvedPath, kind)) {
+        logDual("WARNING", QString("%1 - Ruta rechazada, sale del directorio raíz o no es accesible: '%2'").arg(clientInfo).arg(path));
+        return QString();
+    }
 
-QString FtpClientHandler::decodeFileName(const QString &fileName)
-{
-    return QUrl::fromPercentEncoding(fileName.toUtf8());
+    switch (kind) {
+    case PathResolver::Kind::Missing:
+        return resolvedPath;    // Nuevos archivos/directorios: el antecesor existente está dentro de la raíz
+    case PathResolver::Kind::Directory:
+        return isDir ? resolvedPath : QString();
+    case PathResolver::Kind::File:
+        return isDir ? QString() : resolvedPath;
+    default:
+        return QString();
+    }
 }
+
@@ -17,6 +17,7 @@
 #include <QSettings>
 #include <QCryptographicHash>
 #include <QThread>
+#include <QSocketNotifier>
 
 #include "FtpServer.h"
 #include "Logger.h"
@@ -24,7 +25,28 @@
 #include "TransferWorker.h"
 #include "SecurityPolicy.h"
 #include "DirectoryCache.h"
+#include "DirectoryLister.h"
+#include "TreeWalker.h"
+#include "MetadataIndex.h"
+#include "ChangeJournal.h"
+#include "FileNameIndex.h"
+#include "DirSizeIndex.h"
+#include "PathResolver.h"
+#include "Vfs.h"
+#include "UserRules.h"
+#include "FtpCommand.h"
 #include "DatabaseManager.h"
+#include "BufferPool.h"
+#include "ZeroCopySend.h"
+#include "TlsSessionCache.h"
+#include "TlsHandshakeScheduler.h"
+#include "TarBatchStream.h"
+#include "TarExtractor.h"
+#include "ReadAheadManager.h"
+#include "HotFileCache.h"
+#include "SharedFileReader.h"
+#include "DirectIo.h"
+#include "IoScheduler.h"
 
 #ifdef HAVE_SSL
 #include <QSslSocket>
@@ -38,7 +60,8 @@ enum class Command {
     None,
     List,
     Retr,
-    Stor
+    Stor,
+    BatchRetr   // SITE MRETR: varios archivos en un tar
 };
 
 class FtpClientHandler : public QObject {
@@ -52,10 +75,19 @@ public:
     QString getUsername() const { return currentUser; }
     bool isTransferActive() const { return transferActive; }
 
+    // Canal de control de todas las sesiones: cuántas respuestas salen por escritura
+    struct ControlStats {
+        quint64 commands = 0;
+        quint64 replies = 0;
+        quint64 flushes = 0;    // Escrituras al socket (una por vuelta del bucle de eventos)
+    };
+    static ControlStats controlStats();
+
 #ifdef HAVE_SSL
     // Métodos SSL/TLS
     bool startSecureControl(const QSslConfiguration& config);
     bool startSecureData(const QSslConfiguration& config);
+    void releaseHandshakeSlot();
     bool isSecureControl() const { return m_secureControl; }
     bool isSecureData() const { return m_secureData; }
 
@@ -109,19 +141,35 @@ private:
     bool loggedIn;
     QString rootDir;
     QHash<QString, QString> users;
-    QString currentDir;
+    QString currentDir;             // En disco, dentro de un montaje local; vacío en uno virtual
+    QString m_currentVirtual = "/"; // El mismo, como lo ve el cliente
+    QString m_currentRoot;          // Carpeta de confinamiento de currentDir (confinementRoot)
+    Vfs::Target m_currentTarget;    // Montaje del directorio actual
+    PathResolver m_paths;           // Rutas de la sesión, con el montaje y el directorio actual abiertos
+    Vfs::Target m_renameFrom;       // Origen pendiente de RNTO
+    QString m_renameFromLocal;
+    bool m_renameFromIsDir = false;
     QTcpSocket *socket;
     QTcpSocket *dataSocket;
     std::unique_ptr<QTimer> dataSocketTimer;
     QString currentUser;
-    qint64 speedLimit = 1024 * 1024; // 1MB/s por defecto
+    // Buffer de las líneas de control: se leen y analizan sin reservar memoria
+    std::array<char, FtpCommand::MaxLine> m_line;
+    bool m_lineTooLong = false;     // Descartando el resto de una línea que no cabía
+    QByteArray m_replies;           // Respuestas pendientes de escribir en el socket
+    int m_pendingReplies = 0;
+    bool m_flushScheduled = false;
+    // Carpeta personal y permisos, compilados en PASS; inmutables durante la sesión
+    std::shared_ptr<const UserRules> m_rules = std::make_shared<const UserRules>();
+    QString m_homeLocal;            // Carpeta personal en disco (cuota de usuario)
+    qint64 speedLimit = 0;  // Bytes/s de RETR; 0 = sin límite
     QElapsedTimer transferTimer;
     qint64 bytesTransferred = 0;
     QString salt;
     int connectionCount = 0;
     qint64 restartOffset = 0;
-    const qint64 bufferSize = 1024 * 1024 * 10;
-    QByteArray transferBuffer;
+    // Límite de datos pendientes en el socket de datos antes de leer otro bloque del disco
+    static constexpr qint64 RetrWriteHighWater = 2 * BufferPool::DefaultBlockSize;
     QString clientInfo;
     QString dataSocketIp;
     int dataSocketPort = 0;
@@ -137,13 +185,73 @@ private:
     QString lastCommandArguments;
     QFile *file = nullptr;
     qint64 bytesRemaining = 0;
+    qint64 retrOffset = 0;      // Posición de envío cuando RETR usa sendfile()
+    bool retrZeroCopy = false;  // RETR escribe directamente al descriptor (solo TCP plano)
+    bool m_retrThrottled = false;   // RETR en pausa por el límite de velocidad
+    bool m_retrFailed = false;      // RETR cortado por un error de lectura: se responde 451
+    // Avisa cuando el socket de datos vuelve a admitir escritura tras un EAGAIN de sendfile()
+    std::unique_ptr<QSocketNotifier> m_retrWritable;
+    // Máximo enviado con sendfile() antes de devolver el control al bucle de eventos
+    static constexpr qint64 ZeroCopySlice = 4 * 1024 * 1024;
+    ReadAheadWindow m_readAhead;  // Lectura anticipada adaptativa de RETR
+    QString m_ioDevice;           // Dispositivo del archivo de RETR/STOR para el planificador de E/S
+    std::unique_ptr<SharedFileReader::Subscription> m_sharedRead;  // RETR enganchado a un lector compartido
+    std::unique_ptr<DirectFileReader> m_directReader;   // RETR sin caché de páginas (O_DIRECT)
+    std::unique_ptr<DirectFileWriter> m_directWriter;   // STOR sin caché de páginas (O_DIRECT)
+    std::unique_ptr<VfsBackend::Source> m_vfsSource;    // RETR desde un montaje no local
+    std::unique_ptr<VfsBackend::Sink> m_vfsSink;        // STOR a un montaje no local
+    QStringList m_storOwned;      // Rutas del STOR en curso marcadas con ChangeJournal::beginOwn
+    QString m_storPartial;        // Archivo temporal del STOR en curso; se renombra al terminar
+    std::unique_ptr<DirectoryLister> m_lister;      // LIST en curso, leído por tandas
+    std::unique_ptr<TreeWalker> m_treeWalker;       // LIST -R / MLSD -R en curso
+    std::unique_ptr<ChangeJournal::Reader> m_changeReader;  // SITE CHANGES en curso
+    std::unique_ptr<FileNameIndex::Result> m_findResult;   // SITE FIND en curso
+    qint64 m_findOffset = 0;                        // Bytes de m_findResult ya enviados
+    qint64 m_storLimit = -1;                        // Bytes que admite la cuota en esta subida (-1 sin límite)
+    bool m_storQuotaExceeded = false;
+    bool m_storFailed = false;                      // Falló una escritura del STOR: ya se respondió 426
+    qint64 m_storAllocated = -1;                    // Tamaño anunciado con ALLO para el próximo STOR (-1 ninguno)
+    QByteArray m_listBuffer;                        // Tanda formateada, reutilizada entre llamadas
+    QByteArray m_listPayload;                       // Copia para la caché de listados
+    QString m_listPath;
+    DirectoryCache::Format m_listFormat = DirectoryCache::Format::List;
+    quint32 m_listFlags = 0;
+    quint64 m_listGeneration = 0;
+    bool m_listCacheable = false;
+    bool m_listFirstByte = false;
+    QElapsedTimer m_listTimer;                      // Desde la orden hasta el primer byte
+    std::unique_ptr<TarBatchStream> m_batchStream;  // SITE MRETR en curso
+    static constexpr int BatchMaxFiles = 100000;
+    QString m_untarTarget;                          // SITE UNTAR: destino del próximo STOR
+    std::unique_ptr<TarExtractor> m_tarExtractor;   // STOR en modo tar en curso
 
-    void processCommand(const QString &command);
+#ifdef HAVE_SSL
+    bool m_secureControl = false;
+    bool m_secureData = false;
+    bool m_pbszReceived = false;
+    bool m_protPrivate = false;  // PROT P: las conexiones de datos deben cifrarse
+    QElapsedTimer m_controlHandshakeTimer;
+    QElapsedTimer m_dataHandshakeTimer;
+    quint64 m_handshakeTicket = 0;      // Turno del planificador para el handshake de control
+    // Tiempo máximo de un handshake TLS una vez que tiene turno (control y datos)
+    static constexpr int HandshakeTimeoutMs = 10000;
+    // Espera máxima de turno de una conexión de datos: bloquea el hilo de la sesión
+    static constexpr int DataHandshakeQueueMs = 1000;
+    quint64 m_dataHandshakeTicket = 0;
+#endif
+
+    // Una línea del canal de control, tal como llegó (sin terminar en '\0')
+    void processCommand(const char *data, int length);
+    // Las respuestas se acumulan y salen juntas al volver al bucle de eventos
     void sendResponse(const QString &response);
+    // Envía ya lo acumulado: antes de esperas bloqueantes, de AUTH y de cerrar
+    void flushResponses();
 public:
+    // Se puede llamar desde cualquier hilo: el cierre se hace en el de la sesión
     void forceDisconnect();
     void closeDataSocket();
-    void applySpeedLimit();
+    // Milisegundos que hay que esperar para no superar speedLimit; 0 si se puede seguir
+    int applySpeedLimit();
 
     // Command handlers
     void handleUser(const QString &username);
@@ -151,6 +259,10 @@ public:
     void handlePasv();
     void handlePort(const QString &arg);
     void handleList(const QString &arguments);
+    void handleMlsd(const QString &path);
+    void handleMlst(const QString &path);
+    void handleSize(const QString &fileName);
+    void handleMdtm(const QString &fileName);
     void handleRetr(const QString &fileName);
     void handleStor(const QString &fileName);
     void handleCwd(const QString &path);
@@ -165,13 +277,45 @@ public:
     void handleType(const QString &type); // Nuevo manejador de comandos
     void handleCdup(); // Nuevo manejador de comandos
     void handleDele(const QString &fileName); // Nuevo manejador de comandos
+    void handleRnfr(const QString &path);
+    void handleRnto(const QString &path);
     void handleSyst(); // Comando SYST
     void handleOpts(const QString &arg); // Comando OPTS
+    void handleAllo(const QString &arg); // Comando ALLO
+    void handleSite(const QString &arg); // Comando SITE y sus subcomandos
+    void handleSiteMretr(const QString &arg);
+    void handleSiteUntar(const QString &arg);
+    void handleSiteChanges(const QString &arg);
+    void handleSiteFind(const QString &arg);
+    void handleSiteDu(const QString &arg);
+    void startUntarStor();
 
     // Async helpers
     void proceedWithList(const QString &arguments);
     void proceedWithRetr(const QString &fileName);
     void proceedWithStor(const QString &fileName);
+    void startMemoryRetr(const QByteArray &content);
+    void pumpRetr();
+    void pumpRetrZeroCopy();
+    void endStorOwnership();
+    void discardStorPartial();
+    void releaseRetrNotifier();
+    void failRetr();
+    void pumpRetrShared();
+    void pumpRetrDirect();
+    void pumpRetrVirtual();
+    bool switchStorToDirect();
+    bool collectBatchEntries(const QStringList &patterns, QList<TarBatchStream::Entry> &entries);
+    void startBatchRetr(const QStringList &patterns);
+    void pumpBatch();
+    // 'virtualPath' es la ruta del cliente de 'targetPath' (permisos del recorrido con -R)
+    void startListing(const QString &targetPath, const QString &virtualPath, DirectoryLister::Format format,
+                      bool showHidden, bool recursive);
+    void beginListing(std::unique_ptr<DirectoryLister> lister, const QString &targetPath,
+                      DirectoryLister::Format format, quint32 cacheFlags, quint64 generation);
+    void pumpList();
+    void writeListChunk(const QByteArray &chunk);
+    bool ensureDataProtection();
 
     // Data connection helpers
     bool setupDataConnection(); // Nuevo método auxiliar
@@ -180,6 +324,25 @@ public:
     // Deprecated blocking functions
     bool sendChunk(QByteArray &buffer);
     QString validateFilePath(const QString &fileName, bool isDir = false); // Modificado para aceptar un segundo argumento
+    // Igual, y deja en 'target' el montaje y la ruta dentro de él
+    QString validateFilePath(const QString &fileName, bool isDir, Vfs::Target &target);
+    void changeDirectory(const QString &virtualPath, const QString &localPath, const Vfs::Target &target);
+    // Montaje de una ruta del cliente ya normalizada, dentro de su carpeta personal
+    Vfs::Target resolveSession(const QString &virtualPath) const;
+    // Carpeta de la que no pueden salir los enlaces de un montaje local: la personal
+    // si el usuario tiene una y el montaje la contiene, si no la del montaje
+    QString confinementRoot(const Vfs::Target &target) const;
+    void enterHome();
+    // Comprueba el permiso sobre la ruta; si falta responde 550 y devuelve falso
+    bool permitted(const QString &path, UserRules::Perm perm);
+
+    // Montajes no locales: las órdenes pasan por la interfaz del backend
+    // Cierto si la ruta cae en un montaje no local
+    bool resolveVirtual(const QString &path, Vfs::Target &target);
+    void startVirtualListing(const Vfs::Target &target, DirectoryLister::Format format, bool showHidden);
+    void startVirtualRetr(const Vfs::Target &target);
+    void startVirtualStor(const Vfs::Target &target);
+    void renameVirtual(const Vfs::Target &from, bool isDir, const QString &path);
     QString decodeFileName(const QString &fileName);
     bool sendFileWithVerification(QFile& file, QTcpSocket* socket);
     bool receiveFileWithVerification(QFile& file, QTcpSocket* socket);
@@ -0,0 +1,38 @@
+#include "FtpCommand.h"
+
+namespace FtpCommand {
+
+namespace {
+// Lo mismo que recorta QString::trimmed() en una línea ASCII
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+}
+
+void parse(const char *data, int length, Line &line)
+{
+    line = Line();
+    int begin = 0;
+    int end = length;
+    while (begin < end && isSpace(data[begin])) {
+        ++begin;
+    }
+    while (end > begin && isSpace(data[end - 1])) {
+        --end;
+    }
+
+    int space = begin;
+    while (space < end && data[space] != ' ') {
+        ++space;
+    }
+    line.verb = data + begin;
+    line.verbLength = space - begin;
+    line.code = verbCode(line.verb, line.verbLength);
+    if (space < end) {
+        line.arg = data + space + 1;
+        line.argLength = end - space - 1;
+    }
+}
+
+} // namespace FtpCommand
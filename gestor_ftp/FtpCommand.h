@@ -0,0 +1,163 @@
+#pragma once
+#include <QtGlobal>
+#include <array>
+
+// Análisis y despacho de las órdenes del canal de control.
+//
+// La línea se analiza en el mismo buffer en que se leyó del socket: se recortan
+// los espacios y el CRLF, el verbo (hasta cuatro letras, como todos los de FTP)
+// se empaqueta en mayúsculas en un entero de 32 bits y el argumento queda como
+// puntero y longitud dentro de la línea. Nada de esto reserva memoria.
+//
+// El verbo se busca en una tabla hash perfecta generada en compilación: se prueba
+// un multiplicador tras otro hasta que ninguna orden conocida comparte casilla,
+// así que la búsqueda es una multiplicación, un desplazamiento y una comparación.
+// Cada casilla lleva la orden y sus banderas (si se admite antes de iniciar sesión).
+// Añadir una orden es añadir una fila a Commands; si alguna vez no hubiera
+// multiplicador válido, la compilación falla.
+namespace FtpCommand {
+
+enum class Id : quint8 {
+    Unknown = 0,
+    User, Pass, Quit, Feat, Type, Pwd, Cwd, Cdup,
+    List, Nlst, Mlsd, Mlst, Size, Mdtm, Retr, Stor,
+    Rmd, Dele, Mkd, Xmkd, Rnfr, Rnto,
+    Port, Pasv, Syst, Auth, Pbsz, Prot, Site, Opts, Allo
+};
+
+enum Flag : quint8 {
+    NoFlags = 0x0,
+    BeforeLogin = 0x1       // Se acepta sin haber iniciado sesión
+};
+
+// Línea más larga que se acepta, con el CRLF (las rutas largas caben de sobra)
+static constexpr int MaxLine = 8192;
+
+// "RETR" -> entero; 0 si no son de una a cuatro letras ASCII
+constexpr quint32 verbCode(const char *verb, int length)
+{
+    if (length < 1 || length > 4) {
+        return 0;
+    }
+    quint32 code = 0;
+    for (int i = 0; i < length; ++i) {
+        const char c = verb[i];
+        if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))) {
+            return 0;
+        }
+        code |= quint32(quint8(c & 0xDF)) << (8 * i);    // & 0xDF: a mayúsculas
+    }
+    return code;
+}
+
+template <int N>
+constexpr quint32 verbCode(const char (&verb)[N])
+{
+    return verbCode(verb, N - 1);
+}
+
+struct Entry {
+    quint32 code = 0;
+    Id id = Id::Unknown;
+    quint8 flags = NoFlags;
+};
+
+inline constexpr Entry Commands[] = {
+    {verbCode("USER"), Id::User, BeforeLogin},
+    {verbCode("PASS"), Id::Pass, BeforeLogin},
+    {verbCode("QUIT"), Id::Quit, BeforeLogin},
+    {verbCode("FEAT"), Id::Feat, BeforeLogin},
+    {verbCode("AUTH"), Id::Auth, BeforeLogin},
+    {verbCode("TYPE"), Id::Type, NoFlags},
+    {verbCode("PWD"), Id::Pwd, NoFlags},
+    {verbCode("CWD"), Id::Cwd, NoFlags},
+    {verbCode("CDUP"), Id::Cdup, NoFlags},
+    {verbCode("LIST"), Id::List, NoFlags},
+    {verbCode("NLST"), Id::Nlst, NoFlags},
+    {verbCode("MLSD"), Id::Mlsd, NoFlags},
+    {verbCode("MLST"), Id::Mlst, NoFlags},
+    {verbCode("SIZE"), Id::Size, NoFlags},
+    {verbCode("MDTM"), Id::Mdtm, NoFlags},
+    {verbCode("RETR"), Id::Retr, NoFlags},
+    {verbCode("STOR"), Id::Stor, NoFlags},
+    {verbCode("RMD"), Id::Rmd, NoFlags},
+    {verbCode("DELE"), Id::Dele, NoFlags},
+    {verbCode("MKD"), Id::Mkd, NoFlags},
+    {verbCode("XMKD"), Id::Xmkd, NoFlags},
+    {verbCode("RNFR"), Id::Rnfr, NoFlags},
+    {verbCode("RNTO"), Id::Rnto, NoFlags},
+    {verbCode("PORT"), Id::Port, NoFlags},
+    {verbCode("PASV"), Id::Pasv, NoFlags},
+    {verbCode("SYST"), Id::Syst, NoFlags},
+    {verbCode("PBSZ"), Id::Pbsz, NoFlags},
+    {verbCode("PROT"), Id::Prot, NoFlags},
+    {verbCode("SITE"), Id::Site, NoFlags},
+    {verbCode("OPTS"), Id::Opts, NoFlags},
+    {verbCode("ALLO"), Id::Allo, NoFlags},
+};
+
+static constexpr int TableBits = 7;
+static constexpr int TableSize = 1 << TableBits;
+
+constexpr int slotOf(quint32 code, quint32 multiplier)
+{
+    return int((code * multiplier) >> (32 - TableBits));
+}
+
+// Primer multiplicador impar con el que ninguna orden comparte casilla; 0 si no hay
+constexpr quint32 findMultiplier()
+{
+    for (quint32 multiplier = 0x9E3779B1u, tries = 0; tries < 4096; multiplier += 2, ++tries) {
+        bool used[TableSize] = {};
+        bool collision = false;
+        for (const Entry &entry : Commands) {
+            const int slot = slotOf(entry.code, multiplier);
+            if (used[slot]) {
+                collision = true;
+                break;
+            }
+            used[slot] = true;
+        }
+        if (!collision) {
+            return multiplier;
+        }
+    }
+    return 0;
+}
+
+inline constexpr quint32 Multiplier = findMultiplier();
+static_assert(Multiplier != 0, "No hay multiplicador sin colisiones: aumentar TableBits");
+
+constexpr std::array<Entry, TableSize> buildTable()
+{
+    std::array<Entry, TableSize> table{};
+    for (const Entry &entry : Commands) {
+        table[slotOf(entry.code, Multiplier)] = entry;
+    }
+    return table;
+}
+
+inline constexpr std::array<Entry, TableSize> Table = buildTable();
+
+// Casilla del verbo; Id::Unknown (sin banderas) si no es una orden conocida
+inline const Entry &lookup(quint32 code)
+{
+    static constexpr Entry unknown{};
+    const Entry &entry = Table[slotOf(code, Multiplier)];
+    return entry.code == code && code != 0 ? entry : unknown;
+}
+
+// Una línea ya analizada; 'arg' apunta dentro del buffer original
+struct Line {
+    quint32 code = 0;
+    const char *verb = nullptr;
+    int verbLength = 0;
+    const char *arg = nullptr;
+    int argLength = 0;
+};
+
+// Recorta espacios y CRLF y separa verbo y argumento (lo que sigue al primer
+// espacio) sin copiar nada
+void parse(const char *data, int length, Line &line);
+
+} // namespace FtpCommand
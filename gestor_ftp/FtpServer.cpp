@@ -1,5 +1,6 @@
 #include "FtpServer.h"
 #include "FtpClientHandler.h"
+#include "Vfs.h"
 
 #include <QDebug>
 #include <QThread>
@@ -7,6 +8,7 @@
 FtpServer::FtpServer(const QString &rootDir, const QHash<QString, QString> &users, quint16 port, QObject *parent)
     : QTcpServer(parent), m_rootDir(rootDir), m_users(users)
 {
+    Vfs::instance().setRoot(m_rootDir);
     if (!listen(QHostAddress::Any, port)) {
         qWarning() << "No se pudo iniciar el servidor FTP:" << errorString();
     }
@@ -20,6 +22,7 @@ QString FtpServer::getRootDir() const
 void FtpServer::setRootDir(const QString &newRootDir)
 {
     m_rootDir = newRootDir;
+    Vfs::instance().setRoot(m_rootDir);
     qInfo() << (QString("Directorio raíz cambiado a: %1").arg(newRootDir));
 }
 
@@ -153,7 +156,7 @@ void FtpServer::disconnectClient(const QString& ip) {
         FtpClientHandler* handler = it.value();
         if (handler) {
             qInfo() << (QString("Desconectando cliente: %1").arg(ip));
-            handler->forceDisconnect();
+            handler->forceDisconnect();     // Se encola en el hilo de la sesión
         }
     }
 }
@@ -209,6 +212,9 @@ bool FtpServer::enableSsl(const QString &certificateFile, const QString &private
     m_sslConfiguration.setLocalCertificate(m_certificate);
     m_sslConfiguration.setPrivateKey(m_privateKey);
     m_sslConfiguration.setProtocol(QSsl::TlsV1_2OrLater);
+    m_sslConfiguration.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+    m_sslConfiguration.setSslOption(QSsl::SslOptionDisableSessionSharing, false);
+    m_sslConfiguration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
     
     m_sslEnabled = true;
     qInfo() << ("SSL/TLS habilitado para conexiones seguras");
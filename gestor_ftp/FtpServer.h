@@ -106,7 +106,7 @@ private:
 
 #ifdef HAVE_SSL
     // Configuración SSL/TLS
-    bool m_sslEnabled;
+    bool m_sslEnabled = false;
     QSslConfiguration m_sslConfiguration;
     QSslCertificate m_certificate;
     QSslKey m_privateKey;
@@ -1,5 +1,8 @@
 #include "FtpServerThread.h"
 #include <QDebug>
+#include <QSettings>
+#include "TlsSessionCache.h"
+#include "TlsHandshakeScheduler.h"
 
 FtpServerThread::FtpServerThread(const QString &rootDir, const QHash<QString, QString> &users, int port, QObject *parent)
     : QThread(parent),
@@ -29,6 +32,22 @@ void FtpServerThread::run()
         qInfo() << (QString("Servidor FTP iniciado en %1:%2")
                        .arg(server->serverAddress().toString())
                        .arg(server->serverPort()));
+
+        // FTPS: habilitar si hay certificado y clave configurados
+        QSettings settings("MiEmpresa", "GestorFTP");
+        QString certificate = settings.value("ssl/certificate").toString();
+        QString privateKey = settings.value("ssl/privateKey").toString();
+        if (!certificate.isEmpty() && !privateKey.isEmpty()) {
+            TlsSessionCache &sessions = TlsSessionCache::instance();
+            sessions.setRequireReuse(settings.value("ssl/requireSessionReuse", true).toBool());
+            sessions.setCapacity(settings.value("ssl/sessionCacheSize", 10000).toInt());
+            TlsHandshakeScheduler::instance().configure(settings.value("ssl/handshakeSlots", 0).toInt(),
+                                                        settings.value("ssl/handshakeQueueMax", 1000).toInt(),
+                                                        settings.value("ssl/handshakeQueueTimeoutMs", 10000).toInt());
+            if (!server->enableSsl(certificate, privateKey, settings.value("ssl/keyPassword").toString())) {
+                emit errorOccurred("No se pudo habilitar SSL/TLS con el certificado configurado");
+            }
+        }
     } else {
         emit error(server->errorString());
         emit errorOccurred(QString("Error al iniciar el servidor: %1").arg(server->errorString()));
@@ -0,0 +1,157 @@
+#include "HotFileCache.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <sys/stat.h>
+#endif
+
+void HotFileCache::configure(qint64 capacityBytes, qint64 maxFileBytes)
+{
+    m_capacity.store(qMax<qint64>(0, capacityBytes));
+    m_maxFileSize.store(qMax<qint64>(0, maxFileBytes));
+    QMutexLocker locker(&m_mutex);
+    evictLocked(0);
+    qInfo() << "Caché de archivos populares:" << m_capacity.load() / (1024 * 1024) << "MB, archivos de hasta"
+            << m_maxFileSize.load() / 1024 << "KB";
+}
+
+bool HotFileCache::keyFor(const QString &path, Key &key)
+{
+#ifdef Q_OS_LINUX
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    key.device = st.st_dev;
+    key.inode = st.st_ino;
+    key.mtimeNs = qint64(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    key.size = st.st_size;
+    return true;
+#else
+    // Sin inodos: la ruta canónica identifica el archivo
+    QFileInfo info(path);
+    if (!info.isFile()) {
+        return false;
+    }
+    key.device = 0;
+    key.inode = qHash(info.canonicalFilePath());
+    key.mtimeNs = info.lastModified().toMSecsSinceEpoch() * 1000000LL;
+    key.size = info.size();
+    return true;
+#endif
+}
+
+bool HotFileCache::fetch(const QString &path, QByteArray &data)
+{
+    if (m_capacity.load() == 0) {
+        return false;
+    }
+    Key key;
+    if (!keyFor(path, key) || key.size > m_maxFileSize.load()) {
+        return false;
+    }
+    if (lookup(key, data)) {
+        return true;
+    }
+    if (!shouldAdmit(key)) {
+        return false;
+    }
+
+    // Segunda petición reciente: cargarlo entero y compartirlo con las demás sesiones
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray content = file.read(key.size);
+    if (content.size() != key.size) {
+        return false; // Cambió mientras se leía: servir desde disco
+    }
+    insert(key, content);
+    data = content;
+    return true;
+}
+
+bool HotFileCache::lookup(const Key &key, QByteArray &data)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->position);
+    data = it->data; // Copia superficial: solo sube el recuento de referencias
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool HotFileCache::shouldAdmit(const Key &key)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_ghosts.remove(key)) {
+        return true;
+    }
+    m_ghosts.insert(key, true);
+    m_ghostOrder.push_back(key);
+    while (int(m_ghostOrder.size()) > GhostCapacity) {
+        m_ghosts.remove(m_ghostOrder.front());
+        m_ghostOrder.pop_front();
+    }
+    return false;
+}
+
+void HotFileCache::insert(const Key &key, const QByteArray &data)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_entries.contains(key) || data.size() > m_capacity.load()) {
+        return;
+    }
+    evictLocked(data.size());
+    m_lru.push_front(key);
+    m_entries.insert(key, Node{data, m_lru.begin()});
+    m_usedBytes += data.size();
+    m_insertions.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HotFileCache::evictLocked(qint64 neededBytes)
+{
+    // Las sesiones que aún envían un contenido expulsado conservan su referencia
+    while (!m_lru.empty() && m_usedBytes + neededBytes > m_capacity.load()) {
+        auto it = m_entries.find(m_lru.back());
+        if (it != m_entries.end()) {
+            m_usedBytes -= it->data.size();
+            m_entries.erase(it);
+        }
+        m_lru.pop_back();
+        m_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void HotFileCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.clear();
+    m_lru.clear();
+    m_ghosts.clear();
+    m_ghostOrder.clear();
+    m_usedBytes = 0;
+}
+
+HotFileCache::Stats HotFileCache::stats() const
+{
+    Stats s;
+    s.capacityBytes = m_capacity.load();
+    s.maxFileBytes = m_maxFileSize.load();
+    s.hits = m_hits.load(std::memory_order_relaxed);
+    s.misses = m_misses.load(std::memory_order_relaxed);
+    s.insertions = m_insertions.load(std::memory_order_relaxed);
+    s.evictions = m_evictions.load(std::memory_order_relaxed);
+    QMutexLocker locker(&m_mutex);
+    s.usedBytes = m_usedBytes;
+    s.entries = m_entries.size();
+    return s;
+}
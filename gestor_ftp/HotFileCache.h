@@ -0,0 +1,104 @@
+#ifndef HOTFILECACHE_H
+#define HOTFILECACHE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <list>
+#include <deque>
+#include <atomic>
+
+// Caché en memoria de archivos pequeños muy solicitados, compartida por todas las sesiones.
+//
+// La clave es (dispositivo, inodo, fecha de modificación, tamaño): si el archivo
+// cambia, la clave cambia y la entrada vieja simplemente deja de usarse hasta que
+// la expulse el LRU. El contenido se guarda en QByteArray inmutables, que se
+// comparten por recuento de referencias entre hilos y se entregan al socket sin
+// copiarlos. Un archivo solo entra en la caché la segunda vez que se pide en poco
+// tiempo (lista fantasma), así que una descarga masiva de archivos que se piden
+// una sola vez no desplaza a los populares.
+class HotFileCache {
+public:
+    struct Key {
+        quint64 device = 0;
+        quint64 inode = 0;
+        qint64 mtimeNs = 0;
+        qint64 size = 0;
+
+        bool operator==(const Key &other) const {
+            return device == other.device && inode == other.inode &&
+                   mtimeNs == other.mtimeNs && size == other.size;
+        }
+    };
+
+    struct Stats {
+        qint64 capacityBytes = 0;
+        qint64 usedBytes = 0;
+        qint64 maxFileBytes = 0;
+        int entries = 0;
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 insertions = 0;
+        quint64 evictions = 0;
+        double hitRatio() const { return hits + misses ? double(hits) / (hits + misses) : 0.0; }
+    };
+
+    static constexpr qint64 DefaultCapacity = 128 * 1024 * 1024;
+    static constexpr qint64 DefaultMaxFileSize = 4 * 1024 * 1024;
+
+    static HotFileCache &instance() {
+        static HotFileCache instance;
+        return instance;
+    }
+
+    HotFileCache(const HotFileCache &) = delete;
+    HotFileCache &operator=(const HotFileCache &) = delete;
+
+    // Capacidad 0 desactiva la caché
+    void configure(qint64 capacityBytes, qint64 maxFileBytes);
+
+    // Devuelve true y el contenido si el archivo está (o acaba de entrar) en la caché
+    bool fetch(const QString &path, QByteArray &data);
+
+    void clear();
+    Stats stats() const;
+
+    static bool keyFor(const QString &path, Key &key);
+
+private:
+    HotFileCache() = default;
+
+    struct Node {
+        QByteArray data;
+        std::list<Key>::iterator position;
+    };
+
+    bool lookup(const Key &key, QByteArray &data);
+    bool shouldAdmit(const Key &key);
+    void insert(const Key &key, const QByteArray &data);
+    void evictLocked(qint64 neededBytes);
+
+    static constexpr int GhostCapacity = 16384;
+
+    mutable QMutex m_mutex;
+    QHash<Key, Node> m_entries;
+    std::list<Key> m_lru;            // Más reciente al principio
+    QHash<Key, bool> m_ghosts;       // Pedidos una vez, aún no admitidos
+    std::deque<Key> m_ghostOrder;
+    qint64 m_usedBytes = 0;
+
+    std::atomic<qint64> m_capacity{DefaultCapacity};
+    std::atomic<qint64> m_maxFileSize{DefaultMaxFileSize};
+    std::atomic<quint64> m_hits{0};
+    std::atomic<quint64> m_misses{0};
+    std::atomic<quint64> m_insertions{0};
+    std::atomic<quint64> m_evictions{0};
+};
+
+inline size_t qHash(const HotFileCache::Key &key, size_t seed = 0)
+{
+    return qHashMulti(seed, key.device, key.inode, key.mtimeNs, key.size);
+}
+
+#endif // HOTFILECACHE_H
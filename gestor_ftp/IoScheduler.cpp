@@ -0,0 +1,262 @@
+#include "IoScheduler.h"
+#include "ReadAheadManager.h"
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+
+struct IoScheduler::Device {
+    QString name;
+    int inFlight = 0;
+    std::deque<Waiter *> queues[KindCount];   // FIFO por tipo: el primero es el de plazo más próximo
+    QWaitCondition granted;
+    quint64 completed[KindCount] = {};
+    quint64 expired = 0;
+    double avgWaitMs = 0.0;
+    double avgServiceMs = 0.0;
+    // Máxima espera por intervalos fijos: el actual y el anterior completo
+    qint64 maxWaitStartNs = 0;
+    double maxWaitMs = 0.0;
+    double previousMaxWaitMs = 0.0;
+    qint64 lastUsedNs = 0;
+};
+
+namespace {
+// Peso de cada muestra nueva en las medias móviles
+constexpr double SampleWeight = 0.1;
+// Duración de cada intervalo de la espera máxima
+constexpr qint64 MaxWaitIntervalNs = 10LL * 1000 * 1000 * 1000;
+// Dispositivos sin uso durante este tiempo se olvidan (rutas de montajes retirados, etc.)
+constexpr qint64 IdleDeviceNs = 10LL * 60 * 1000 * 1000 * 1000;
+
+double smooth(double average, double sample)
+{
+    return average == 0.0 ? sample : average + SampleWeight * (sample - average);
+}
+} // namespace
+
+// =====================================================================================
+// Seccion: Configuración
+// =====================================================================================
+
+void IoScheduler::configure(int queueDepth, int readDeadlineMs, int metadataDeadlineMs, int writeDeadlineMs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_queueDepth.store(qMax(0, queueDepth));
+    m_deadlineMs[int(Kind::Read)] = qMax(1, readDeadlineMs);
+    m_deadlineMs[int(Kind::Metadata)] = qMax(1, metadataDeadlineMs);
+    m_deadlineMs[int(Kind::Write)] = qMax(1, writeDeadlineMs);
+    // Una profundidad mayor puede dar turno ya a quien espera
+    for (Device *device : std::as_const(m_devices)) {
+        dispatchLocked(*device);
+    }
+
+    if (queueDepth <= 0) {
+        qInfo() << "Planificador de E/S desactivado";
+        return;
+    }
+    qInfo() << "Planificador de E/S: profundidad" << queueDepth << "por dispositivo, plazos"
+            << readDeadlineMs << "/" << metadataDeadlineMs << "/" << writeDeadlineMs << "ms (lectura/listado/escritura)";
+}
+
+void IoScheduler::setDeviceQueueDepth(const QString &device, int queueDepth)
+{
+    QMutexLocker locker(&m_mutex);
+    if (queueDepth > 0) {
+        m_deviceDepths.insert(device, queueDepth);
+    } else {
+        m_deviceDepths.remove(device);
+    }
+    if (Device *existing = m_devices.value(device)) {
+        dispatchLocked(*existing);
+    }
+}
+
+QString IoScheduler::deviceFor(int fd, const QString &path)
+{
+    return ReadAheadManager::instance().deviceFor(fd, path);
+}
+
+// =====================================================================================
+// Seccion: Turnos
+// =====================================================================================
+
+IoScheduler::Device *IoScheduler::deviceLocked(const QString &name)
+{
+    auto it = m_devices.constFind(name);
+    if (it != m_devices.constEnd()) {
+        return it.value();
+    }
+    // Solo crecen aquí, así que es el momento de retirar los que ya no se usan
+    const qint64 now = m_clock.nsecsElapsed();
+    pruneIdleLocked(now);
+    Device *device = new Device;
+    device->name = name;
+    device->maxWaitStartNs = now;
+    device->lastUsedNs = now;
+    m_devices.insert(name, device);
+    return device;
+}
+
+void IoScheduler::pruneIdleLocked(qint64 nowNs)
+{
+    for (auto it = m_devices.begin(); it != m_devices.end();) {
+        Device *device = it.value();
+        bool idle = device->inFlight == 0 && nowNs - device->lastUsedNs > IdleDeviceNs;
+        for (int k = 0; idle && k < KindCount; ++k) {
+            idle = device->queues[k].empty();
+        }
+        if (idle) {
+            delete device;
+            it = m_devices.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int IoScheduler::depthFor(const Device &device) const
+{
+    return m_deviceDepths.value(device.name, m_queueDepth.load());
+}
+
+IoScheduler::Ticket IoScheduler::acquire(const QString &deviceName, Kind kind)
+{
+    Ticket ticket;
+    if (m_queueDepth.load() <= 0 || deviceName.isEmpty()) {
+        return ticket; // Sin planificador: turno vacío
+    }
+
+    QMutexLocker locker(&m_mutex);
+    Device *device = deviceLocked(deviceName);
+    const qint64 now = m_clock.nsecsElapsed();
+    Waiter waiter{kind, now, now + qint64(m_deadlineMs[int(kind)]) * 1000000};
+    device->queues[int(kind)].push_back(&waiter);
+    dispatchLocked(*device);
+    while (!waiter.granted) {
+        device->granted.wait(&m_mutex);
+    }
+
+    ticket.m_device = device;
+    ticket.m_kind = kind;
+    ticket.m_startNs = m_clock.nsecsElapsed();
+    return ticket;
+}
+
+void IoScheduler::dispatchLocked(Device &device)
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    bool grantedAny = false;
+    while (device.inFlight < depthFor(device)) {
+        // Primero las peticiones con el plazo vencido, la más antigua antes
+        int from = -1;
+        for (int k = 0; k < KindCount; ++k) {
+            const std::deque<Waiter *> &queue = device.queues[k];
+            if (!queue.empty() && queue.front()->deadlineNs <= now &&
+                (from < 0 || queue.front()->deadlineNs < device.queues[from].front()->deadlineNs)) {
+                from = k;
+            }
+        }
+        // Si ninguna ha vencido, por prioridad: lecturas, listados, escrituras
+        for (int k = 0; from < 0 && k < KindCount; ++k) {
+            if (!device.queues[k].empty()) {
+                from = k;
+            }
+        }
+        if (from < 0) {
+            break;
+        }
+        Waiter *waiter = device.queues[from].front();
+        device.queues[from].pop_front();
+        grantLocked(device, waiter, now);
+        grantedAny = true;
+    }
+    if (grantedAny) {
+        device.granted.wakeAll();
+    }
+}
+
+void IoScheduler::grantLocked(Device &device, Waiter *waiter, qint64 nowNs)
+{
+    waiter->granted = true;
+    device.inFlight++;
+    const double waitMs = (nowNs - waiter->enqueuedNs) / 1e6;
+    device.avgWaitMs = smooth(device.avgWaitMs, waitMs);
+    const qint64 sinceStart = nowNs - device.maxWaitStartNs;
+    if (sinceStart >= MaxWaitIntervalNs) {
+        // Un intervalo entero sin esperas no deja máximo anterior
+        device.previousMaxWaitMs = sinceStart >= 2 * MaxWaitIntervalNs ? 0.0 : device.maxWaitMs;
+        device.maxWaitMs = 0.0;
+        device.maxWaitStartNs = nowNs - sinceStart % MaxWaitIntervalNs;
+    }
+    device.maxWaitMs = qMax(device.maxWaitMs, waitMs);
+    if (nowNs > waiter->deadlineNs) {
+        device.expired++;
+    }
+}
+
+void IoScheduler::finish(Device *device, Kind kind, qint64 startNs)
+{
+    QMutexLocker locker(&m_mutex);
+    device->inFlight--;
+    device->completed[int(kind)]++;
+    device->lastUsedNs = m_clock.nsecsElapsed();
+    device->avgServiceMs = smooth(device->avgServiceMs, (m_clock.nsecsElapsed() - startNs) / 1e6);
+    dispatchLocked(*device);
+}
+
+IoScheduler::Ticket &IoScheduler::Ticket::operator=(Ticket &&other) noexcept
+{
+    if (this != &other) {
+        release();
+        m_device = other.m_device;
+        m_kind = other.m_kind;
+        m_startNs = other.m_startNs;
+        other.m_device = nullptr;
+    }
+    return *this;
+}
+
+void IoScheduler::Ticket::release()
+{
+    if (m_device) {
+        IoScheduler::instance().finish(m_device, m_kind, m_startNs);
+        m_device = nullptr;
+    }
+}
+
+IoScheduler::Stats IoScheduler::stats() const
+{
+    Stats s;
+    s.queueDepth = m_queueDepth.load();
+    s.enabled = s.queueDepth > 0;
+
+    QMutexLocker locker(&m_mutex);
+    for (int k = 0; k < KindCount; ++k) {
+        s.deadlineMs[k] = m_deadlineMs[k];
+    }
+    const qint64 now = m_clock.nsecsElapsed();
+    for (const Device *device : m_devices) {
+        DeviceStats d;
+        d.device = device->name;
+        d.queueDepth = depthFor(*device);
+        d.inFlight = device->inFlight;
+        for (int k = 0; k < KindCount; ++k) {
+            d.queued += int(device->queues[k].size());
+            d.completed[k] = device->completed[k];
+        }
+        d.expired = device->expired;
+        d.avgWaitMs = device->avgWaitMs;
+        d.avgServiceMs = device->avgServiceMs;
+        // Consultar no altera nada: el intervalo avanza con el reloj, no con las consultas
+        const qint64 sinceStart = now - device->maxWaitStartNs;
+        if (sinceStart < MaxWaitIntervalNs) {
+            d.maxWaitMs = qMax(device->maxWaitMs, device->previousMaxWaitMs);
+        } else if (sinceStart < 2 * MaxWaitIntervalNs) {
+            d.maxWaitMs = device->maxWaitMs;
+        }
+        s.devices.append(d);
+    }
+    std::sort(s.devices.begin(), s.devices.end(),
+              [](const DeviceStats &a, const DeviceStats &b) { return a.device < b.device; });
+    return s;
+}
@@ -0,0 +1,124 @@
+#ifndef IOSCHEDULER_H
+#define IOSCHEDULER_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <deque>
+#include <memory>
+#include <atomic>
+
+// Planificador de E/S de disco por dispositivo para RETR, STOR y LIST.
+//
+// Cada sesión hace su E/S en su propio hilo; sin coordinación, unas pocas subidas
+// pueden saturar un disco mientras las descargas de otro esperan detrás en la
+// misma cola del kernel. Antes de cada operación de disco la sesión pide turno al
+// dispositivo que contiene el archivo: cada dispositivo admite un número fijo de
+// operaciones en curso (profundidad de cola) y reparte los turnos dando prioridad
+// a las lecturas, después a los listados y por último a las escrituras. Cada
+// petición tiene un plazo según su tipo; las que lo superan pasan por delante de
+// todo, así que las escrituras no se quedan sin turno indefinidamente.
+class IoScheduler {
+    struct Device;
+
+public:
+    // En orden de prioridad
+    enum class Kind { Read = 0, Metadata = 1, Write = 2 };
+    static constexpr int KindCount = 3;
+
+    struct DeviceStats {
+        QString device;
+        int queueDepth = 0;
+        int inFlight = 0;
+        int queued = 0;
+        quint64 completed[KindCount] = {};
+        quint64 expired = 0;          // Atendidas tras vencer su plazo
+        double avgWaitMs = 0.0;       // Espera en cola (media móvil)
+        double avgServiceMs = 0.0;    // Duración de la operación (media móvil)
+        double maxWaitMs = 0.0;       // Máxima espera en los últimos 10-20 s
+    };
+
+    struct Stats {
+        bool enabled = false;
+        int queueDepth = 0;
+        int deadlineMs[KindCount] = {};
+        QList<DeviceStats> devices;
+    };
+
+    static constexpr int DefaultQueueDepth = 8;
+    static constexpr int DefaultReadDeadlineMs = 50;
+    static constexpr int DefaultMetadataDeadlineMs = 100;
+    static constexpr int DefaultWriteDeadlineMs = 500;
+
+    // Turno concedido: se devuelve al destruirse
+    class Ticket {
+    public:
+        Ticket() = default;
+        ~Ticket() { release(); }
+        Ticket(Ticket &&other) noexcept { *this = std::move(other); }
+        Ticket &operator=(Ticket &&other) noexcept;
+        Ticket(const Ticket &) = delete;
+        Ticket &operator=(const Ticket &) = delete;
+
+        void release();
+
+    private:
+        friend class IoScheduler;
+        Device *m_device = nullptr;
+        Kind m_kind = Kind::Read;
+        qint64 m_startNs = 0;
+    };
+
+    static IoScheduler &instance() {
+        static IoScheduler instance;
+        return instance;
+    }
+
+    IoScheduler(const IoScheduler &) = delete;
+    IoScheduler &operator=(const IoScheduler &) = delete;
+
+    // Profundidad 0 desactiva el planificador
+    void configure(int queueDepth, int readDeadlineMs, int metadataDeadlineMs, int writeDeadlineMs);
+    // Profundidad propia de un dispositivo ("sda", "nvme0n1p2"...)
+    void setDeviceQueueDepth(const QString &device, int queueDepth);
+
+    // Dispositivo de un archivo abierto o, con fd < 0, de una ruta
+    static QString deviceFor(int fd, const QString &path);
+
+    // Espera turno en el dispositivo; bloquea el hilo llamador mientras tanto
+    Ticket acquire(const QString &device, Kind kind);
+
+    Stats stats() const;
+
+private:
+    IoScheduler() { m_clock.start(); }
+
+    struct Waiter {
+        Kind kind;
+        qint64 enqueuedNs;
+        qint64 deadlineNs;
+        bool granted = false;
+    };
+
+    Device *deviceLocked(const QString &name);
+    void pruneIdleLocked(qint64 nowNs);
+    int depthFor(const Device &device) const;
+    void dispatchLocked(Device &device);
+    void grantLocked(Device &device, Waiter *waiter, qint64 nowNs);
+    void finish(Device *device, Kind kind, qint64 startNs);
+
+    mutable QMutex m_mutex;
+    // Los tickets apuntan a ellos: solo se liberan sin turnos en curso ni esperas
+    QHash<QString, Device *> m_devices;
+    QHash<QString, int> m_deviceDepths;
+    QElapsedTimer m_clock;
+
+    std::atomic<int> m_queueDepth{DefaultQueueDepth};
+    int m_deadlineMs[KindCount] = {DefaultReadDeadlineMs, DefaultMetadataDeadlineMs, DefaultWriteDeadlineMs};
+};
+
+#endif // IOSCHEDULER_H
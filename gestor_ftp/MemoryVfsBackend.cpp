@@ -0,0 +1,659 @@
+#include "MemoryVfsBackend.h"
+#include <QDateTime>
+#include <QStringList>
+#include <QDebug>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+// Bloque estático que devuelve map(): los datos sintéticos no se generan por lectura
+constexpr qint64 FillBlock = 1024 * 1024;
+// Periodo del patrón; primo para que no coincida con ningún tamaño de bloque
+constexpr int PatternPeriod = 251;
+
+constexpr quint64 FnvOffset = 14695981039346656037ull;
+constexpr quint64 FnvPrime = 1099511628211ull;
+
+const char *zeroBlock()
+{
+    static const std::vector<char> block(size_t(FillBlock), 0);
+    return block.data();
+}
+
+const char *patternBlock()
+{
+    // Con PatternPeriod bytes de más, cualquier desplazamiento tiene un bloque completo
+    static const std::vector<char> block = []() {
+        std::vector<char> bytes(size_t(FillBlock + PatternPeriod));
+        for (size_t i = 0; i < bytes.size(); ++i) {
+            bytes[i] = char(i % PatternPeriod);
+        }
+        return bytes;
+    }();
+    return block.data();
+}
+
+// FNV-1a de 64 bits, incremental: el hash de "padre/nombre" sigue al de "padre/"
+quint64 hashPath(QStringView path, quint64 hash = FnvOffset)
+{
+    for (const QChar c : path) {
+        hash ^= c.unicode();
+        hash *= FnvPrime;
+    }
+    return hash;
+}
+
+quint64 hashName(const char *name, int length, quint64 hash)
+{
+    for (int i = 0; i < length; ++i) {
+        hash ^= quint8(name[i]);
+        hash *= FnvPrime;
+    }
+    return hash;
+}
+
+// Índice decimal sin ceros a la izquierda, como lo escribe el listado
+bool parseIndex(QStringView digits, quint64 &value)
+{
+    if (digits.isEmpty() || digits.size() > 19 || (digits.size() > 1 && digits.front() == u'0')) {
+        return false;
+    }
+    value = 0;
+    for (const QChar c : digits) {
+        if (c < u'0' || c > u'9') {
+            return false;
+        }
+        value = value * 10 + quint64(c.unicode() - u'0');
+    }
+    return true;
+}
+
+// "64M", "1G", "4096"
+bool parseBytes(const QString &text, qint64 &bytes)
+{
+    QString number = text.trimmed().toUpper();
+    qint64 multiplier = 1;
+    if (number.endsWith(QLatin1Char('K'))) {
+        multiplier = 1024;
+    } else if (number.endsWith(QLatin1Char('M'))) {
+        multiplier = 1024 * 1024;
+    } else if (number.endsWith(QLatin1Char('G'))) {
+        multiplier = 1024ll * 1024 * 1024;
+    } else if (number.endsWith(QLatin1Char('T'))) {
+        multiplier = 1024ll * 1024 * 1024 * 1024;
+    }
+    if (multiplier > 1) {
+        number.chop(1);
+    }
+    bool ok = false;
+    const qint64 value = number.toLongLong(&ok);
+    if (!ok || value < 0 || value > std::numeric_limits<qint64>::max() / multiplier) {
+        return false;
+    }
+    bytes = value * multiplier;
+    return true;
+}
+
+qint64 nowSecs()
+{
+    return QDateTime::currentSecsSinceEpoch();
+}
+}
+
+// =====================================================================================
+// Seccion: Lectura, escritura y listado
+// =====================================================================================
+
+class MemoryVfsBackend::MemoryLister : public VfsBackend::Lister {
+public:
+    MemoryLister(MemoryVfsBackend *backend, const QString &path, quint64 dirs, quint64 files,
+                 QStringList extra)
+        : m_backend(backend), m_path(path), m_dirs(dirs), m_files(files), m_extra(std::move(extra)),
+          m_prefixHash(path.isEmpty() ? FnvOffset : hashPath(u"/", hashPath(path)))
+    {
+    }
+
+    int next(std::vector<NamedEntry> &out, int maxEntries) override
+    {
+        QReadLocker locker(&m_backend->m_lock);
+        // Sin cambios de los clientes en este directorio no hace falta mirar cada nombre
+        const bool checkOverlay = !m_backend->m_removed.isEmpty() || m_backend->m_children.contains(m_path);
+        const quint64 total = m_dirs + m_files;
+        int added = 0;
+        char name[32];
+        while (added < maxEntries && m_index < total) {
+            const quint64 i = m_index++;
+            const bool isDir = i < m_dirs;
+            const int length = isDir ? std::snprintf(name, sizeof(name), "d%llu", static_cast<unsigned long long>(i))
+                                     : std::snprintf(name, sizeof(name), "f%llu.bin",
+                                                     static_cast<unsigned long long>(i - m_dirs));
+            if (checkOverlay) {
+                const QString child = childOf(m_path, QString::fromLatin1(name, length));
+                if (m_backend->m_nodes.contains(child) || m_backend->m_removed.contains(child)) {
+                    continue;   // Reemplazada o borrada: sale con las demás de la capa escribible
+                }
+            }
+            NamedEntry named;
+            named.name = QByteArray(name, length);
+            named.entry = m_backend->makeEntry(isDir, isDir ? 0 : m_backend->m_spec.fileSize,
+                                               m_backend->m_createdSecs, hashName(name, length, m_prefixHash));
+            out.push_back(std::move(named));
+            added++;
+        }
+        while (added < maxEntries && m_extraPos < m_extra.size()) {
+            const QString &childName = m_extra.at(m_extraPos++);
+            NamedEntry named;
+            if (!m_backend->statLocked(childOf(m_path, childName), named.entry)) {
+                continue;   // Borrada mientras se listaba
+            }
+            named.name = childName.toUtf8();
+            out.push_back(std::move(named));
+            added++;
+        }
+        return added;
+    }
+
+private:
+    MemoryVfsBackend *m_backend;
+    const QString m_path;
+    const quint64 m_dirs;
+    const quint64 m_files;
+    const QStringList m_extra;      // Nombres de la capa escribible al empezar
+    const quint64 m_prefixHash;
+    quint64 m_index = 0;
+    qsizetype m_extraPos = 0;
+};
+
+class MemoryVfsBackend::MemorySource : public VfsBackend::Source {
+public:
+    MemorySource(Fill fill, qint64 size, const QByteArray &data) : m_fill(fill), m_size(size), m_data(data) {}
+
+    qint64 size() const override { return m_size; }
+
+    qint64 map(qint64 offset, qint64 maxBytes, const char **data) override
+    {
+        if (offset < 0 || offset > m_size) {
+            return -1;
+        }
+        const qint64 length = qMin(qMin(maxBytes, m_size - offset), FillBlock);
+        if (length <= 0) {
+            return 0;
+        }
+        switch (m_fill) {
+        case Fill::Stored:
+            // Copia compartida del contenido: una subida simultánea no la cambia
+            *data = m_data.constData() + offset;
+            return length;
+        case Fill::Pattern:
+            *data = patternBlock() + offset % PatternPeriod;
+            return length;
+        case Fill::Zero:
+            break;
+        }
+        *data = zeroBlock();
+        return length;
+    }
+
+private:
+    const Fill m_fill;
+    const qint64 m_size;
+    const QByteArray m_data;
+};
+
+class MemoryVfsBackend::MemorySink : public VfsBackend::Sink {
+public:
+    MemorySink(MemoryVfsBackend *backend, const QString &path, qint64 offset)
+        : m_backend(backend), m_path(path), m_position(offset) {}
+
+    qint64 write(const char *data, qint64 length) override
+    {
+        QWriteLocker locker(&m_backend->m_lock);
+        auto it = m_backend->m_nodes.find(m_path);
+        if (it == m_backend->m_nodes.end() || it->isDir) {
+            return -1;  // Borrado o reemplazado mientras se subía
+        }
+        Node &node = *it;
+        const qint64 end = m_position + length;
+        if (node.fill == Fill::Stored) {
+            const qint64 previous = node.data.size();
+            const qint64 growth = qMax<qint64>(0, end - previous);
+            if (m_backend->m_stored + growth <= m_backend->m_spec.storeBytes) {
+                if (growth > 0) {
+                    node.data.resize(end);
+                    std::memset(node.data.data() + previous, 0, size_t(end - previous));
+                }
+                std::memcpy(node.data.data() + m_position, data, size_t(length));
+                m_backend->m_stored += growth;
+            } else {
+                // Sin presupuesto: desde aquí solo cuenta el tamaño
+                m_backend->m_stored -= previous;
+                node.data = QByteArray();
+                node.fill = Fill::Zero;
+            }
+        }
+        node.size = qMax(node.size, end);
+        node.mtimeSecs = nowSecs();
+        m_position = end;
+        return length;
+    }
+
+    bool finish() override { return true; }
+
+private:
+    MemoryVfsBackend *m_backend;
+    const QString m_path;
+    qint64 m_position;
+};
+
+// =====================================================================================
+// Seccion: Especificación
+// =====================================================================================
+
+MemoryVfsBackend::MemoryVfsBackend(const Spec &spec)
+    : m_spec(spec),
+      m_source(QString("mem:dirs=%1,depth=%2,files=%3,size=%4,pattern=%5,store=%6")
+                   .arg(spec.dirs).arg(spec.depth).arg(spec.files).arg(spec.fileSize)
+                   .arg(QLatin1String(spec.pattern ? "pattern" : "zero")).arg(spec.storeBytes)),
+      m_createdSecs(nowSecs())
+{
+}
+
+bool MemoryVfsBackend::parseSpec(const QString &text, Spec &spec)
+{
+    QString body = text.trimmed();
+    if (body.startsWith(QLatin1String("mem:"), Qt::CaseInsensitive)) {
+        body = body.mid(4);
+    }
+    spec = Spec();
+    for (const QString &item : body.split(QLatin1Char(','), Qt::SkipEmptyParts)) {
+        const QString key = item.section(QLatin1Char('='), 0, 0).trimmed().toLower();
+        const QString value = item.section(QLatin1Char('='), 1).trimmed().toLower();
+        bool ok = false;
+        if (key == QLatin1String("dirs")) {
+            spec.dirs = value.toULongLong(&ok);
+        } else if (key == QLatin1String("depth")) {
+            spec.depth = value.toInt(&ok);
+            ok = ok && spec.depth >= 0 && spec.depth <= MaxDepth;
+        } else if (key == QLatin1String("files")) {
+            spec.files = value.toULongLong(&ok);
+        } else if (key == QLatin1String("size")) {
+            ok = parseBytes(value, spec.fileSize);
+        } else if (key == QLatin1String("store")) {
+            ok = parseBytes(value, spec.storeBytes);
+        } else if (key == QLatin1String("pattern")) {
+            ok = value == QLatin1String("zero") || value == QLatin1String("pattern");
+            spec.pattern = value == QLatin1String("pattern");
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    // Sin subdirectorios la profundidad no significa nada, y al revés
+    if (spec.dirs == 0 || spec.depth == 0) {
+        spec.dirs = 0;
+        spec.depth = 0;
+    }
+    return true;
+}
+
+std::shared_ptr<MemoryVfsBackend> MemoryVfsBackend::fromSpec(const QString &text)
+{
+    Spec spec;
+    if (!parseSpec(text, spec)) {
+        qWarning() << "Especificación de montaje en memoria no válida:" << text;
+        return nullptr;
+    }
+    return std::make_shared<MemoryVfsBackend>(spec);
+}
+
+// =====================================================================================
+// Seccion: Árbol sintético y capa escribible
+// =====================================================================================
+
+bool MemoryVfsBackend::syntheticKind(QStringView path, bool &isDir) const
+{
+    isDir = true;
+    if (path.isEmpty()) {
+        return true;
+    }
+    int level = 0;
+    qsizetype pos = 0;
+    while (true) {
+        const qsizetype slash = path.indexOf(u'/', pos);
+        const bool last = slash < 0;
+        const QStringView part = path.mid(pos, last ? path.size() - pos : slash - pos);
+        quint64 index = 0;
+        if (part.startsWith(u'd') && level < m_spec.depth && parseIndex(part.mid(1), index) && index < m_spec.dirs) {
+            level++;
+        } else if (last && part.startsWith(u'f') && part.endsWith(u".bin")
+                   && parseIndex(part.mid(1, part.size() - 5), index) && index < m_spec.files) {
+            isDir = false;
+            return true;
+        } else {
+            return false;
+        }
+        if (last) {
+            return true;
+        }
+        pos = slash + 1;
+    }
+}
+
+bool MemoryVfsBackend::hiddenLocked(const QString &path) const
+{
+    if (m_removed.isEmpty()) {
+        return false;
+    }
+    // Borrada ella o cualquiera de sus antecesores
+    QString current = path;
+    while (!current.isEmpty()) {
+        if (m_removed.contains(current)) {
+            return true;
+        }
+        current = parentOf(current);
+    }
+    return false;
+}
+
+bool MemoryVfsBackend::syntheticVisibleLocked(const QString &path, bool &isDir) const
+{
+    return syntheticKind(path, isDir) && !hiddenLocked(path);
+}
+
+MemoryVfsBackend::Entry MemoryVfsBackend::makeEntry(bool isDir, qint64 size, qint64 mtimeSecs, quint64 inode) const
+{
+    Entry entry;
+    entry.isDir = isDir;
+    entry.mode = isDir ? 0755 : 0644;
+    entry.size = isDir ? 0 : size;
+    entry.mtimeSecs = mtimeSecs;
+    entry.device = quint64(quintptr(this));
+    entry.inode = inode;
+    return entry;
+}
+
+MemoryVfsBackend::Entry MemoryVfsBackend::nodeEntry(const QString &path, const Node &node) const
+{
+    return makeEntry(node.isDir, node.size, node.mtimeSecs, hashPath(path));
+}
+
+bool MemoryVfsBackend::statLocked(const QString &path, Entry &entry) const
+{
+    const auto node = m_nodes.constFind(path);
+    if (node != m_nodes.constEnd()) {
+        entry = nodeEntry(path, *node);
+        return true;
+    }
+    bool isDir = false;
+    if (!syntheticVisibleLocked(path, isDir)) {
+        return false;
+    }
+    entry = makeEntry(isDir, m_spec.fileSize, m_createdSecs, hashPath(path));
+    return true;
+}
+
+void MemoryVfsBackend::insertNodeLocked(const QString &path, const Node &node)
+{
+    auto previous = m_nodes.constFind(path);
+    if (previous != m_nodes.constEnd()) {
+        m_stored -= previous->data.size();
+    }
+    m_nodes.insert(path, node);
+    m_stored += node.data.size();
+    m_children[parentOf(path)].insert(nameOf(path));
+}
+
+void MemoryVfsBackend::removeNodeLocked(const QString &path)
+{
+    auto node = m_nodes.find(path);
+    if (node == m_nodes.end()) {
+        return;
+    }
+    m_stored -= node->data.size();
+    m_nodes.erase(node);
+    const QString parent = parentOf(path);
+    auto children = m_children.find(parent);
+    if (children != m_children.end()) {
+        children->remove(nameOf(path));
+        if (children->isEmpty()) {
+            m_children.erase(children);
+        }
+    }
+}
+
+void MemoryVfsBackend::removeTreeLocked(const QString &path)
+{
+    const QString prefix = path + QLatin1Char('/');
+    for (auto it = m_nodes.begin(); it != m_nodes.end();) {
+        if (it.key().startsWith(prefix)) {
+            m_stored -= it->data.size();
+            it = m_nodes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = m_children.begin(); it != m_children.end();) {
+        if (it.key() == path || it.key().startsWith(prefix)) {
+            it = m_children.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = m_removed.begin(); it != m_removed.end();) {
+        if (it->startsWith(prefix)) {
+            it = m_removed.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    removeNodeLocked(path);
+
+    // La entrada sintética del mismo nombre queda tapada, con todo lo que cuelga de ella
+    bool isDir = false;
+    if (syntheticKind(path, isDir)) {
+        m_removed.insert(path);
+    }
+}
+
+QString MemoryVfsBackend::parentOf(const QString &path)
+{
+    const qsizetype slash = path.lastIndexOf(QLatin1Char('/'));
+    return slash < 0 ? QString() : path.left(slash);
+}
+
+QString MemoryVfsBackend::nameOf(const QString &path)
+{
+    return path.mid(path.lastIndexOf(QLatin1Char('/')) + 1);
+}
+
+QString MemoryVfsBackend::childOf(const QString &parent, const QString &name)
+{
+    return parent.isEmpty() ? name : parent + QLatin1Char('/') + name;
+}
+
+qint64 MemoryVfsBackend::storedBytes() const
+{
+    QReadLocker locker(&m_lock);
+    return m_stored;
+}
+
+// =====================================================================================
+// Seccion: Operaciones del backend
+// =====================================================================================
+
+bool MemoryVfsBackend::stat(const QString &path, Entry &entry)
+{
+    QReadLocker locker(&m_lock);
+    return statLocked(path, entry);
+}
+
+std::unique_ptr<VfsBackend::Lister> MemoryVfsBackend::list(const QString &path)
+{
+    QReadLocker locker(&m_lock);
+    Entry entry;
+    if (!statLocked(path, entry) || !entry.isDir) {
+        return nullptr;
+    }
+    quint64 dirs = 0;
+    quint64 files = 0;
+    bool isDir = false;
+    if (syntheticVisibleLocked(path, isDir)) {
+        const int level = path.isEmpty() ? 0 : int(path.count(QLatin1Char('/'))) + 1;
+        dirs = level < m_spec.depth ? m_spec.dirs : 0;
+        files = m_spec.files;
+    }
+    QStringList extra = m_children.value(path).values();
+    std::sort(extra.begin(), extra.end());
+    return std::make_unique<MemoryLister>(this, path, dirs, files, std::move(extra));
+}
+
+bool MemoryVfsBackend::mkdir(const QString &path)
+{
+    QWriteLocker locker(&m_lock);
+    QString current;
+    for (const QString &part : path.split(QLatin1Char('/'), Qt::SkipEmptyParts)) {
+        current = childOf(current, part);
+        Entry entry;
+        if (statLocked(current, entry)) {
+            if (!entry.isDir) {
+                return false;
+            }
+            continue;
+        }
+        Node node;
+        node.isDir = true;
+        node.mtimeSecs = nowSecs();
+        insertNodeLocked(current, node);
+    }
+    return true;
+}
+
+bool MemoryVfsBackend::rmdir(const QString &path)
+{
+    QWriteLocker locker(&m_lock);
+    Entry entry;
+    if (path.isEmpty() || !statLocked(path, entry) || !entry.isDir) {
+        return false;
+    }
+    removeTreeLocked(path);
+    return true;
+}
+
+bool MemoryVfsBackend::unlink(const QString &path)
+{
+    QWriteLocker locker(&m_lock);
+    Entry entry;
+    if (path.isEmpty() || !statLocked(path, entry) || entry.isDir) {
+        return false;
+    }
+    removeTreeLocked(path);
+    return true;
+}
+
+bool MemoryVfsBackend::rename(const QString &from, const QString &to)
+{
+    QWriteLocker locker(&m_lock);
+    Entry source;
+    Entry parent;
+    Entry existing;
+    if (from.isEmpty() || to.isEmpty() || !statLocked(from, source)
+        || !statLocked(parentOf(to), parent) || !parent.isDir) {
+        return false;
+    }
+    if (from == to) {
+        return true;
+    }
+    const bool targetExists = statLocked(to, existing);
+    if (targetExists && (source.isDir || existing.isDir)) {
+        return false;   // Solo se reemplazan archivos
+    }
+
+    // Se mueven los nodos de la capa escribible; un archivo sintético pasa a ella
+    // con su descripción, sin contenido
+    QList<QPair<QString, Node>> moved;
+    if (source.isDir) {
+        bool isDir = false;
+        if (syntheticVisibleLocked(from, isDir) || to.startsWith(from + QLatin1Char('/'))) {
+            return false;
+        }
+        const QString prefix = from + QLatin1Char('/');
+        for (auto it = m_nodes.constBegin(); it != m_nodes.constEnd(); ++it) {
+            if (it.key() == from || it.key().startsWith(prefix)) {
+                moved.append({to + it.key().mid(from.size()), it.value()});
+            }
+        }
+    } else {
+        const auto node = m_nodes.constFind(from);
+        if (node != m_nodes.constEnd()) {
+            moved.append({to, node.value()});
+        } else {
+            Node synthetic;
+            synthetic.fill = m_spec.pattern ? Fill::Pattern : Fill::Zero;
+            synthetic.size = m_spec.fileSize;
+            synthetic.mtimeSecs = m_createdSecs;
+            moved.append({to, synthetic});
+        }
+    }
+
+    removeTreeLocked(from);
+    if (targetExists) {
+        removeTreeLocked(to);
+    }
+    // Los padres antes que los hijos, para que el índice de nombres quede completo
+    std::sort(moved.begin(), moved.end(), [](const QPair<QString, Node> &a, const QPair<QString, Node> &b) {
+        return a.first.size() < b.first.size();
+    });
+    for (const auto &node : moved) {
+        insertNodeLocked(node.first, node.second);
+    }
+    return true;
+}
+
+std::unique_ptr<VfsBackend::Source> MemoryVfsBackend::openSource(const QString &path)
+{
+    QReadLocker locker(&m_lock);
+    const auto node = m_nodes.constFind(path);
+    if (node != m_nodes.constEnd()) {
+        if (node->isDir) {
+            return nullptr;
+        }
+        return std::make_unique<MemorySource>(node->fill, node->size, node->data);
+    }
+    bool isDir = false;
+    if (!syntheticVisibleLocked(path, isDir) || isDir) {
+        return nullptr;
+    }
+    return std::make_unique<MemorySource>(m_spec.pattern ? Fill::Pattern : Fill::Zero, m_spec.fileSize, QByteArray());
+}
+
+std::unique_ptr<VfsBackend::Sink> MemoryVfsBackend::openSink(const QString &path, qint64 offset)
+{
+    QWriteLocker locker(&m_lock);
+    Entry parent;
+    Entry existing;
+    if (path.isEmpty() || !statLocked(parentOf(path), parent) || !parent.isDir) {
+        return nullptr;
+    }
+    const bool exists = statLocked(path, existing);
+    if (exists && existing.isDir) {
+        return nullptr;
+    }
+
+    if (offset <= 0 || !exists) {
+        Node created;
+        created.mtimeSecs = nowSecs();
+        insertNodeLocked(path, created);
+        offset = 0;
+    } else if (!m_nodes.contains(path)) {
+        // Continuar un archivo sintético: pasa a la capa escribible sin su contenido
+        Node synthetic;
+        synthetic.fill = m_spec.pattern ? Fill::Pattern : Fill::Zero;
+        synthetic.size = m_spec.fileSize;
+        synthetic.mtimeSecs = m_createdSecs;
+        insertNodeLocked(path, synthetic);
+    }
+    return std::make_unique<MemorySink>(this, path, offset);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "Vfs.h"
+#include <QHash>
+#include <QSet>
+#include <QReadWriteLock>
+
+// Backend en memoria para pruebas de carga: mide el coste del protocolo y de los
+// hilos del servidor sin que intervenga el disco.
+//
+// El árbol sintético no ocupa memoria: se calcula a partir de la especificación.
+// Cada directorio de nivel menor que 'depth' tiene 'dirs' subdirectorios (d0, d1...)
+// y todos tienen 'files' archivos (f0.bin, f1.bin...) de 'size' bytes, con ceros o
+// con un patrón (byte i = i % 251) que permite detectar datos cambiados de sitio.
+// Un directorio con millones de entradas se lista por tandas sin construirlo.
+//
+// Encima hay una capa escribible: STOR, MKD, DELE, RMD y RNTO crean nodos propios o
+// marcan como borradas entradas sintéticas. El contenido subido se guarda hasta
+// 'store' bytes en total; a partir de ahí solo se anota el tamaño y se lee como
+// ceros. Los directorios sintéticos no se pueden renombrar.
+//
+// Especificación: "mem:dirs=10,depth=3,files=1000,size=1M,pattern=zero,store=64M"
+class MemoryVfsBackend : public VfsBackend {
+public:
+    struct Spec {
+        quint64 dirs = 0;
+        int depth = 0;
+        quint64 files = 0;
+        qint64 fileSize = 0;
+        bool pattern = false;
+        qint64 storeBytes = 64 * 1024 * 1024;
+    };
+
+    static constexpr int MaxDepth = 32;
+
+    explicit MemoryVfsBackend(const Spec &spec);
+
+    // "dirs=10,files=1000,size=1M" (con o sin "mem:"); falso si algo no se entiende
+    static bool parseSpec(const QString &text, Spec &spec);
+    static std::shared_ptr<MemoryVfsBackend> fromSpec(const QString &text);
+
+    QByteArray kind() const override { return QByteArrayLiteral("memory"); }
+    QString source() const override { return m_source; }
+
+    bool stat(const QString &path, Entry &entry) override;
+    std::unique_ptr<Lister> list(const QString &path) override;
+    bool mkdir(const QString &path) override;
+    bool rmdir(const QString &path) override;
+    bool unlink(const QString &path) override;
+    bool rename(const QString &from, const QString &to) override;
+    std::unique_ptr<Source> openSource(const QString &path) override;
+    std::unique_ptr<Sink> openSink(const QString &path, qint64 offset) override;
+
+    qint64 storedBytes() const;
+
+private:
+    class MemoryLister;
+    class MemorySource;
+    class MemorySink;
+
+    enum class Fill { Zero, Pattern, Stored };
+
+    // Entrada creada o modificada por los clientes
+    struct Node {
+        bool isDir = false;
+        Fill fill = Fill::Stored;
+        QByteArray data;            // Solo con Fill::Stored
+        qint64 size = 0;
+        qint64 mtimeSecs = 0;
+    };
+
+    bool syntheticKind(QStringView path, bool &isDir) const;
+    bool statLocked(const QString &path, Entry &entry) const;
+    bool hiddenLocked(const QString &path) const;
+    bool syntheticVisibleLocked(const QString &path, bool &isDir) const;
+    void insertNodeLocked(const QString &path, const Node &node);
+    void removeNodeLocked(const QString &path);
+    void removeTreeLocked(const QString &path);
+    Entry makeEntry(bool isDir, qint64 size, qint64 mtimeSecs, quint64 inode) const;
+    Entry nodeEntry(const QString &path, const Node &node) const;
+    static QString parentOf(const QString &path);
+    static QString nameOf(const QString &path);
+    static QString childOf(const QString &parent, const QString &name);
+
+    const Spec m_spec;
+    const QString m_source;
+    const qint64 m_createdSecs;
+    mutable QReadWriteLock m_lock;
+    QHash<QString, Node> m_nodes;
+    QHash<QString, QSet<QString>> m_children;   // Nombres de m_nodes por directorio padre
+    QSet<QString> m_removed;                    // Entradas sintéticas borradas, con lo que cuelga
+    qint64 m_stored = 0;
+};
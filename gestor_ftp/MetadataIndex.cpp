@@ -0,0 +1,960 @@
+#include "MetadataIndex.h"
+#include "IoScheduler.h"
+#include "ChangeJournal.h"
+#include "FileNameIndex.h"
+#include <QThread>
+#include <QObject>
+#include <QTimer>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <QSocketNotifier>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+#ifdef Q_OS_LINUX
+// Cualquier cambio en las entradas de un directorio vigilado
+constexpr quint32 WatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE |
+                              IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+#endif
+
+// Los cambios se agrupan durante este tiempo y se escriben en una sola transacción
+constexpr int FlushDelayMs = 200;
+
+// Un archivo modificado hace menos de esto se sigue escribiendo: sus IN_MODIFY llegan
+// en cada tanda y rehacer el SHA-256 cada vez leería el archivo entero una y otra vez
+constexpr qint64 HashSettleSecs = 2;
+constexpr int HashSettleMs = int(HashSettleSecs * 1000) + 500;
+
+// Conexión de lectura del hilo actual; se cierra al terminar el hilo
+struct ReaderConnection {
+    QString name;
+    quint64 generation = 0;
+    ~ReaderConnection() {
+        if (!name.isEmpty()) {
+            QSqlDatabase::removeDatabase(name);
+        }
+    }
+};
+thread_local ReaderConnection t_reader;
+std::atomic<quint64> g_connectionCounter{0};
+
+QSqlDatabase readerConnection(const QString &dbPath, quint64 generation)
+{
+    if (!t_reader.name.isEmpty() && t_reader.generation == generation) {
+        return QSqlDatabase::database(t_reader.name, false);
+    }
+    if (!t_reader.name.isEmpty()) {
+        QSqlDatabase::removeDatabase(t_reader.name);
+    }
+    t_reader.name = QString("metadata_index_%1").arg(g_connectionCounter.fetch_add(1));
+    t_reader.generation = generation;
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", t_reader.name);
+    db.setDatabaseName(dbPath);
+    // Solo lectura: si el índice aún no existe la apertura falla y se va al disco
+    db.setConnectOptions("QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=1000");
+    return db;
+}
+
+QByteArray nameBytes(const QString &name)
+{
+#ifdef Q_OS_LINUX
+    return QFile::encodeName(name);
+#else
+    return name.toUtf8();
+#endif
+}
+
+QString parentOf(const QString &path)
+{
+    const int slash = path.lastIndexOf(QLatin1Char('/'));
+    return slash <= 0 ? QStringLiteral("/") : path.left(slash);
+}
+
+// Límites [inferior, superior) de las rutas que cuelgan de 'path' ('/' + 1 == '0')
+void subtreeBounds(const QString &path, QString &lower, QString &upper)
+{
+    lower = path.endsWith(QLatin1Char('/')) ? path : path + QLatin1Char('/');
+    upper = lower.left(lower.size() - 1) + QLatin1Char('0');
+}
+
+void readEntry(const QSqlQuery &query, int first, DirectoryLister::Entry &entry)
+{
+    entry.isDir = query.value(first).toBool();
+    entry.isLink = query.value(first + 1).toBool();
+    entry.mode = query.value(first + 2).toUInt();
+    entry.size = query.value(first + 3).toLongLong();
+    entry.mtimeSecs = query.value(first + 4).toLongLong();
+    entry.device = quint64(query.value(first + 5).toLongLong());
+    entry.inode = quint64(query.value(first + 6).toLongLong());
+}
+} // namespace
+
+MetadataIndex::MetadataIndex() = default;
+
+// =====================================================================================
+// Seccion: Configuración
+// =====================================================================================
+
+void MetadataIndex::configure(bool enabled, const QString &root, const QString &dbPath,
+                              qint64 hashMaxBytes, int maxWatches, int rescanMinutes)
+{
+    QString path = dbPath;
+    if (path.isEmpty()) {
+        path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/db/metadata_index.db";
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        m_root = QDir::cleanPath(QDir(root).absolutePath());
+        m_dbPath = path;
+        m_hashMaxBytes = qMax<qint64>(0, hashMaxBytes);
+        m_maxWatches = qMax(0, maxWatches);
+        m_rescanMinutes = qMax(0, rescanMinutes);
+        m_configGeneration++;
+        m_dirty.clear();
+        m_dirtyParents.clear();
+        m_pending.clear();
+    }
+    m_enabled.store(enabled);
+    if (!enabled) {
+        qInfo() << "Índice de metadatos desactivado";
+        return;
+    }
+
+    // Abrir SQLite no carga nada: el arranque no depende del tamaño del árbol
+    startThread();
+    QMetaObject::invokeMethod(m_context, [this]() {
+        openDatabase();
+        beginPass();
+    }, Qt::QueuedConnection);
+    qInfo() << "Índice de metadatos en" << path << "para" << root;
+}
+
+void MetadataIndex::setRoot(const QString &root)
+{
+    const QString clean = QDir::cleanPath(QDir(root).absolutePath());
+    {
+        QMutexLocker locker(&m_mutex);
+        if (clean == m_root) {
+            return;
+        }
+        m_root = clean;
+        m_dirty.clear();
+        m_dirtyParents.clear();
+        m_pending.clear();
+    }
+    if (!m_enabled.load()) {
+        return;
+    }
+    QMetaObject::invokeMethod(m_context, [this]() {
+        openDatabase();
+        beginPass();
+    }, Qt::QueuedConnection);
+}
+
+void MetadataIndex::startThread()
+{
+    if (m_thread) {
+        return;
+    }
+    // El hilo y su contexto viven lo mismo que el proceso
+    m_thread = new QThread;
+    m_thread->setObjectName(QStringLiteral("MetadataIndex"));
+    m_context = new QObject;
+    m_context->moveToThread(m_thread);
+    m_thread->start();
+
+    QMetaObject::invokeMethod(m_context, [this]() {
+        m_flushTimer = new QTimer(m_context);
+        m_flushTimer->setSingleShot(true);
+        m_flushTimer->setInterval(FlushDelayMs);
+        QObject::connect(m_flushTimer, &QTimer::timeout, m_context, [this]() { applyPending(); });
+
+        // Archivos que estaban cambiando: calcular su hash cuando dejen de hacerlo
+        m_hashTimer = new QTimer(m_context);
+        m_hashTimer->setSingleShot(true);
+        m_hashTimer->setInterval(HashSettleMs);
+        QObject::connect(m_hashTimer, &QTimer::timeout, m_context, [this]() {
+            if (m_hashDeferred.isEmpty()) {
+                return;
+            }
+            {
+                QMutexLocker locker(&m_mutex);
+                for (const QString &path : std::as_const(m_hashDeferred)) {
+                    m_pending.insert(path);
+                }
+            }
+            m_hashDeferred.clear();
+            applyPending();
+        });
+
+        m_rescanTimer = new QTimer(m_context);
+        QObject::connect(m_rescanTimer, &QTimer::timeout, m_context, [this]() {
+            if (m_crawlQueue.empty()) {
+                beginPass();
+            }
+        });
+
+#ifdef Q_OS_LINUX
+        m_inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_inotifyFd < 0) {
+            qWarning() << "inotify no disponible, el índice de metadatos se revalidará por pasadas:"
+                       << qt_error_string(errno);
+        } else {
+            auto *notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, m_context);
+            QObject::connect(notifier, &QSocketNotifier::activated, m_context, [this]() { readEvents(); });
+        }
+#endif
+    }, Qt::QueuedConnection);
+}
+
+// =====================================================================================
+// Seccion: Base de datos (hilo del índice)
+// =====================================================================================
+
+void MetadataIndex::openDatabase()
+{
+    QString dbPath;
+    QString root;
+    quint64 generation = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        dbPath = m_dbPath;
+        root = m_root;
+        generation = m_configGeneration;
+    }
+
+    // Lo vigilado y lo encolado pertenecía a la configuración anterior
+    m_crawlQueue.clear();
+    m_queued.store(0);
+    m_hashDeferred.clear();
+#ifdef Q_OS_LINUX
+    for (auto it = m_watchPaths.constBegin(); it != m_watchPaths.constEnd(); ++it) {
+        ::inotify_rm_watch(m_inotifyFd, it.key());
+    }
+#endif
+    m_watchPaths.clear();
+    m_watchIds.clear();
+    m_watched.store(0);
+    m_watchLimitReached.store(false);
+
+    const QString name = QString("metadata_index_writer_%1").arg(generation);
+    if (!m_writerName.isEmpty() && m_writerName != name) {
+        QSqlDatabase::removeDatabase(m_writerName);
+    }
+    m_writerName = name;
+    m_dbReady = false;
+    QDir().mkpath(QFileInfo(dbPath).absolutePath());
+    QSqlDatabase db = QSqlDatabase::contains(name) ? QSqlDatabase::database(name, false)
+                                                   : QSqlDatabase::addDatabase("QSQLITE", name);
+    db.setDatabaseName(dbPath);
+    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "No se pudo abrir el índice de metadatos:" << db.lastError().text();
+        return;
+    }
+
+    QSqlQuery query(db);
+    // WAL: las sesiones leen mientras el rastreador escribe
+    query.exec("PRAGMA journal_mode=WAL");
+    query.exec("PRAGMA synchronous=NORMAL");
+    query.exec("CREATE TABLE IF NOT EXISTS meta (key TEXT PRIMARY KEY, value TEXT)");
+    query.exec("CREATE TABLE IF NOT EXISTS entries ("
+               "path TEXT PRIMARY KEY, "
+               "parent TEXT NOT NULL, "
+               "name TEXT NOT NULL, "
+               "is_dir INTEGER NOT NULL, "
+               "is_link INTEGER NOT NULL, "
+               "mode INTEGER NOT NULL, "
+               "size INTEGER NOT NULL, "
+               "mtime INTEGER NOT NULL, "
+               "device INTEGER NOT NULL, "
+               "inode INTEGER NOT NULL, "
+               "hash BLOB, "
+               "complete INTEGER NOT NULL DEFAULT 0)");   // Directorio con todas sus entradas
+    if (!query.exec("CREATE INDEX IF NOT EXISTS entries_parent ON entries (parent)")) {
+        qCritical() << "Error creando las tablas del índice de metadatos:" << query.lastError().text();
+        return;
+    }
+
+    // Otra raíz: lo guardado no sirve
+    query.exec("SELECT value FROM meta WHERE key = 'root'");
+    const QString storedRoot = query.next() ? query.value(0).toString() : QString();
+    if (storedRoot != root) {
+        if (!storedRoot.isEmpty()) {
+            qInfo() << "El directorio raíz cambió, se descarta el índice de metadatos de" << storedRoot;
+        }
+        query.exec("DELETE FROM entries");
+        query.prepare("INSERT OR REPLACE INTO meta (key, value) VALUES ('root', ?)");
+        query.addBindValue(root);
+        query.exec();
+    }
+    m_dbReady = true;
+}
+
+void MetadataIndex::writeRow(QSqlDatabase &db, const Row &row)
+{
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO entries (path, parent, name, is_dir, is_link, mode, size, mtime, device, inode, hash) "
+                  "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?) "
+                  "ON CONFLICT (path) DO UPDATE SET parent = excluded.parent, name = excluded.name, "
+                  "is_dir = excluded.is_dir, is_link = excluded.is_link, mode = excluded.mode, "
+                  "size = excluded.size, mtime = excluded.mtime, device = excluded.device, "
+                  "inode = excluded.inode, hash = excluded.hash");
+    query.addBindValue(row.path);
+    query.addBindValue(row.parent);
+    query.addBindValue(row.name);
+    query.addBindValue(int(row.entry.isDir));
+    query.addBindValue(int(row.entry.isLink));
+    query.addBindValue(row.entry.mode);
+    query.addBindValue(row.entry.size);
+    query.addBindValue(row.entry.mtimeSecs);
+    query.addBindValue(qint64(row.entry.device));
+    query.addBindValue(qint64(row.entry.inode));
+    query.addBindValue(row.hash.isEmpty() ? QVariant() : QVariant(row.hash));
+    if (!query.exec()) {
+        qWarning() << "Error escribiendo en el índice de metadatos:" << row.path << query.lastError().text();
+    }
+}
+
+void MetadataIndex::removeTree(QSqlDatabase &db, const QString &path)
+{
+    QString lower;
+    QString upper;
+    subtreeBounds(path, lower, upper);
+    QSqlQuery query(db);
+    query.prepare("DELETE FROM entries WHERE path = ? OR (path >= ? AND path < ?)");
+    query.addBindValue(path);
+    query.addBindValue(lower);
+    query.addBindValue(upper);
+    query.exec();
+}
+
+QByteArray MetadataIndex::hashFor(const Row &row, const QByteArray &previousHash, qint64 previousSize,
+                                  qint64 previousMtime)
+{
+    if (row.entry.isDir || m_hashMaxBytes <= 0 || row.entry.size > m_hashMaxBytes) {
+        return QByteArray();
+    }
+    if (!previousHash.isEmpty() && previousSize == row.entry.size && previousMtime == row.entry.mtimeSecs) {
+        return previousHash; // Sin cambios desde el último cálculo
+    }
+    if (QDateTime::currentSecsSinceEpoch() - row.entry.mtimeSecs < HashSettleSecs) {
+        // Aún se escribe: se guarda sin hash y se vuelve a mirar cuando se asiente
+        m_hashDeferred.insert(row.path);
+        if (!m_hashTimer->isActive()) {
+            m_hashTimer->start();
+        }
+        return QByteArray();
+    }
+    QFile file(row.path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    // Turno propio por archivo: leerlo entero no debe retener el del listado
+    IoScheduler::Ticket io = IoScheduler::instance().acquire(IoScheduler::deviceFor(file.handle(), row.path),
+                                                             IoScheduler::Kind::Metadata);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(&file);
+    return hash.result().toHex();
+}
+
+// =====================================================================================
+// Seccion: Rastreador (hilo del índice)
+// =====================================================================================
+
+void MetadataIndex::beginPass()
+{
+    if (!m_dbReady || !m_enabled.load()) {
+        return;
+    }
+    QString root;
+    {
+        QMutexLocker locker(&m_mutex);
+        root = m_root;
+    }
+    QSqlDatabase db = QSqlDatabase::database(m_writerName, false);
+    Row row;
+    if (!DirectoryLister::statPath(root, row.entry) || !row.entry.isDir) {
+        qWarning() << "El directorio raíz no existe, no se indexa:" << root;
+        return;
+    }
+    // La raíz no tiene padre indexado: solo sirve para listar su contenido
+    row.path = root;
+    row.name = root;
+    writeRow(db, row);
+
+    m_passStartMs = QDateTime::currentMSecsSinceEpoch();
+    m_crawlQueue.push_back(root);
+    m_queued.store(int(m_crawlQueue.size()));
+    QMetaObject::invokeMethod(m_context, [this]() { crawlNext(); }, Qt::QueuedConnection);
+}
+
+void MetadataIndex::crawlNext()
+{
+    // Un directorio por vuelta: entre medias se atienden inotify y los cambios propios
+    if (m_crawlQueue.empty() || !m_enabled.load() || !m_dbReady) {
+        return;
+    }
+    const QString dir = m_crawlQueue.front();
+    m_crawlQueue.pop_front();
+    crawlDirectory(dir);
+    m_queued.store(int(m_crawlQueue.size()));
+
+    if (!m_crawlQueue.empty()) {
+        QMetaObject::invokeMethod(m_context, [this]() { crawlNext(); }, Qt::QueuedConnection);
+        return;
+    }
+    if (m_passStartMs > 0) {
+        const qint64 elapsed = QDateTime::currentMSecsSinceEpoch() - m_passStartMs;
+        m_passStartMs = 0;
+        m_passes.fetch_add(1);
+        m_lastPassMs.store(elapsed);
+        qInfo() << "Índice de metadatos revalidado en" << elapsed / 1000.0 << "s";
+    }
+    // Sin vigilancia completa, lo de fuera del servidor se recoge con pasadas periódicas
+    const bool watchedAll = m_inotifyFd >= 0 && !m_watchLimitReached.load();
+    if (!watchedAll && m_rescanMinutes > 0 && !m_rescanTimer->isActive()) {
+        m_rescanTimer->start(m_rescanMinutes * 60 * 1000);
+    } else if (watchedAll) {
+        m_rescanTimer->stop();
+    }
+}
+
+void MetadataIndex::crawlDirectory(const QString &dir)
+{
+    IoScheduler::Ticket io = IoScheduler::instance().acquire(IoScheduler::deviceFor(-1, dir),
+                                                             IoScheduler::Kind::Metadata);
+    QSqlDatabase db = QSqlDatabase::database(m_writerName, false);
+
+    // Vigilar antes de leer: lo que cambie durante la lectura llegará como evento
+    const bool watched = watchDirectory(dir);
+
+    struct Previous {
+        QByteArray hash;
+        qint64 size = 0;
+        qint64 mtime = 0;
+        bool isDir = false;
+    };
+    QHash<QString, Previous> previous;
+    QSqlQuery query(db);
+    // Un directorio ya completo que se revalida (arranque, pasada periódica): lo que
+    // cambió con el servidor parado o sin vigilancia va al diario de cambios
+    query.prepare("SELECT complete FROM entries WHERE path = ?");
+    query.addBindValue(dir);
+    query.exec();
+    const bool journalDiff = query.next() && query.value(0).toBool() && ChangeJournal::instance().isEnabled();
+
+    query.prepare("SELECT name, hash, size, mtime, is_dir FROM entries WHERE parent = ?");
+    query.addBindValue(dir);
+    query.exec();
+    while (query.next()) {
+        previous.insert(query.value(0).toString(),
+                        Previous{query.value(1).toByteArray(), query.value(2).toLongLong(), query.value(3).toLongLong(),
+                                 query.value(4).toBool()});
+    }
+
+    // Con el turno del disco solo se lee el directorio; los hashes piden el suyo
+    std::vector<Row> rows;
+    QDirIterator it(dir, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        Row row;
+        row.path = QDir::cleanPath(info.absoluteFilePath());
+        if (!DirectoryLister::statPath(row.path, row.entry)) {
+            continue; // Enlace roto o archivo especial: tampoco aparece en los listados
+        }
+        row.parent = dir;
+        row.name = info.fileName();
+        row.entry.isLink = info.isSymLink();
+        rows.push_back(std::move(row));
+    }
+    io.release();
+
+    db.transaction();
+    for (Row &row : rows) {
+        const auto old = previous.constFind(row.name);
+        row.hash = old != previous.constEnd() ? hashFor(row, old->hash, old->size, old->mtime)
+                                              : hashFor(row, QByteArray(), -1, -1);
+        if (journalDiff) {
+            if (old == previous.constEnd()) {
+                ChangeJournal::instance().recordExternal(ChangeJournal::Kind::Create, row.path, row.entry.isDir);
+            } else if (!row.entry.isDir && (old->size != row.entry.size || old->mtime != row.entry.mtimeSecs)) {
+                ChangeJournal::instance().recordExternal(ChangeJournal::Kind::Modify, row.path, false);
+            }
+        }
+        writeRow(db, row);
+        previous.remove(row.name);
+        m_crawledEntries.fetch_add(1, std::memory_order_relaxed);
+        // Sin seguir enlaces: un enlace a un ancestro daría un ciclo
+        if (row.entry.isDir && !row.entry.isLink) {
+            m_crawlQueue.push_back(row.path);
+        }
+    }
+    // Lo que ya no está en el directorio
+    for (auto gone = previous.constBegin(); gone != previous.constEnd(); ++gone) {
+        const QString path = dir + QLatin1Char('/') + gone.key();
+        if (journalDiff) {
+            ChangeJournal::instance().recordExternal(ChangeJournal::Kind::Delete, path, gone->isDir);
+        }
+        removeTree(db, path);
+        unwatchTree(path);
+    }
+    query.prepare("UPDATE entries SET complete = ? WHERE path = ?");
+    query.addBindValue(int(watched));
+    query.addBindValue(dir);
+    query.exec();
+    db.commit();
+    m_crawledDirectories.fetch_add(1, std::memory_order_relaxed);
+}
+
+// =====================================================================================
+// Seccion: Cambios
+// =====================================================================================
+
+bool MetadataIndex::insideRoot(const QString &path) const
+{
+    return path == m_root ||
+        (path.startsWith(m_root) && (m_root.endsWith(QLatin1Char('/')) || path.at(m_root.size()) == QLatin1Char('/')));
+}
+
+bool MetadataIndex::isDirtyLocked(const QString &path) const
+{
+    if (m_dirty.isEmpty()) {
+        return false;
+    }
+    // La ruta o un ancestro (un árbol borrado o movido) con cambios sin escribir
+    QString current = path;
+    while (current.size() >= m_root.size()) {
+        if (m_dirty.contains(current)) {
+            return true;
+        }
+        if (current == m_root) {
+            break;
+        }
+        current = parentOf(current);
+    }
+    return false;
+}
+
+void MetadataIndex::markDirty(const QString &path)
+{
+    // Con m_mutex tomado
+    m_dirty.insert(path);
+    m_dirtyParents.insert(parentOf(path));
+    m_pending.insert(path);
+}
+
+void MetadataIndex::refresh(const QString &path)
+{
+    if (!m_enabled.load()) {
+        return;
+    }
+    const QString clean = QDir::cleanPath(path);
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!insideRoot(clean)) {
+            return;
+        }
+        markDirty(clean);
+        // La fecha del directorio padre también cambió; se actualiza sin dejar de servirlo
+        if (clean != m_root) {
+            m_pending.insert(parentOf(clean));
+        }
+    }
+    QMetaObject::invokeMethod(m_context, [this]() {
+        if (!m_flushTimer->isActive()) {
+            m_flushTimer->start();
+        }
+    }, Qt::QueuedConnection);
+}
+
+void MetadataIndex::applyPending()
+{
+    if (!m_dbReady) {
+        return; // Siguen sucias: las consultas van al disco hasta que se escriban
+    }
+    QSet<QString> pending;
+    {
+        QMutexLocker locker(&m_mutex);
+        pending.swap(m_pending);
+    }
+    if (pending.isEmpty()) {
+        return;
+    }
+
+    QSqlDatabase db = QSqlDatabase::database(m_writerName, false);
+    db.transaction();
+    for (const QString &path : std::as_const(pending)) {
+        refreshPath(db, path);
+    }
+    db.commit();
+    m_updates.fetch_add(quint64(pending.size()), std::memory_order_relaxed);
+
+    // Ya escritas: vuelven a servirse desde el índice, salvo que hayan cambiado otra vez
+    QMutexLocker locker(&m_mutex);
+    for (const QString &path : std::as_const(pending)) {
+        if (!m_pending.contains(path)) {
+            m_dirty.remove(path);
+        }
+    }
+    m_dirtyParents.clear();
+    for (const QString &path : std::as_const(m_dirty)) {
+        m_dirtyParents.insert(parentOf(path));
+    }
+
+    if (!m_crawlQueue.empty()) {
+        QMetaObject::invokeMethod(m_context, [this]() { crawlNext(); }, Qt::QueuedConnection);
+    }
+}
+
+void MetadataIndex::refreshPath(QSqlDatabase &db, const QString &path)
+{
+    QSqlQuery query(db);
+    query.prepare("SELECT is_dir, complete, hash, size, mtime FROM entries WHERE path = ?");
+    query.addBindValue(path);
+    query.exec();
+    const bool known = query.next();
+    const bool wasDir = known && query.value(0).toBool();
+    const bool wasComplete = known && query.value(1).toBool();
+    const QByteArray oldHash = known ? query.value(2).toByteArray() : QByteArray();
+    const qint64 oldSize = known ? query.value(3).toLongLong() : -1;
+    const qint64 oldMtime = known ? query.value(4).toLongLong() : -1;
+
+    Row row;
+    row.path = path;
+    if (!DirectoryLister::statPath(path, row.entry)) {
+        if (known) {
+            removeTree(db, path);
+            if (wasDir) {
+                unwatchTree(path);
+            }
+        }
+        return;
+    }
+
+    bool isRoot = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        isRoot = path == m_root;
+    }
+    const QFileInfo info(path);
+    row.entry.isLink = info.isSymLink();
+    row.parent = isRoot ? QString() : parentOf(path);
+    row.name = isRoot ? path : info.fileName();
+    row.hash = hashFor(row, oldHash, oldSize, oldMtime);
+    writeRow(db, row);
+
+    // Directorio nuevo (MKD, SITE UNTAR, movido desde fuera): rastrearlo
+    if (row.entry.isDir && !row.entry.isLink && !wasComplete) {
+        m_crawlQueue.push_back(path);
+        m_queued.store(int(m_crawlQueue.size()));
+    }
+}
+
+// =====================================================================================
+// Seccion: Vigilancia (hilo del índice)
+// =====================================================================================
+
+bool MetadataIndex::watchDirectory(const QString &dir)
+{
+#ifdef Q_OS_LINUX
+    if (m_inotifyFd < 0) {
+        return true; // Sin inotify se confía en las pasadas periódicas
+    }
+    if (m_watchIds.contains(dir)) {
+        return true;
+    }
+    if (m_watchIds.size() >= m_maxWatches) {
+        m_watchLimitReached.store(true);
+        return false;
+    }
+    const int wd = ::inotify_add_watch(m_inotifyFd, QFile::encodeName(dir).constData(), WatchMask);
+    if (wd < 0) {
+        if (errno == ENOSPC && !m_watchLimitReached.exchange(true)) {
+            qWarning() << "Límite de vigilancias de inotify alcanzado; los directorios sin vigilar"
+                          " se listarán desde el disco (fs.inotify.max_user_watches)";
+        }
+        return false;
+    }
+    m_watchPaths.insert(wd, dir);
+    m_watchIds.insert(dir, wd);
+    m_watched.store(int(m_watchIds.size()));
+    return true;
+#else
+    Q_UNUSED(dir);
+    return true; // Sin vigilancia: cambios propios y pasadas periódicas
+#endif
+}
+
+void MetadataIndex::unwatchTree(const QString &path)
+{
+#ifdef Q_OS_LINUX
+    QString lower;
+    QString upper;
+    subtreeBounds(path, lower, upper);
+    for (auto it = m_watchIds.begin(); it != m_watchIds.end();) {
+        if (it.key() == path || (it.key() >= lower && it.key() < upper)) {
+            ::inotify_rm_watch(m_inotifyFd, it.value());
+            m_watchPaths.remove(it.value());
+            it = m_watchIds.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_watched.store(int(m_watchIds.size()));
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+void MetadataIndex::readEvents()
+{
+#ifdef Q_OS_LINUX
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    bool overflow = false;
+    bool changed = false;
+    // Para el diario de cambios: lo de fuera del servidor, con los movimientos emparejados
+    struct JournalEvent {
+        ChangeJournal::Kind kind;
+        QString path;
+        bool isDir;
+        QString newPath;
+    };
+    std::vector<JournalEvent> journal;
+    QHash<quint32, size_t> movedFrom;   // Cookie -> posición en 'journal'
+    const bool journalEnabled = ChangeJournal::instance().isEnabled();
+    // Altas, bajas y movimientos: cambian los nombres que ve SITE FIND
+    std::vector<QString> renamed;
+    const bool namesEnabled = FileNameIndex::instance().isEnabled();
+    QString root;
+    {
+        QMutexLocker locker(&m_mutex);
+        root = m_root;
+        for (;;) {
+            const ssize_t length = ::read(m_inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            for (const char *p = buffer; p < buffer + length;) {
+                const auto *event = reinterpret_cast<const struct inotify_event *>(p);
+                p += sizeof(struct inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                    continue;
+                }
+                if (event->mask & IN_IGNORED) {
+                    m_watchIds.remove(m_watchPaths.take(event->wd));
+                    continue;
+                }
+                const QString dir = m_watchPaths.value(event->wd);
+                if (dir.isEmpty()) {
+                    continue;
+                }
+                if (event->len > 0) {
+                    const QString path = dir + QLatin1Char('/') + QFile::decodeName(event->name);
+                    markDirty(path);
+                    m_pending.insert(dir); // Fecha del directorio
+                    if (namesEnabled && (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))) {
+                        renamed.push_back(path);
+                    }
+                    if (journalEnabled) {
+                        const bool isDir = event->mask & IN_ISDIR;
+                        if (event->mask & IN_MOVED_FROM) {
+                            movedFrom.insert(event->cookie, journal.size());
+                            journal.push_back({ChangeJournal::Kind::Delete, path, isDir, QString()});
+                        } else if (event->mask & IN_MOVED_TO) {
+                            const auto from = movedFrom.constFind(event->cookie);
+                            if (from != movedFrom.constEnd()) {
+                                journal[from.value()].kind = ChangeJournal::Kind::Rename;
+                                journal[from.value()].newPath = path;
+                                movedFrom.erase(from);
+                            } else {
+                                journal.push_back({ChangeJournal::Kind::Create, path, isDir, QString()});
+                            }
+                        } else if (event->mask & IN_CREATE) {
+                            journal.push_back({ChangeJournal::Kind::Create, path, isDir, QString()});
+                        } else if (event->mask & IN_CLOSE_WRITE) {
+                            journal.push_back({ChangeJournal::Kind::Modify, path, isDir, QString()});
+                        } else if (event->mask & IN_DELETE) {
+                            journal.push_back({ChangeJournal::Kind::Delete, path, isDir, QString()});
+                        }
+                    }
+                }
+                if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                    markDirty(dir);
+                }
+                changed = true;
+            }
+        }
+    }
+    m_watched.store(int(m_watchIds.size()));
+
+    // Un movimiento sin pareja en esta tanda salió del árbol vigilado: se anota como borrado
+    for (const JournalEvent &event : journal) {
+        ChangeJournal::instance().recordExternal(event.kind, event.path, event.isDir, event.newPath);
+    }
+    for (const QString &path : renamed) {
+        FileNameIndex::instance().refresh(path);
+    }
+
+    if (overflow) {
+        ChangeJournal::instance().recordExternal(ChangeJournal::Kind::Rescan, root, true);
+        FileNameIndex::instance().rebuild();
+        // Eventos perdidos: nada es de fiar hasta revalidarlo
+        m_overflows.fetch_add(1);
+        qWarning() << "Desbordamiento de la cola de inotify, se revalida el índice de metadatos";
+        if (m_dbReady) {
+            QSqlDatabase db = QSqlDatabase::database(m_writerName, false);
+            QSqlQuery query(db);
+            query.exec("UPDATE entries SET complete = 0");
+        }
+        if (m_crawlQueue.empty()) {
+            beginPass();
+        }
+    }
+    if (changed && !m_flushTimer->isActive()) {
+        m_flushTimer->start();
+    }
+#endif
+}
+
+// =====================================================================================
+// Seccion: Consultas (hilos de las sesiones)
+// =====================================================================================
+
+bool MetadataIndex::lookup(const QString &path, DirectoryLister::Entry &entry, QByteArray *hash)
+{
+    if (!m_enabled.load()) {
+        return false;
+    }
+    const QString clean = QDir::cleanPath(path);
+    QString dbPath;
+    quint64 generation = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!insideRoot(clean) || isDirtyLocked(clean)) {
+            return false;
+        }
+        dbPath = m_dbPath;
+        generation = m_configGeneration;
+    }
+    m_lookups.fetch_add(1, std::memory_order_relaxed);
+
+    QSqlDatabase db = readerConnection(dbPath, generation);
+    if (!db.isOpen() && !db.open()) {
+        return false;
+    }
+    // Solo si el directorio que la contiene está completo y vigilado
+    QSqlQuery query(db);
+    query.prepare("SELECT e.is_dir, e.is_link, e.mode, e.size, e.mtime, e.device, e.inode, e.hash "
+                  "FROM entries e JOIN entries p ON p.path = e.parent "
+                  "WHERE e.path = ? AND p.complete = 1");
+    query.addBindValue(clean);
+    if (!query.exec() || !query.next()) {
+        return false;
+    }
+    readEntry(query, 0, entry);
+    if (hash) {
+        *hash = query.value(7).toByteArray();
+    }
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool MetadataIndex::listDirectory(const QString &dir, std::vector<DirectoryLister::NamedEntry> &entries)
+{
+    if (!m_enabled.load()) {
+        return false;
+    }
+    const QString clean = QDir::cleanPath(dir);
+    QString dbPath;
+    quint64 generation = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!insideRoot(clean) || isDirtyLocked(clean) || m_dirtyParents.contains(clean)) {
+            return false;
+        }
+        dbPath = m_dbPath;
+        generation = m_configGeneration;
+    }
+
+    QSqlDatabase db = readerConnection(dbPath, generation);
+    if (!db.isOpen() && !db.open()) {
+        return false;
+    }
+    // Una sola transacción: el estado del directorio y sus entradas de la misma instantánea
+    db.transaction();
+    QSqlQuery query(db);
+    query.prepare("SELECT complete FROM entries WHERE path = ? AND is_dir = 1");
+    query.addBindValue(clean);
+    if (!query.exec() || !query.next() || !query.value(0).toBool()) {
+        db.rollback();
+        return false;
+    }
+    query.prepare("SELECT name, is_dir, is_link, mode, size, mtime, device, inode FROM entries "
+                  "WHERE parent = ? LIMIT ?");
+    query.addBindValue(clean);
+    query.addBindValue(MaxIndexedListing + 1);
+    query.setForwardOnly(true);
+    if (!query.exec()) {
+        db.rollback();
+        return false;
+    }
+    entries.clear();
+    while (query.next()) {
+        if (int(entries.size()) >= MaxIndexedListing) {
+            entries.clear();
+            db.rollback();
+            return false; // Demasiado grande para tenerlo entero en memoria
+        }
+        DirectoryLister::NamedEntry named;
+        named.name = nameBytes(query.value(0).toString());
+        readEntry(query, 1, named.entry);
+        entries.push_back(std::move(named));
+    }
+    db.rollback();
+    m_listings.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+MetadataIndex::Stats MetadataIndex::stats() const
+{
+    Stats s;
+    s.enabled = m_enabled.load();
+    {
+        QMutexLocker locker(&m_mutex);
+        s.root = m_root;
+    }
+#ifdef Q_OS_LINUX
+    s.watcherActive = m_inotifyFd >= 0;
+#endif
+    s.watchedDirectories = m_watched.load();
+    s.watchLimitReached = m_watchLimitReached.load();
+    s.queuedDirectories = m_queued.load();
+    s.crawledDirectories = m_crawledDirectories.load();
+    s.crawledEntries = m_crawledEntries.load();
+    s.passes = m_passes.load();
+    s.lastPassSeconds = m_lastPassMs.load() / 1000.0;
+    s.lookups = m_lookups.load();
+    s.hits = m_hits.load();
+    s.listings = m_listings.load();
+    s.updates = m_updates.load();
+    s.overflows = m_overflows.load();
+    return s;
+}
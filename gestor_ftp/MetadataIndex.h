@@ -0,0 +1,159 @@
+#pragma once
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include "DirectoryLister.h"
+
+class QThread;
+class QObject;
+class QTimer;
+class QSqlDatabase;
+
+// Índice persistente de metadatos del árbol servido (SQLite junto a la base de
+// datos de usuarios).
+//
+// Guarda de cada ruta bajo el directorio raíz el tipo, permisos, tamaño, fecha,
+// dispositivo/inodo y, opcionalmente, un SHA-256 del contenido. SIZE, MDTM, MLST y
+// los listados lo consultan antes que el disco, así que tras un reinicio las
+// primeras órdenes sobre un árbol enorme no esperan a metadatos fríos.
+//
+// Un rastreador en un hilo propio recorre el árbol directorio a directorio (uno por
+// vuelta del bucle de eventos, con prioridad de metadatos en IoScheduler) y lo
+// mantiene al día con inotify en Linux; las operaciones del propio servidor
+// (STOR, DELE, MKD, RMD...) avisan con refresh(). Abrir el índice al arrancar no
+// carga nada: las consultas van a SQLite según llegan, y el rastreador revalida
+// en segundo plano lo que cambió con el servidor parado. Mientras una ruta tiene
+// un cambio pendiente de aplicar, las consultas sobre ella van al disco. Los eventos
+// de inotify y lo que cambió con el servidor parado alimentan además el diario de
+// cambios (ChangeJournal), y las altas y bajas, el índice de nombres (FileNameIndex).
+class MetadataIndex {
+public:
+    struct Stats {
+        bool enabled = false;
+        QString root;
+        bool watcherActive = false;
+        int watchedDirectories = 0;
+        bool watchLimitReached = false;    // Hay directorios sin vigilar (no se sirven desde el índice)
+        int queuedDirectories = 0;         // Pendientes de rastrear en esta pasada
+        quint64 crawledDirectories = 0;
+        quint64 crawledEntries = 0;
+        quint64 passes = 0;                // Pasadas completas del rastreador
+        double lastPassSeconds = 0.0;
+        quint64 lookups = 0;
+        quint64 hits = 0;
+        quint64 listings = 0;              // Listados servidos desde el índice
+        quint64 updates = 0;               // Rutas actualizadas por cambios
+        quint64 overflows = 0;             // Colas de inotify desbordadas
+        double hitRatio() const { return lookups ? double(hits) / lookups : 0.0; }
+    };
+
+    static constexpr int DefaultMaxWatches = 65536;
+    // Un directorio con más entradas se lista del disco, por tandas
+    static constexpr int MaxIndexedListing = 100000;
+
+    static MetadataIndex& instance() {
+        static MetadataIndex instance;
+        return instance;
+    }
+
+    MetadataIndex(const MetadataIndex &) = delete;
+    MetadataIndex &operator=(const MetadataIndex &) = delete;
+
+    // dbPath vacío: <AppData>/db/metadata_index.db. hashMaxBytes 0 no calcula hashes.
+    // rescanMinutes: pasada completa periódica cuando no se puede vigilar todo (0 nunca)
+    void configure(bool enabled, const QString &root, const QString &dbPath = QString(),
+                   qint64 hashMaxBytes = 0, int maxWatches = DefaultMaxWatches, int rescanMinutes = 60);
+    // Otro directorio raíz: el índice anterior se descarta y se rastrea el nuevo
+    void setRoot(const QString &root);
+    bool isEnabled() const { return m_enabled.load(); }
+
+    // Metadatos de una ruta si su directorio está indexado y al día
+    bool lookup(const QString &path, DirectoryLister::Entry &entry, QByteArray *hash = nullptr);
+    // Entradas de un directorio completo y al día (incluidos los ocultos)
+    bool listDirectory(const QString &dir, std::vector<DirectoryLister::NamedEntry> &entries);
+
+    // La ruta cambió (o desapareció) por una operación del servidor
+    void refresh(const QString &path);
+
+    Stats stats() const;
+
+private:
+    MetadataIndex();
+
+    struct Row {
+        QString path;
+        QString parent;
+        QString name;
+        DirectoryLister::Entry entry;
+        QByteArray hash;
+    };
+
+    // Hilo del índice: único escritor
+    void startThread();
+    void openDatabase();
+    void beginPass();
+    void crawlNext();
+    void crawlDirectory(const QString &dir);
+    void applyPending();
+    void refreshPath(QSqlDatabase &db, const QString &path);
+    void removeTree(QSqlDatabase &db, const QString &path);
+    bool watchDirectory(const QString &dir);
+    void unwatchTree(const QString &path);
+    void readEvents();
+    void writeRow(QSqlDatabase &db, const Row &row);
+    // Vacío si no corresponde o si el archivo aún se está escribiendo (se recalcula
+    // cuando se asiente)
+    QByteArray hashFor(const Row &row, const QByteArray &previousHash, qint64 previousSize,
+                       qint64 previousMtime);
+
+    bool insideRoot(const QString &path) const;
+    bool isDirtyLocked(const QString &path) const;
+    void markDirty(const QString &path);
+
+    std::atomic<bool> m_enabled{false};
+    mutable QMutex m_mutex;
+    QString m_root;
+    QString m_dbPath;
+    qint64 m_hashMaxBytes = 0;
+    int m_maxWatches = DefaultMaxWatches;
+    int m_rescanMinutes = 60;
+    quint64 m_configGeneration = 0;         // Las conexiones de lectura se rehacen al cambiar
+
+    // Cambios aún no escritos: las consultas sobre ellos y sus descendientes van al disco
+    QSet<QString> m_dirty;
+    QSet<QString> m_dirtyParents;
+    QSet<QString> m_pending;
+
+    // Solo en el hilo del índice
+    QThread *m_thread = nullptr;
+    QObject *m_context = nullptr;
+    QTimer *m_flushTimer = nullptr;
+    QTimer *m_rescanTimer = nullptr;
+    QTimer *m_hashTimer = nullptr;
+    QSet<QString> m_hashDeferred;           // Archivos modificados hace poco, sin hash todavía
+    QString m_writerName;
+    bool m_dbReady = false;
+    std::deque<QString> m_crawlQueue;
+    qint64 m_passStartMs = 0;
+    QHash<int, QString> m_watchPaths;       // Descriptor de inotify -> directorio
+    QHash<QString, int> m_watchIds;
+    int m_inotifyFd = -1;
+
+    std::atomic<int> m_queued{0};
+    std::atomic<int> m_watched{0};
+    std::atomic<bool> m_watchLimitReached{false};
+    std::atomic<quint64> m_crawledDirectories{0};
+    std::atomic<quint64> m_crawledEntries{0};
+    std::atomic<quint64> m_passes{0};
+    std::atomic<qint64> m_lastPassMs{0};
+    std::atomic<quint64> m_lookups{0};
+    std::atomic<quint64> m_hits{0};
+    std::atomic<quint64> m_listings{0};
+    std::atomic<quint64> m_updates{0};
+    std::atomic<quint64> m_overflows{0};
+};
@@ -0,0 +1,303 @@
+#include "PathResolver.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <cerrno>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#if __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#else
+struct open_how {
+    quint64 flags;
+    quint64 mode;
+    quint64 resolve;
+};
+#define RESOLVE_NO_MAGICLINKS 0x02
+#define RESOLVE_BENEATH 0x08
+#endif
+#ifndef SYS_openat2
+#define SYS_openat2 437
+#endif
+#endif
+
+namespace {
+std::atomic<quint64> s_resolutions{0};
+std::atomic<quint64> s_kernelResolutions{0};
+std::atomic<quint64> s_rejected{0};
+
+#ifdef Q_OS_LINUX
+long callOpenat2(int dirFd, const char *path, quint64 flags)
+{
+    struct open_how how = {};
+    how.flags = flags | O_PATH | O_CLOEXEC;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+    return ::syscall(SYS_openat2, dirFd, path, &how, sizeof(how));
+}
+#endif
+}
+
+PathResolver::~PathResolver()
+{
+#ifdef Q_OS_LINUX
+    if (m_currentFd >= 0) {
+        ::close(m_currentFd);
+    }
+#endif
+    m_root.close();
+    m_other.close();
+}
+
+void PathResolver::RootHandle::open(const QString &root)
+{
+    close();
+    path = QDir::cleanPath(root);
+    canonical = QFileInfo(path).canonicalFilePath();
+#ifdef Q_OS_LINUX
+    if (isSupported()) {
+        fd = ::open(QFile::encodeName(path).constData(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    }
+#endif
+}
+
+void PathResolver::RootHandle::close()
+{
+#ifdef Q_OS_LINUX
+    if (fd >= 0) {
+        ::close(fd);
+    }
+#endif
+    fd = -1;
+    path.clear();
+    canonical.clear();
+}
+
+bool PathResolver::isSupported()
+{
+#ifdef Q_OS_LINUX
+    // Kernel 5.6 o posterior y sin un filtro seccomp que bloquee la llamada
+    static const bool supported = []() {
+        const long fd = callOpenat2(AT_FDCWD, "/", O_DIRECTORY);
+        if (fd < 0) {
+            return false;
+        }
+        ::close(int(fd));
+        return true;
+    }();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+bool PathResolver::isInside(const QString &root, const QString &path)
+{
+#ifdef Q_OS_WIN
+    const Qt::CaseSensitivity cs = Qt::CaseInsensitive;
+#else
+    const Qt::CaseSensitivity cs = Qt::CaseSensitive;
+#endif
+    if (root.isEmpty() || !path.startsWith(root, cs)) {
+        return false;
+    }
+    return path.size() == root.size() || root.endsWith(QLatin1Char('/'))
+        || path.at(root.size()) == QLatin1Char('/');
+}
+
+PathResolver::Stats PathResolver::stats()
+{
+    Stats s;
+    s.kernelSupport = isSupported();
+    s.resolutions = s_resolutions.load(std::memory_order_relaxed);
+    s.kernelResolutions = s_kernelResolutions.load(std::memory_order_relaxed);
+    s.rejected = s_rejected.load(std::memory_order_relaxed);
+    return s;
+}
+
+QString PathResolver::normalize(const QString &ftpPath, const QString &currentVirtual)
+{
+    // ".." no puede pasar de "/"
+    const QString base = ftpPath.startsWith(QLatin1Char('/')) ? QString() : currentVirtual;
+    const QString joined = QDir::cleanPath(QLatin1Char('/') + base + QLatin1Char('/') + ftpPath);
+    if (joined == QLatin1String("/..") || joined.startsWith(QLatin1String("/../"))) {
+        s_rejected.fetch_add(1, std::memory_order_relaxed);
+        return QString();
+    }
+    return joined;
+}
+
+void PathResolver::sync(const QString &root, const QString &current)
+{
+    if (QDir::cleanPath(root) != m_root.path) {
+        m_root.open(root);
+        m_current.clear();
+        m_currentRelative.clear();
+    }
+
+    if (current == m_current) {
+        return;
+    }
+    m_current = current;
+    const QString cleanCurrent = QDir::cleanPath(current);
+    m_currentRelative = isInside(m_root.path, cleanCurrent) ? relativeOf(m_root.path, cleanCurrent) : QString();
+#ifdef Q_OS_LINUX
+    if (m_currentFd >= 0) {
+        ::close(m_currentFd);
+        m_currentFd = -1;
+    }
+    // En la carpeta del montaje se usa directamente su descriptor
+    if (m_root.fd >= 0 && !m_currentRelative.isEmpty()) {
+        int error = 0;
+        m_currentFd = openBeneath(m_root.fd, m_currentRelative, O_DIRECTORY, error);
+    }
+#endif
+}
+
+QString PathResolver::relativeOf(const QString &root, const QString &absolute)
+{
+    if (absolute.size() <= root.size()) {
+        return QString();
+    }
+    return absolute.mid(root.endsWith(QLatin1Char('/')) ? root.size() : root.size() + 1);
+}
+
+bool PathResolver::inspect(const QString &root, const QString &absolute, Kind &kind)
+{
+    s_resolutions.fetch_add(1, std::memory_order_relaxed);
+    const QString cleanRoot = QDir::cleanPath(root);
+    if (!isInside(cleanRoot, absolute)) {
+        s_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Otro montaje: se guarda abierto el último consultado
+    const bool sameMount = cleanRoot == m_root.path;
+    if (!sameMount && cleanRoot != m_other.path) {
+        m_other.open(cleanRoot);
+    }
+    const RootHandle &handle = sameMount ? m_root : m_other;
+
+    bool ok;
+#ifdef Q_OS_LINUX
+    if (handle.fd >= 0) {
+        s_kernelResolutions.fetch_add(1, std::memory_order_relaxed);
+        ok = inspectKernel(handle.fd, sameMount, relativeOf(cleanRoot, absolute), kind);
+    } else {
+        ok = inspectFallback(handle, absolute, kind);
+    }
+#else
+    ok = inspectFallback(handle, absolute, kind);
+#endif
+    if (!ok) {
+        s_rejected.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ok;
+}
+
+#ifdef Q_OS_LINUX
+int PathResolver::openBeneath(int dirFd, const QString &relative, int flags, int &error)
+{
+    const QByteArray path = relative.isEmpty() ? QByteArray(".") : QFile::encodeName(relative);
+    long fd;
+    do {
+        fd = callOpenat2(dirFd, path.constData(), quint64(flags));
+    } while (fd < 0 && errno == EAGAIN);   // Carrera con un rename en otro punto del árbol
+    error = fd < 0 ? errno : 0;
+    return int(fd);
+}
+
+bool PathResolver::inspectKernel(int rootFd, bool fromCurrent, const QString &relative, Kind &kind)
+{
+    // Desde el directorio actual se recorren menos componentes
+    int dirFd = rootFd;
+    QString target = relative;
+    if (fromCurrent && m_currentFd >= 0 && (relative == m_currentRelative
+                             || relative.startsWith(m_currentRelative + QLatin1Char('/')))) {
+        dirFd = m_currentFd;
+        target = relative.mid(m_currentRelative.size() + 1);
+    }
+
+    int error = 0;
+    int fd = openBeneath(dirFd, target, 0, error);
+    if (fd < 0 && error == EXDEV && dirFd != rootFd) {
+        // Un enlace que sale del directorio actual puede seguir dentro del montaje
+        dirFd = rootFd;
+        target = relative;
+        fd = openBeneath(dirFd, target, 0, error);
+    }
+
+    if (fd >= 0) {
+        struct stat st;
+        const bool statted = ::fstat(fd, &st) == 0;
+        ::close(fd);
+        if (!statted) {
+            return false;
+        }
+        kind = S_ISDIR(st.st_mode) ? Kind::Directory
+             : S_ISREG(st.st_mode) ? Kind::File : Kind::Other;
+        return true;
+    }
+    if (error != ENOENT) {
+        return false;   // EXDEV (sale del montaje), ELOOP, EACCES, ENOTDIR...
+    }
+
+    // Un enlace roto: STOR escribiría a través de él, quizá fuera del montaje
+    fd = openBeneath(dirFd, target, O_NOFOLLOW, error);
+    if (fd >= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // No existe: vale si el antecesor existente más cercano es un directorio del montaje
+    QString parent = relative;
+    while (!parent.isEmpty()) {
+        const int slash = parent.lastIndexOf(QLatin1Char('/'));
+        parent = slash < 0 ? QString() : parent.left(slash);
+        fd = openBeneath(rootFd, parent, O_DIRECTORY, error);
+        if (fd >= 0) {
+            ::close(fd);
+            kind = Kind::Missing;
+            return true;
+        }
+        if (error != ENOENT) {
+            return false;
+        }
+    }
+    return false;
+}
+#endif
+
+bool PathResolver::inspectFallback(const RootHandle &root, const QString &absolute, Kind &kind)
+{
+    QFileInfo info(absolute);
+    if (info.exists()) {
+        // La ruta canónica resuelve los enlaces: tiene que seguir dentro del montaje
+        if (!root.canonical.isEmpty() && !isInside(root.canonical, info.canonicalFilePath())) {
+            return false;
+        }
+        kind = info.isDir() ? Kind::Directory : info.isFile() ? Kind::File : Kind::Other;
+        return true;
+    }
+    if (info.isSymLink()) {
+        return false;   // Enlace roto
+    }
+
+    QString parent = absolute;
+    while (isInside(root.path, parent) && parent != root.path) {
+        parent = QFileInfo(parent).path();
+        QFileInfo ancestor(parent);
+        if (ancestor.exists()) {
+            if (!ancestor.isDir() || (!root.canonical.isEmpty()
+                                      && !isInside(root.canonical, ancestor.canonicalFilePath()))) {
+                return false;
+            }
+            kind = Kind::Missing;
+            return true;
+        }
+    }
+    return false;
+}
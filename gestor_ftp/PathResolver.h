@@ -0,0 +1,73 @@
+#pragma once
+#include <QString>
+#include <atomic>
+
+// Resolución de las rutas FTP de una sesión dentro de los montajes locales.
+//
+// Primero se normaliza la ruta pedida (absoluta o relativa al directorio actual)
+// como ruta virtual; si sube por encima de "/" se rechaza. El sistema de archivos
+// virtual (Vfs) la traduce a una ruta en disco bajo la carpeta de su montaje, y
+// en Linux se comprueba con una sola llamada a openat2() con RESOLVE_BENEATH y
+// RESOLVE_NO_MAGICLINKS desde el descriptor del directorio actual, que la sesión
+// mantiene abierto, o desde el de la carpeta del montaje: el kernel recorre los
+// componentes y rechaza cualquier enlace simbólico que lleve fuera, cosa que la
+// comparación de cadenas no ve. Sin openat2 (Windows, kernels anteriores a 5.6)
+// se comprueba con QFileInfo y la ruta canónica.
+class PathResolver {
+public:
+    enum class Kind { Missing, File, Directory, Other };
+
+    struct Stats {
+        bool kernelSupport = false;
+        quint64 resolutions = 0;
+        quint64 kernelResolutions = 0;    // Resueltas con openat2
+        quint64 rejected = 0;             // Fuera de la raíz o a través de un enlace que sale
+    };
+
+    PathResolver() = default;
+    ~PathResolver();
+    PathResolver(const PathResolver &) = delete;
+    PathResolver &operator=(const PathResolver &) = delete;
+
+    // Ruta virtual normalizada ("/a/b") de una ruta FTP absoluta o relativa a
+    // currentVirtual; vacía si sube por encima de "/" (sin tocar el disco)
+    static QString normalize(const QString &ftpPath, const QString &currentVirtual);
+
+    // Carpeta del montaje y directorio actual (en disco) de la sesión; solo se
+    // reabren los descriptores si cambian
+    void sync(const QString &root, const QString &current);
+    // Qué hay en 'absolute', una ruta bajo 'root' (la carpeta de su montaje). Falso
+    // si algún componente existente la saca de 'root' o no se puede recorrer. Si no
+    // existe (Missing), el antecesor existente más cercano tiene que ser un directorio
+    // dentro de 'root'.
+    bool inspect(const QString &root, const QString &absolute, Kind &kind);
+
+    // path es root o está debajo (no basta con startsWith: "/srv/ftp2" no está en "/srv/ftp")
+    static bool isInside(const QString &root, const QString &path);
+    static bool isSupported();
+    static Stats stats();
+
+private:
+    // Descriptor y ruta canónica de una carpeta de montaje
+    struct RootHandle {
+        QString path;               // Limpia, sin barra final
+        QString canonical;          // Para la comprobación sin openat2
+        int fd = -1;
+
+        void open(const QString &root);
+        void close();
+    };
+
+    static QString relativeOf(const QString &root, const QString &absolute);
+#ifdef Q_OS_LINUX
+    static int openBeneath(int dirFd, const QString &relative, int flags, int &error);
+    bool inspectKernel(int rootFd, bool fromCurrent, const QString &relative, Kind &kind);
+#endif
+    static bool inspectFallback(const RootHandle &root, const QString &absolute, Kind &kind);
+
+    RootHandle m_root;              // Montaje del directorio actual
+    RootHandle m_other;             // El último montaje distinto consultado
+    QString m_current;
+    QString m_currentRelative;      // "" en la carpeta del montaje
+    int m_currentFd = -1;
+};
@@ -0,0 +1,244 @@
+#include "ReadAheadManager.h"
+#include <QMutexLocker>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QFile>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+namespace {
+// Segundos de consumo que debe cubrir la ventana
+constexpr double WindowSeconds = 1.0;
+// Intervalo mínimo entre muestras de velocidad
+constexpr qint64 SampleIntervalMs = 250;
+} // namespace
+
+// =====================================================================================
+// Seccion: Presupuesto global y estadísticas por dispositivo
+// =====================================================================================
+
+void ReadAheadManager::configure(qint64 budgetBytes, qint64 maxWindowBytes)
+{
+    m_budget.store(qMax<qint64>(MinWindow, budgetBytes));
+    m_maxWindow.store(qBound<qint64>(MinWindow, maxWindowBytes, m_budget.load()));
+    qInfo() << "Lectura anticipada: presupuesto" << m_budget.load() / (1024 * 1024)
+            << "MB, ventana máxima" << m_maxWindow.load() / (1024 * 1024) << "MB";
+}
+
+qint64 ReadAheadManager::reserve(qint64 wanted)
+{
+    qint64 current = m_reserved.load();
+    for (;;) {
+        const qint64 available = m_budget.load() - current;
+        const qint64 granted = qBound<qint64>(0, wanted, available);
+        if (granted < wanted) {
+            m_budgetLimited.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (granted == 0) {
+            return 0;
+        }
+        if (m_reserved.compare_exchange_weak(current, current + granted)) {
+            return granted;
+        }
+    }
+}
+
+void ReadAheadManager::release(qint64 bytes)
+{
+    if (bytes > 0) {
+        m_reserved.fetch_sub(bytes);
+    }
+}
+
+QString ReadAheadManager::deviceFor(int fd, const QString &path)
+{
+#ifdef Q_OS_LINUX
+    struct stat st;
+    const bool known = fd >= 0 ? ::fstat(fd, &st) == 0
+                               : ::stat(QFile::encodeName(path).constData(), &st) == 0;
+    if (known) {
+        const quint64 key = st.st_dev;
+        QMutexLocker locker(&m_mutex);
+        auto it = m_deviceNames.constFind(key);
+        if (it != m_deviceNames.constEnd()) {
+            return it.value();
+        }
+        // /sys/dev/block/MAYOR:MENOR enlaza con el dispositivo de bloques (sda1, nvme0n1p2...)
+        const QString id = QString("%1:%2").arg(major(st.st_dev)).arg(minor(st.st_dev));
+        QString name = QFileInfo("/sys/dev/block/" + id).symLinkTarget().section('/', -1);
+        if (name.isEmpty()) {
+            name = id;
+        }
+        m_deviceNames.insert(key, name);
+        return name;
+    }
+#else
+    Q_UNUSED(fd);
+#endif
+    // Sin fstat: agrupar por volumen
+    return QStorageInfo(QFileInfo(path).absolutePath()).rootPath();
+}
+
+void ReadAheadManager::transferStarted(const QString &device)
+{
+    QMutexLocker locker(&m_mutex);
+    m_devices[device].activeTransfers++;
+}
+
+void ReadAheadManager::transferFinished(const QString &device)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_devices.find(device);
+    if (it != m_devices.end() && it->activeTransfers > 0) {
+        it->activeTransfers--;
+    }
+}
+
+void ReadAheadManager::rollBucket(Device &device, qint64 nowMs) const
+{
+    // Cubos de un segundo; la velocidad es una media móvil exponencial de los cubos cerrados
+    const qint64 elapsed = nowMs - device.bucketStartMs;
+    if (elapsed < 1000) {
+        return;
+    }
+    const double bucketRate = device.bucketBytes * 1000.0 / elapsed;
+    device.rate = device.rate == 0.0 ? bucketRate : 0.7 * device.rate + 0.3 * bucketRate;
+    // Los segundos sin lecturas también cuentan (decaimiento)
+    for (qint64 idle = elapsed / 1000 - 1; idle > 0 && device.rate > 1.0; --idle) {
+        device.rate *= 0.7;
+    }
+    device.bucketBytes = 0;
+    device.bucketStartMs = nowMs;
+}
+
+void ReadAheadManager::recordRead(const QString &device, qint64 bytes)
+{
+    const qint64 now = m_clock.elapsed();
+    QMutexLocker locker(&m_mutex);
+    Device &d = m_devices[device];
+    if (d.bytesRead == 0 && d.bucketBytes == 0) {
+        d.bucketStartMs = now; // Primer cubo del dispositivo
+    }
+    rollBucket(d, now);
+    d.bytesRead += bytes;
+    d.bucketBytes += bytes;
+}
+
+ReadAheadManager::Stats ReadAheadManager::stats() const
+{
+    Stats s;
+    s.budgetBytes = m_budget.load();
+    s.reservedBytes = m_reserved.load();
+    s.maxWindowBytes = m_maxWindow.load();
+    s.advisories = m_advisories.load(std::memory_order_relaxed);
+    s.budgetLimited = m_budgetLimited.load(std::memory_order_relaxed);
+
+    const qint64 now = m_clock.elapsed();
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_devices.begin(); it != m_devices.end(); ++it) {
+        rollBucket(it.value(), now);
+        DeviceStats d;
+        d.device = it.key();
+        d.bytesRead = it->bytesRead;
+        d.recentBytesPerSec = it->rate;
+        d.activeTransfers = it->activeTransfers;
+        s.devices.append(d);
+    }
+    return s;
+}
+
+// =====================================================================================
+// Seccion: Ventana por transferencia
+// =====================================================================================
+
+void ReadAheadWindow::start(int fd, const QString &path, qint64 fileSize, qint64 startOffset)
+{
+    stop();
+    if (fd < 0) {
+        return;
+    }
+    ReadAheadManager &manager = ReadAheadManager::instance();
+    m_fd = fd;
+    m_fileSize = fileSize;
+    m_device = manager.deviceFor(fd, path);
+    m_rate = 0.0;
+    m_sampleBytes = 0;
+    m_sampleTimer.start();
+    manager.transferStarted(m_device);
+
+#ifdef Q_OS_LINUX
+    // Acceso secuencial: el kernel duplica su propia lectura anticipada para este archivo
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    // Hasta conocer la velocidad del cliente, empezar con la ventana mínima
+    m_window = manager.reserve(qMin(ReadAheadManager::MinWindow, fileSize - startOffset));
+    m_issuedUntil = startOffset;
+    advise(startOffset, m_window);
+}
+
+void ReadAheadWindow::consumed(qint64 offset, qint64 bytes)
+{
+    if (m_fd < 0) {
+        return;
+    }
+    ReadAheadManager &manager = ReadAheadManager::instance();
+    manager.recordRead(m_device, bytes);
+    m_sampleBytes += bytes;
+
+    const qint64 elapsed = m_sampleTimer.elapsed();
+    if (elapsed >= SampleIntervalMs) {
+        const double sample = m_sampleBytes * 1000.0 / elapsed;
+        m_rate = m_rate == 0.0 ? sample : 0.75 * m_rate + 0.25 * sample;
+        m_sampleBytes = 0;
+        m_sampleTimer.restart();
+
+        // Redimensionar la ventana según la velocidad medida, dentro del presupuesto
+        const qint64 remaining = m_fileSize - offset;
+        qint64 target = qBound(ReadAheadManager::MinWindow, qint64(m_rate * WindowSeconds), manager.maxWindow());
+        target = qMin(target, qMax<qint64>(0, remaining));
+        if (target > m_window) {
+            m_window += manager.reserve(target - m_window);
+        } else if (target < m_window) {
+            manager.release(m_window - target);
+            m_window = target;
+        }
+    }
+
+    // Pedir más cuando lo ya solicitado cubre menos de media ventana
+    const qint64 ahead = m_issuedUntil - offset;
+    if (m_window > 0 && ahead < m_window / 2 && m_issuedUntil < m_fileSize) {
+        const qint64 from = qMax(offset, m_issuedUntil);
+        advise(from, offset + m_window - from);
+    }
+}
+
+void ReadAheadWindow::advise(qint64 offset, qint64 length)
+{
+    length = qMin(length, m_fileSize - offset);
+    if (length <= 0) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    ::posix_fadvise(m_fd, offset, length, POSIX_FADV_WILLNEED);
+    ReadAheadManager::instance().countAdvisory();
+#endif
+    m_issuedUntil = offset + length;
+}
+
+void ReadAheadWindow::stop()
+{
+    if (m_fd < 0) {
+        return;
+    }
+    ReadAheadManager &manager = ReadAheadManager::instance();
+    manager.release(m_window);
+    manager.transferFinished(m_device);
+    m_window = 0;
+    m_fd = -1;
+}
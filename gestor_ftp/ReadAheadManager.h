@@ -0,0 +1,122 @@
+#ifndef READAHEADMANAGER_H
+#define READAHEADMANAGER_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <atomic>
+
+// Lectura anticipada adaptativa para las descargas (RETR).
+//
+// Con muchas descargas simultáneas de archivos grandes, la lectura anticipada
+// por defecto del kernel (fija y pequeña) obliga a los discos mecánicos a saltar
+// de un archivo a otro constantemente. Cada transferencia declara su acceso
+// secuencial y pide por adelantado (POSIX_FADV_WILLNEED) una ventana
+// proporcional a lo rápido que la consume su cliente: los clientes lentos no
+// acaparan caché y los rápidos reciben lecturas largas y contiguas. La suma de
+// todas las ventanas tiene un tope global.
+class ReadAheadManager {
+public:
+    struct DeviceStats {
+        QString device;
+        quint64 bytesRead = 0;
+        double recentBytesPerSec = 0.0;   // Media móvil por segundos
+        int activeTransfers = 0;
+    };
+
+    struct Stats {
+        qint64 budgetBytes = 0;
+        qint64 reservedBytes = 0;
+        qint64 maxWindowBytes = 0;
+        quint64 advisories = 0;       // Llamadas WILLNEED emitidas
+        quint64 budgetLimited = 0;    // Ventanas recortadas por el tope global
+        QList<DeviceStats> devices;
+    };
+
+    static constexpr qint64 MinWindow = 256 * 1024;
+    static constexpr qint64 DefaultMaxWindow = 32 * 1024 * 1024;
+    static constexpr qint64 DefaultBudget = 256 * 1024 * 1024;
+
+    static ReadAheadManager &instance() {
+        static ReadAheadManager instance;
+        return instance;
+    }
+
+    ReadAheadManager(const ReadAheadManager &) = delete;
+    ReadAheadManager &operator=(const ReadAheadManager &) = delete;
+
+    void configure(qint64 budgetBytes, qint64 maxWindowBytes);
+    qint64 maxWindow() const { return m_maxWindow.load(); }
+
+    // Reserva hasta 'wanted' bytes del presupuesto global; devuelve lo concedido
+    qint64 reserve(qint64 wanted);
+    void release(qint64 bytes);
+    void countAdvisory() { m_advisories.fetch_add(1, std::memory_order_relaxed); }
+
+    // Dispositivo de un descriptor abierto o, con fd < 0, de una ruta (nombre legible, cacheado)
+    QString deviceFor(int fd, const QString &path);
+    void transferStarted(const QString &device);
+    void transferFinished(const QString &device);
+    void recordRead(const QString &device, qint64 bytes);
+
+    Stats stats() const;
+
+private:
+    ReadAheadManager() { m_clock.start(); }
+
+    struct Device {
+        quint64 bytesRead = 0;
+        qint64 bucketStartMs = 0;
+        qint64 bucketBytes = 0;
+        double rate = 0.0;
+        int activeTransfers = 0;
+    };
+
+    void rollBucket(Device &device, qint64 nowMs) const;
+
+    std::atomic<qint64> m_budget{DefaultBudget};
+    std::atomic<qint64> m_maxWindow{DefaultMaxWindow};
+    std::atomic<qint64> m_reserved{0};
+    std::atomic<quint64> m_advisories{0};
+    std::atomic<quint64> m_budgetLimited{0};
+
+    mutable QMutex m_mutex;
+    mutable QHash<QString, Device> m_devices;
+    QHash<quint64, QString> m_deviceNames;   // st_dev -> nombre
+    QElapsedTimer m_clock;
+};
+
+// Ventana de lectura anticipada de una transferencia. No es segura entre hilos:
+// pertenece al hilo de la sesión.
+class ReadAheadWindow {
+public:
+    ReadAheadWindow() = default;
+    ~ReadAheadWindow() { stop(); }
+
+    ReadAheadWindow(const ReadAheadWindow &) = delete;
+    ReadAheadWindow &operator=(const ReadAheadWindow &) = delete;
+
+    void start(int fd, const QString &path, qint64 fileSize, qint64 startOffset = 0);
+    // El consumidor ha llegado a 'offset' tras leer 'bytes'
+    void consumed(qint64 offset, qint64 bytes);
+    void stop();
+
+    bool isActive() const { return m_fd >= 0; }
+    qint64 window() const { return m_window; }
+
+private:
+    void advise(qint64 offset, qint64 length);
+
+    int m_fd = -1;
+    QString m_device;
+    qint64 m_fileSize = 0;
+    qint64 m_issuedUntil = 0;   // Hasta dónde ya se pidió al kernel
+    qint64 m_window = 0;        // Ventana reservada del presupuesto global
+    double m_rate = 0.0;        // Bytes por segundo consumidos (media móvil)
+    qint64 m_sampleBytes = 0;
+    QElapsedTimer m_sampleTimer;
+};
+
+#endif // READAHEADMANAGER_H
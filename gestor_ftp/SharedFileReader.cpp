@@ -0,0 +1,235 @@
+#include "SharedFileReader.h"
+#include "IoScheduler.h"
+#include <QMutexLocker>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+// =====================================================================================
+// Seccion: Lector compartido
+// =====================================================================================
+
+SharedFileReader::SharedFileReader(const QString &path, qint64 size)
+    : m_path(path)
+    , m_size(size)
+    , m_file(path)
+{
+}
+
+SharedFileReader::~SharedFileReader()
+{
+    m_file.close();
+}
+
+bool SharedFileReader::open()
+{
+    if (!m_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        qWarning() << "No se pudo abrir para lectura compartida:" << m_path << m_file.errorString();
+        return false;
+    }
+#ifdef Q_OS_LINUX
+    ::posix_fadvise(m_file.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    m_device = IoScheduler::deviceFor(m_file.handle(), m_path);
+    return true;
+}
+
+int SharedFileReader::subscriberCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    int count = 0;
+    for (const Subscriber &s : m_subscribers) {
+        if (!s.detached) {
+            count++;
+        }
+    }
+    return count;
+}
+
+std::unique_ptr<SharedFileReader::Subscription> SharedFileReader::subscribe(const std::shared_ptr<SharedFileReader> &reader)
+{
+    QMutexLocker locker(&reader->m_mutex);
+    const int id = reader->m_nextId++;
+    reader->m_subscribers.insert(id, Subscriber());
+    return std::unique_ptr<Subscription>(new Subscription(reader, id));
+}
+
+void SharedFileReader::unsubscribe(int id)
+{
+    QMutexLocker locker(&m_mutex);
+    m_subscribers.remove(id);
+    releaseConsumedLocked();
+}
+
+bool SharedFileReader::blockFor(int id, qint64 index, QByteArray &data)
+{
+    SharedReadRegistry &registry = SharedReadRegistry::instance();
+    QMutexLocker locker(&m_mutex);
+    for (;;) {
+        auto self = m_subscribers.find(id);
+        if (self == m_subscribers.end() || self->detached) {
+            return false;
+        }
+        self->position = index;
+
+        auto it = m_blocks.find(index);
+        if (it != m_blocks.end()) {
+            data = it->second; // Copia superficial
+            self->position = index + 1;
+            releaseConsumedLocked();
+            registry.recordServed(data.size());
+            return true;
+        }
+        if (!m_loading.contains(index)) {
+            break;
+        }
+        // Otro suscriptor ya lo está leyendo: esperar en lugar de leerlo dos veces
+        m_blockLoaded.wait(&m_mutex);
+    }
+
+    // Este suscriptor va en cabeza: los que quedan a más de una ventana se desenganchan
+    detachLaggardsLocked(index);
+    m_loading.insert(index);
+    locker.unlock();
+
+    QByteArray loaded;
+    const bool ok = readFromStorage(index, loaded);
+
+    locker.relock();
+    m_loading.remove(index);
+    if (!ok) {
+        // Nunca se guarda un bloque vacío o corto: todos los suscriptores (también los
+        // que esperan este bloque) se desenganchan y siguen con sus propias lecturas
+        qWarning() << "Lectura compartida fallida en el bloque" << index << "de" << m_path;
+        m_failed.store(true);
+        for (Subscriber &s : m_subscribers) {
+            if (!s.detached) {
+                s.detached = true;
+                SharedReadRegistry::instance().recordDetach();
+            }
+        }
+        m_blocks.clear();
+        m_blockLoaded.wakeAll();
+        return false;
+    }
+    m_blocks[index] = loaded;
+    auto self = m_subscribers.find(id);
+    if (self != m_subscribers.end()) {
+        self->position = index + 1;
+    }
+    releaseConsumedLocked();
+    m_blockLoaded.wakeAll();
+
+    data = loaded;
+    registry.recordServed(data.size());
+    return true;
+}
+
+bool SharedFileReader::readFromStorage(qint64 index, QByteArray &data)
+{
+    const qint64 offset = index * BlockSize;
+    const qint64 length = qBound<qint64>(0, m_size - offset, BlockSize);
+    if (length == 0) {
+        return false;   // Más allá del final: nadie debería pedirlo
+    }
+
+    // Primero el turno del disco y después el archivo: quien espera turno no retiene
+    // m_ioMutex, así que el planificador ordena a todos los lectores por igual
+    IoScheduler::Ticket turn = IoScheduler::instance().acquire(m_device, IoScheduler::Kind::Read);
+    QMutexLocker io(&m_ioMutex);
+    if (!m_file.seek(offset)) {
+        return false;
+    }
+    data = m_file.read(length);
+    io.unlock();
+    turn.release();
+    SharedReadRegistry::instance().recordStorageRead(data.size());
+    return data.size() == length;   // Corto: el archivo cambió o falló el disco
+}
+
+void SharedFileReader::detachLaggardsLocked(qint64 leaderIndex)
+{
+    for (auto it = m_subscribers.begin(); it != m_subscribers.end(); ++it) {
+        if (!it->detached && it->position + WindowBlocks <= leaderIndex) {
+            it->detached = true;
+            SharedReadRegistry::instance().recordDetach();
+        }
+    }
+}
+
+void SharedFileReader::releaseConsumedLocked()
+{
+    // Los bloques por detrás del suscriptor más atrasado ya no los necesita nadie
+    qint64 lowest = -1;
+    for (const Subscriber &s : m_subscribers) {
+        if (!s.detached && (lowest < 0 || s.position < lowest)) {
+            lowest = s.position;
+        }
+    }
+    if (lowest < 0) {
+        m_blocks.clear();
+        return;
+    }
+    m_blocks.erase(m_blocks.begin(), m_blocks.lower_bound(lowest));
+}
+
+SharedFileReader::Subscription::~Subscription()
+{
+    m_reader->unsubscribe(m_id);
+}
+
+bool SharedFileReader::Subscription::block(qint64 index, QByteArray &data)
+{
+    return m_reader->blockFor(m_id, index, data);
+}
+
+// =====================================================================================
+// Seccion: Registro global
+// =====================================================================================
+
+std::unique_ptr<SharedFileReader::Subscription> SharedReadRegistry::subscribe(const QString &path)
+{
+    const qint64 minSize = m_minFileSize.load();
+    if (minSize <= 0) {
+        return nullptr;
+    }
+    HotFileCache::Key key;
+    if (!HotFileCache::keyFor(path, key) || key.size < minSize) {
+        return nullptr;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    std::shared_ptr<SharedFileReader> reader = m_readers.value(key).lock();
+    if (!reader || reader->failed()) {
+        // Limpiar los lectores que ya no tienen suscriptores
+        for (auto it = m_readers.begin(); it != m_readers.end();) {
+            it = it->expired() ? m_readers.erase(it) : std::next(it);
+        }
+        reader = std::make_shared<SharedFileReader>(path, key.size);
+        if (!reader->open()) {
+            return nullptr;
+        }
+        m_readers.insert(key, reader);
+    }
+    return SharedFileReader::subscribe(reader);
+}
+
+SharedReadRegistry::Stats SharedReadRegistry::stats() const
+{
+    Stats s;
+    s.storageBytes = m_storageBytes.load(std::memory_order_relaxed);
+    s.servedBytes = m_servedBytes.load(std::memory_order_relaxed);
+    s.detaches = m_detaches.load(std::memory_order_relaxed);
+    s.minFileSize = m_minFileSize.load();
+
+    QMutexLocker locker(&m_mutex);
+    for (const auto &weak : m_readers) {
+        if (std::shared_ptr<SharedFileReader> reader = weak.lock()) {
+            s.activeReaders++;
+            s.subscribers += reader->subscriberCount();
+        }
+    }
+    return s;
+}
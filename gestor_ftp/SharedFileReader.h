@@ -0,0 +1,132 @@
+#ifndef SHAREDFILEREADER_H
+#define SHAREDFILEREADER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+#include <map>
+#include <memory>
+#include <atomic>
+#include "HotFileCache.h"
+
+// Lector compartido para descargas simultáneas del mismo archivo grande.
+//
+// Todas las sesiones que descargan el mismo archivo (mismo inodo, fecha y tamaño)
+// se suscriben a un único lector. El primero que necesita un bloque lo lee del
+// disco y los demás lo reciben de memoria: los bloques se guardan en una ventana
+// deslizante de QByteArray compartidos que se libera cuando todos los suscriptores
+// han pasado. Si un suscriptor se queda más de una ventana por detrás del más
+// adelantado, se le desengancha y sigue leyendo por su cuenta, para que uno lento
+// no obligue a retener el archivo entero en memoria.
+class SharedFileReader {
+public:
+    static constexpr qint64 BlockSize = 1024 * 1024;
+    static constexpr qint64 WindowBlocks = 64;
+
+    class Subscription {
+    public:
+        ~Subscription();
+        Subscription(const Subscription &) = delete;
+        Subscription &operator=(const Subscription &) = delete;
+
+        // Bloque 'index' del archivo, siempre completo. Devuelve false si este suscriptor
+        // fue desenganchado y debe seguir leyendo por su cuenta (también cuando falla
+        // una lectura compartida: cada uno lo reintenta y responde por sí mismo).
+        bool block(qint64 index, QByteArray &data);
+
+    private:
+        friend class SharedFileReader;
+        Subscription(std::shared_ptr<SharedFileReader> reader, int id) : m_reader(std::move(reader)), m_id(id) {}
+        std::shared_ptr<SharedFileReader> m_reader;
+        int m_id;
+    };
+
+    SharedFileReader(const QString &path, qint64 size);
+    ~SharedFileReader();
+
+    bool open();
+    int subscriberCount() const;
+    // Una lectura del disco falló: ya no entrega bloques a nadie
+    bool failed() const { return m_failed.load(); }
+
+    static std::unique_ptr<Subscription> subscribe(const std::shared_ptr<SharedFileReader> &reader);
+
+private:
+    struct Subscriber {
+        qint64 position = 0;    // Siguiente bloque que necesita
+        bool detached = false;
+    };
+
+    bool blockFor(int id, qint64 index, QByteArray &data);
+    bool readFromStorage(qint64 index, QByteArray &data);
+    void unsubscribe(int id);
+    void detachLaggardsLocked(qint64 leaderIndex);
+    void releaseConsumedLocked();
+
+    QString m_path;
+    qint64 m_size;
+    QFile m_file;
+    QString m_device;
+    QMutex m_ioMutex;                 // Serializa las lecturas del descriptor compartido
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_blockLoaded;
+    std::map<qint64, QByteArray> m_blocks;
+    QSet<qint64> m_loading;
+    QHash<int, Subscriber> m_subscribers;
+    int m_nextId = 1;
+    std::atomic<bool> m_failed{false};
+};
+
+// Registro global de lectores compartidos por archivo
+class SharedReadRegistry {
+public:
+    struct Stats {
+        int activeReaders = 0;
+        int subscribers = 0;
+        quint64 storageBytes = 0;    // Leídos del disco por los lectores compartidos
+        quint64 servedBytes = 0;     // Entregados a los suscriptores
+        quint64 detaches = 0;
+        qint64 minFileSize = 0;
+    };
+
+    static constexpr qint64 DefaultMinFileSize = 64 * 1024 * 1024;
+
+    static SharedReadRegistry &instance() {
+        static SharedReadRegistry instance;
+        return instance;
+    }
+
+    SharedReadRegistry(const SharedReadRegistry &) = delete;
+    SharedReadRegistry &operator=(const SharedReadRegistry &) = delete;
+
+    // Tamaño mínimo para compartir la lectura (0 desactiva el mecanismo)
+    void setMinFileSize(qint64 bytes) { m_minFileSize.store(bytes); }
+    qint64 minFileSize() const { return m_minFileSize.load(); }
+
+    // Suscribe a la descarga de 'path'; nullptr si no aplica o no se puede abrir
+    std::unique_ptr<SharedFileReader::Subscription> subscribe(const QString &path);
+
+    void recordStorageRead(qint64 bytes) { m_storageBytes.fetch_add(bytes, std::memory_order_relaxed); }
+    void recordServed(qint64 bytes) { m_servedBytes.fetch_add(bytes, std::memory_order_relaxed); }
+    void recordDetach() { m_detaches.fetch_add(1, std::memory_order_relaxed); }
+
+    Stats stats() const;
+
+private:
+    SharedReadRegistry() = default;
+
+    mutable QMutex m_mutex;
+    QHash<HotFileCache::Key, std::weak_ptr<SharedFileReader>> m_readers;
+
+    std::atomic<qint64> m_minFileSize{DefaultMinFileSize};
+    std::atomic<quint64> m_storageBytes{0};
+    std::atomic<quint64> m_servedBytes{0};
+    std::atomic<quint64> m_detaches{0};
+};
+
+#endif // SHAREDFILEREADER_H
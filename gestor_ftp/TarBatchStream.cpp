@@ -0,0 +1,204 @@
+#include "TarBatchStream.h"
+#include <QThreadPool>
+#include <QThread>
+#include <QMutexLocker>
+#include <QDebug>
+#include <cstring>
+
+namespace {
+// Pool propio: la lectura anticipada no debe competir con otros usos del pool global
+QThreadPool &readAheadPool()
+{
+    static QThreadPool *pool = []() {
+        QThreadPool *p = new QThreadPool;
+        p->setMaxThreadCount(qBound(2, QThread::idealThreadCount(), 8));
+        return p;
+    }();
+    return *pool;
+}
+} // namespace
+
+TarBatchStream::TarBatchStream(QList<Entry> entries, const Limits &limits, QObject *context,
+                               std::function<void()> onDataReady)
+    : m_entries(std::move(entries)),
+      m_limits(limits),
+      m_notifier(std::make_shared<Notifier>())
+{
+    m_notifier->context = context;
+    m_notifier->callback = std::move(onDataReady);
+    schedulePrefetch();
+}
+
+TarBatchStream::~TarBatchStream()
+{
+    // Las lecturas en curso terminan solas; solo hay que evitar que avisen a un objeto destruido
+    QMutexLocker locker(&m_notifier->mutex);
+    m_notifier->context = nullptr;
+}
+
+bool TarBatchStream::isPrefetched(const Entry &entry) const
+{
+    return !entry.isDir && entry.size <= m_limits.smallFileLimit;
+}
+
+void TarBatchStream::schedulePrefetch()
+{
+    while (m_nextPrefetch < m_entries.size() &&
+           (m_prefetched.empty() ||
+            (int(m_prefetched.size()) < m_limits.readAheadFiles && m_prefetchBytes < m_limits.readAheadBytes))) {
+        const Entry &entry = m_entries[m_nextPrefetch++];
+        if (!isPrefetched(entry)) {
+            m_prefetched.push_back(nullptr); // Se leerá directamente cuando le toque
+            continue;
+        }
+
+        auto prefetch = std::make_shared<Prefetch>();
+        m_prefetched.push_back(prefetch);
+        m_prefetchBytes += entry.size;
+
+        const QString path = entry.absolutePath;
+        const qint64 size = entry.size;
+        std::shared_ptr<Notifier> notifier = m_notifier;
+        readAheadPool().start([prefetch, notifier, path, size]() {
+            {
+                QMutexLocker locker(&notifier->mutex);
+                if (!notifier->context) {
+                    return; // El stream ya no existe: no leer en balde
+                }
+            }
+            QByteArray data;
+            bool failed = false;
+            QFile file(path);
+            if (file.open(QIODevice::ReadOnly)) {
+                data = file.read(size);
+                failed = data.size() != size;
+            } else {
+                failed = true;
+            }
+            {
+                QMutexLocker locker(&prefetch->mutex);
+                prefetch->data = std::move(data);
+                prefetch->failed = failed;
+                prefetch->done = true;
+            }
+            QMutexLocker locker(&notifier->mutex);
+            if (notifier->context) {
+                QMetaObject::invokeMethod(notifier->context, notifier->callback, Qt::QueuedConnection);
+            }
+        });
+    }
+}
+
+qint64 TarBatchStream::read(char *out, qint64 maxBytes)
+{
+    qint64 produced = 0;
+    while (produced < maxBytes) {
+        if (m_pendingPos < m_pending.size()) {
+            const qint64 chunk = qMin<qint64>(m_pending.size() - m_pendingPos, maxBytes - produced);
+            std::memcpy(out + produced, m_pending.constData() + m_pendingPos, chunk);
+            m_pendingPos += chunk;
+            produced += chunk;
+            continue;
+        }
+        if (m_inData) {
+            const qint64 copied = copyData(out + produced, maxBytes - produced);
+            if (copied == 0 && m_inData) {
+                break; // El archivo actual aún se está leyendo en segundo plano
+            }
+            produced += copied;
+            continue;
+        }
+        if (m_finished) {
+            break;
+        }
+        if (!startNextEntry()) {
+            m_pending = TarFormat::endOfArchive();
+            m_pendingPos = 0;
+            m_finished = true;
+        }
+    }
+    return produced;
+}
+
+bool TarBatchStream::startNextEntry()
+{
+    if (m_current + 1 >= m_entries.size()) {
+        return false;
+    }
+    if (m_prefetched.empty()) {
+        schedulePrefetch();
+    }
+    ++m_current;
+    m_currentPrefetch = m_prefetched.front();
+    m_prefetched.pop_front();
+
+    const Entry &entry = m_entries[m_current];
+    m_pending = TarFormat::entryHeader(entry.archiveName, entry.isDir ? 0 : entry.size, entry.mtime,
+                                       entry.permissions,
+                                       entry.isDir ? TarFormat::Directory : TarFormat::RegularFile);
+    m_pendingPos = 0;
+
+    if (!entry.isDir) {
+        m_inData = true;
+        m_dataRemaining = entry.size;
+        m_dataOffset = 0;
+        if (!m_currentPrefetch) {
+            m_currentFile.setFileName(entry.absolutePath);
+            if (!m_currentFile.open(QIODevice::ReadOnly)) {
+                qWarning() << "SITE MRETR: no se pudo abrir" << entry.absolutePath << "- se envía relleno con ceros";
+                ++m_failedFiles;
+            }
+        }
+    }
+    schedulePrefetch();
+    return true;
+}
+
+qint64 TarBatchStream::copyData(char *out, qint64 maxBytes)
+{
+    const Entry &entry = m_entries[m_current];
+    if (m_dataRemaining == 0) {
+        // Fin de los datos: relleno hasta el bloque y liberar la ventana
+        m_pending = QByteArray(TarFormat::paddingFor(entry.size), '\0');
+        m_pendingPos = 0;
+        if (m_currentPrefetch) {
+            m_prefetchBytes -= entry.size;
+            m_currentPrefetch.reset();
+        }
+        m_currentFile.close();
+        m_inData = false;
+        schedulePrefetch();
+        return 0;
+    }
+
+    const qint64 wanted = qMin(maxBytes, m_dataRemaining);
+    qint64 copied = 0;
+    if (m_currentPrefetch) {
+        QMutexLocker locker(&m_currentPrefetch->mutex);
+        if (!m_currentPrefetch->done) {
+            return 0;
+        }
+        if (m_currentPrefetch->failed && m_dataOffset == 0) {
+            qWarning() << "SITE MRETR: lectura incompleta de" << entry.absolutePath << "- se rellena con ceros";
+            ++m_failedFiles;
+        }
+        const QByteArray &data = m_currentPrefetch->data;
+        copied = qBound<qint64>(0, data.size() - m_dataOffset, wanted);
+        std::memcpy(out, data.constData() + m_dataOffset, copied);
+    } else if (m_currentFile.isOpen()) {
+        copied = qMax<qint64>(0, m_currentFile.read(out, wanted));
+    }
+
+    // El archivo encogió o falló: la cabecera ya salió, completar con ceros
+    if (copied < wanted) {
+        if (m_currentFile.isOpen()) {
+            qWarning() << "SITE MRETR:" << entry.absolutePath << "es más corto de lo esperado";
+            ++m_failedFiles;
+            m_currentFile.close();
+        }
+        std::memset(out + copied, 0, wanted - copied);
+    }
+    m_dataOffset += wanted;
+    m_dataRemaining -= wanted;
+    return wanted;
+}
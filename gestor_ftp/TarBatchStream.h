@@ -0,0 +1,96 @@
+#ifndef TARBATCHSTREAM_H
+#define TARBATCHSTREAM_H
+
+#include <QString>
+#include <QList>
+#include <QFile>
+#include <QObject>
+#include <QMutex>
+#include <QByteArray>
+#include <memory>
+#include <deque>
+#include <functional>
+#include "TarFormat.h"
+
+// Archivo tar de muchos archivos generado al vuelo, sin temporales (SITE MRETR).
+//
+// Los archivos pequeños se leen por adelantado y en paralelo en un pool de
+// hilos propio, con una ventana acotada en número de archivos y en bytes; los
+// grandes se leen por bloques en el hilo de la sesión cuando les toca. Así el
+// socket de datos no espera a que el disco sirva cada archivo diminuto de uno
+// en uno.
+class TarBatchStream {
+public:
+    struct Entry {
+        QString absolutePath;
+        QString archiveName;
+        qint64 size = 0;
+        qint64 mtime = 0;
+        QFileDevice::Permissions permissions;
+        bool isDir = false;
+    };
+
+    struct Limits {
+        int readAheadFiles = 64;
+        qint64 readAheadBytes = 16 * 1024 * 1024;
+        qint64 smallFileLimit = 1024 * 1024;   // Por encima se lee en el hilo de la sesión
+    };
+
+    // 'onDataReady' se ejecuta en el hilo de 'context' cuando termina una lectura anticipada
+    TarBatchStream(QList<Entry> entries, const Limits &limits, QObject *context, std::function<void()> onDataReady);
+    ~TarBatchStream();
+
+    TarBatchStream(const TarBatchStream &) = delete;
+    TarBatchStream &operator=(const TarBatchStream &) = delete;
+
+    // Copia hasta 'maxBytes' del archivo tar. Devuelve 0 si el siguiente archivo
+    // aún no está leído (se avisará con onDataReady) o si ya terminó (atEnd()).
+    qint64 read(char *out, qint64 maxBytes);
+    bool atEnd() const { return m_finished && m_pendingPos >= m_pending.size(); }
+
+    int fileCount() const { return m_entries.size(); }
+    int failedFiles() const { return m_failedFiles; }
+
+private:
+    // Contenido de un archivo leído por adelantado; compartido con el hilo lector
+    struct Prefetch {
+        QMutex mutex;
+        bool done = false;
+        bool failed = false;
+        QByteArray data;
+    };
+
+    // Contexto de aviso compartido con los hilos lectores; se anula al destruir el stream
+    struct Notifier {
+        QMutex mutex;
+        QObject *context = nullptr;
+        std::function<void()> callback;
+    };
+
+    bool isPrefetched(const Entry &entry) const;
+    void schedulePrefetch();
+    bool startNextEntry();
+    qint64 copyData(char *out, qint64 maxBytes);
+
+    QList<Entry> m_entries;
+    Limits m_limits;
+    std::shared_ptr<Notifier> m_notifier;
+
+    int m_nextPrefetch = 0;      // Siguiente entrada a encargar
+    qint64 m_prefetchBytes = 0;  // Bytes en vuelo o en memoria
+    std::deque<std::shared_ptr<Prefetch>> m_prefetched;  // En orden de entrada
+
+    int m_current = -1;
+    std::shared_ptr<Prefetch> m_currentPrefetch;
+    QFile m_currentFile;
+    qint64 m_dataRemaining = 0;
+    qint64 m_dataOffset = 0;
+    bool m_inData = false;
+
+    QByteArray m_pending;        // Cabeceras, relleno y fin de archivo por copiar
+    qint64 m_pendingPos = 0;
+    bool m_finished = false;
+    int m_failedFiles = 0;
+};
+
+#endif // TARBATCHSTREAM_H
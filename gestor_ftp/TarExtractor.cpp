@@ -0,0 +1,326 @@
+#include "TarExtractor.h"
+#include <QThreadPool>
+#include <QThread>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QDebug>
+
+namespace {
+// Pool de E/S para escribir archivos pequeños en paralelo
+QThreadPool &writerPool()
+{
+    static QThreadPool *pool = []() {
+        QThreadPool *p = new QThreadPool;
+        p->setMaxThreadCount(qBound(2, QThread::idealThreadCount(), 8));
+        return p;
+    }();
+    return *pool;
+}
+
+// Tope para cabeceras pax y nombres largos: son metadatos, no contenido
+constexpr qint64 MaxMetadataSize = 1024 * 1024;
+
+void applyMetadata(QFile &file, qint64 mtime, int mode)
+{
+    if (mode != 0) {
+        file.setPermissions(TarFormat::permissionsFromMode(mode) | QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    }
+    if (mtime > 0) {
+        file.setFileTime(QDateTime::fromSecsSinceEpoch(mtime), QFileDevice::FileModificationTime);
+    }
+}
+} // namespace
+
+TarExtractor::TarExtractor(PathResolver resolver)
+    : m_resolver(std::move(resolver)),
+      m_shared(std::make_shared<Shared>())
+{
+    m_pendingOverride.size = -1;
+    m_pendingOverride.mtime = -1;
+}
+
+TarExtractor::~TarExtractor()
+{
+    // Las escrituras en vuelo tienen su propia copia del estado compartido
+    if (m_largeFile.isOpen()) {
+        m_largeFile.close();
+    }
+}
+
+bool TarExtractor::feed(const char *data, qint64 size)
+{
+    qint64 pos = 0;
+    while (pos < size) {
+        switch (m_state) {
+        case State::End:
+            return true; // Lo que venga tras el fin de archivo se ignora
+
+        case State::Header: {
+            const qint64 take = qMin<qint64>(TarFormat::BlockSize - m_block.size(), size - pos);
+            m_block.append(data + pos, take);
+            pos += take;
+            if (m_block.size() == TarFormat::BlockSize) {
+                const bool ok = processHeader(m_block.constData());
+                m_block.clear();
+                if (!ok) {
+                    return false;
+                }
+            }
+            break;
+        }
+
+        case State::Data: {
+            const qint64 take = qMin(m_remaining, size - pos);
+            writeData(data + pos, take);
+            pos += take;
+            m_remaining -= take;
+            if (m_remaining == 0) {
+                endEntry();
+            }
+            break;
+        }
+
+        case State::Metadata: {
+            const qint64 take = qMin(m_remaining, size - pos);
+            m_metadata.append(data + pos, take);
+            pos += take;
+            m_remaining -= take;
+            if (m_remaining == 0) {
+                endEntry();
+            }
+            break;
+        }
+
+        case State::Padding: {
+            const qint64 take = qMin(m_padding, size - pos);
+            pos += take;
+            m_padding -= take;
+            if (m_padding == 0) {
+                m_state = State::Header;
+            }
+            break;
+        }
+        }
+    }
+    return true;
+}
+
+bool TarExtractor::processHeader(const char *block)
+{
+    if (TarFormat::isZeroBlock(block)) {
+        if (++m_zeroBlocks >= 2) {
+            m_state = State::End;
+            m_result.complete = true;
+        }
+        return true;
+    }
+    m_zeroBlocks = 0;
+
+    TarFormat::Header header;
+    if (!TarFormat::parseHeader(block, header)) {
+        recordError("cabecera tar inválida");
+        return false;
+    }
+    m_remaining = header.size;
+    m_padding = TarFormat::paddingFor(header.size);
+
+    // Metadatos que modifican la entrada siguiente
+    if (header.type == TarFormat::PaxHeader || header.type == TarFormat::PaxGlobalHeader ||
+        header.type == TarFormat::GnuLongName) {
+        if (header.size > MaxMetadataSize) {
+            recordError("cabecera extendida demasiado grande");
+            return false;
+        }
+        m_metadata.clear();
+        m_metadataType = header.type;
+        m_state = State::Metadata;
+        if (m_remaining == 0) {
+            endEntry();
+        }
+        return true;
+    }
+
+    if (m_hasOverride) {
+        if (!m_pendingOverride.name.isEmpty()) header.name = m_pendingOverride.name;
+        if (m_pendingOverride.size >= 0) header.size = m_pendingOverride.size;
+        if (m_pendingOverride.mtime >= 0) header.mtime = m_pendingOverride.mtime;
+        m_pendingOverride = TarFormat::Header();
+        m_pendingOverride.size = -1;
+        m_pendingOverride.mtime = -1;
+        m_hasOverride = false;
+        m_remaining = header.size;
+        m_padding = TarFormat::paddingFor(header.size);
+    }
+    m_header = header;
+    m_targetPath.clear();
+
+    QString name = QString::fromUtf8(header.name);
+    while (name.startsWith("./")) {
+        name.remove(0, 2);
+    }
+
+    if (header.type == TarFormat::Directory) {
+        const QString path = name.isEmpty() ? QString() : m_resolver(name, true);
+        if (name.isEmpty()) {
+            // "./": la propia carpeta de destino
+        } else if (path.isEmpty()) {
+            qWarning() << "SITE UNTAR: carpeta rechazada" << name;
+            m_result.skipped++;
+        } else if (QDir().mkpath(path)) {
+            m_result.directories++;
+        } else {
+            recordError(QString("no se pudo crear la carpeta %1").arg(name));
+        }
+    } else if (header.type == TarFormat::RegularFile || header.type == '7') {
+        m_targetPath = m_resolver(name, false);
+        if (m_targetPath.isEmpty()) {
+            qWarning() << "SITE UNTAR: archivo rechazado" << name;
+            m_result.skipped++;
+        } else {
+            beginFile();
+        }
+    } else {
+        // Enlaces, dispositivos y FIFOs no se crean: podrían apuntar fuera de la raíz
+        qWarning() << "SITE UNTAR: entrada de tipo" << header.type << "omitida:" << name;
+        m_result.skipped++;
+    }
+
+    m_state = State::Data;
+    if (m_remaining == 0) {
+        endEntry();
+    }
+    return true;
+}
+
+void TarExtractor::beginFile()
+{
+    if (m_header.size <= SmallFileLimit) {
+        m_smallData.clear();
+        m_smallData.reserve(m_header.size);
+        return;
+    }
+
+    QDir().mkpath(QFileInfo(m_targetPath).absolutePath());
+    m_largeFile.setFileName(m_targetPath);
+    if (!m_largeFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        recordError(QString("no se pudo crear %1: %2").arg(m_targetPath, m_largeFile.errorString()));
+        m_targetPath.clear();
+    }
+}
+
+void TarExtractor::writeData(const char *data, qint64 size)
+{
+    if (m_state == State::Metadata || m_targetPath.isEmpty()) {
+        return;
+    }
+    if (m_largeFile.isOpen()) {
+        if (m_largeFile.write(data, size) != size) {
+            recordError(QString("error escribiendo %1: %2").arg(m_targetPath, m_largeFile.errorString()));
+            m_largeFile.close();
+            m_targetPath.clear();
+        }
+        return;
+    }
+    m_smallData.append(data, size);
+}
+
+void TarExtractor::endEntry()
+{
+    if (m_state == State::Metadata) {
+        if (m_metadataType == TarFormat::PaxHeader) {
+            TarFormat::applyPaxRecords(m_metadata, m_pendingOverride);
+            m_hasOverride = true;
+        } else if (m_metadataType == TarFormat::GnuLongName) {
+            m_pendingOverride.name = QByteArray(m_metadata.constData(), qstrnlen(m_metadata.constData(), m_metadata.size()));
+            m_hasOverride = true;
+        }
+        m_metadata.clear();
+    } else if (!m_targetPath.isEmpty()) {
+        if (m_largeFile.isOpen()) {
+            applyMetadata(m_largeFile, m_header.mtime, m_header.mode);
+            m_largeFile.close();
+            m_result.files++;
+        } else {
+            submitSmallFile();
+        }
+        m_targetPath.clear();
+    }
+    m_state = m_padding > 0 ? State::Padding : State::Header;
+}
+
+void TarExtractor::submitSmallFile()
+{
+    const qint64 size = m_smallData.size();
+    {
+        // Contrapresión: no acumular más de MaxPendingBytes sin escribir
+        QMutexLocker locker(&m_shared->mutex);
+        while (m_shared->pendingBytes > 0 && m_shared->pendingBytes + size > MaxPendingBytes) {
+            m_shared->changed.wait(&m_shared->mutex);
+        }
+        m_shared->pendingJobs++;
+        m_shared->pendingBytes += size;
+    }
+    m_result.files++;
+
+    std::shared_ptr<Shared> shared = m_shared;
+    const QString path = m_targetPath;
+    const QByteArray data = std::move(m_smallData);
+    const qint64 mtime = m_header.mtime;
+    const int mode = m_header.mode;
+    m_smallData = QByteArray();
+
+    writerPool().start([shared, path, data, mtime, mode]() {
+        QString error;
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            error = QString("no se pudo crear %1: %2").arg(path, file.errorString());
+        } else if (file.write(data) != data.size()) {
+            error = QString("error escribiendo %1: %2").arg(path, file.errorString());
+        } else {
+            applyMetadata(file, mtime, mode);
+        }
+
+        QMutexLocker locker(&shared->mutex);
+        if (!error.isEmpty()) {
+            qWarning() << "SITE UNTAR:" << error;
+            shared->errors++;
+            if (shared->firstError.isEmpty()) {
+                shared->firstError = error;
+            }
+        }
+        shared->pendingJobs--;
+        shared->pendingBytes -= data.size();
+        shared->changed.wakeAll();
+    });
+}
+
+void TarExtractor::recordError(const QString &message)
+{
+    qWarning() << "SITE UNTAR:" << message;
+    m_result.errors++;
+    if (m_result.firstError.isEmpty()) {
+        m_result.firstError = message;
+    }
+}
+
+TarExtractor::Result TarExtractor::finish()
+{
+    if (m_largeFile.isOpen()) {
+        recordError(QString("%1 quedó incompleto").arg(m_targetPath));
+        m_largeFile.close();
+    }
+
+    QMutexLocker locker(&m_shared->mutex);
+    while (m_shared->pendingJobs > 0) {
+        m_shared->changed.wait(&m_shared->mutex);
+    }
+    Result result = m_result;
+    result.errors += m_shared->errors;
+    if (result.firstError.isEmpty()) {
+        result.firstError = m_shared->firstError;
+    }
+    return result;
+}
@@ -0,0 +1,90 @@
+#ifndef TAREXTRACTOR_H
+#define TAREXTRACTOR_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <functional>
+#include <memory>
+#include "TarFormat.h"
+
+// Extrae un archivo tar a medida que llega por la conexión de datos (SITE UNTAR + STOR).
+//
+// El flujo se interpreta por bloques sin guardarlo entero. Los archivos pequeños
+// se acumulan en memoria y se escriben en paralelo en un pool de E/S; los grandes
+// se escriben por partes en el hilo de la sesión. Si los datos pendientes de
+// escribir superan el límite, feed() espera a que el disco se ponga al día, y
+// esa espera es la que frena al cliente a través de la ventana TCP.
+class TarExtractor {
+public:
+    // Traduce el nombre de una entrada a una ruta absoluta permitida, o devuelve
+    // una cadena vacía para rechazarla
+    using PathResolver = std::function<QString(const QString &name, bool isDir)>;
+
+    struct Result {
+        int files = 0;
+        int directories = 0;
+        int skipped = 0;       // Enlaces, dispositivos y rutas rechazadas
+        int errors = 0;
+        bool complete = false; // Se recibió el fin de archivo
+        QString firstError;
+    };
+
+    static constexpr qint64 SmallFileLimit = 1024 * 1024;
+    static constexpr qint64 MaxPendingBytes = 64 * 1024 * 1024;
+
+    explicit TarExtractor(PathResolver resolver);
+    ~TarExtractor();
+
+    TarExtractor(const TarExtractor &) = delete;
+    TarExtractor &operator=(const TarExtractor &) = delete;
+
+    // Procesa datos recibidos. Devuelve false si el flujo no es un tar válido.
+    bool feed(const char *data, qint64 size);
+
+    // Espera a que terminen las escrituras pendientes y devuelve el resumen
+    Result finish();
+
+private:
+    enum class State { Header, Data, Padding, Metadata, End };
+
+    // Estado compartido con las tareas del pool de E/S
+    struct Shared {
+        QMutex mutex;
+        QWaitCondition changed;
+        int pendingJobs = 0;
+        qint64 pendingBytes = 0;
+        int errors = 0;
+        QString firstError;
+    };
+
+    bool processHeader(const char *block);
+    void beginFile();
+    void writeData(const char *data, qint64 size);
+    void endEntry();
+    void submitSmallFile();
+    void recordError(const QString &message);
+
+    PathResolver m_resolver;
+    std::shared_ptr<Shared> m_shared;
+    Result m_result;
+
+    State m_state = State::Header;
+    QByteArray m_block;              // Bloque de cabecera a medio recibir
+    TarFormat::Header m_header;
+    TarFormat::Header m_pendingOverride;  // Nombre/tamaño de pax o GNU para la siguiente entrada
+    bool m_hasOverride = false;
+    QByteArray m_metadata;           // Contenido de una cabecera pax o nombre largo GNU
+    char m_metadataType = 0;
+    qint64 m_remaining = 0;          // Bytes de datos que faltan en la entrada actual
+    qint64 m_padding = 0;
+    int m_zeroBlocks = 0;
+
+    QString m_targetPath;            // Ruta de la entrada actual; vacía si se descarta
+    QByteArray m_smallData;          // Contenido de un archivo pequeño
+    QFile m_largeFile;
+};
+
+#endif // TAREXTRACTOR_H
@@ -0,0 +1,221 @@
+#include "TarFormat.h"
+#include <cstring>
+
+namespace {
+// Campo numérico octal terminado en NUL que ocupa exactamente 'width' bytes
+void writeOctal(char *field, int width, qint64 value)
+{
+    QByteArray digits = QByteArray::number(value, 8).rightJustified(width - 1, '0');
+    std::memcpy(field, digits.constData(), width - 1);
+    field[width - 1] = '\0';
+}
+
+// Mayor valor representable en un campo octal de 'width' bytes
+constexpr qint64 maxOctal(int width)
+{
+    return (qint64(1) << (3 * (width - 1))) - 1;
+}
+} // namespace
+
+int TarFormat::unixMode(QFileDevice::Permissions permissions)
+{
+    int mode = 0;
+    if (permissions & QFileDevice::ReadOwner)  mode |= 0400;
+    if (permissions & QFileDevice::WriteOwner) mode |= 0200;
+    if (permissions & QFileDevice::ExeOwner)   mode |= 0100;
+    if (permissions & QFileDevice::ReadGroup)  mode |= 0040;
+    if (permissions & QFileDevice::WriteGroup) mode |= 0020;
+    if (permissions & QFileDevice::ExeGroup)   mode |= 0010;
+    if (permissions & QFileDevice::ReadOther)  mode |= 0004;
+    if (permissions & QFileDevice::WriteOther) mode |= 0002;
+    if (permissions & QFileDevice::ExeOther)   mode |= 0001;
+    return mode;
+}
+
+QByteArray TarFormat::entryHeader(const QString &name, qint64 size, qint64 mtime,
+                                  QFileDevice::Permissions permissions, EntryType type)
+{
+    QByteArray path = name.toUtf8();
+    if (type == Directory && !path.endsWith('/')) {
+        path += '/';
+    }
+    int mode = unixMode(permissions);
+    if (mode == 0) {
+        mode = type == Directory ? 0755 : 0644;
+    }
+
+    // ¿Cabe en ustar? El nombre puede partirse en prefijo (155) + nombre (100) por una '/'
+    QByteArray ustarName = path;
+    QByteArray ustarPrefix;
+    bool needsPax = false;
+    if (path.size() > 100) {
+        needsPax = true;
+        for (int slash = path.lastIndexOf('/', path.size() - 2); slash > 0; slash = path.lastIndexOf('/', slash - 1)) {
+            if (slash <= 155 && path.size() - slash - 1 <= 100) {
+                ustarPrefix = path.left(slash);
+                ustarName = path.mid(slash + 1);
+                needsPax = false;
+                break;
+            }
+        }
+    }
+    const bool hugeSize = size > maxOctal(12);
+
+    QByteArray result;
+    if (needsPax || hugeSize) {
+        QByteArray records;
+        if (needsPax) {
+            records += paxRecord("path", path);
+            ustarName = path.right(100);
+            ustarPrefix.clear();
+        }
+        if (hugeSize) {
+            records += paxRecord("size", QByteArray::number(size));
+        }
+        result += ustarBlock(QByteArrayLiteral("././@PaxHeader"), QByteArray(), records.size(), mtime, 0644, PaxHeader);
+        result += records;
+        result += QByteArray(paddingFor(records.size()), '\0');
+    }
+    result += ustarBlock(ustarName, ustarPrefix, hugeSize ? 0 : size, mtime, mode, type);
+    return result;
+}
+
+QByteArray TarFormat::ustarBlock(const QByteArray &name, const QByteArray &prefix, qint64 size,
+                                 qint64 mtime, int mode, char type)
+{
+    QByteArray block(BlockSize, '\0');
+    char *h = block.data();
+
+    std::memcpy(h, name.constData(), qMin<qsizetype>(name.size(), 100));
+    writeOctal(h + 100, 8, mode);
+    writeOctal(h + 108, 8, 0);                                // uid
+    writeOctal(h + 116, 8, 0);                                // gid
+    writeOctal(h + 124, 12, size);
+    writeOctal(h + 136, 12, qBound<qint64>(0, mtime, maxOctal(12)));
+    h[156] = type;
+    std::memcpy(h + 257, "ustar", 6);                         // magic con NUL
+    std::memcpy(h + 263, "00", 2);                            // versión
+    std::memcpy(h + 265, "ftp", 3);                           // uname
+    std::memcpy(h + 297, "ftp", 3);                           // gname
+    std::memcpy(h + 345, prefix.constData(), qMin<qsizetype>(prefix.size(), 155));
+
+    // Suma de comprobación calculada con el propio campo relleno de espacios
+    std::memset(h + 148, ' ', 8);
+    unsigned int checksum = 0;
+    for (int i = 0; i < BlockSize; ++i) {
+        checksum += static_cast<unsigned char>(h[i]);
+    }
+    writeOctal(h + 148, 7, checksum);
+    h[155] = ' ';
+    return block;
+}
+
+QByteArray TarFormat::paxRecord(const QByteArray &key, const QByteArray &value)
+{
+    // "<longitud> <clave>=<valor>\n", donde la longitud incluye sus propios dígitos
+    const int base = key.size() + value.size() + 3;
+    int length = base + QByteArray::number(base).size();
+    if (QByteArray::number(length).size() != QByteArray::number(base).size()) {
+        ++length;
+    }
+    return QByteArray::number(length) + ' ' + key + '=' + value + '\n';
+}
+
+QFileDevice::Permissions TarFormat::permissionsFromMode(int mode)
+{
+    QFileDevice::Permissions permissions;
+    if (mode & 0400) permissions |= QFileDevice::ReadOwner | QFileDevice::ReadUser;
+    if (mode & 0200) permissions |= QFileDevice::WriteOwner | QFileDevice::WriteUser;
+    if (mode & 0100) permissions |= QFileDevice::ExeOwner | QFileDevice::ExeUser;
+    if (mode & 0040) permissions |= QFileDevice::ReadGroup;
+    if (mode & 0020) permissions |= QFileDevice::WriteGroup;
+    if (mode & 0010) permissions |= QFileDevice::ExeGroup;
+    if (mode & 0004) permissions |= QFileDevice::ReadOther;
+    if (mode & 0002) permissions |= QFileDevice::WriteOther;
+    if (mode & 0001) permissions |= QFileDevice::ExeOther;
+    return permissions;
+}
+
+qint64 TarFormat::parseNumber(const char *field, int width)
+{
+    // Codificación base-256 de GNU para valores que no caben en octal
+    if (static_cast<unsigned char>(field[0]) & 0x80) {
+        qint64 value = static_cast<unsigned char>(field[0]) & 0x7f;
+        for (int i = 1; i < width; ++i) {
+            value = (value << 8) | static_cast<unsigned char>(field[i]);
+        }
+        return value;
+    }
+    qint64 value = 0;
+    int i = 0;
+    while (i < width && (field[i] == ' ' || field[i] == '\0')) {
+        ++i;
+    }
+    for (; i < width && field[i] >= '0' && field[i] <= '7'; ++i) {
+        value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+bool TarFormat::isZeroBlock(const char *block)
+{
+    for (int i = 0; i < BlockSize; ++i) {
+        if (block[i] != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TarFormat::parseHeader(const char *block, Header &header)
+{
+    unsigned int checksum = 0;
+    for (int i = 0; i < BlockSize; ++i) {
+        checksum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(block[i]);
+    }
+    if (qint64(checksum) != parseNumber(block + 148, 8)) {
+        return false;
+    }
+
+    header.name = QByteArray(block, qstrnlen(block, 100));
+    // Con magia POSIX ("ustar\0") el prefijo se antepone al nombre; el formato
+    // antiguo de GNU ("ustar  ") usa esos bytes para otras cosas
+    if (std::memcmp(block + 257, "ustar", 6) == 0 && block[345] != '\0') {
+        header.name = QByteArray(block + 345, qstrnlen(block + 345, 155)) + '/' + header.name;
+    }
+    header.mode = int(parseNumber(block + 100, 8));
+    header.size = parseNumber(block + 124, 12);
+    header.mtime = parseNumber(block + 136, 12);
+    header.type = block[156] == '\0' ? RegularFile : block[156];
+    return true;
+}
+
+void TarFormat::applyPaxRecords(const QByteArray &records, Header &header)
+{
+    qsizetype pos = 0;
+    while (pos < records.size()) {
+        const qsizetype space = records.indexOf(' ', pos);
+        if (space < 0) {
+            break;
+        }
+        const qint64 length = records.mid(pos, space - pos).toLongLong();
+        if (length <= 0 || pos + length > records.size()) {
+            break;
+        }
+        // "<longitud> <clave>=<valor>\n"
+        const QByteArray record = records.mid(space + 1, pos + length - space - 2);
+        const qsizetype equals = record.indexOf('=');
+        if (equals > 0) {
+            const QByteArray key = record.left(equals);
+            const QByteArray value = record.mid(equals + 1);
+            if (key == "path") {
+                header.name = value;
+            } else if (key == "size") {
+                header.size = value.toLongLong();
+            } else if (key == "mtime") {
+                header.mtime = qint64(value.toDouble());
+            }
+        }
+        pos += length;
+    }
+}
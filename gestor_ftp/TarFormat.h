@@ -0,0 +1,64 @@
+#ifndef TARFORMAT_H
+#define TARFORMAT_H
+
+#include <QByteArray>
+#include <QString>
+#include <QFileDevice>
+
+// Cabeceras del formato tar POSIX (ustar + extensiones pax).
+//
+// Los nombres que no caben en los campos ustar y los tamaños de 8 GB o más se
+// describen con una cabecera pax ('x') delante de la entrada, que entienden GNU
+// tar, bsdtar, 7-Zip y la biblioteca estándar de Python.
+class TarFormat {
+public:
+    static constexpr int BlockSize = 512;
+
+    enum EntryType : char {
+        RegularFile = '0',
+        HardLink = '1',
+        SymLink = '2',
+        Directory = '5',
+        PaxHeader = 'x',
+        PaxGlobalHeader = 'g',
+        GnuLongName = 'L'
+    };
+
+    // Cabecera leída de un archivo tar
+    struct Header {
+        QByteArray name;
+        qint64 size = 0;
+        qint64 mtime = 0;
+        int mode = 0;
+        char type = RegularFile;
+    };
+
+    // Cabecera completa de una entrada (uno o más bloques de 512 bytes)
+    static QByteArray entryHeader(const QString &name, qint64 size, qint64 mtime,
+                                  QFileDevice::Permissions permissions, EntryType type);
+
+    // Relleno con ceros hasta el siguiente múltiplo de 512 tras 'size' bytes de datos
+    static qint64 paddingFor(qint64 size) { return (BlockSize - size % BlockSize) % BlockSize; }
+
+    // Marca de fin de archivo: dos bloques a cero
+    static QByteArray endOfArchive() { return QByteArray(2 * BlockSize, '\0'); }
+
+    // Bits de modo Unix a partir de los permisos de Qt, y al revés
+    static int unixMode(QFileDevice::Permissions permissions);
+    static QFileDevice::Permissions permissionsFromMode(int mode);
+
+    // Interpreta un bloque de cabecera. Devuelve false si la suma de comprobación no cuadra.
+    static bool parseHeader(const char *block, Header &header);
+    static bool isZeroBlock(const char *block);
+
+    // Aplica los registros pax "path", "size" y "mtime" de 'records' a la cabecera siguiente
+    static void applyPaxRecords(const QByteArray &records, Header &header);
+
+private:
+    static QByteArray ustarBlock(const QByteArray &name, const QByteArray &prefix, qint64 size,
+                                 qint64 mtime, int mode, char type);
+    static QByteArray paxRecord(const QByteArray &key, const QByteArray &value);
+    static qint64 parseNumber(const char *field, int width);
+};
+
+#endif // TARFORMAT_H
@@ -0,0 +1,180 @@
+#include "TlsHandshakeScheduler.h"
+#include <QMutexLocker>
+#include <QThread>
+#include <QDeadlineTimer>
+#include <QDebug>
+
+TlsHandshakeScheduler::TlsHandshakeScheduler()
+    : m_slots(qMax(1, QThread::idealThreadCount()))
+{
+    m_clock.start();
+}
+
+void TlsHandshakeScheduler::configure(int slots, int maxQueued, int queueTimeoutMs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_slots = slots > 0 ? slots : qMax(1, QThread::idealThreadCount());
+    m_maxQueued = qMax(0, maxQueued);
+    m_queueTimeoutMs.store(qMax(100, queueTimeoutMs));
+    // Si se amplió el número de turnos, despachar a los que esperan
+    grantNextLocked();
+    qInfo() << "Handshakes TLS simultáneos:" << m_slots << "- cola máxima:" << m_maxQueued;
+}
+
+quint64 TlsHandshakeScheduler::request(QObject *context, std::function<void()> onGranted)
+{
+    QMutexLocker locker(&m_mutex);
+    Waiter waiter;
+    waiter.ticket = m_nextTicket++;
+    waiter.enqueuedAtMs = m_clock.elapsed();
+    waiter.context = context;
+    waiter.onGranted = std::move(onGranted);
+
+    if (m_queue.empty() && m_active.size() < m_slots) {
+        grantLocked(waiter);
+        return waiter.ticket;
+    }
+    if (int(m_queue.size()) >= m_maxQueued) {
+        m_rejected++;
+        return 0;
+    }
+    m_queue.push_back(std::move(waiter));
+    m_peakQueued = qMax(m_peakQueued, int(m_queue.size()));
+    return m_queue.back().ticket;
+}
+
+quint64 TlsHandshakeScheduler::acquireBlocking(int timeoutMs)
+{
+    QMutexLocker locker(&m_mutex);
+    Waiter waiter;
+    waiter.ticket = m_nextTicket++;
+    waiter.enqueuedAtMs = m_clock.elapsed();
+
+    if (m_queue.empty() && m_active.size() < m_slots) {
+        grantLocked(waiter);
+        return waiter.ticket;
+    }
+    if (int(m_queue.size()) >= m_maxQueued) {
+        m_rejected++;
+        return 0;
+    }
+
+    const quint64 ticket = waiter.ticket;
+    m_blockingGrants.insert(ticket, false);
+    // Detrás de las demás esperas bloqueantes, delante de los handshakes de control
+    auto position = m_queue.begin();
+    while (position != m_queue.end() && !position->context) {
+        ++position;
+    }
+    m_queue.insert(position, std::move(waiter));
+    m_peakQueued = qMax(m_peakQueued, int(m_queue.size()));
+
+    QDeadlineTimer deadline(timeoutMs);
+    while (!m_blockingGrants.value(ticket)) {
+        if (!m_blockingGranted.wait(&m_mutex, deadline) && !m_blockingGrants.value(ticket)) {
+            // Tiempo agotado sin turno: salir de la cola
+            m_blockingGrants.remove(ticket);
+            for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+                if (it->ticket == ticket) {
+                    m_queue.erase(it);
+                    break;
+                }
+            }
+            m_timedOut++;
+            return 0;
+        }
+    }
+    m_blockingGrants.remove(ticket);
+    return ticket;
+}
+
+bool TlsHandshakeScheduler::cancel(quint64 ticket)
+{
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+        if (it->ticket == ticket) {
+            m_queue.erase(it);
+            m_timedOut++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TlsHandshakeScheduler::release(quint64 ticket)
+{
+    if (ticket == 0) {
+        return;
+    }
+    QMutexLocker locker(&m_mutex);
+    auto active = m_active.find(ticket);
+    if (active != m_active.end()) {
+        record(m_handshake, m_clock.elapsed() - active->grantedAtMs);
+        m_active.erase(active);
+        grantNextLocked();
+        return;
+    }
+    // Abandonó la espera (por ejemplo, el cliente se desconectó)
+    for (auto it = m_queue.begin(); it != m_queue.end(); ++it) {
+        if (it->ticket == ticket) {
+            m_queue.erase(it);
+            return;
+        }
+    }
+}
+
+void TlsHandshakeScheduler::grantLocked(const Waiter &waiter)
+{
+    const qint64 now = m_clock.elapsed();
+    m_active.insert(waiter.ticket, Active{now});
+    m_granted++;
+    record(m_wait, now - waiter.enqueuedAtMs);
+
+    if (!waiter.context) {
+        if (m_blockingGrants.contains(waiter.ticket)) {
+            m_blockingGrants[waiter.ticket] = true;
+            m_blockingGranted.wakeAll();
+        }
+        return;
+    }
+    // Publicar el aviso con el mutex tomado: quien destruya el contexto tiene que
+    // pasar antes por release(), y Qt descarta los eventos de objetos destruidos
+    QMetaObject::invokeMethod(waiter.context, waiter.onGranted, Qt::QueuedConnection);
+}
+
+void TlsHandshakeScheduler::grantNextLocked()
+{
+    while (!m_queue.empty() && m_active.size() < m_slots) {
+        Waiter waiter = std::move(m_queue.front());
+        m_queue.pop_front();
+        grantLocked(waiter);
+    }
+}
+
+void TlsHandshakeScheduler::record(Histogram &histogram, qint64 ms)
+{
+    int bucket = 0;
+    while (bucket < HistogramBuckets - 1 && ms > BucketLimitsMs[bucket]) {
+        ++bucket;
+    }
+    histogram.counts[bucket]++;
+    histogram.samples++;
+    histogram.totalMs += ms;
+    histogram.maxMs = qMax(histogram.maxMs, ms);
+}
+
+TlsHandshakeScheduler::Stats TlsHandshakeScheduler::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    Stats s;
+    s.slots = m_slots;
+    s.active = m_active.size();
+    s.queued = int(m_queue.size());
+    s.peakQueued = m_peakQueued;
+    s.granted = m_granted;
+    s.timedOut = m_timedOut;
+    s.rejected = m_rejected;
+    s.wait = m_wait;
+    s.handshake = m_handshake;
+    return s;
+}
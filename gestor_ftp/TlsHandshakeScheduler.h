@@ -0,0 +1,112 @@
+#ifndef TLSHANDSHAKESCHEDULER_H
+#define TLSHANDSHAKESCHEDULER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QHash>
+#include <deque>
+#include <functional>
+#include <atomic>
+
+// Limita cuántos handshakes TLS se ejecutan a la vez en todo el servidor.
+//
+// Cada sesión tiene su propio hilo y QSslSocket solo puede negociar en el hilo
+// que lo posee, así que el trabajo criptográfico no se puede mover a otro hilo.
+// Lo que sí se puede es acotar la concurrencia: una ráfaga de AUTH TLS ya no
+// reparte la CPU entre cientos de handshakes simultáneos (que terminarían todos
+// tarde) sino que los atiende en orden, como mucho 'slots' a la vez, y el resto
+// espera en una cola FIFO con tiempo máximo.
+class TlsHandshakeScheduler {
+public:
+    // Límites de los cubos de los histogramas en milisegundos (el último es "más")
+    static constexpr int HistogramBuckets = 12;
+    static constexpr int BucketLimitsMs[HistogramBuckets - 1] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 5000};
+
+    struct Histogram {
+        quint64 counts[HistogramBuckets] = {};
+        quint64 samples = 0;
+        qint64 totalMs = 0;
+        qint64 maxMs = 0;
+    };
+
+    struct Stats {
+        int slots = 0;
+        int active = 0;
+        int queued = 0;
+        int peakQueued = 0;
+        quint64 granted = 0;
+        quint64 timedOut = 0;
+        quint64 rejected = 0;   // Cola llena
+        Histogram wait;         // Tiempo en cola hasta obtener turno
+        Histogram handshake;    // Duración del handshake con turno concedido
+    };
+
+    static TlsHandshakeScheduler &instance() {
+        static TlsHandshakeScheduler instance;
+        return instance;
+    }
+
+    TlsHandshakeScheduler(const TlsHandshakeScheduler &) = delete;
+    TlsHandshakeScheduler &operator=(const TlsHandshakeScheduler &) = delete;
+
+    void configure(int slots, int maxQueued, int queueTimeoutMs);
+    int queueTimeoutMs() const { return m_queueTimeoutMs.load(); }
+
+    // Pide turno de forma asíncrona. 'onGranted' se ejecuta en el hilo de
+    // 'context' (y nunca si el objeto ya se destruyó). Devuelve el ticket, o 0
+    // si la cola está llena.
+    quint64 request(QObject *context, std::function<void()> onGranted);
+
+    // Pide turno bloqueando el hilo actual hasta 'timeoutMs'. Devuelve 0 si no lo obtuvo.
+    // Lo usan las conexiones de datos de sesiones ya cifradas: pasan por delante de
+    // los handshakes de control en cola para que el hilo de la sesión espere poco.
+    quint64 acquireBlocking(int timeoutMs);
+
+    // Retira un ticket todavía en cola. Devuelve false si ya tenía turno.
+    bool cancel(quint64 ticket);
+
+    // Libera el turno (o retira de la cola) al terminar o abandonar el handshake
+    void release(quint64 ticket);
+
+    Stats stats() const;
+
+private:
+    TlsHandshakeScheduler();
+
+    struct Waiter {
+        quint64 ticket = 0;
+        qint64 enqueuedAtMs = 0;
+        QObject *context = nullptr;     // nullptr: espera bloqueante
+        std::function<void()> onGranted;
+    };
+
+    struct Active {
+        qint64 grantedAtMs = 0;
+    };
+
+    void grantLocked(const Waiter &waiter);
+    void grantNextLocked();
+    static void record(Histogram &histogram, qint64 ms);
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_blockingGranted;
+    std::deque<Waiter> m_queue;
+    QHash<quint64, Active> m_active;
+    QHash<quint64, bool> m_blockingGrants;
+    QElapsedTimer m_clock;
+    quint64 m_nextTicket = 1;
+    int m_slots;
+    int m_maxQueued = 1000;
+    int m_peakQueued = 0;
+    std::atomic<int> m_queueTimeoutMs{10000};
+
+    quint64 m_granted = 0;
+    quint64 m_timedOut = 0;
+    quint64 m_rejected = 0;
+    Histogram m_wait;
+    Histogram m_handshake;
+};
+
+#endif // TLSHANDSHAKESCHEDULER_H
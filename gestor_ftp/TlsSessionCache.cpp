@@ -0,0 +1,88 @@
+#include "TlsSessionCache.h"
+#include <QMutexLocker>
+#include <QDebug>
+
+TlsSessionCache::TlsSessionCache() = default;
+
+void TlsSessionCache::setCapacity(int capacity)
+{
+    // Las sesiones ya registradas siguen hasta que se cierre su canal de control
+    QMutexLocker locker(&m_mutex);
+    m_capacity = qMax(1, capacity);
+}
+
+bool TlsSessionCache::hasRoom() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.size() < m_capacity;
+}
+
+#ifdef HAVE_SSL
+void TlsSessionCache::storeControlSession(const QString &sessionId, const QHostAddress &peer,
+                                          const QSslConfiguration &negotiated, qint64 handshakeMs)
+{
+    m_controlHandshakes.fetch_add(1, std::memory_order_relaxed);
+    m_controlHandshakeMsTotal.fetch_add(handshakeMs, std::memory_order_relaxed);
+
+    // Sin expulsar a nadie: el tope ya se comprobó en AUTH (hasRoom) y, si dos AUTH
+    // simultáneos lo rebasan por una entrada, es mejor eso que dejar una sesión viva sin datos
+    QMutexLocker locker(&m_mutex);
+    Entry &entry = m_entries[sessionId];
+    entry.peer = peer;
+    entry.configuration = negotiated;
+}
+
+bool TlsSessionCache::lookupForData(const QString &sessionId, const QHostAddress &dataPeer, QSslConfiguration &config)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.find(sessionId);
+    if (it == m_entries.end()) {
+        m_peerCheckFailures.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // La conexión de datos debe venir del mismo cliente que negoció la sesión
+    if (!it->peer.isEqual(dataPeer, QHostAddress::TolerantConversion)) {
+        m_peerMismatches.fetch_add(1, std::memory_order_relaxed);
+        m_peerCheckFailures.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_peerChecks.fetch_add(1, std::memory_order_relaxed);
+    config = it->configuration;
+    return true;
+}
+#endif
+
+void TlsSessionCache::recordDataHandshake(qint64 handshakeMs)
+{
+    m_dataHandshakes.fetch_add(1, std::memory_order_relaxed);
+    m_dataHandshakeMsTotal.fetch_add(handshakeMs, std::memory_order_relaxed);
+}
+
+void TlsSessionCache::removeSession(const QString &sessionId)
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.remove(sessionId);
+}
+
+TlsSessionCache::Stats TlsSessionCache::stats() const
+{
+    Stats s;
+    {
+        QMutexLocker locker(&m_mutex);
+        s.entries = m_entries.size();
+    }
+    s.peerChecks = m_peerChecks.load(std::memory_order_relaxed);
+    s.peerCheckFailures = m_peerCheckFailures.load(std::memory_order_relaxed);
+    s.peerMismatches = m_peerMismatches.load(std::memory_order_relaxed);
+    s.rejected = m_rejected.load(std::memory_order_relaxed);
+    s.refusedAuth = m_refusedAuth.load(std::memory_order_relaxed);
+    s.controlHandshakes = m_controlHandshakes.load(std::memory_order_relaxed);
+    s.dataHandshakes = m_dataHandshakes.load(std::memory_order_relaxed);
+    if (s.controlHandshakes > 0) {
+        s.avgControlHandshakeMs = double(m_controlHandshakeMsTotal.load()) / s.controlHandshakes;
+    }
+    if (s.dataHandshakes > 0) {
+        s.avgDataHandshakeMs = double(m_dataHandshakeMsTotal.load()) / s.dataHandshakes;
+    }
+    return s;
+}
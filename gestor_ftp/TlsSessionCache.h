@@ -0,0 +1,105 @@
+#ifndef TLSSESSIONCACHE_H
+#define TLSSESSIONCACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QHostAddress>
+#include <QMutex>
+#include <atomic>
+
+#ifdef HAVE_SSL
+#include <QSslConfiguration>
+#endif
+
+// Registro de las sesiones de control cifradas, compartido por todos los hilos.
+//
+// Cada sesión FTPS registra aquí la configuración negociada en su canal de
+// control; las conexiones de datos de esa misma sesión la buscan y parten de una
+// copia de ella en lugar de la configuración genérica del servidor. No es
+// reanudación de sesión TLS: Qt crea un contexto OpenSSL por socket, así que ni
+// la caché de sesiones del servidor ni la clave de los tickets se comparten entre
+// el canal de control y los de datos, y cada conexión de datos hace su handshake
+// completo. Por eso los contadores son comprobaciones de cliente, no aciertos de
+// una caché. Lo que aporta es el control de acceso: con la reutilización obligatoria, una
+// conexión de datos solo se acepta si existe una sesión de control cifrada y
+// vigente del mismo cliente (mismo criterio que require_ssl_reuse en otros
+// servidores), así nadie puede colarse en el canal de datos de otra sesión.
+//
+// La entrada vive exactamente lo que el canal de control: se borra al cerrarse y
+// nunca caduca ni se expulsa antes, porque con la reutilización obligatoria eso
+// dejaría a un cliente conectado sin poder abrir conexiones de datos. El tope de
+// entradas se aplica al aceptar AUTH: sin sitio, se rechaza la sesión nueva.
+class TlsSessionCache {
+public:
+    struct Stats {
+        int entries = 0;
+        quint64 peerChecks = 0;          // Conexiones de datos de una sesión cifrada del mismo cliente
+        quint64 peerCheckFailures = 0;   // Sin sesión de control cifrada o desde otra IP
+        quint64 peerMismatches = 0;
+        quint64 rejected = 0;            // Conexiones de datos rechazadas por exigir reutilización
+        quint64 refusedAuth = 0;         // AUTH rechazados por tener el registro lleno
+        quint64 controlHandshakes = 0;
+        quint64 dataHandshakes = 0;
+        double avgControlHandshakeMs = 0.0;
+        double avgDataHandshakeMs = 0.0;
+    };
+
+    static TlsSessionCache &instance() {
+        static TlsSessionCache instance;
+        return instance;
+    }
+
+    TlsSessionCache(const TlsSessionCache &) = delete;
+    TlsSessionCache &operator=(const TlsSessionCache &) = delete;
+
+    void setRequireReuse(bool require) { m_requireReuse.store(require); }
+    bool requireReuse() const { return m_requireReuse.load(); }
+    void setCapacity(int capacity);
+    // Hay sitio para una sesión de control cifrada más (se pregunta antes del AUTH)
+    bool hasRoom() const;
+
+#ifdef HAVE_SSL
+    // Registra la sesión de control ya cifrada de un cliente
+    void storeControlSession(const QString &sessionId, const QHostAddress &peer,
+                             const QSslConfiguration &negotiated, qint64 handshakeMs);
+
+    // Busca la sesión de control para una conexión de datos.
+    // Devuelve false en caso de fallo; 'config' solo es válida si devuelve true.
+    bool lookupForData(const QString &sessionId, const QHostAddress &dataPeer, QSslConfiguration &config);
+#endif
+
+    void recordDataHandshake(qint64 handshakeMs);
+    void recordRejected() { m_rejected.fetch_add(1, std::memory_order_relaxed); }
+    void recordRefusedAuth() { m_refusedAuth.fetch_add(1, std::memory_order_relaxed); }
+    void removeSession(const QString &sessionId);
+
+    Stats stats() const;
+
+private:
+    TlsSessionCache();
+
+    struct Entry {
+        QHostAddress peer;
+#ifdef HAVE_SSL
+        QSslConfiguration configuration;
+#endif
+    };
+
+    mutable QMutex m_mutex;
+    QHash<QString, Entry> m_entries;
+    int m_capacity = 10000;
+
+    std::atomic<bool> m_requireReuse{true};
+
+    std::atomic<quint64> m_peerChecks{0};
+    std::atomic<quint64> m_peerCheckFailures{0};
+    std::atomic<quint64> m_peerMismatches{0};
+    std::atomic<quint64> m_rejected{0};
+    std::atomic<quint64> m_refusedAuth{0};
+    std::atomic<quint64> m_controlHandshakes{0};
+    std::atomic<quint64> m_dataHandshakes{0};
+    std::atomic<qint64> m_controlHandshakeMsTotal{0};
+    std::atomic<qint64> m_dataHandshakeMsTotal{0};
+};
+
+#endif // TLSSESSIONCACHE_H
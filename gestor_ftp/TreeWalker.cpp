@@ -0,0 +1,260 @@
+#include "TreeWalker.h"
+#include "IoScheduler.h"
+#include <QThreadPool>
+#include <QThread>
+#include <QFile>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+
+namespace {
+// Pool propio: un recorrido grande no debe dejar sin hilos a otros usos del pool global
+QThreadPool &walkerPool()
+{
+    static QThreadPool *pool = []() {
+        QThreadPool *p = new QThreadPool;
+        p->setMaxThreadCount(qBound(2, QThread::idealThreadCount(), 16));
+        return p;
+    }();
+    return *pool;
+}
+
+std::atomic<int> g_maxDepth{TreeWalker::DefaultMaxDepth};
+std::atomic<qint64> g_maxEntries{TreeWalker::DefaultMaxEntries};
+
+// Los nombres llegan como bytes del sistema de archivos (UTF-8 fuera de Linux)
+QString nameToString(const QByteArray &name)
+{
+#ifdef Q_OS_LINUX
+    return QFile::decodeName(name);
+#else
+    return QString::fromUtf8(name);
+#endif
+}
+} // namespace
+
+// =====================================================================================
+// Seccion: Configuración
+// =====================================================================================
+
+void TreeWalker::configure(int maxDepth, qint64 maxEntries, int threads)
+{
+    g_maxDepth.store(qMax(0, maxDepth));
+    g_maxEntries.store(qMax<qint64>(1, maxEntries));
+    if (threads > 0) {
+        walkerPool().setMaxThreadCount(threads);
+    }
+    qInfo() << "Listados recursivos: profundidad máxima" << maxDepth << ", hasta" << maxEntries
+            << "entradas," << walkerPool().maxThreadCount() << "hilos";
+}
+
+TreeWalker::Limits TreeWalker::defaultLimits()
+{
+    Limits limits;
+    limits.maxDepth = g_maxDepth.load();
+    limits.maxEntries = g_maxEntries.load();
+    return limits;
+}
+
+// =====================================================================================
+// Seccion: Lectura en el pool
+// =====================================================================================
+
+TreeWalker::TreeWalker(const QString &root, DirectoryLister::Format format, bool showHidden, const Limits &limits,
+                       QObject *context, std::function<void()> onDataReady, DescendFilter canDescend)
+    : m_state(std::make_shared<State>())
+{
+    m_state->context = context;
+    m_state->callback = std::move(onDataReady);
+    m_state->canDescend = std::move(canDescend);
+    m_state->rootPath = root;
+    m_state->format = format;
+    m_state->showHidden = showHidden;
+    m_state->limits = limits;
+    m_state->device = IoScheduler::deviceFor(-1, root);
+
+    m_state->root = std::make_unique<Node>();
+    m_state->root->path = root;
+    m_state->root->relative = format == DirectoryLister::Format::Mlsd ? QByteArray() : QByteArray(".");
+    m_stack.push_back(Frame{m_state->root.get()});
+
+    QMutexLocker locker(&m_state->mutex);
+    m_state->pending.push_back(m_state->root.get());
+    scheduleLocked(m_state);
+}
+
+TreeWalker::~TreeWalker()
+{
+    // Los directorios en lectura terminan solos; solo hay que no empezar más ni avisar
+    QMutexLocker locker(&m_state->mutex);
+    m_state->context = nullptr;
+    m_state->pending.clear();
+}
+
+void TreeWalker::scheduleLocked(const std::shared_ptr<State> &state)
+{
+    // Con un tope propio de tareas en vuelo el orden lo decide nuestra cola, no la del pool
+    while (state->context && !state->pending.empty() &&
+           state->running < walkerPool().maxThreadCount() &&
+           state->buffered < state->limits.maxBufferedBytes) {
+        Node *node = state->pending.front();
+        state->pending.pop_front();
+        startLocked(state, node);
+    }
+}
+
+void TreeWalker::startLocked(const std::shared_ptr<State> &state, Node *node)
+{
+    node->started = true;
+    state->running++;
+    walkerPool().start([state, node]() { listNode(state, node); });
+}
+
+void TreeWalker::listNode(const std::shared_ptr<State> &state, Node *node)
+{
+    {
+        QMutexLocker locker(&state->mutex);
+        if (!state->context) {
+            state->running--;
+            return; // El listado ya se canceló
+        }
+    }
+
+    QByteArray block;
+    QList<QByteArray> directories;
+    const bool list = state->format == DirectoryLister::Format::List;
+    if (list) {
+        // Cabecera de cada directorio como en "ls -R"
+        if (node->depth > 0) {
+            block.append("\r\n", 2);
+        }
+        block.append(node->relative);
+        block.append(":\r\n", 3);
+    }
+
+    DirectoryLister lister;
+    lister.setDirectorySink(&directories);
+    if (!list) {
+        lister.setNamePrefix(node->relative);
+    }
+    if (lister.open(node->path, state->showHidden, state->format)) {
+        while (!lister.atEnd()) {
+            IoScheduler::Ticket io = IoScheduler::instance().acquire(state->device, IoScheduler::Kind::Metadata);
+            lister.next(block);
+        }
+    } else {
+        qWarning() << "No se pudo leer el directorio" << node->path << lister.errorString();
+    }
+
+    // Subcarpetas en las que no se puede entrar: aparecen en su directorio pero no se recorren.
+    // El filtro es de solo lectura tras construir el walker: se consulta sin el mutex
+    if (state->canDescend && !directories.isEmpty()) {
+        const QString base = node->path.mid(state->rootPath.size() + 1);
+        directories.removeIf([&](const QByteArray &name) {
+            return !state->canDescend(base.isEmpty() ? nameToString(name) : base + QLatin1Char('/') + nameToString(name));
+        });
+    }
+
+    QMutexLocker locker(&state->mutex);
+    state->running--;
+    state->entries += lister.entryCount();
+    state->directories++;
+    if (state->entries >= state->limits.maxEntries) {
+        state->truncated = true;
+    }
+
+    // Hijos al principio de la cola y en su orden: el primero es el próximo que se envía
+    if (!directories.isEmpty()) {
+        if (state->truncated || node->depth >= state->limits.maxDepth) {
+            state->truncated = true;
+        } else {
+            node->children.reserve(directories.size());
+            for (const QByteArray &name : std::as_const(directories)) {
+                auto child = std::make_unique<Node>();
+                child->path = node->path + QLatin1Char('/') + nameToString(name);
+                child->relative = list ? node->relative + '/' + name : node->relative + name + '/';
+                child->depth = node->depth + 1;
+                node->children.push_back(std::move(child));
+            }
+            for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+                state->pending.push_front(it->get());
+            }
+        }
+    }
+
+    state->buffered += block.size();
+    node->block = std::move(block);
+    node->done = true;
+    scheduleLocked(state);
+
+    if (state->context) {
+        QMetaObject::invokeMethod(state->context, state->callback, Qt::QueuedConnection);
+    }
+}
+
+// =====================================================================================
+// Seccion: Salida en orden
+// =====================================================================================
+
+qint64 TreeWalker::next(QByteArray &out, qint64 maxBytes)
+{
+    const qint64 before = out.size();
+    QMutexLocker locker(&m_state->mutex);
+    while (!m_stack.empty() && out.size() < maxBytes) {
+        Frame &top = m_stack.back();
+        Node *node = top.node;
+
+        if (!top.emitted) {
+            if (!node->done) {
+                // El que toca aún no ha empezado (la cola estaba llena de adelantados)
+                if (!node->started) {
+                    auto queued = std::find(m_state->pending.begin(), m_state->pending.end(), node);
+                    if (queued != m_state->pending.end()) {
+                        m_state->pending.erase(queued);
+                    }
+                    startLocked(m_state, node);
+                }
+                break;
+            }
+            out.append(node->block);
+            m_state->buffered -= node->block.size();
+            node->block = QByteArray();
+            top.emitted = true;
+            scheduleLocked(m_state); // Hay sitio para leer más por delante
+            continue;
+        }
+
+        if (top.nextChild < node->children.size()) {
+            Node *child = node->children[top.nextChild++].get();
+            m_stack.push_back(Frame{child});
+            continue;
+        }
+
+        // Subárbol enviado: liberarlo
+        m_stack.pop_back();
+        if (!m_stack.empty()) {
+            Frame &parent = m_stack.back();
+            parent.node->children[parent.nextChild - 1].reset();
+        }
+    }
+    return out.size() - before;
+}
+
+qint64 TreeWalker::entryCount() const
+{
+    QMutexLocker locker(&m_state->mutex);
+    return m_state->entries;
+}
+
+qint64 TreeWalker::directoryCount() const
+{
+    QMutexLocker locker(&m_state->mutex);
+    return m_state->directories;
+}
+
+bool TreeWalker::truncated() const
+{
+    QMutexLocker locker(&m_state->mutex);
+    return m_state->truncated;
+}
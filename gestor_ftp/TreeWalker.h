@@ -0,0 +1,107 @@
+#ifndef TREEWALKER_H
+#define TREEWALKER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QObject>
+#include <QMutex>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <functional>
+#include "DirectoryLister.h"
+
+// Recorrido recursivo de un árbol para LIST -R y MLSD -R.
+//
+// Cada directorio se lee con DirectoryLister en un pool de hilos propio; los
+// hilos toman trabajo de una cola común ordenada en profundidad, así que los
+// subárboles que el socket va a necesitar antes se leen antes. La salida sigue
+// siempre el mismo orden (preorden, con los subdirectorios en el orden en que
+// aparecen en su directorio), sea cual sea el hilo que termine primero: el hilo
+// de la sesión copia cada directorio en cuanto él y todos los anteriores están
+// listos. Los bloques leídos y aún no enviados tienen un tope en bytes, y el
+// recorrido se corta al llegar a la profundidad o al número de entradas máximo.
+class TreeWalker {
+public:
+    static constexpr int DefaultMaxDepth = 32;
+    static constexpr qint64 DefaultMaxEntries = 1000000;
+
+    struct Limits {
+        int maxDepth = DefaultMaxDepth;
+        qint64 maxEntries = DefaultMaxEntries;
+        qint64 maxBufferedBytes = 8 * 1024 * 1024;   // Leído por delante del socket
+    };
+
+    // Límites y número de hilos para los recorridos nuevos
+    static void configure(int maxDepth, qint64 maxEntries, int threads);
+    static Limits defaultLimits();
+
+    // Decide si se entra en una subcarpeta ("sub/dir", relativa a la raíz del recorrido).
+    // Se llama desde los hilos del pool: no puede tocar estado de la sesión sin protegerlo
+    using DescendFilter = std::function<bool(const QString &relativePath)>;
+
+    // 'onDataReady' se ejecuta en el hilo de 'context' cada vez que termina un directorio.
+    // Sin 'canDescend' se entra en todas las subcarpetas
+    TreeWalker(const QString &root, DirectoryLister::Format format, bool showHidden, const Limits &limits,
+               QObject *context, std::function<void()> onDataReady, DescendFilter canDescend = nullptr);
+    ~TreeWalker();
+
+    TreeWalker(const TreeWalker &) = delete;
+    TreeWalker &operator=(const TreeWalker &) = delete;
+
+    // Añade a 'out' los directorios ya leídos que tocan, hasta superar 'maxBytes'.
+    // Devuelve 0 si el siguiente aún se está leyendo (se avisará con onDataReady).
+    qint64 next(QByteArray &out, qint64 maxBytes = DirectoryLister::BatchBytes);
+    bool atEnd() const { return m_stack.empty(); }
+
+    qint64 entryCount() const;
+    qint64 directoryCount() const;
+    // Se dejó algo sin listar por los límites
+    bool truncated() const;
+
+private:
+    struct Node {
+        QString path;
+        QByteArray relative;    // "./sub" en LIST, "sub/" en MLSD
+        int depth = 0;
+        bool started = false;
+        bool done = false;
+        QByteArray block;       // Cabecera y líneas del directorio
+        std::vector<std::unique_ptr<Node>> children;
+    };
+
+    // Estado compartido con los hilos del pool; sobrevive al walker si queda trabajo en curso
+    struct State {
+        QMutex mutex;
+        QObject *context = nullptr;
+        std::function<void()> callback;
+        DescendFilter canDescend;
+        QString rootPath;
+        DirectoryLister::Format format = DirectoryLister::Format::List;
+        bool showHidden = false;
+        Limits limits;
+        QString device;
+        std::unique_ptr<Node> root;
+        std::deque<Node *> pending;     // Directorios por leer, el más urgente delante
+        int running = 0;
+        qint64 buffered = 0;
+        qint64 entries = 0;
+        qint64 directories = 0;
+        bool truncated = false;
+    };
+
+    struct Frame {
+        Node *node;
+        bool emitted = false;
+        size_t nextChild = 0;
+    };
+
+    static void scheduleLocked(const std::shared_ptr<State> &state);
+    static void startLocked(const std::shared_ptr<State> &state, Node *node);
+    static void listNode(const std::shared_ptr<State> &state, Node *node);
+
+    std::shared_ptr<State> m_state;
+    std::vector<Frame> m_stack;     // Camino del preorden que va enviando el hilo de la sesión
+};
+
+#endif // TREEWALKER_H
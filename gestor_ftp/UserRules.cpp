@@ -0,0 +1,108 @@
+#include "UserRules.h"
+#include "DatabaseManager.h"
+#include <QDir>
+#include <algorithm>
+
+UserRules::UserRules(const QString &home, const QHash<QString, QString> &rules)
+{
+    const QString cleanHome = QDir::cleanPath(home);
+    if (cleanHome.startsWith(QLatin1Char('/'))) {
+        m_home = cleanHome;
+    }
+    m_rules.reserve(rules.size());
+    for (auto it = rules.constBegin(); it != rules.constEnd(); ++it) {
+        Rule rule;
+        rule.path = QDir::cleanPath(it.key());
+        // Una regla mal escrita no debe abrir nada: se queda sin permisos
+        if (!rule.path.startsWith(QLatin1Char('/')) || !parsePerms(it.value(), rule.perms)) {
+            rule.perms = 0;
+        }
+        if (rule.path.startsWith(QLatin1Char('/'))) {
+            m_rules.push_back(rule);
+        }
+    }
+    // Todas las reglas que cubren una ruta son antecesoras suyas: la más larga es la más cercana
+    std::sort(m_rules.begin(), m_rules.end(), [](const Rule &a, const Rule &b) {
+        return a.path.size() > b.path.size();
+    });
+}
+
+std::shared_ptr<const UserRules> UserRules::load(const QString &user)
+{
+    DatabaseManager &db = DatabaseManager::instance();
+    return std::make_shared<const UserRules>(db.getUserHome(user), db.getUserPermissions(user));
+}
+
+bool UserRules::parsePerms(const QString &text, quint8 &perms)
+{
+    perms = 0;
+    if (text == QLatin1String("-")) {
+        return true;    // Sin ningún permiso
+    }
+    if (text.isEmpty()) {
+        return false;
+    }
+    for (const QChar c : text) {
+        switch (c.toLower().unicode()) {
+        case 'r': perms |= Read; break;
+        case 'w': perms |= Write; break;
+        case 'd': perms |= Delete; break;
+        case 'm': perms |= Mkdir; break;
+        default: return false;
+        }
+    }
+    return true;
+}
+
+QString UserRules::permsString(quint8 perms)
+{
+    QString text;
+    if (perms & Read) text += QLatin1Char('r');
+    if (perms & Write) text += QLatin1Char('w');
+    if (perms & Delete) text += QLatin1Char('d');
+    if (perms & Mkdir) text += QLatin1Char('m');
+    return text.isEmpty() ? QStringLiteral("-") : text;
+}
+
+QString UserRules::serverPath(const QString &clientPath) const
+{
+    if (!confined() || clientPath.isEmpty()) {
+        return clientPath;
+    }
+    return clientPath == QLatin1String("/") ? m_home : m_home + clientPath;
+}
+
+QString UserRules::clientPath(const QString &serverPath) const
+{
+    if (!confined()) {
+        return serverPath;
+    }
+    if (serverPath == m_home) {
+        return QStringLiteral("/");
+    }
+    if (serverPath.size() > m_home.size() && serverPath.startsWith(m_home)
+        && serverPath.at(m_home.size()) == QLatin1Char('/')) {
+        return serverPath.mid(m_home.size());
+    }
+    return QString();
+}
+
+bool UserRules::allows(const QString &clientPath, Perm perm) const
+{
+    if (m_rules.empty()) {
+        return true;
+    }
+    return (permsFor(serverPath(clientPath)) & perm) != 0;
+}
+
+quint8 UserRules::permsFor(const QString &serverPath) const
+{
+    for (const Rule &rule : m_rules) {
+        if (rule.path == QLatin1String("/") || serverPath == rule.path
+            || (serverPath.size() > rule.path.size() && serverPath.startsWith(rule.path)
+                && serverPath.at(rule.path.size()) == QLatin1Char('/'))) {
+            return rule.perms;
+        }
+    }
+    return All;
+}
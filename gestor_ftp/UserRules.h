@@ -0,0 +1,63 @@
+#pragma once
+#include <QHash>
+#include <QString>
+#include <memory>
+#include <vector>
+
+// Carpeta personal y permisos de un usuario, compilados al iniciar sesión.
+//
+// DatabaseManager guarda por usuario una carpeta personal (ruta virtual del
+// servidor, "/clientes/ana") y reglas de permisos por carpeta ("rwdm"). Al
+// aceptar PASS se leen una sola vez y se compilan en un objeto inmutable que la
+// sesión comparte por puntero: cada orden se comprueba contra él sin tocar la base
+// de datos ni tomar ningún mutex. Los cambios hechos desde la consola se aplican
+// en el siguiente inicio de sesión.
+//
+// La carpeta personal actúa como raíz de la sesión: el cliente ve "/" y todas sus
+// rutas se traducen debajo de ella. Las reglas usan rutas del servidor, como las
+// cuotas de carpeta; manda la regla de la carpeta más cercana y, sin ninguna que
+// la cubra, todo está permitido (un usuario sin reglas se comporta como antes).
+class UserRules {
+public:
+    enum Perm : quint8 {
+        Read = 0x1,         // RETR, LIST, MLSD, MLST, SIZE, MDTM, SITE MRETR/FIND/DU
+        Write = 0x2,        // STOR, APPE, destino de RNTO, SITE UNTAR
+        Delete = 0x4,       // DELE, RMD, origen de RNFR
+        Mkdir = 0x8,        // MKD, carpetas de SITE UNTAR
+        All = Read | Write | Delete | Mkdir
+    };
+
+    // Sin carpeta personal ni reglas
+    UserRules() = default;
+    UserRules(const QString &home, const QHash<QString, QString> &rules);
+
+    // Lee la carpeta y las reglas del usuario de DatabaseManager
+    static std::shared_ptr<const UserRules> load(const QString &user);
+
+    // "rwdm" -> máscara; falso si hay letras desconocidas
+    static bool parsePerms(const QString &text, quint8 &perms);
+    static QString permsString(quint8 perms);
+
+    const QString &home() const { return m_home; }
+    bool confined() const { return m_home != QLatin1String("/"); }
+
+    // Ruta virtual del cliente ("/docs") -> ruta del servidor ("/clientes/ana/docs")
+    QString serverPath(const QString &clientPath) const;
+    // Al revés; vacía si queda fuera de la carpeta personal
+    QString clientPath(const QString &serverPath) const;
+
+    // clientPath ya normalizada (PathResolver::normalize)
+    bool allows(const QString &clientPath, Perm perm) const;
+    quint8 permsFor(const QString &serverPath) const;
+
+    int ruleCount() const { return int(m_rules.size()); }
+
+private:
+    struct Rule {
+        QString path;       // Limpia, sin barra final salvo "/"
+        quint8 perms = 0;
+    };
+
+    QString m_home = QStringLiteral("/");
+    std::vector<Rule> m_rules;      // De la más larga a la más corta
+};
@@ -0,0 +1,428 @@
+#include "Vfs.h"
+#include "PathResolver.h"
+#include "MemoryVfsBackend.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <cstdio>
+#endif
+
+namespace {
+// Tope del bloque que map() lee de un archivo local
+constexpr qint64 LocalMapBytes = 256 * 1024;
+
+class LocalLister : public VfsBackend::Lister {
+public:
+    explicit LocalLister(const QString &path)
+        : m_it(path, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot) {}
+
+    int next(std::vector<VfsBackend::NamedEntry> &out, int maxEntries) override
+    {
+        int added = 0;
+        while (added < maxEntries && m_it.hasNext()) {
+            const QString path = m_it.next();
+            VfsBackend::NamedEntry named;
+            if (!DirectoryLister::statPath(path, named.entry)) {
+                continue;   // Desapareció mientras se leía
+            }
+            named.name = QFile::encodeName(m_it.fileName());
+            out.push_back(std::move(named));
+            added++;
+        }
+        return added;
+    }
+
+private:
+    QDirIterator m_it;
+};
+
+class LocalSource : public VfsBackend::Source {
+public:
+    explicit LocalSource(const QString &path) : m_file(path) {}
+    bool open() { return m_file.open(QIODevice::ReadOnly); }
+
+    qint64 size() const override { return m_file.size(); }
+    int descriptor() const override { return m_file.handle(); }
+
+    qint64 map(qint64 offset, qint64 maxBytes, const char **data) override
+    {
+        // El disco no se puede mapear sin copia desde aquí: para eso está descriptor()
+        if (!m_file.seek(offset)) {
+            return -1;
+        }
+        m_buffer.resize(int(qMin(maxBytes, LocalMapBytes)));
+        const qint64 read = m_file.read(m_buffer.data(), m_buffer.size());
+        *data = m_buffer.constData();
+        return read;
+    }
+
+private:
+    QFile m_file;
+    QByteArray m_buffer;
+};
+
+class LocalSink : public VfsBackend::Sink {
+public:
+    explicit LocalSink(const QString &path) : m_file(path) {}
+
+    bool open(qint64 offset)
+    {
+        if (offset > 0) {
+            return m_file.open(QIODevice::ReadWrite) && m_file.seek(offset);
+        }
+        return m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+
+    int descriptor() const override { return m_file.handle(); }
+    qint64 write(const char *data, qint64 length) override { return m_file.write(data, length); }
+
+    bool finish() override
+    {
+        const bool ok = m_file.flush() && m_file.error() == QFileDevice::NoError;
+        m_file.close();
+        return ok;
+    }
+
+private:
+    QFile m_file;
+};
+}
+
+// =====================================================================================
+// Seccion: Backend local
+// =====================================================================================
+
+LocalVfsBackend::LocalVfsBackend(const QString &root)
+    : m_root(QDir::cleanPath(root))
+{
+}
+
+QString LocalVfsBackend::localPath(const QString &path) const
+{
+    if (path.isEmpty()) {
+        return m_root;
+    }
+    return m_root.endsWith(QLatin1Char('/')) ? m_root + path : m_root + QLatin1Char('/') + path;
+}
+
+bool LocalVfsBackend::stat(const QString &path, Entry &entry)
+{
+    return DirectoryLister::statPath(localPath(path), entry);
+}
+
+std::unique_ptr<VfsBackend::Lister> LocalVfsBackend::list(const QString &path)
+{
+    const QString dir = localPath(path);
+    if (!QFileInfo(dir).isDir()) {
+        return nullptr;
+    }
+    return std::make_unique<LocalLister>(dir);
+}
+
+bool LocalVfsBackend::mkdir(const QString &path)
+{
+    return QDir().mkpath(localPath(path));
+}
+
+bool LocalVfsBackend::rmdir(const QString &path)
+{
+    // Nunca la carpeta del montaje
+    return !path.isEmpty() && QDir(localPath(path)).removeRecursively();
+}
+
+bool LocalVfsBackend::unlink(const QString &path)
+{
+    return QFile::remove(localPath(path));
+}
+
+bool LocalVfsBackend::rename(const QString &from, const QString &to)
+{
+    return !from.isEmpty() && !to.isEmpty() && renamePath(localPath(from), localPath(to));
+}
+
+bool LocalVfsBackend::renamePath(const QString &from, const QString &to)
+{
+#ifdef Q_OS_LINUX
+    // Atómico, y reemplaza un archivo de destino
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#else
+    // QDir::rename no reemplaza: se borra antes un archivo de destino
+    const QFileInfo target(to);
+    if (target.exists() && !target.isDir() && QFileInfo(from).isFile() && !QFile::remove(to)) {
+        return false;
+    }
+    return QDir().rename(from, to);
+#endif
+}
+
+std::unique_ptr<VfsBackend::Source> LocalVfsBackend::openSource(const QString &path)
+{
+    auto source = std::make_unique<LocalSource>(localPath(path));
+    if (!source->open()) {
+        return nullptr;
+    }
+    return source;
+}
+
+std::unique_ptr<VfsBackend::Sink> LocalVfsBackend::openSink(const QString &path, qint64 offset)
+{
+    auto sink = std::make_unique<LocalSink>(localPath(path));
+    if (!sink->open(offset)) {
+        return nullptr;
+    }
+    return sink;
+}
+
+// =====================================================================================
+// Seccion: Tabla de montajes
+// =====================================================================================
+
+QString Vfs::cleanMountPoint(const QString &mountPoint)
+{
+    QString path = mountPoint.trimmed();
+    path.replace(QLatin1Char('\\'), QLatin1Char('/'));
+    if (path.isEmpty()) {
+        return QString();
+    }
+    return PathResolver::normalize(path, QStringLiteral("/"));
+}
+
+bool Vfs::parseMount(const QString &spec, QString &mountPoint, QString &localDir)
+{
+    if (!spec.contains(QLatin1Char('='))) {
+        return false;
+    }
+    mountPoint = cleanMountPoint(spec.section(QLatin1Char('='), 0, 0));
+    localDir = spec.section(QLatin1Char('='), 1).trimmed();
+    return !mountPoint.isEmpty() && mountPoint != QLatin1String("/") && !localDir.isEmpty();
+}
+
+std::shared_ptr<VfsBackend> Vfs::createBackend(const QString &source)
+{
+    if (source.startsWith(QLatin1String("mem:"), Qt::CaseInsensitive)) {
+        return MemoryVfsBackend::fromSpec(source);
+    }
+    if (!QFileInfo(source).isDir()) {
+        return nullptr;
+    }
+    return std::make_shared<LocalVfsBackend>(QFileInfo(source).absoluteFilePath());
+}
+
+void Vfs::setRoot(const QString &rootDir)
+{
+    QWriteLocker locker(&m_lock);
+    m_rootDir = QDir::cleanPath(rootDir);
+    if (m_rootOverride) {
+        return;     // La carpeta se recuerda para cuando se quite el otro backend
+    }
+    const auto current = m_mounts.value(QStringLiteral("/"));
+    if (current && current->localRoot() == QDir::cleanPath(rootDir)) {
+        return;
+    }
+    m_mounts.insert(QStringLiteral("/"), std::make_shared<LocalVfsBackend>(rootDir));
+    rebuildLocked();
+}
+
+bool Vfs::setRootSource(const QString &source)
+{
+    std::shared_ptr<VfsBackend> backend;
+    if (!source.trimmed().isEmpty()) {
+        backend = createBackend(source.trimmed());
+        if (!backend) {
+            return false;
+        }
+    }
+    QWriteLocker locker(&m_lock);
+    m_rootOverride = backend;
+    if (backend) {
+        m_mounts.insert(QStringLiteral("/"), backend);
+    } else if (!m_rootDir.isEmpty()) {
+        m_mounts.insert(QStringLiteral("/"), std::make_shared<LocalVfsBackend>(m_rootDir));
+    }
+    rebuildLocked();
+    qInfo() << "Raíz del árbol virtual:" << (backend ? backend->source() : m_rootDir);
+    return true;
+}
+
+QString Vfs::rootSource() const
+{
+    QReadLocker locker(&m_lock);
+    return m_rootOverride ? m_rootOverride->source() : QString();
+}
+
+void Vfs::configure(const QStringList &mounts)
+{
+    {
+        QWriteLocker locker(&m_lock);
+        for (auto it = m_mounts.begin(); it != m_mounts.end();) {
+            if (it.key() != QLatin1String("/")) {
+                it = m_mounts.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        rebuildLocked();
+    }
+
+    for (const QString &spec : mounts) {
+        QString mountPoint;
+        QString localDir;
+        std::shared_ptr<VfsBackend> backend;
+        if (parseMount(spec, mountPoint, localDir)) {
+            backend = createBackend(localDir);
+        }
+        if (!backend) {
+            qWarning() << "Montaje ignorado (se espera /virtual=carpeta existente o mem:...):" << spec;
+            continue;
+        }
+        mount(mountPoint, backend);
+    }
+}
+
+bool Vfs::mount(const QString &mountPoint, std::shared_ptr<VfsBackend> backend)
+{
+    const QString point = cleanMountPoint(mountPoint);
+    if (point.isEmpty() || !backend) {
+        return false;
+    }
+    {
+        QWriteLocker locker(&m_lock);
+        m_mounts.insert(point, backend);
+        rebuildLocked();
+    }
+    qInfo() << QString("Montado %1 en %2").arg(backend->source(), point);
+
+    // El punto de montaje aparece en los listados de su padre si existe allí como carpeta
+    if (point != QLatin1String("/")) {
+        const Target parent = resolve(QFileInfo(point).path());
+        if (parent.isValid()) {
+            const QString name = point.mid(point.lastIndexOf(QLatin1Char('/')) + 1);
+            parent.backend->mkdir(parent.path.isEmpty() ? name : parent.path + QLatin1Char('/') + name);
+        }
+    }
+    return true;
+}
+
+bool Vfs::unmount(const QString &mountPoint)
+{
+    const QString point = cleanMountPoint(mountPoint);
+    QWriteLocker locker(&m_lock);
+    if (point == QLatin1String("/") || !m_mounts.remove(point)) {
+        return false;
+    }
+    rebuildLocked();
+    return true;
+}
+
+void Vfs::rebuildLocked()
+{
+    // Los montajes cambian muy poco: se rehace el trie entero
+    m_nodes.clear();
+    m_nodes.emplace_back();
+    for (auto it = m_mounts.constBegin(); it != m_mounts.constEnd(); ++it) {
+        int node = 0;
+        const QStringList parts = it.key().split(QLatin1Char('/'), Qt::SkipEmptyParts);
+        for (const QString &part : parts) {
+            auto child = m_nodes[node].children.constFind(part);
+            if (child == m_nodes[node].children.constEnd()) {
+                m_nodes.emplace_back();
+                const int created = int(m_nodes.size() - 1);
+                m_nodes[node].children.insert(part, created);
+                node = created;
+            } else {
+                node = *child;
+            }
+        }
+        m_nodes[node].backend = it.value();
+        m_nodes[node].mountPoint = it.key();
+    }
+}
+
+Vfs::Target Vfs::resolve(const QString &virtualPath) const
+{
+    QReadLocker locker(&m_lock);
+    if (m_nodes.empty() || !virtualPath.startsWith(QLatin1Char('/'))) {
+        return Target();
+    }
+
+    // Se baja por el trie componente a componente y se queda el montaje más profundo
+    int node = 0;
+    int best = m_nodes[0].backend ? 0 : -1;
+    int bestEnd = 0;
+    const int size = virtualPath.size();
+    int pos = 1;
+    while (pos < size) {
+        int slash = virtualPath.indexOf(QLatin1Char('/'), pos);
+        if (slash < 0) {
+            slash = size;
+        }
+        const auto &children = m_nodes[node].children;
+        const auto child = children.constFind(virtualPath.mid(pos, slash - pos));
+        if (child == children.constEnd()) {
+            break;
+        }
+        node = *child;
+        if (m_nodes[node].backend) {
+            best = node;
+            bestEnd = slash;
+        }
+        pos = slash + 1;
+    }
+    if (best < 0) {
+        return Target();
+    }
+
+    Target target;
+    target.backend = m_nodes[best].backend;
+    target.mountPoint = m_nodes[best].mountPoint;
+    target.path = bestEnd + 1 < size ? virtualPath.mid(bestEnd + 1) : QString();
+    const QString root = target.backend->localRoot();
+    if (!root.isEmpty()) {
+        target.local = target.path.isEmpty() ? root
+                     : root.endsWith(QLatin1Char('/')) ? root + target.path
+                     : root + QLatin1Char('/') + target.path;
+    }
+    return target;
+}
+
+QString Vfs::virtualPathOf(const QString &localPath) const
+{
+    const QString clean = QDir::cleanPath(localPath);
+    QReadLocker locker(&m_lock);
+    QString bestRoot;
+    QString bestPoint;
+    for (auto it = m_mounts.constBegin(); it != m_mounts.constEnd(); ++it) {
+        const QString root = it.value()->localRoot();
+        if (!root.isEmpty() && root.size() > bestRoot.size() && PathResolver::isInside(root, clean)) {
+            bestRoot = root;
+            bestPoint = it.key();
+        }
+    }
+    if (bestRoot.isEmpty()) {
+        return QString();
+    }
+    const int skip = bestRoot.endsWith(QLatin1Char('/')) ? bestRoot.size() - 1 : bestRoot.size();
+    const QString rest = clean.mid(skip);   // "" o "/a/b"
+    if (bestPoint == QLatin1String("/")) {
+        return rest.isEmpty() ? bestPoint : rest;
+    }
+    return bestPoint + rest;
+}
+
+QList<Vfs::Mount> Vfs::mounts() const
+{
+    QReadLocker locker(&m_lock);
+    QList<Mount> result;
+    for (auto it = m_mounts.constBegin(); it != m_mounts.constEnd(); ++it) {
+        result.append({it.key(), it.value()->kind(), it.value()->source()});
+    }
+    std::sort(result.begin(), result.end(), [](const Mount &a, const Mount &b) {
+        return a.mountPoint < b.mountPoint;
+    });
+    return result;
+}
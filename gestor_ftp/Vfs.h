@@ -0,0 +1,172 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QReadWriteLock>
+#include <memory>
+#include <vector>
+#include "DirectoryLister.h"
+
+// Sistema de archivos virtual: el árbol que ve el cliente se reparte entre montajes.
+//
+// Cada montaje asocia una ruta virtual ("/", "/videos") a un backend. La tabla es
+// un trie por componentes, así que encontrar el montaje de una ruta cuesta lo que
+// su profundidad, no el número de montajes. Las rutas dentro de un backend son
+// relativas a su punto de montaje, sin barra inicial ("" es la raíz del montaje).
+//
+// Los montajes de disco local (LocalVfsBackend) devuelven su carpeta en
+// localRoot(): para ellos el servidor sigue trabajando con rutas de disco, QFile y
+// sendfile(), y con las cachés e índices, sin pasar por las llamadas virtuales. El
+// resto de backends, como el de memoria para pruebas de carga (MemoryVfsBackend),
+// se usan solo a través de esta interfaz.
+class VfsBackend {
+public:
+    using Entry = DirectoryLister::Entry;
+    using NamedEntry = DirectoryLister::NamedEntry;
+
+    // Lectura de un directorio por tandas
+    class Lister {
+    public:
+        virtual ~Lister() = default;
+        // Añade hasta maxEntries entradas; 0 al terminar
+        virtual int next(std::vector<NamedEntry> &out, int maxEntries) = 0;
+    };
+
+    // Origen de RETR: un descriptor para sendfile() o bloques del propio backend sin copiar
+    class Source {
+    public:
+        virtual ~Source() = default;
+        virtual qint64 size() const = 0;
+        virtual int descriptor() const { return -1; }
+        // Hasta maxBytes desde offset; *data apunta a memoria del backend, válida hasta
+        // la siguiente llamada. 0 al final, -1 si hay error
+        virtual qint64 map(qint64 offset, qint64 maxBytes, const char **data) = 0;
+    };
+
+    // Destino de STOR
+    class Sink {
+    public:
+        virtual ~Sink() = default;
+        virtual int descriptor() const { return -1; }
+        virtual qint64 write(const char *data, qint64 length) = 0;
+        virtual bool finish() = 0;
+    };
+
+    virtual ~VfsBackend() = default;
+
+    virtual QByteArray kind() const = 0;
+    // Texto para la consola ("D:/datos", "memoria")
+    virtual QString source() const = 0;
+    // Carpeta en disco si es un montaje local normal; vacía en otro caso
+    virtual QString localRoot() const { return QString(); }
+
+    virtual bool stat(const QString &path, Entry &entry) = 0;
+    // Nulo si no es un directorio
+    virtual std::unique_ptr<Lister> list(const QString &path) = 0;
+    // Crea también los niveles intermedios, como MKD
+    virtual bool mkdir(const QString &path) = 0;
+    // Borra el directorio con su contenido, como RMD
+    virtual bool rmdir(const QString &path) = 0;
+    virtual bool unlink(const QString &path) = 0;
+    // Reemplaza el destino si es un archivo
+    virtual bool rename(const QString &from, const QString &to) = 0;
+    virtual std::unique_ptr<Source> openSource(const QString &path) = 0;
+    // offset > 0 continúa una subida (REST); 0 trunca
+    virtual std::unique_ptr<Sink> openSink(const QString &path, qint64 offset) = 0;
+};
+
+// Una carpeta del disco
+class LocalVfsBackend : public VfsBackend {
+public:
+    explicit LocalVfsBackend(const QString &root);
+
+    QByteArray kind() const override { return QByteArrayLiteral("local"); }
+    QString source() const override { return m_root; }
+    QString localRoot() const override { return m_root; }
+    QString localPath(const QString &path) const;
+
+    bool stat(const QString &path, Entry &entry) override;
+    std::unique_ptr<Lister> list(const QString &path) override;
+    bool mkdir(const QString &path) override;
+    bool rmdir(const QString &path) override;
+    bool unlink(const QString &path) override;
+    bool rename(const QString &from, const QString &to) override;
+    std::unique_ptr<Source> openSource(const QString &path) override;
+    std::unique_ptr<Sink> openSink(const QString &path, qint64 offset) override;
+
+    // rename() con reemplazo del destino, también para rutas de disco fuera de un backend
+    static bool renamePath(const QString &from, const QString &to);
+
+private:
+    QString m_root;     // Limpia, sin barra final
+};
+
+class Vfs {
+public:
+    struct Target {
+        std::shared_ptr<VfsBackend> backend;
+        QString mountPoint;         // "/" o "/videos"
+        QString path;               // Dentro del montaje ("" es su raíz)
+        QString local;              // Ruta en disco si el montaje es local
+        bool isValid() const { return backend != nullptr; }
+        bool isLocal() const { return !local.isEmpty(); }
+        bool isVirtual() const { return backend && local.isEmpty(); }
+    };
+
+    struct Mount {
+        QString mountPoint;
+        QByteArray kind;
+        QString source;
+    };
+
+    static Vfs& instance() {
+        static Vfs instance;
+        return instance;
+    }
+
+    Vfs(const Vfs &) = delete;
+    Vfs &operator=(const Vfs &) = delete;
+
+    // La raíz del servidor, montada en "/" (no toca los demás montajes)
+    void setRoot(const QString &rootDir);
+    // Otro backend para "/" en lugar de la carpeta raíz ("mem:..."); vacío vuelve a ella
+    bool setRootSource(const QString &source);
+    QString rootSource() const;
+    // Montajes adicionales, "/virtual=/ruta/en/disco" o "/virtual=mem:..."; sustituyen
+    // a los anteriores
+    void configure(const QStringList &mounts);
+    bool mount(const QString &mountPoint, std::shared_ptr<VfsBackend> backend);
+    bool unmount(const QString &mountPoint);
+
+    // virtualPath normalizada ("/a/b"); inválido si no hay montaje
+    Target resolve(const QString &virtualPath) const;
+    // Ruta virtual de una ruta de disco dentro de un montaje local; vacía si no lo está
+    QString virtualPathOf(const QString &localPath) const;
+    QList<Mount> mounts() const;
+
+    // "/videos" a partir de "videos/", "\videos"...; vacío si no es válido
+    static QString cleanMountPoint(const QString &mountPoint);
+    // "/virtual=/ruta" -> punto de montaje y carpeta
+    static bool parseMount(const QString &spec, QString &mountPoint, QString &localDir);
+    // Backend para una carpeta existente o una especificación "mem:..."; nulo si no vale
+    static std::shared_ptr<VfsBackend> createBackend(const QString &source);
+
+private:
+    Vfs() = default;
+
+    struct Node {
+        QHash<QString, int> children;
+        std::shared_ptr<VfsBackend> backend;
+        QString mountPoint;
+    };
+
+    void rebuildLocked();
+
+    mutable QReadWriteLock m_lock;
+    QHash<QString, std::shared_ptr<VfsBackend>> m_mounts;
+    QString m_rootDir;
+    std::shared_ptr<VfsBackend> m_rootOverride;     // Backend de "/" si no es la carpeta raíz
+    std::vector<Node> m_nodes;      // El 0 es "/"
+};
@@ -0,0 +1,60 @@
+#include "ZeroCopySend.h"
+#include <QFile>
+#include <QDebug>
+
+#ifdef HAVE_SSL
+#include <QSslSocket>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <cerrno>
+#endif
+
+bool ZeroCopySend::canSendFileDirectly(QTcpSocket *socket)
+{
+#ifdef Q_OS_LINUX
+    if (!socket || socket->state() != QAbstractSocket::ConnectedState) {
+        return false;
+    }
+#ifdef HAVE_SSL
+    // Cifrado o con el handshake en curso: los datos tienen que pasar por OpenSSL
+    QSslSocket *sslSocket = qobject_cast<QSslSocket *>(socket);
+    if (sslSocket && sslSocket->mode() != QSslSocket::UnencryptedMode) {
+        return false;
+    }
+#endif
+    return true;
+#else
+    Q_UNUSED(socket);
+    return false;
+#endif
+}
+
+qint64 ZeroCopySend::sendFile(qintptr socketDescriptor, int fileDescriptor, qint64 offset, qint64 count)
+{
+#ifdef Q_OS_LINUX
+    off_t position = static_cast<off_t>(offset);
+    ssize_t sent = ::sendfile(static_cast<int>(socketDescriptor), fileDescriptor, &position,
+                              static_cast<size_t>(count));
+    if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        qWarning() << "sendfile falló:" << qt_error_string(errno);
+        return -1;
+    }
+    if (sent == 0 && count > 0) {
+        qWarning() << "sendfile: fin de archivo inesperado en el offset" << offset;
+        return -1;
+    }
+    return static_cast<qint64>(sent);
+#else
+    Q_UNUSED(socketDescriptor);
+    Q_UNUSED(fileDescriptor);
+    Q_UNUSED(offset);
+    Q_UNUSED(count);
+    return -1;
+#endif
+}
@@ -0,0 +1,23 @@
+#ifndef ZEROCOPYSEND_H
+#define ZEROCOPYSEND_H
+
+#include <QtGlobal>
+#include <QTcpSocket>
+
+// Envío de archivos sin copias con sendfile() (solo Linux).
+//
+// Solo sirve para conexiones de datos sin cifrar: el backend OpenSSL de Qt
+// cifra a través de BIOs en memoria, no sobre el descriptor, así que con
+// PROT P los datos tienen que pasar por QSslSocket y la ruta con buffers.
+class ZeroCopySend {
+public:
+    // El socket admite escritura directa al descriptor: TCP plano conectado
+    static bool canSendFileDirectly(QTcpSocket *socket);
+
+    // Envía hasta 'count' bytes del archivo desde 'offset' sin pasar por espacio de usuario.
+    // Devuelve los bytes enviados, 0 si el socket está lleno (esperar a que se pueda
+    // escribir) o -1 si falla.
+    static qint64 sendFile(qintptr socketDescriptor, int fileDescriptor, qint64 offset, qint64 count);
+};
+
+#endif // ZEROCOPYSEND_H
@@ -0,0 +1,55 @@
+#!/bin/bash
+# ========================================
+#    BENCHMARK FTP / FTPS
+# ========================================
+# Compara el rendimiento de descarga (RETR) en tres modos contra un servidor
+# en marcha con SSL configurado (claves ssl/certificate y ssl/privateKey):
+#   1. FTP plano (sendfile sin cifrado)
+#   2. FTPS con una suite AES-CBC
+#   3. FTPS con una suite AES-GCM
+# Con PROT P el cifrado siempre se hace en espacio de usuario (QSslSocket): el
+# servidor no implementa kTLS, así que este script no lo mide.
+#
+# Uso: ./bench_ftps.sh <host> <puerto> <usuario> <contraseña> <archivo_remoto> [repeticiones]
+# El archivo remoto debería ser grande (1 GB o más) para medir caudal sostenido.
+
+set -u
+
+if [ $# -lt 5 ]; then
+    echo "Uso: $0 <host> <puerto> <usuario> <contraseña> <archivo_remoto> [repeticiones]"
+    exit 1
+fi
+
+HOST="$1"
+PORT="$2"
+USER="$3"
+PASS="$4"
+REMOTE="$5"
+RUNS="${6:-3}"
+URL="ftp://${HOST}:${PORT}/${REMOTE}"
+
+run_mode() {
+    local label="$1"
+    shift
+    local total=0
+    for i in $(seq 1 "$RUNS"); do
+        # speed_download se expresa en bytes por segundo
+        local speed
+        speed=$(curl -s -o /dev/null --user "${USER}:${PASS}" -w '%{speed_download}' "$@" "$URL")
+        if [ -z "$speed" ] || [ "$speed" = "0" ] || [ "$speed" = "0.000" ]; then
+            echo "  ${label}: la descarga falló (intento ${i})"
+            return
+        fi
+        total=$(echo "$total + $speed" | bc)
+    done
+    local mbps
+    mbps=$(echo "scale=1; $total / $RUNS / 1048576" | bc)
+    printf "  %-28s %8s MB/s\n" "$label" "$mbps"
+}
+
+echo "========================================"
+echo "   Descarga de ${REMOTE} (${RUNS} repeticiones por modo)"
+echo "========================================"
+run_mode "FTP plano"
+run_mode "FTPS AES-CBC" --ssl-reqd --insecure --tls-max 1.2 --ciphers ECDHE-RSA-AES128-SHA256
+run_mode "FTPS AES-GCM" --ssl-reqd --insecure --tls-max 1.2 --ciphers ECDHE-RSA-AES128-GCM-SHA256
@@ -8,6 +8,7 @@
 #include <QNetworkInterface>
 #include <QProcess>
 #include <QDir>
+#include <QFileInfo>
 #include <QStandardPaths>
 #include <QDateTime>
 #include <QDesktopServices>
@@ -18,6 +19,47 @@
 #include <QRandomGenerator>
 #include <QScrollBar>
 #include <QCheckBox>
+#include "BufferPool.h"
+#include "TlsSessionCache.h"
+#include "TlsHandshakeScheduler.h"
+#include "ReadAheadManager.h"
+#include "HotFileCache.h"
+#include "SharedFileReader.h"
+#include "DirectIo.h"
+#include "IoScheduler.h"
+#include "DirectoryCache.h"
+#include "MetadataIndex.h"
+#include "ChangeJournal.h"
+#include "FileNameIndex.h"
+#include "DirSizeIndex.h"
+#include "DirectoryLister.h"
+#include "TreeWalker.h"
+#include "Vfs.h"
+#include "UserRules.h"
+#include "FtpClientHandler.h"
+#include <QTableWidgetItem>
+
+namespace {
+// Histograma de latencias en una línea por cubo no vacío: "<=10 ms: 42"
+QString formatHistogram(const QString &title, const TlsHandshakeScheduler::Histogram &histogram)
+{
+    QString text = QString("=== %1 (%2 muestras, media %3 ms, máx %4 ms) ===")
+                       .arg(title)
+                       .arg(histogram.samples)
+                       .arg(histogram.samples ? double(histogram.totalMs) / histogram.samples : 0.0, 0, 'f', 1)
+                       .arg(histogram.maxMs);
+    for (int i = 0; i < TlsHandshakeScheduler::HistogramBuckets; ++i) {
+        if (histogram.counts[i] == 0) {
+            continue;
+        }
+        const QString bucket = i < TlsHandshakeScheduler::HistogramBuckets - 1
+            ? QString("<=%1 ms").arg(TlsHandshakeScheduler::BucketLimitsMs[i])
+            : QString(">%1 ms").arg(TlsHandshakeScheduler::BucketLimitsMs[i - 1]);
+        text += QString("\n  • %1: %2").arg(bucket, -10).arg(histogram.counts[i]);
+    }
+    return text;
+}
+} // namespace
 
 // Definición de la instancia estática para el manejador de logs
 gestor* gestor::instance = nullptr;
@@ -265,6 +307,12 @@ void gestor::setupCommandCompleter()
                         << "log off"
                         << "listcon"
                         << "desuser"
+                        << "stats"
+                        << "quota"
+                        << "home"
+                        << "perm"
+                        << "mount"
+                        << "umount"
                         << "help";
 
     // Crear y configurar el QCompleter
@@ -442,6 +490,10 @@ void gestor::executeCommand(const QString &command)
                 {
                     ftpThread->setRootDir(rootDir);
                 }
+                ChangeJournal::instance().setRoot(rootDir);
+                MetadataIndex::instance().setRoot(rootDir);
+                FileNameIndex::instance().setRoot(rootDir);
+                DirSizeIndex::instance().setRoot(rootDir);
                 // Guardar la nueva ruta en la configuración
                 QSettings settings("MiEmpresa", "GestorFTP");
                 settings.setValue("rootDir", rootDir);
@@ -582,6 +634,7 @@ void gestor::executeCommand(const QString &command)
             {
                 if (ftpThread)
                     ftpThread->refreshUsers(dbManager.getAllUsers());
+                DirSizeIndex::instance().setQuotas(dbManager.getUserQuotas(), dbManager.getDirectoryQuotas());
                 appendConsoleOutput("Usuario eliminado: " + username);
             }
             else
@@ -594,6 +647,498 @@ void gestor::executeCommand(const QString &command)
             appendConsoleOutput("Uso: elimuser <usuario>");
         }
     }
+    else if (cmd == "quota")
+    {
+        if (parts.size() == 1)
+        {
+            const QHash<QString, qint64> users = dbManager.getUserQuotas();
+            const QHash<QString, qint64> directories = dbManager.getDirectoryQuotas();
+            appendConsoleOutput("Cuotas de espacio:");
+            for (auto it = users.constBegin(); it != users.constEnd(); ++it)
+            {
+                appendConsoleOutput(QString("  Usuario %1: %2 MB").arg(it.key()).arg(it.value() / (1024.0 * 1024.0), 0, 'f', 1));
+            }
+            for (auto it = directories.constBegin(); it != directories.constEnd(); ++it)
+            {
+                DirSizeIndex::Totals used;
+                const bool known = DirSizeIndex::instance().totals(QDir::cleanPath(rootDir + it.key()), used);
+                appendConsoleOutput(QString("  Carpeta %1: %2 MB%3")
+                                        .arg(it.key())
+                                        .arg(it.value() / (1024.0 * 1024.0), 0, 'f', 1)
+                                        .arg(known ? QString(" (usados %1 MB)").arg(used.bytes / (1024.0 * 1024.0), 0, 'f', 1)
+                                                   : QString()));
+            }
+            if (users.isEmpty() && directories.isEmpty())
+            {
+                appendConsoleOutput("  Ninguna");
+            }
+        }
+        else if (parts.size() >= 3)
+        {
+            const QString target = parts[1];
+            bool ok = parts[2] == "off";
+            qint64 bytes = 0;
+            if (!ok)
+            {
+                const double megabytes = parts[2].toDouble(&ok);
+                ok = ok && megabytes > 0;
+                bytes = qint64(megabytes * 1024 * 1024);
+            }
+            // Las carpetas empiezan por '/' y son relativas a la raíz; lo demás es un usuario
+            if (ok)
+            {
+                ok = target.startsWith('/') ? dbManager.setDirectoryQuota(QDir::cleanPath(target), bytes)
+                                            : dbManager.setUserQuota(target, bytes);
+            }
+            if (ok)
+            {
+                DirSizeIndex::instance().setQuotas(dbManager.getUserQuotas(), dbManager.getDirectoryQuotas());
+                appendConsoleOutput(bytes > 0 ? QString("Cuota de %1: %2 MB").arg(target, parts[2])
+                                              : QString("Cuota de %1 eliminada").arg(target));
+            }
+            else
+            {
+                appendConsoleOutput("Error al guardar la cuota (¿existe el usuario?)");
+            }
+        }
+        else
+        {
+            appendConsoleOutput("Uso: quota [<usuario>|</carpeta> <MB>|off]");
+        }
+    }
+    else if (cmd == "home")
+    {
+        if (parts.size() == 1)
+        {
+            const QHash<QString, QString> homes = dbManager.getUserHomes();
+            appendConsoleOutput("Carpetas personales:");
+            for (auto it = homes.constBegin(); it != homes.constEnd(); ++it)
+            {
+                appendConsoleOutput(QString("  %1: %2").arg(it.key(), it.value()));
+            }
+            if (homes.isEmpty())
+            {
+                appendConsoleOutput("  Ninguna (todos los usuarios ven la raíz)");
+            }
+        }
+        else if (parts.size() >= 3)
+        {
+            const QString user = parts[1];
+            const QString home = parts[2] == "off" ? QString("/") : QDir::cleanPath(parts.mid(2).join(' '));
+            bool ok = home.startsWith('/') && !home.split('/').contains("..");
+            // En un montaje local la carpeta se crea si falta
+            const Vfs::Target target = ok ? Vfs::instance().resolve(home) : Vfs::Target();
+            if (ok && target.isLocal() && !QFileInfo(target.local).isDir())
+            {
+                ok = QDir().mkpath(target.local);
+                if (ok)
+                {
+                    DirectoryCache::instance().invalidate(QFileInfo(target.local).absolutePath());
+                    MetadataIndex::instance().refresh(target.local);
+                    FileNameIndex::instance().refresh(target.local);
+                    DirSizeIndex::instance().refresh(target.local);
+                }
+            }
+            if (ok && dbManager.setUserHome(user, home))
+            {
+                appendConsoleOutput(home == "/" ? QString("%1 vuelve a ver la raíz").arg(user)
+                                                : QString("Carpeta personal de %1: %2 (desde el próximo inicio de sesión)").arg(user, home));
+            }
+            else
+            {
+                appendConsoleOutput("Error al guardar la carpeta personal (¿existe el usuario?)");
+            }
+        }
+        else
+        {
+            appendConsoleOutput("Uso: home [<usuario> </carpeta>|off]");
+        }
+    }
+    else if (cmd == "perm")
+    {
+        if (parts.size() == 2)
+        {
+            const QHash<QString, QString> rules = dbManager.getUserPermissions(parts[1]);
+            appendConsoleOutput(QString("Permisos de %1 (r leer, w escribir, d borrar, m crear carpetas):").arg(parts[1]));
+            for (auto it = rules.constBegin(); it != rules.constEnd(); ++it)
+            {
+                appendConsoleOutput(QString("  %1: %2").arg(it.key(), it.value()));
+            }
+            if (rules.isEmpty())
+            {
+                appendConsoleOutput("  Sin reglas: todo permitido");
+            }
+        }
+        else if (parts.size() >= 4)
+        {
+            const QString user = parts[1];
+            const QString path = QDir::cleanPath(parts.mid(2, parts.size() - 3).join(' '));
+            const QString value = parts.last();
+            quint8 perms = 0;
+            bool ok = path.startsWith('/') && (value == "off" || UserRules::parsePerms(value, perms));
+            if (ok)
+            {
+                ok = dbManager.setUserPermission(user, path, value == "off" ? QString() : UserRules::permsString(perms));
+            }
+            if (ok)
+            {
+                appendConsoleOutput(value == "off" ? QString("Regla de %1 sobre %2 eliminada").arg(user, path)
+                                                   : QString("Permisos de %1 sobre %2: %3 (desde el próximo inicio de sesión)")
+                                                         .arg(user, path, UserRules::permsString(perms)));
+            }
+            else
+            {
+                appendConsoleOutput("Error al guardar los permisos (¿existe el usuario? use r, w, d, m, - u off)");
+            }
+        }
+        else
+        {
+            appendConsoleOutput("Uso: perm <usuario> [</carpeta> rwdm|-|off]");
+        }
+    }
+    else if (cmd == "mount")
+    {
+        if (parts.size() == 1)
+        {
+            appendConsoleOutput("Montajes:");
+            for (const Vfs::Mount &mount : Vfs::instance().mounts())
+            {
+                appendConsoleOutput(QString("  %1 -> %2 (%3)").arg(mount.mountPoint, mount.source, QString::fromLatin1(mount.kind)));
+            }
+        }
+        else if (parts.size() >= 3)
+        {
+            const QString mountPoint = Vfs::cleanMountPoint(parts[1]);
+            const QString source = parts.mid(2).join(' ');
+            const bool memory = source.startsWith("mem:", Qt::CaseInsensitive);
+            if (mountPoint == "/" && memory)
+            {
+                // Toda la raíz en memoria, para pruebas de carga sin disco
+                if (Vfs::instance().setRootSource(source))
+                {
+                    QSettings settings("MiEmpresa", "GestorFTP");
+                    settings.setValue("vfs/root", Vfs::instance().rootSource());
+                    appendConsoleOutput("Raíz servida desde memoria: " + Vfs::instance().rootSource());
+                }
+                else
+                {
+                    appendConsoleOutput("Error: especificación no válida (mem:dirs=N,depth=N,files=N,size=1M,pattern=zero|pattern,store=64M)");
+                }
+            }
+            else
+            {
+                std::shared_ptr<VfsBackend> backend = mountPoint.isEmpty() || mountPoint == "/" ? nullptr : Vfs::createBackend(source);
+                if (!backend)
+                {
+                    appendConsoleOutput("Error: se espera un punto de montaje distinto de / y una carpeta existente o mem:...");
+                }
+                else
+                {
+                    Vfs::instance().mount(mountPoint, backend);
+                    saveMounts();
+                    appendConsoleOutput(QString("Montado %1 en %2").arg(backend->source(), mountPoint));
+                }
+            }
+        }
+        else
+        {
+            appendConsoleOutput("Uso: mount [</virtual> <carpeta>|mem:...]");
+        }
+    }
+    else if (cmd == "umount")
+    {
+        if (parts.size() > 1 && parts[1] == "/" && !Vfs::instance().rootSource().isEmpty())
+        {
+            // Vuelve a servir la carpeta raíz
+            Vfs::instance().setRootSource(QString());
+            QSettings settings("MiEmpresa", "GestorFTP");
+            settings.remove("vfs/root");
+            appendConsoleOutput("Raíz servida de nuevo desde " + rootDir);
+        }
+        else if (parts.size() > 1 && Vfs::instance().unmount(parts[1]))
+        {
+            saveMounts();
+            appendConsoleOutput("Desmontado " + parts[1]);
+        }
+        else
+        {
+            appendConsoleOutput("Uso: umount </virtual> (la raíz solo si está en memoria)");
+        }
+    }
+    else if (cmd == "stats")
+    {
+        QString subCmd = parts.size() > 1 ? parts[1] : QString();
+        if (subCmd.isEmpty() || subCmd == "buffers")
+        {
+            BufferPool::Stats pool = BufferPool::instance().stats();
+            appendConsoleOutput(QString("=== Pool de buffers ===\n"
+                                        "  • Tamaño de bloque: %1 KB%2\n"
+                                        "  • Bloques reservados: %3 / %4\n"
+                                        "  • En uso: %5 (pico: %6)\n"
+                                        "  • Préstamos: %7 (aciertos de caché por hilo: %8)\n"
+                                        "  • Rechazos por tope: %9")
+                                    .arg(pool.blockSize / 1024)
+                                    .arg(pool.hugePages ? " (huge pages)" : "")
+                                    .arg(pool.allocatedBlocks)
+                                    .arg(pool.maxBlocks)
+                                    .arg(pool.inUse)
+                                    .arg(pool.peakInUse)
+                                    .arg(pool.acquisitions)
+                                    .arg(pool.threadCacheHits)
+                                    .arg(pool.exhausted));
+        }
+        if (subCmd.isEmpty() || subCmd == "tls")
+        {
+            TlsSessionCache::Stats tls = TlsSessionCache::instance().stats();
+            appendConsoleOutput(QString("=== Sesiones TLS ===\n"
+                                        "  • Sesiones de control en caché: %1 (reutilización obligatoria: %2)\n"
+                                        "  • Conexiones de datos comprobadas: %3 / Sin sesión válida: %4 (otra IP: %5)\n"
+                                        "  • Conexiones de datos rechazadas: %6 / AUTH rechazados por registro lleno: %7\n"
+                                        "  • Handshakes de control: %8 (media %9 ms)\n"
+                                        "  • Handshakes de datos: %10 (media %11 ms)")
+                                    .arg(tls.entries)
+                                    .arg(TlsSessionCache::instance().requireReuse() ? "sí" : "no")
+                                    .arg(tls.peerChecks)
+                                    .arg(tls.peerCheckFailures)
+                                    .arg(tls.peerMismatches)
+                                    .arg(tls.rejected)
+                                    .arg(tls.refusedAuth)
+                                    .arg(tls.controlHandshakes)
+                                    .arg(tls.avgControlHandshakeMs, 0, 'f', 1)
+                                    .arg(tls.dataHandshakes)
+                                    .arg(tls.avgDataHandshakeMs, 0, 'f', 1));
+        }
+        if (subCmd.isEmpty() || subCmd == "tls")
+        {
+            TlsHandshakeScheduler::Stats hs = TlsHandshakeScheduler::instance().stats();
+            appendConsoleOutput(QString("=== Planificador de handshakes TLS ===\n"
+                                        "  • Turnos: %1 en uso / %2 (en cola: %3, pico: %4)\n"
+                                        "  • Concedidos: %5 / Tiempo agotado: %6 / Cola llena: %7")
+                                    .arg(hs.active)
+                                    .arg(hs.slots)
+                                    .arg(hs.queued)
+                                    .arg(hs.peakQueued)
+                                    .arg(hs.granted)
+                                    .arg(hs.timedOut)
+                                    .arg(hs.rejected));
+            appendConsoleOutput(formatHistogram("Espera en cola", hs.wait));
+            appendConsoleOutput(formatHistogram("Duración del handshake", hs.handshake));
+        }
+        if (subCmd.isEmpty() || subCmd == "io")
+        {
+            ReadAheadManager::Stats io = ReadAheadManager::instance().stats();
+            QString text = QString("=== Lectura anticipada ===\n"
+                                   "  • Reservado: %1 / %2 MB (ventana máxima %3 MB)\n"
+                                   "  • Avisos WILLNEED: %4 / Ventanas recortadas por el tope: %5")
+                               .arg(io.reservedBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                               .arg(io.budgetBytes / (1024 * 1024))
+                               .arg(io.maxWindowBytes / (1024 * 1024))
+                               .arg(io.advisories)
+                               .arg(io.budgetLimited);
+            for (const ReadAheadManager::DeviceStats &device : io.devices)
+            {
+                text += QString("\n  • %1: %2 MB/s, %3 MB leídos, %4 descargas activas")
+                            .arg(device.device)
+                            .arg(device.recentBytesPerSec / (1024.0 * 1024.0), 0, 'f', 1)
+                            .arg(device.bytesRead / (1024 * 1024))
+                            .arg(device.activeTransfers);
+            }
+            SharedReadRegistry::Stats shared = SharedReadRegistry::instance().stats();
+            text += QString("\n=== Lectura compartida (archivos desde %1 MB) ===\n"
+                            "  • Lectores activos: %2 con %3 descargas enganchadas\n"
+                            "  • Leído del disco: %4 MB / Entregado: %5 MB (factor %6x)\n"
+                            "  • Descargas desenganchadas por quedarse atrás: %7")
+                        .arg(shared.minFileSize / (1024 * 1024))
+                        .arg(shared.activeReaders)
+                        .arg(shared.subscribers)
+                        .arg(shared.storageBytes / (1024 * 1024))
+                        .arg(shared.servedBytes / (1024 * 1024))
+                        .arg(shared.storageBytes ? double(shared.servedBytes) / shared.storageBytes : 0.0, 0, 'f', 2)
+                        .arg(shared.detaches);
+            DirectIoPolicy::Stats direct = DirectIoPolicy::instance().stats();
+            text += QString("\n=== E/S directa (%1) ===\n"
+                            "  • Umbral: %2 MB / Rutas: %3 / Profundidad: %4\n"
+                            "  • Descargas: %5 (%6 MB) / Subidas: %7 (%8 MB) / Sin soporte O_DIRECT: %9")
+                        .arg(DirectIoPolicy::isSupported() ? "activa" : "no disponible")
+                        .arg(direct.thresholdBytes / (1024 * 1024))
+                        .arg(direct.paths.isEmpty() ? QString("ninguna") : direct.paths.join(", "))
+                        .arg(direct.queueDepth)
+                        .arg(direct.reads)
+                        .arg(direct.bytesRead / (1024 * 1024))
+                        .arg(direct.writes)
+                        .arg(direct.bytesWritten / (1024 * 1024))
+                        .arg(direct.fallbacks);
+            IoScheduler::Stats scheduler = IoScheduler::instance().stats();
+            text += QString("\n=== Planificador de E/S (%1) ===\n"
+                            "  • Profundidad por defecto: %2 / Plazos: %3 ms lectura, %4 ms listado, %5 ms escritura")
+                        .arg(scheduler.enabled ? "activo" : "desactivado")
+                        .arg(scheduler.queueDepth)
+                        .arg(scheduler.deadlineMs[int(IoScheduler::Kind::Read)])
+                        .arg(scheduler.deadlineMs[int(IoScheduler::Kind::Metadata)])
+                        .arg(scheduler.deadlineMs[int(IoScheduler::Kind::Write)]);
+            for (const IoScheduler::DeviceStats &device : scheduler.devices)
+            {
+                text += QString("\n  • %1: %2/%3 en curso, %4 en cola, espera %5 ms (máx. %6), servicio %7 ms, "
+                                "%8 lecturas / %9 listados / %10 escrituras, %11 plazos vencidos")
+                            .arg(device.device)
+                            .arg(device.inFlight)
+                            .arg(device.queueDepth)
+                            .arg(device.queued)
+                            .arg(device.avgWaitMs, 0, 'f', 1)
+                            .arg(device.maxWaitMs, 0, 'f', 1)
+                            .arg(device.avgServiceMs, 0, 'f', 1)
+                            .arg(device.completed[int(IoScheduler::Kind::Read)])
+                            .arg(device.completed[int(IoScheduler::Kind::Metadata)])
+                            .arg(device.completed[int(IoScheduler::Kind::Write)])
+                            .arg(device.expired);
+            }
+            FtpClientHandler::ControlStats control = FtpClientHandler::controlStats();
+            text += QString("\n=== Canal de control ===\n"
+                            "  • Órdenes: %1 / Respuestas: %2 / Escrituras al socket: %3 (%4 respuestas por escritura)")
+                        .arg(control.commands)
+                        .arg(control.replies)
+                        .arg(control.flushes)
+                        .arg(control.flushes ? double(control.replies) / control.flushes : 0.0, 0, 'f', 2);
+            appendConsoleOutput(text);
+        }
+        if (subCmd.isEmpty() || subCmd == "cache")
+        {
+            HotFileCache::Stats cache = HotFileCache::instance().stats();
+            appendConsoleOutput(QString("=== Caché de archivos populares ===\n"
+                                        "  • Ocupado: %1 / %2 MB en %3 archivos (máx. %4 KB por archivo)\n"
+                                        "  • Aciertos: %5 / Fallos: %6 (tasa de acierto %7%)\n"
+                                        "  • Inserciones: %8 / Expulsiones: %9")
+                                    .arg(cache.usedBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                                    .arg(cache.capacityBytes / (1024 * 1024))
+                                    .arg(cache.entries)
+                                    .arg(cache.maxFileBytes / 1024)
+                                    .arg(cache.hits)
+                                    .arg(cache.misses)
+                                    .arg(cache.hitRatio() * 100.0, 0, 'f', 1)
+                                    .arg(cache.insertions)
+                                    .arg(cache.evictions));
+
+            DirectoryCache::Stats listing = DirectoryCache::instance().stats();
+            appendConsoleOutput(QString("=== Caché de listados ===\n"
+                                        "  • Ocupado: %1 / %2 MB en %3 listados de %4 directorios vigilados%5\n"
+                                        "  • Aciertos: %6 / Fallos: %7 (tasa de acierto %8%)\n"
+                                        "  • Inserciones: %9 / Invalidaciones: %10 / Expulsiones: %11 / Descartados por cambios: %12")
+                                    .arg(listing.usedBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                                    .arg(listing.capacityBytes / (1024 * 1024))
+                                    .arg(listing.entries)
+                                    .arg(listing.watchedDirectories)
+                                    .arg(listing.watcherActive ? QString() : QString(" (sin vigilancia de cambios)"))
+                                    .arg(listing.hits)
+                                    .arg(listing.misses)
+                                    .arg(listing.hitRatio() * 100.0, 0, 'f', 1)
+                                    .arg(listing.insertions)
+                                    .arg(listing.invalidations)
+                                    .arg(listing.evictions)
+                                    .arg(listing.staleRenders));
+
+            DirectoryLister::Stats listers = DirectoryLister::stats();
+            appendConsoleOutput(QString("=== Listados ===\n"
+                                        "  • Desde disco: %1 (%2 entradas), primer byte en %3 ms de media\n"
+                                        "  • Desde caché: %4, primer byte en %5 ms de media\n"
+                                        "  • Primer byte más lento desde la última consulta: %6 ms")
+                                    .arg(listers.listings)
+                                    .arg(listers.entries)
+                                    .arg(listers.avgFirstByteMs, 0, 'f', 1)
+                                    .arg(listers.cachedListings)
+                                    .arg(listers.avgCachedFirstByteMs, 0, 'f', 1)
+                                    .arg(listers.maxFirstByteMs, 0, 'f', 1));
+
+            MetadataIndex::Stats index = MetadataIndex::instance().stats();
+            if (index.enabled)
+            {
+                appendConsoleOutput(QString("=== Índice de metadatos ===\n"
+                                            "  • Raíz: %1, %2 directorios vigilados%3\n"
+                                            "  • Rastreados: %4 directorios, %5 entradas (%6 pendientes); %7 pasadas, la última en %8 s\n"
+                                            "  • Consultas: %9, aciertos %10 (tasa %11%), listados servidos %12\n"
+                                            "  • Cambios aplicados: %13 / Desbordamientos de inotify: %14")
+                                        .arg(index.root)
+                                        .arg(index.watchedDirectories)
+                                        .arg(!index.watcherActive ? QString(" (sin inotify, revalidación por pasadas)")
+                                             : index.watchLimitReached ? QString(" (límite de vigilancias alcanzado)")
+                                                                       : QString())
+                                        .arg(index.crawledDirectories)
+                                        .arg(index.crawledEntries)
+                                        .arg(index.queuedDirectories)
+                                        .arg(index.passes)
+                                        .arg(index.lastPassSeconds, 0, 'f', 1)
+                                        .arg(index.lookups)
+                                        .arg(index.hits)
+                                        .arg(index.hitRatio() * 100.0, 0, 'f', 1)
+                                        .arg(index.listings)
+                                        .arg(index.updates)
+                                        .arg(index.overflows));
+            }
+
+            ChangeJournal::Stats journal = ChangeJournal::instance().stats();
+            if (journal.enabled)
+            {
+                appendConsoleOutput(QString("=== Diario de cambios ===\n"
+                                            "  • Secuencias %1 a %2 en %3 segmentos (%4 MB)\n"
+                                            "  • Anotados desde el arranque: %5 (%6 vistos por inotify, %7 repetidos descartados)\n"
+                                            "  • Consultas SITE CHANGES: %8")
+                                        .arg(journal.firstSequence)
+                                        .arg(journal.lastSequence)
+                                        .arg(journal.segments)
+                                        .arg(journal.bytes / (1024.0 * 1024.0), 0, 'f', 1)
+                                        .arg(journal.recorded)
+                                        .arg(journal.external)
+                                        .arg(journal.suppressed)
+                                        .arg(journal.queries));
+            }
+
+            FileNameIndex::Stats names = FileNameIndex::instance().stats();
+            if (names.enabled)
+            {
+                appendConsoleOutput(QString("=== Índice de nombres ===\n"
+                                            "  • %1\n"
+                                            "  • Entradas: %2, nombres distintos %3, memoria %4 / %5 MB%6\n"
+                                            "  • Última construcción: %7 s / Cambios aplicados: %8\n"
+                                            "  • Búsquedas SITE FIND: %9, media %10 ms")
+                                        .arg(!names.ready ? QString("Construyendo...")
+                                             : names.building ? QString("Listo (reconstruyendo en segundo plano)")
+                                                              : QString("Listo"))
+                                        .arg(names.entries)
+                                        .arg(names.uniqueNames)
+                                        .arg(names.memoryBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                                        .arg(names.capacityBytes / (1024 * 1024))
+                                        .arg(names.truncated ? QString(" (tope alcanzado, índice incompleto)") : QString())
+                                        .arg(names.lastBuildSeconds, 0, 'f', 1)
+                                        .arg(names.updates)
+                                        .arg(names.queries)
+                                        .arg(names.avgQueryMs, 0, 'f', 2));
+            }
+
+            DirSizeIndex::Stats sizes = DirSizeIndex::instance().stats();
+            if (sizes.enabled)
+            {
+                appendConsoleOutput(QString("=== Tamaños y cuotas ===\n"
+                                            "  • %1: %2 directorios, %3 archivos, %4 MB\n"
+                                            "  • Cambios aplicados: %5 / Reconciliaciones: %6 (%7 directorios, la última en %8 s, %9 MB corregidos)\n"
+                                            "  • Cuotas: %10 de usuario, %11 de carpeta; subidas rechazadas %12")
+                                        .arg(sizes.ready ? QString("Listo") : QString("Sembrando..."))
+                                        .arg(sizes.directories)
+                                        .arg(sizes.root.files)
+                                        .arg(sizes.root.bytes / (1024.0 * 1024.0), 0, 'f', 1)
+                                        .arg(sizes.updates)
+                                        .arg(sizes.passes)
+                                        .arg(sizes.reconciledDirectories)
+                                        .arg(sizes.lastPassSeconds, 0, 'f', 1)
+                                        .arg(sizes.correctedBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                                        .arg(sizes.userQuotas)
+                                        .arg(sizes.directoryQuotas)
+                                        .arg(sizes.rejections));
+            }
+        }
+        if (!subCmd.isEmpty() && subCmd != "buffers" && subCmd != "tls" && subCmd != "io" && subCmd != "cache")
+        {
+            appendConsoleOutput("Uso: stats [buffers|tls|io|cache]");
+        }
+    }
     else if (cmd == "help")
     {
         appendConsoleOutput(
@@ -612,7 +1157,13 @@ void gestor::executeCommand(const QString &command)
             "  adduser <usuario> <contraseña> - Agrega un usuario\n"
             "  moduser <usuario> <nueva_contraseña> - Modifica un usuario\n"
             "  listuser - Lista los usuarios\n"
-            "  elimuser <usuario> - Elimina un usuario");
+            "  elimuser <usuario> - Elimina un usuario\n"
+            "  quota [<usuario>|</carpeta> <MB>|off] - Muestra o fija cuotas de espacio\n"
+            "  home [<usuario> </carpeta>|off] - Muestra o fija la carpeta personal de un usuario\n"
+            "  perm <usuario> [</carpeta> rwdm|-|off] - Muestra o fija los permisos de un usuario\n"
+            "  mount [</virtual> <carpeta>|mem:...] - Muestra los montajes o monta una carpeta o un árbol en memoria\n"
+            "  umount </virtual> - Desmonta una carpeta\n"
+            "  stats [buffers|tls|io|cache] - Muestra métricas internas del servidor");
     }
     else
     {
@@ -1096,6 +1647,30 @@ void gestor::updateMonitoringStats()
 
     // Actualizar información de recursos
     updateResourceUsage();
+    updateDiskIoStats();
+}
+
+// Colas del planificador de E/S por dispositivo
+void gestor::updateDiskIoStats()
+{
+    IoScheduler::Stats io = IoScheduler::instance().stats();
+    ui->groupBoxDiscos->setTitle(io.enabled ? tr("E/S por Disco") : tr("E/S por Disco (planificador desactivado)"));
+    ui->tableDiscos->setRowCount(io.devices.size());
+    for (int row = 0; row < io.devices.size(); ++row)
+    {
+        const IoScheduler::DeviceStats &device = io.devices[row];
+        const QStringList cells = {
+            device.device,
+            QString("%1 / %2").arg(device.inFlight).arg(device.queueDepth),
+            QString::number(device.queued),
+            QString("%1 (máx. %2)").arg(device.avgWaitMs, 0, 'f', 1).arg(device.maxWaitMs, 0, 'f', 1),
+            QString::number(device.avgServiceMs, 'f', 1),
+            QString::number(device.expired)};
+        for (int column = 0; column < cells.size(); ++column)
+        {
+            ui->tableDiscos->setItem(row, column, new QTableWidgetItem(cells[column]));
+        }
+    }
 }
 
 // Actualizar información de uso de recursos
@@ -1626,6 +2201,101 @@ void gestor::loadSettings()
         // Guardar la corrección
         settings.setValue("rootDir", rootDir);
     }
+
+    // Pool de buffers de transferencia (debe configurarse antes de iniciar el servidor)
+    BufferPool::instance().configure(
+        settings.value("transfer/bufferBlockKB", BufferPool::DefaultBlockSize / 1024).toLongLong() * 1024,
+        settings.value("transfer/bufferMaxBlocks", BufferPool::DefaultMaxBlocks).toInt(),
+        settings.value("transfer/hugePages", false).toBool());
+
+    // Lectura anticipada de RETR: tope global y ventana máxima por transferencia
+    ReadAheadManager::instance().configure(
+        settings.value("transfer/readAheadBudgetMB", ReadAheadManager::DefaultBudget / (1024 * 1024)).toLongLong() * 1024 * 1024,
+        settings.value("transfer/readAheadMaxWindowMB", ReadAheadManager::DefaultMaxWindow / (1024 * 1024)).toLongLong() * 1024 * 1024);
+
+    // Caché de archivos populares (0 MB la desactiva)
+    HotFileCache::instance().configure(
+        settings.value("transfer/hotCacheMB", HotFileCache::DefaultCapacity / (1024 * 1024)).toLongLong() * 1024 * 1024,
+        settings.value("transfer/hotCacheMaxFileKB", HotFileCache::DefaultMaxFileSize / 1024).toLongLong() * 1024);
+
+    // Caché de listados renderizados, invalidada por cambios en disco (0 MB la desactiva)
+    DirectoryCache::instance().configure(
+        settings.value("cache/listingMB", DirectoryCache::DefaultCapacity / (1024 * 1024)).toLongLong() * 1024 * 1024);
+
+    // Carpetas de otros volúmenes montadas en el árbol virtual ("/videos=D:/videos"), o
+    // árboles sintéticos en memoria ("/bench=mem:files=1000,size=1M"), también en la raíz
+    Vfs::instance().setRoot(rootDir);
+    if (!Vfs::instance().setRootSource(settings.value("vfs/root").toString()))
+    {
+        qWarning() << "vfs/root no válido; se sirve la carpeta raíz";
+        Vfs::instance().setRootSource(QString());
+    }
+    Vfs::instance().configure(settings.value("vfs/mounts").toStringList());
+
+    // Diario de cambios para SITE CHANGES (antes que el índice, que le pasa lo que ve inotify)
+    ChangeJournal::instance().configure(
+        settings.value("journal/enabled", false).toBool(),
+        rootDir,
+        settings.value("journal/path").toString(),
+        settings.value("journal/maxMB", ChangeJournal::DefaultMaxBytes / (1024 * 1024)).toLongLong() * 1024 * 1024);
+
+    // Índice persistente de metadatos del árbol servido (opcional; se abre sin cargar nada)
+    MetadataIndex::instance().configure(
+        settings.value("index/enabled", false).toBool(),
+        rootDir,
+        settings.value("index/path").toString(),
+        settings.value("index/hashMaxMB", 0).toLongLong() * 1024 * 1024,
+        settings.value("index/maxWatches", MetadataIndex::DefaultMaxWatches).toInt(),
+        settings.value("index/rescanMinutes", 60).toInt());
+
+    // Índice de nombres en memoria para SITE FIND (se construye en segundo plano)
+    FileNameIndex::instance().configure(
+        settings.value("find/enabled", false).toBool(),
+        rootDir,
+        settings.value("find/maxMB", FileNameIndex::DefaultCapacity / (1024 * 1024)).toLongLong() * 1024 * 1024,
+        settings.value("find/maxResults", FileNameIndex::DefaultMaxResults).toInt(),
+        settings.value("find/rebuildMinutes", 60).toInt());
+
+    // Tamaños por directorio para SITE DU y las cuotas (se siembra en segundo plano)
+    DirSizeIndex::instance().setQuotas(dbManager.getUserQuotas(), dbManager.getDirectoryQuotas());
+    DirSizeIndex::instance().configure(
+        settings.value("quota/enabled", false).toBool(),
+        rootDir,
+        settings.value("quota/reconcileMinutes", 30).toInt());
+
+    // LIST -R / MLSD -R: límites del recorrido e hilos del pool (0 = según los núcleos)
+    TreeWalker::configure(
+        settings.value("list/recursiveMaxDepth", TreeWalker::DefaultMaxDepth).toInt(),
+        settings.value("list/recursiveMaxEntries", TreeWalker::DefaultMaxEntries).toLongLong(),
+        settings.value("list/walkerThreads", 0).toInt());
+
+    // Descargas simultáneas de un mismo archivo grande comparten la lectura (0 MB la desactiva)
+    SharedReadRegistry::instance().setMinFileSize(
+        settings.value("transfer/sharedReadMinMB", SharedReadRegistry::DefaultMinFileSize / (1024 * 1024)).toLongLong() * 1024 * 1024);
+
+    // E/S directa (sin caché de páginas) para archivos enormes o rutas concretas; umbral 0 la limita a las rutas
+    DirectIoPolicy::instance().configure(
+        settings.value("transfer/directIoThresholdMB", DirectIoPolicy::DefaultThreshold / (1024 * 1024)).toLongLong() * 1024 * 1024,
+        settings.value("transfer/directIoPaths").toStringList(),
+        settings.value("transfer/directIoQueueDepth", DirectIoPolicy::DefaultQueueDepth).toInt());
+
+    // Planificador de E/S por dispositivo; io/deviceQueueDepth admite entradas "sda=2"
+    IoScheduler::instance().configure(
+        settings.value("io/queueDepth", IoScheduler::DefaultQueueDepth).toInt(),
+        settings.value("io/readDeadlineMs", IoScheduler::DefaultReadDeadlineMs).toInt(),
+        settings.value("io/metadataDeadlineMs", IoScheduler::DefaultMetadataDeadlineMs).toInt(),
+        settings.value("io/writeDeadlineMs", IoScheduler::DefaultWriteDeadlineMs).toInt());
+    const QStringList deviceDepths = settings.value("io/deviceQueueDepth").toStringList();
+    for (const QString &entry : deviceDepths)
+    {
+        const QString device = entry.section('=', 0, 0).trimmed();
+        bool ok = false;
+        const int depth = entry.section('=', 1).trimmed().toInt(&ok);
+        if (!device.isEmpty() && ok)
+        {
+            IoScheduler::instance().setDeviceQueueDepth(device, depth);
+        }
+    }
 }
 
 void gestor::saveSettings()
@@ -1640,6 +2310,21 @@ void gestor::saveSettings()
     qInfo() << QString("Configuración guardada - Directorio raíz: %1").arg(rootDir);
 }
 
+void gestor::saveMounts()
+{
+    // La raíz se guarda aparte en rootDir (o vfs/root si está en memoria)
+    QStringList mounts;
+    for (const Vfs::Mount &mount : Vfs::instance().mounts())
+    {
+        if (mount.mountPoint != "/")
+        {
+            mounts << mount.mountPoint + "=" + mount.source;
+        }
+    }
+    QSettings settings("MiEmpresa", "GestorFTP");
+    settings.setValue("vfs/mounts", mounts);
+}
+
 void gestor::initializeDatabase()
 {
     if (!dbManager.isValid())
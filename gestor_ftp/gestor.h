@@ -128,6 +128,7 @@ private:
     void loadTranslations();
     void loadSettings();
     void saveSettings();
+    void saveMounts();
     void fetchPublicIP();
     void handlePublicIPResponse(QNetworkReply *reply);
     void setupCommandCompleter();
@@ -136,6 +137,7 @@ private:
     void setupMonitoringSystem();
     void updateMonitoringStats();
     void updateResourceUsage();
+    void updateDiskIoStats();
     qint64 getProcessMemoryUsage();
     double getProcessCpuUsage();
     void getDiskSpaceInfo(qint64 &total, qint64 &free);
@@ -28,7 +28,31 @@ SOURCES += \
     ErrorHandler.cpp \
     ShortcutManager.cpp \
     ShortcutDialog.cpp \
-    SystemMonitor.cpp
+    SystemMonitor.cpp \
+    BufferPool.cpp \
+    ZeroCopySend.cpp \
+    TlsSessionCache.cpp \
+    TlsHandshakeScheduler.cpp \
+    TarFormat.cpp \
+    TarBatchStream.cpp \
+    TarExtractor.cpp \
+    ReadAheadManager.cpp \
+    HotFileCache.cpp \
+    SharedFileReader.cpp \
+    DirectIo.cpp \
+    IoScheduler.cpp \
+    DirectoryCache.cpp \
+    DirectoryLister.cpp \
+    TreeWalker.cpp \
+    MetadataIndex.cpp \
+    ChangeJournal.cpp \
+    FileNameIndex.cpp \
+    DirSizeIndex.cpp \
+    PathResolver.cpp \
+    Vfs.cpp \
+    MemoryVfsBackend.cpp \
+    UserRules.cpp \
+    FtpCommand.cpp
 
 HEADERS += \
     FtpClientHandler.h \
@@ -40,7 +64,31 @@ HEADERS += \
     ErrorHandler.h \
     ShortcutManager.h \
     ShortcutDialog.h \
-    SystemMonitor.h
+    SystemMonitor.h \
+    BufferPool.h \
+    ZeroCopySend.h \
+    TlsSessionCache.h \
+    TlsHandshakeScheduler.h \
+    TarFormat.h \
+    TarBatchStream.h \
+    TarExtractor.h \
+    ReadAheadManager.h \
+    HotFileCache.h \
+    SharedFileReader.h \
+    DirectIo.h \
+    IoScheduler.h \
+    DirectoryCache.h \
+    DirectoryLister.h \
+    TreeWalker.h \
+    MetadataIndex.h \
+    ChangeJournal.h \
+    FileNameIndex.h \
+    DirSizeIndex.h \
+    PathResolver.h \
+    Vfs.h \
+    MemoryVfsBackend.h \
+    UserRules.h \
+    FtpCommand.h
 
 FORMS += \
     gestor.ui
@@ -3,6 +3,11 @@
 #include <QSignalSpy>
 #include <QFile>
 #include <QDir>
+#include <QThread>
+#include <QElapsedTimer>
+#include <vector>
+#include <thread>
+#include <atomic>
 
 void TestGestorFTP::testDatabaseOperations()
 {
@@ -129,6 +134,809 @@ void TestGestorFTP::testDirectoryListing()
     QDir(testSubDir).removeRecursively();
 }
 
+void TestGestorFTP::testDirectoryCache()
+{
+    DirectoryCache &cache = DirectoryCache::instance();
+    cache.clear();
+    cache.configure(1024 * 1024);
+
+    QString listDir = testDir + "/listado";
+    QDir().mkpath(listDir);
+    const QByteArray listing("-rwxr-xr-x 1 owner group          0 Jan 01 00:00 a.txt\r\n");
+
+    // Sin listado guardado: fallo; tras insertarlo se sirve tal cual
+    QByteArray payload;
+    QVERIFY(!cache.lookup(listDir, DirectoryCache::Format::List, 0, payload));
+    quint64 generation = cache.beginRender(listDir);
+    if (generation == 0) {
+        QSKIP("No se pueden vigilar directorios en este sistema");
+    }
+    cache.insert(listDir, DirectoryCache::Format::List, 0, listing, generation);
+    QVERIFY(cache.lookup(listDir, DirectoryCache::Format::List, 0, payload));
+    QCOMPARE(payload, listing);
+    // Otras opciones son otra entrada
+    QVERIFY(!cache.lookup(listDir, DirectoryCache::Format::List, DirectoryCache::ShowHidden, payload));
+
+    // Un listado generado antes de una invalidación no se guarda
+    generation = cache.beginRender(listDir);
+    cache.invalidate(listDir);
+    QVERIFY(!cache.lookup(listDir, DirectoryCache::Format::List, 0, payload));
+    cache.insert(listDir, DirectoryCache::Format::List, 0, listing, generation);
+    QVERIFY(!cache.lookup(listDir, DirectoryCache::Format::List, 0, payload));
+
+    // Un cambio en disco hecho por fuera del servidor también invalida
+    generation = cache.beginRender(listDir);
+    cache.insert(listDir, DirectoryCache::Format::List, 0, listing, generation);
+    QVERIFY(cache.lookup(listDir, DirectoryCache::Format::List, 0, payload));
+    QFile created(listDir + "/nuevo.txt");
+    QVERIFY(created.open(QIODevice::WriteOnly));
+    created.close();
+    QTRY_VERIFY_WITH_TIMEOUT(!cache.lookup(listDir, DirectoryCache::Format::List, 0, payload), 2000);
+    QVERIFY(cache.stats().invalidations >= 2);
+
+    QDir(listDir).removeRecursively();
+    cache.clear();
+    cache.configure(DirectoryCache::DefaultCapacity);
+}
+
+void TestGestorFTP::testDirectoryLister()
+{
+    QString listDir = testDir + "/tandas";
+    QDir().mkpath(listDir + "/sub");
+    const int fileCount = 500;
+    for (int i = 0; i < fileCount; ++i) {
+        QFile f(listDir + QString("/archivo_%1.txt").arg(i));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(QByteArray(i, 'x'));
+    }
+    QFile hidden(listDir + "/.oculto");
+    QVERIFY(hidden.open(QIODevice::WriteOnly));
+    hidden.close();
+
+    // Tandas pequeñas: cada una se queda cerca del tope pedido
+    DirectoryLister lister;
+    QVERIFY(lister.open(listDir, false));
+    QByteArray listing;
+    QByteArray batch;
+    int batches = 0;
+    while (!lister.atEnd()) {
+        batch.resize(0);
+        lister.next(batch, 1024);
+        QVERIFY(batch.size() < 1024 + 256);
+        listing.append(batch);
+        batches++;
+    }
+    QVERIFY(lister.errorString().isEmpty());
+    QVERIFY(batches > 10);
+    QCOMPARE(lister.entryCount(), qint64(fileCount + 1));
+
+    const QList<QByteArray> lines = listing.split('\n');
+    QCOMPARE(lines.size(), fileCount + 2); // Más la cadena vacía tras el último salto
+    QVERIFY(listing.contains(" archivo_499.txt\r\n"));
+    QVERIFY(listing.contains("        499 "));
+    QVERIFY(!listing.contains(".oculto"));
+    for (const QByteArray &line : lines) {
+        if (line.endsWith(" sub\r")) {
+            QVERIFY(line.startsWith('d'));
+        }
+    }
+
+    // Con -a aparecen los ocultos, "." y ".."
+    DirectoryLister all;
+    QVERIFY(all.open(listDir, true));
+    QByteArray everything;
+    while (!all.atEnd()) {
+        all.next(everything);
+    }
+    QVERIFY(everything.contains(" .oculto\r\n"));
+    QVERIFY(everything.contains(" ..\r\n"));
+
+    QVERIFY(!DirectoryLister().open(listDir + "/no_existe", false));
+    QDir(listDir).removeRecursively();
+}
+
+void TestGestorFTP::testMlsdFacts()
+{
+    QString listDir = testDir + "/mlsd";
+    QDir().mkpath(listDir + "/carpeta");
+    QFile f(listDir + "/datos.bin");
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write(QByteArray(1234, 'x'));
+    f.close();
+    QFile hidden(listDir + "/.config");
+    QVERIFY(hidden.open(QIODevice::WriteOnly));
+    hidden.close();
+
+    DirectoryLister lister;
+    QVERIFY(lister.open(listDir, true, DirectoryLister::Format::Mlsd));
+    QByteArray listing;
+    while (!lister.atEnd()) {
+        lister.next(listing);
+    }
+    QCOMPARE(lister.entryCount(), qint64(3)); // MLSD nunca incluye "." ni ".."
+
+    // Los ocultos salen siempre, sin opción -a (los clientes de sincronización los necesitan)
+    DirectoryLister plain;
+    QVERIFY(plain.open(listDir, false, DirectoryLister::Format::Mlsd));
+    QByteArray plainListing;
+    while (!plain.atEnd()) {
+        plain.next(plainListing);
+    }
+    QVERIFY(plainListing.contains(" .config\r\n"));
+    QVERIFY(!plainListing.contains(" ..\r\n"));
+
+    QByteArray fileLine;
+    QByteArray dirLine;
+    for (const QByteArray &line : listing.split('\n')) {
+        if (line.endsWith(" datos.bin\r")) {
+            fileLine = line;
+        } else if (line.endsWith(" carpeta\r")) {
+            dirLine = line;
+        }
+    }
+    QVERIFY(fileLine.startsWith("type=file;size=1234;modify="));
+    QVERIFY(fileLine.contains(";perm=r"));
+    QVERIFY(fileLine.contains(";unique="));
+    QVERIFY(dirLine.startsWith("type=dir;modify="));
+    QVERIFY(dirLine.contains("perm=el"));
+
+    // MLST, SIZE y MDTM usan los mismos datos
+    QByteArray facts;
+    QVERIFY(DirectoryLister::factsFor(listDir + "/datos.bin", facts));
+    QCOMPARE(facts, fileLine.left(fileLine.indexOf(' ')));
+    qint64 size = 0;
+    qint64 mtime = 0;
+    bool isDir = true;
+    QVERIFY(DirectoryLister::sizeAndTime(listDir + "/datos.bin", size, mtime, isDir));
+    QCOMPARE(size, qint64(1234));
+    QVERIFY(!isDir);
+    QCOMPARE(DirectoryLister::timeVal(0), QByteArray("19700101000000"));
+    QCOMPARE(DirectoryLister::timeVal(mtime),
+             QFileInfo(listDir + "/datos.bin").lastModified().toUTC().toString("yyyyMMddHHmmss").toLatin1());
+    QVERIFY(!DirectoryLister::factsFor(listDir + "/no_existe", facts));
+
+    QDir(listDir).removeRecursively();
+}
+
+namespace {
+// Recorre el árbol completo atendiendo los avisos del pool en este hilo
+QByteArray walkTree(TreeWalker &walker)
+{
+    QByteArray out;
+    QElapsedTimer timer;
+    timer.start();
+    while (!walker.atEnd() && timer.elapsed() < 10000) {
+        if (walker.next(out) == 0) {
+            QTest::qWait(1);
+        }
+    }
+    return out;
+}
+} // namespace
+
+void TestGestorFTP::testTreeWalker()
+{
+    QString root = testDir + "/arbol";
+    for (const QString &dir : {"/a/x", "/a/y", "/b", "/c/z/w"}) {
+        QDir().mkpath(root + dir);
+    }
+    for (const QString &file : {"/raiz.txt", "/a/uno.txt", "/a/x/dos.txt", "/c/z/w/tres.txt"}) {
+        QFile f(root + file);
+        QVERIFY(f.open(QIODevice::WriteOnly));
+    }
+
+    QObject context;
+    int notifications = 0;
+    TreeWalker::Limits limits;
+
+    // Preorden estable: cada directorio antes que sus hijos, sin depender de los hilos
+    TreeWalker first(root, DirectoryLister::Format::List, false, limits, &context, [&]() { notifications++; });
+    const QByteArray listing = walkTree(first);
+    QVERIFY(first.atEnd());
+    QVERIFY(!first.truncated());
+    QCOMPARE(first.directoryCount(), qint64(8));
+    QVERIFY(listing.startsWith(".:\r\n"));
+    QVERIFY(listing.indexOf("./a:\r\n") < listing.indexOf("./a/x:\r\n"));
+    QVERIFY(listing.indexOf("./c:\r\n") < listing.indexOf("./c/z/w:\r\n"));
+    QVERIFY(listing.contains(" tres.txt\r\n"));
+    QVERIFY(notifications > 0);
+
+    TreeWalker second(root, DirectoryLister::Format::List, false, limits, &context, []() {});
+    QCOMPARE(walkTree(second), listing);
+
+    // MLSD -R: nombres relativos a la raíz
+    TreeWalker mlsd(root, DirectoryLister::Format::Mlsd, false, limits, &context, []() {});
+    const QByteArray facts = walkTree(mlsd);
+    QVERIFY(facts.contains(" c/z/w/tres.txt\r\n"));
+    QVERIFY(facts.contains("type=dir;"));
+
+    // Subcarpetas sin permiso: se ven en su directorio pero no se recorren
+    TreeWalker filtered(root, DirectoryLister::Format::Mlsd, false, limits, &context, []() {},
+                        [](const QString &relative) { return relative != QLatin1String("c/z"); });
+    const QByteArray pruned = walkTree(filtered);
+    QVERIFY(pruned.contains(" c/z\r\n"));
+    QVERIFY(!pruned.contains("c/z/w"));
+    QVERIFY(pruned.contains(" a/x/dos.txt\r\n"));
+
+    // Límites de profundidad y de entradas
+    limits.maxDepth = 1;
+    TreeWalker shallow(root, DirectoryLister::Format::List, false, limits, &context, []() {});
+    const QByteArray top = walkTree(shallow);
+    QVERIFY(shallow.truncated());
+    QVERIFY(top.contains("./a:\r\n"));
+    QVERIFY(!top.contains("./a/x:"));
+
+    limits = TreeWalker::Limits();
+    limits.maxEntries = 2;
+    TreeWalker few(root, DirectoryLister::Format::List, false, limits, &context, []() {});
+    walkTree(few);
+    QVERIFY(few.atEnd());
+    QVERIFY(few.truncated());
+
+    QDir(root).removeRecursively();
+}
+
+void TestGestorFTP::testMetadataIndex()
+{
+    QString root = testDir + "/indice";
+    QString dbPath = testDir + "/indice.db";
+    QDir().mkpath(root + "/sub");
+    QFile a(root + "/a.txt");
+    QVERIFY(a.open(QIODevice::WriteOnly));
+    a.write(QByteArray(100, 'x'));
+    a.close();
+    QFile b(root + "/sub/b.txt");
+    QVERIFY(b.open(QIODevice::WriteOnly));
+    b.close();
+
+    MetadataIndex &index = MetadataIndex::instance();
+    quint64 passes = index.stats().passes;
+    index.configure(true, root, dbPath);
+    QTRY_VERIFY_WITH_TIMEOUT(index.stats().passes > passes && index.stats().queuedDirectories == 0, 10000);
+
+    DirectoryLister::Entry entry;
+    QVERIFY(index.lookup(root + "/a.txt", entry));
+    QCOMPARE(entry.size, qint64(100));
+    QVERIFY(!entry.isDir);
+    std::vector<DirectoryLister::NamedEntry> entries;
+    QVERIFY(index.listDirectory(root + "/sub", entries));
+    QCOMPARE(int(entries.size()), 1);
+    QCOMPARE(entries[0].name, QByteArray("b.txt"));
+    QVERIFY(!index.lookup(testDir + "/indice.db", entry)); // Fuera de la raíz
+
+    // Un cambio avisado se consulta en disco hasta que el índice lo recoge
+    QVERIFY(a.open(QIODevice::WriteOnly));
+    a.write(QByteArray(200, 'x'));
+    a.close();
+    index.refresh(root + "/a.txt");
+    QVERIFY(!index.lookup(root + "/a.txt", entry));
+    qint64 size = 0;
+    qint64 mtime = 0;
+    bool isDir = false;
+    QVERIFY(DirectoryLister::sizeAndTime(root + "/a.txt", size, mtime, isDir));
+    QCOMPARE(size, qint64(200));
+    QTRY_VERIFY_WITH_TIMEOUT(index.lookup(root + "/a.txt", entry) && entry.size == 200, 5000);
+
+    QVERIFY(QDir(root + "/sub").removeRecursively());
+    index.refresh(root + "/sub");
+    // Mientras el borrado está pendiente la raíz se lista del disco; después, sin "sub"
+    QTRY_VERIFY_WITH_TIMEOUT(index.listDirectory(root, entries) && entries.size() == 1, 5000);
+    QVERIFY(!index.lookup(root + "/sub", entry));
+    QVERIFY(!index.lookup(root + "/sub/b.txt", entry));
+
+    // Arranque en caliente: lo guardado se sirve sin esperar al rastreador
+    index.configure(true, root, dbPath);
+    QVERIFY(index.lookup(root + "/a.txt", entry));
+    QCOMPARE(entry.size, qint64(200));
+
+    // Un archivo que se acaba de escribir no se hashea hasta que deja de cambiar
+    index.configure(true, root, dbPath, 1024 * 1024);
+    QFile c(root + "/c.txt");
+    QVERIFY(c.open(QIODevice::WriteOnly));
+    c.write("contenido");
+    c.close();
+    index.refresh(root + "/c.txt");
+    QByteArray hash;
+    QTRY_VERIFY_WITH_TIMEOUT(index.lookup(root + "/c.txt", entry, &hash), 5000);
+    if (QDateTime::currentSecsSinceEpoch() - entry.mtimeSecs < 2) {
+        QVERIFY(hash.isEmpty());
+    }
+    QTRY_VERIFY_WITH_TIMEOUT(index.lookup(root + "/c.txt", entry, &hash) && !hash.isEmpty(), 10000);
+    QCOMPARE(hash, QCryptographicHash::hash("contenido", QCryptographicHash::Sha256).toHex());
+
+    index.configure(false, root, dbPath);
+    QVERIFY(!index.lookup(root + "/a.txt", entry));
+    QDir(root).removeRecursively();
+}
+
+namespace {
+QByteArray readChanges(ChangeJournal::Reader &reader)
+{
+    QByteArray out;
+    while (!reader.atEnd()) {
+        reader.next(out, 1000);
+    }
+    return out;
+}
+} // namespace
+
+void TestGestorFTP::testChangeJournal()
+{
+    QString root = testDir + "/diario_raiz";
+    QString dir = testDir + "/diario";
+    QDir(dir).removeRecursively();
+    ChangeJournal &journal = ChangeJournal::instance();
+    journal.configure(true, root, dir, 1024 * 1024);
+    QCOMPARE(journal.lastSequence(), quint64(0));
+
+    journal.record(ChangeJournal::Kind::Create, root + "/a.txt", false);
+    journal.record(ChangeJournal::Kind::Create, root + "/sub", true);
+    journal.record(ChangeJournal::Kind::Rename, root + "/a.txt", false, root + "/sub/a.txt");
+    journal.record(ChangeJournal::Kind::Delete, testDir + "/fuera.txt", false); // Fuera de la raíz
+    QCOMPARE(journal.lastSequence(), quint64(3));
+
+    std::unique_ptr<ChangeJournal::Reader> reader = journal.openReader(0);
+    QVERIFY(reader);
+    QList<QByteArray> lines = readChanges(*reader).split('\n');
+    QCOMPARE(lines.size(), 4); // Tres líneas y el resto vacío
+    QVERIFY(lines[0].startsWith("1 "));
+    QVERIFY(lines[0].endsWith(" create file /a.txt\r"));
+    QVERIFY(lines[2].endsWith(" rename file /a.txt\t/sub/a.txt\r"));
+
+    reader = journal.openReader(2);
+    QVERIFY(reader);
+    QVERIFY(readChanges(*reader).startsWith("3 "));
+    reader = journal.openReader(3);
+    QVERIFY(reader && readChanges(*reader).isEmpty());
+    QVERIFY(!journal.openReader(4)); // Posterior a la última: de otro diario
+
+    // Un evento de inotify de un cambio ya anotado por el servidor no se repite
+    journal.recordExternal(ChangeJournal::Kind::Create, root + "/sub", true);
+    journal.recordExternal(ChangeJournal::Kind::Modify, root + "/otro.txt", false);
+    QCOMPARE(journal.lastSequence(), quint64(4));
+    QCOMPARE(journal.stats().suppressed, quint64(1));
+
+    // Solo se omite la misma ruta y clase de cambio: lo de fuera dentro de una carpeta
+    // que el servidor acaba de tocar (SITE UNTAR, MKD) sí se anota
+    journal.record(ChangeJournal::Kind::Modify, root + "/sub", true);
+    journal.recordExternal(ChangeJournal::Kind::Create, root + "/sub/de_fuera.txt", false);
+    journal.recordExternal(ChangeJournal::Kind::Delete, root + "/sub", true);
+    QCOMPARE(journal.lastSequence(), quint64(7));
+    // Tras un RMD, los borrados de lo que había dentro son suyos
+    journal.record(ChangeJournal::Kind::Delete, root + "/viejo", true);
+    journal.recordExternal(ChangeJournal::Kind::Delete, root + "/viejo/hijo.txt", false);
+    journal.recordExternal(ChangeJournal::Kind::Create, root + "/viejo", true);
+    QCOMPARE(journal.lastSequence(), quint64(9));
+    QCOMPARE(journal.stats().suppressed, quint64(2));
+
+    // Al reabrir se sigue numerando donde se quedó
+    journal.configure(true, root, dir, 1024 * 1024);
+    QCOMPARE(journal.lastSequence(), quint64(9));
+
+    // Con el tope superado se descartan los segmentos antiguos: las secuencias viejas ya no se sirven
+    const QString longName = root + "/" + QString(80, 'x');
+    for (int i = 0; i < 30000; ++i) {
+        journal.record(ChangeJournal::Kind::Modify, longName, false);
+    }
+    QVERIFY(journal.firstSequence() > 1);
+    QVERIFY(!journal.openReader(0));
+    const quint64 first = journal.firstSequence();
+    reader = journal.openReader(first + 100);
+    QVERIFY(reader);
+    QVERIFY(readChanges(*reader).startsWith(QByteArray::number(first + 101) + " "));
+
+    journal.configure(false, root, dir);
+    QDir(dir).removeRecursively();
+}
+
+void TestGestorFTP::testFileNameIndex()
+{
+    QString root = testDir + "/nombres";
+    QDir().mkpath(root + "/Fotos/2024");
+    QDir().mkpath(root + "/docs");
+    for (const QString &name : {QString("/Fotos/2024/playa.JPG"), QString("/Fotos/2024/nieve.jpg"),
+                                QString("/docs/informe.pdf"), QString("/docs/playa.txt")}) {
+        QFile file(root + name);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.close();
+    }
+
+    FileNameIndex &index = FileNameIndex::instance();
+    index.configure(true, root);
+    QTRY_VERIFY_WITH_TIMEOUT(index.isReady(), 10000);
+    QCOMPARE(index.stats().entries, qint64(7));
+
+    // Subcadena y comodín, sin distinguir mayúsculas; las carpetas terminan en '/'
+    FileNameIndex::Result result = index.search("PLAYA", root);
+    QCOMPARE(result.matches, 2);
+    QVERIFY(result.lines.contains("/Fotos/2024/playa.JPG\r\n"));
+    QVERIFY(result.lines.contains("/docs/playa.txt\r\n"));
+    result = index.search("*.jpg", root);
+    QCOMPARE(result.matches, 2);
+    result = index.search("20[0-9]?", root);
+    QCOMPARE(result.lines, QByteArray("/Fotos/2024/\r\n"));
+
+    // Solo bajo el directorio indicado, y con tope de resultados
+    result = index.search("playa", root + "/docs");
+    QCOMPARE(result.lines, QByteArray("/docs/playa.txt\r\n"));
+    result = index.search("*", root, 3);
+    QCOMPARE(result.matches, 3);
+    QVERIFY(result.truncated);
+
+    // Altas y bajas avisadas; un directorio se vuelve a leer entero
+    QVERIFY(QDir(root + "/Fotos").removeRecursively());
+    index.refresh(root + "/Fotos");
+    QDir().mkpath(root + "/docs/nuevo");
+    QFile added(root + "/docs/nuevo/playa2.png");
+    QVERIFY(added.open(QIODevice::WriteOnly));
+    added.close();
+    index.refresh(root + "/docs/nuevo");
+    QTRY_COMPARE_WITH_TIMEOUT(index.search("playa", root).matches, 2, 5000);
+    result = index.search("playa", root);
+    QVERIFY(result.lines.contains("/docs/nuevo/playa2.png\r\n"));
+    QVERIFY(!result.lines.contains("Fotos"));
+
+    index.configure(false, root);
+    QVERIFY(!index.isReady());
+    QDir(root).removeRecursively();
+}
+
+void TestGestorFTP::testDirSizeIndex()
+{
+    QString root = testDir + "/tamanos";
+    QDir().mkpath(root + "/a/b");
+    auto writeFile = [](const QString &path, int size) {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QByteArray(size, 'x'));
+    };
+    writeFile(root + "/raiz.txt", 10);
+    writeFile(root + "/a/uno.txt", 100);
+    writeFile(root + "/a/b/dos.txt", 1000);
+
+    DirSizeIndex &index = DirSizeIndex::instance();
+    index.setQuotas({{"usuario", 5000}}, {{"/a", 1500}});
+    index.configure(true, root, 0);
+    QTRY_VERIFY_WITH_TIMEOUT(index.isReady(), 10000);
+
+    DirSizeIndex::Totals totals;
+    QVERIFY(index.totals(root, totals));
+    QCOMPARE(totals.bytes, qint64(1110));
+    QCOMPARE(totals.files, qint64(3));
+    QCOMPARE(totals.dirs, qint64(2));
+    QVERIFY(index.totals(root + "/a", totals));
+    QCOMPARE(totals.bytes, qint64(1100));
+
+    // La cuota más estricta: la de /a deja 400 bytes; fuera de /a manda la del usuario
+    DirSizeIndex::Headroom room = index.headroom(root + "/a/b/nuevo.bin", "usuario", root);
+    QCOMPARE(room.bytes, qint64(400));
+    QCOMPARE(room.scope, QString("/a"));
+    room = index.headroom(root + "/otro.bin", "usuario", root);
+    QCOMPARE(room.bytes, qint64(5000 - 1110));
+    QCOMPARE(index.headroom(root + "/otro.bin", "nadie", root).bytes, qint64(-1));
+
+    // Cambios avisados: suben por los antecesores sin recorrer nada
+    writeFile(root + "/a/b/tres.txt", 400);
+    index.fileChanged(root + "/a/b/tres.txt", -1, 400);
+    QVERIFY(index.totals(root, totals));
+    QCOMPARE(totals.bytes, qint64(1510));
+    QCOMPARE(totals.files, qint64(4));
+    QCOMPARE(index.headroom(root + "/a/x", "usuario", root).bytes, qint64(0));
+
+    QVERIFY(QDir(root + "/a/b").removeRecursively());
+    index.directoryRemoved(root + "/a/b");
+    QVERIFY(index.totals(root + "/a", totals));
+    QCOMPARE(totals.bytes, qint64(100));
+    QCOMPARE(totals.dirs, qint64(0));
+    QVERIFY(!index.totals(root + "/a/b", totals));
+
+    // MKD con niveles intermedios: se recorren en segundo plano
+    QDir().mkpath(root + "/c/d");
+    writeFile(root + "/c/d/cuatro.txt", 7);
+    index.refresh(root + "/c/d");
+    QTRY_VERIFY_WITH_TIMEOUT(index.totals(root + "/c", totals) && totals.bytes == 7, 5000);
+    QVERIFY(index.totals(root, totals));
+    QCOMPARE(totals.bytes, qint64(117));
+    QCOMPARE(totals.dirs, qint64(3));
+
+    index.setQuotas({}, {});
+    index.configure(false, root);
+    QDir(root).removeRecursively();
+}
+
+void TestGestorFTP::testPathResolver()
+{
+    QString base = testDir + "/resolucion";
+    QString root = base + "/ftp";
+    QDir().mkpath(root + "/docs/sub");
+    QDir().mkpath(base + "/ftp2");
+    QFile file(root + "/docs/leeme.txt");
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.close();
+
+    // Prefijo de cadena no es lo mismo que estar dentro
+    QVERIFY(PathResolver::isInside(root, root));
+    QVERIFY(PathResolver::isInside(root, root + "/docs"));
+    QVERIFY(!PathResolver::isInside(root, base + "/ftp2"));
+    QVERIFY(!PathResolver::isInside(root, base));
+
+    // ".." no pasa de la raíz virtual
+    QCOMPARE(PathResolver::normalize("leeme.txt", "/docs"), QString("/docs/leeme.txt"));
+    QCOMPARE(PathResolver::normalize("/docs/sub", "/docs"), QString("/docs/sub"));
+    QCOMPARE(PathResolver::normalize("../docs/./sub/..", "/docs"), QString("/docs"));
+    QVERIFY(PathResolver::normalize("../../ftp2", "/docs").isEmpty());
+    QVERIFY(PathResolver::normalize("/../ftp2", "/docs").isEmpty());
+
+    PathResolver resolver;
+    resolver.sync(root, root + "/docs");
+    PathResolver::Kind kind;
+    QVERIFY(resolver.inspect(root, root + "/docs/leeme.txt", kind));
+    QCOMPARE(kind, PathResolver::Kind::File);
+    QVERIFY(resolver.inspect(root, root + "/docs/sub", kind));
+    QCOMPARE(kind, PathResolver::Kind::Directory);
+    // Destino nuevo, con niveles intermedios que tampoco existen (MKD a/b/c)
+    QVERIFY(resolver.inspect(root, root + "/docs/nuevo/otro", kind));
+    QCOMPARE(kind, PathResolver::Kind::Missing);
+    QVERIFY(!resolver.inspect(root, base + "/ftp2", kind));
+    // Otro montaje
+    QVERIFY(resolver.inspect(base + "/ftp2", base + "/ftp2", kind));
+    QCOMPARE(kind, PathResolver::Kind::Directory);
+
+#ifndef Q_OS_WIN
+    // Enlaces que salen de la raíz: ni se siguen ni sirven de destino
+    QVERIFY(QFile::link(base + "/ftp2", root + "/fuera"));
+    QVERIFY(QFile::link(base + "/no-existe", root + "/roto"));
+    QVERIFY(QFile::link("sub", root + "/docs/atajo"));
+    QVERIFY(!resolver.inspect(root, root + "/fuera", kind));
+    QVERIFY(!resolver.inspect(root, root + "/fuera/x.txt", kind));
+    QVERIFY(!resolver.inspect(root, root + "/roto", kind));
+    // Un enlace relativo que no sale de la raíz sigue valiendo
+    QVERIFY(resolver.inspect(root, root + "/docs/atajo", kind));
+    QCOMPARE(kind, PathResolver::Kind::Directory);
+#endif
+
+    QDir(base).removeRecursively();
+}
+
+void TestGestorFTP::testVfs()
+{
+    QString base = testDir + "/vfs";
+    QDir().mkpath(base + "/raiz/docs");
+    QDir().mkpath(base + "/volumen/sub");
+    QFile file(base + "/volumen/sub/a.txt");
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("hola");
+    file.close();
+
+    Vfs &vfs = Vfs::instance();
+    vfs.setRoot(base + "/raiz");
+    QVERIFY(vfs.mount("/media/videos", std::make_shared<LocalVfsBackend>(base + "/volumen")));
+    // El punto de montaje aparece como carpeta en su padre
+    QVERIFY(QFileInfo(base + "/raiz/media/videos").isDir());
+
+    // Gana el montaje más profundo que contiene la ruta
+    Vfs::Target target = vfs.resolve("/docs/x.txt");
+    QCOMPARE(target.mountPoint, QString("/"));
+    QCOMPARE(target.path, QString("docs/x.txt"));
+    QCOMPARE(target.local, base + "/raiz/docs/x.txt");
+    target = vfs.resolve("/media/videos/sub/a.txt");
+    QCOMPARE(target.mountPoint, QString("/media/videos"));
+    QCOMPARE(target.path, QString("sub/a.txt"));
+    QCOMPARE(target.local, base + "/volumen/sub/a.txt");
+    target = vfs.resolve("/media/videos");
+    QVERIFY(target.path.isEmpty());
+    QCOMPARE(target.local, base + "/volumen");
+    QCOMPARE(vfs.resolve("/media/videos2").mountPoint, QString("/"));
+
+    QCOMPARE(vfs.virtualPathOf(base + "/volumen/sub"), QString("/media/videos/sub"));
+    QCOMPARE(vfs.virtualPathOf(base + "/raiz"), QString("/"));
+    QVERIFY(vfs.virtualPathOf(base).isEmpty());
+
+    // Operaciones del backend local
+    VfsBackend &backend = *vfs.resolve("/media/videos").backend;
+    VfsBackend::Entry entry;
+    QVERIFY(backend.stat("sub/a.txt", entry));
+    QCOMPARE(entry.size, qint64(4));
+    QVERIFY(backend.mkdir("nueva/honda"));
+    QVERIFY(backend.rename("sub/a.txt", "nueva/b.txt"));
+    std::unique_ptr<VfsBackend::Lister> lister = backend.list("nueva");
+    QVERIFY(lister);
+    std::vector<VfsBackend::NamedEntry> entries;
+    QCOMPARE(lister->next(entries, 100), 2);
+    QCOMPARE(lister->next(entries, 100), 0);
+    std::unique_ptr<VfsBackend::Source> source = backend.openSource("nueva/b.txt");
+    QVERIFY(source);
+    const char *data = nullptr;
+    QCOMPARE(source->map(0, 100, &data), qint64(4));
+    QCOMPARE(QByteArray(data, 4), QByteArray("hola"));
+    source.reset();
+    QVERIFY(backend.unlink("nueva/b.txt"));
+    QVERIFY(backend.rmdir("nueva"));
+    QVERIFY(!backend.rmdir(""));
+
+    QVERIFY(vfs.unmount("/media/videos"));
+    QCOMPARE(vfs.resolve("/media/videos/sub").mountPoint, QString("/"));
+    QVERIFY(!vfs.unmount("/"));
+
+    vfs.setRoot(testDir);
+    QDir(base).removeRecursively();
+}
+
+void TestGestorFTP::testMemoryVfs()
+{
+    MemoryVfsBackend::Spec spec;
+    QVERIFY(MemoryVfsBackend::parseSpec("mem:dirs=3,depth=2,files=1000000,size=3M,pattern=pattern,store=1K", spec));
+    QCOMPARE(spec.dirs, quint64(3));
+    QCOMPARE(spec.fileSize, qint64(3 * 1024 * 1024));
+    QVERIFY(!MemoryVfsBackend::parseSpec("mem:files=muchos", spec));
+    auto backend = MemoryVfsBackend::fromSpec("mem:dirs=3,depth=2,files=1000000,size=3M,pattern=pattern,store=1K");
+    QVERIFY(backend);
+
+    // El árbol sintético se calcula a partir del nombre
+    VfsBackend::Entry entry;
+    QVERIFY(backend->stat("d2/d0", entry) && entry.isDir);
+    QVERIFY(backend->stat("d2/d0/f999999.bin", entry) && !entry.isDir);
+    QCOMPARE(entry.size, qint64(3 * 1024 * 1024));
+    QVERIFY(!backend->stat("d2/d0/d0", entry));      // Más allá de la profundidad
+    QVERIFY(!backend->stat("d3", entry));
+    QVERIFY(!backend->stat("f1000000.bin", entry));
+    QVERIFY(!backend->stat("f01.bin", entry));
+
+    // Un millón de entradas por tandas, sin construir el directorio
+    std::unique_ptr<VfsBackend::Lister> lister = backend->list("d1");
+    QVERIFY(lister);
+    std::vector<VfsBackend::NamedEntry> entries;
+    QCOMPARE(lister->next(entries, 5), 5);
+    QCOMPARE(entries[0].name, QByteArray("d0"));
+    QCOMPARE(entries[3].name, QByteArray("f0.bin"));
+    qint64 total = 5;
+    int added;
+    while ((added = lister->next(entries, 65536)) > 0) {
+        total += added;
+        entries.clear();
+    }
+    QCOMPARE(total, qint64(3 + 1000000));
+
+    // Datos al vuelo: el patrón sigue el desplazamiento absoluto
+    std::unique_ptr<VfsBackend::Source> source = backend->openSource("f7.bin");
+    QVERIFY(source);
+    QCOMPARE(source->size(), qint64(3 * 1024 * 1024));
+    const char *data = nullptr;
+    QVERIFY(source->map(1000, 4096, &data) == 4096);
+    QCOMPARE(quint8(data[0]), quint8(1000 % 251));
+    QCOMPARE(quint8(data[300]), quint8(1300 % 251));
+
+    // Capa escribible: lo subido se guarda hasta el presupuesto
+    std::unique_ptr<VfsBackend::Sink> sink = backend->openSink("d0/subido.txt", 0);
+    QVERIFY(sink);
+    QCOMPARE(sink->write("hola", 4), qint64(4));
+    QVERIFY(sink->finish());
+    source = backend->openSource("d0/subido.txt");
+    QCOMPARE(source->map(0, 100, &data), qint64(4));
+    QCOMPARE(QByteArray(data, 4), QByteArray("hola"));
+    sink = backend->openSink("grande.bin", 0);
+    const QByteArray block(2048, 'x');
+    QCOMPARE(sink->write(block.constData(), block.size()), qint64(block.size()));
+    QVERIFY(backend->storedBytes() <= 1024);
+    QVERIFY(backend->stat("grande.bin", entry));
+    QCOMPARE(entry.size, qint64(2048));
+
+    // Borrar, crear y renombrar sobre el árbol sintético
+    QVERIFY(backend->unlink("d0/f5.bin"));
+    QVERIFY(!backend->stat("d0/f5.bin", entry));
+    QVERIFY(backend->rmdir("d1"));
+    QVERIFY(!backend->stat("d1/d2/f0.bin", entry));
+    QVERIFY(backend->mkdir("d1/nueva"));
+    QVERIFY(backend->stat("d1/nueva", entry) && entry.isDir);
+    QVERIFY(!backend->stat("d1/f0.bin", entry));     // El contenido sintético sigue borrado
+    QVERIFY(backend->rename("d0/f6.bin", "d1/nueva/movido.bin"));
+    QVERIFY(backend->stat("d1/nueva/movido.bin", entry));
+    QCOMPARE(entry.size, qint64(3 * 1024 * 1024));
+    QVERIFY(!backend->stat("d0/f6.bin", entry));
+    QVERIFY(!backend->rename("d2", "otro"));          // Directorio sintético
+    QVERIFY(backend->rename("d1/nueva", "renombrada"));
+    QVERIFY(backend->stat("renombrada/movido.bin", entry));
+
+    // Montado como raíz, las rutas no tienen carpeta en disco
+    Vfs &vfs = Vfs::instance();
+    vfs.setRoot(testDir);
+    QVERIFY(vfs.setRootSource("mem:files=10"));
+    Vfs::Target target = vfs.resolve("/f3.bin");
+    QVERIFY(target.isVirtual());
+    QVERIFY(target.local.isEmpty());
+    QVERIFY(!vfs.setRootSource("mem:size=nada"));
+    QVERIFY(vfs.setRootSource(QString()));
+    QVERIFY(vfs.resolve("/").isLocal());
+    vfs.setRoot(testDir);
+}
+
+void TestGestorFTP::testUserRules()
+{
+    // Sin carpeta ni reglas: todo permitido y las rutas no cambian
+    const UserRules open;
+    QVERIFY(!open.confined());
+    QCOMPARE(open.serverPath("/docs"), QString("/docs"));
+    QVERIFY(open.allows("/docs/a.txt", UserRules::Delete));
+
+    QHash<QString, QString> rules;
+    rules.insert("/clientes/ana", "r");
+    rules.insert("/clientes/ana/subidas", "rwm");
+    rules.insert("/clientes/ana/subidas/cerrado", "-");
+    rules.insert("/clientes/ana/mal", "rx");        // Letra desconocida: sin permisos
+    const UserRules ana("/clientes/ana/", rules);
+    QVERIFY(ana.confined());
+    QCOMPARE(ana.home(), QString("/clientes/ana"));
+    QCOMPARE(ana.ruleCount(), 4);
+
+    // La carpeta personal es la raíz de la sesión
+    QCOMPARE(ana.serverPath("/"), QString("/clientes/ana"));
+    QCOMPARE(ana.serverPath("/subidas/x.bin"), QString("/clientes/ana/subidas/x.bin"));
+    QCOMPARE(ana.clientPath("/clientes/ana"), QString("/"));
+    QCOMPARE(ana.clientPath("/clientes/ana/subidas/"), QString("/subidas/"));
+    QVERIFY(ana.clientPath("/clientes/anabel/x").isEmpty());
+    QVERIFY(ana.clientPath("/otro").isEmpty());
+
+    // Manda la regla más cercana
+    QVERIFY(ana.allows("/", UserRules::Read));
+    QVERIFY(!ana.allows("/informe.pdf", UserRules::Write));
+    QVERIFY(ana.allows("/subidas/x.bin", UserRules::Write));
+    QVERIFY(ana.allows("/subidas", UserRules::Mkdir));
+    QVERIFY(!ana.allows("/subidas/x.bin", UserRules::Delete));
+    QVERIFY(!ana.allows("/subidas/cerrado/y.bin", UserRules::Read));
+    QVERIFY(ana.allows("/subidas/cerradosno", UserRules::Read));
+    QVERIFY(!ana.allows("/mal/z", UserRules::Read));
+
+    quint8 perms = 0;
+    QVERIFY(UserRules::parsePerms("RWdm", perms));
+    QCOMPARE(perms, quint8(UserRules::All));
+    QCOMPARE(UserRules::permsString(UserRules::Read | UserRules::Delete), QString("rd"));
+    QVERIFY(UserRules::parsePerms("-", perms) && perms == 0);
+    QVERIFY(!UserRules::parsePerms("", perms));
+
+    // Lo guardado en la base de datos se compila al iniciar sesión
+    QVERIFY(dbManager->addUser("rulesuser", "rulespass"));
+    QVERIFY(dbManager->setUserHome("rulesuser", "/clientes/rules"));
+    QVERIFY(dbManager->setUserPermission("rulesuser", "/clientes/rules/ro", "r"));
+    QVERIFY(!dbManager->setUserHome("noexiste", "/x"));
+    std::shared_ptr<const UserRules> loaded = UserRules::load("rulesuser");
+    QCOMPARE(loaded->home(), QString("/clientes/rules"));
+    QVERIFY(!loaded->allows("/ro/a", UserRules::Write));
+    QVERIFY(loaded->allows("/otra/a", UserRules::Write));
+    QVERIFY(dbManager->removeUser("rulesuser"));
+    QCOMPARE(dbManager->getUserHome("rulesuser"), QString("/"));
+    QVERIFY(dbManager->getUserPermissions("rulesuser").isEmpty());
+}
+
+void TestGestorFTP::testFtpCommand()
+{
+    // Cada orden conocida ocupa su propia casilla
+    for (const FtpCommand::Entry &entry : FtpCommand::Commands) {
+        QCOMPARE(FtpCommand::lookup(entry.code).id, entry.id);
+    }
+    QCOMPARE(FtpCommand::verbCode("retr"), FtpCommand::verbCode("RETR"));
+    QCOMPARE(FtpCommand::verbCode("RETRY"), quint32(0));
+    QCOMPARE(FtpCommand::verbCode("R3TR"), quint32(0));
+
+    // Igual que trimmed() + section(' ', 0, 0).toUpper() + section(' ', 1)
+    const QByteArray raw = "  retr  mi archivo.txt \r\n";
+    FtpCommand::Line line;
+    FtpCommand::parse(raw.constData(), raw.size(), line);
+    QCOMPARE(FtpCommand::lookup(line.code).id, FtpCommand::Id::Retr);
+    QCOMPARE(QByteArray(line.arg, line.argLength), QByteArray(" mi archivo.txt"));
+    QVERIFY(line.arg >= raw.constData() && line.arg < raw.constData() + raw.size());   // Sin copia
+
+    FtpCommand::parse("PWD\r\n", 5, line);
+    QCOMPARE(FtpCommand::lookup(line.code).id, FtpCommand::Id::Pwd);
+    QCOMPARE(line.argLength, 0);
+    FtpCommand::parse("\r\n", 2, line);
+    QCOMPARE(FtpCommand::lookup(line.code).id, FtpCommand::Id::Unknown);
+    FtpCommand::parse("XYZW a", 6, line);
+    QCOMPARE(FtpCommand::lookup(line.code).id, FtpCommand::Id::Unknown);
+    QVERIFY(!(FtpCommand::lookup(line.code).flags & FtpCommand::BeforeLogin));
+    QVERIFY(FtpCommand::lookup(FtpCommand::verbCode("PASS")).flags & FtpCommand::BeforeLogin);
+    QCOMPARE(FtpCommand::lookup(FtpCommand::verbCode("allo")).id, FtpCommand::Id::Allo);
+}
+
 void TestGestorFTP::testPathValidation()
 {
     QString basePath = testDir;
@@ -176,6 +984,35 @@ void TestGestorFTP::testInvalidCommands()
     socket.disconnectFromHost();
 }
 
+void TestGestorFTP::testPipelinedReplies()
+{
+    QTcpSocket socket;
+    socket.connectToHost("localhost", 2121);
+    QVERIFY(socket.waitForConnected(1000));
+    QByteArray received;
+    while (!received.contains("\r\n") && socket.waitForReadyRead(1000)) {
+        received += socket.readAll();
+    }
+    QVERIFY(received.startsWith("220"));
+
+    // Dos órdenes en una sola escritura: las once líneas de respuesta salen juntas
+    const FtpClientHandler::ControlStats before = FtpClientHandler::controlStats();
+    socket.write("FEAT\r\nSYST\r\n");
+    QVERIFY(socket.waitForBytesWritten(1000));
+    received.clear();
+    while (received.count("\r\n") < 11 && socket.waitForReadyRead(1000)) {
+        received += socket.readAll();
+    }
+    const FtpClientHandler::ControlStats after = FtpClientHandler::controlStats();
+    QCOMPARE(received.count("\r\n"), qsizetype(11));
+    QVERIFY(received.indexOf("211 End") < received.indexOf("530"));   // En orden
+    QCOMPARE(after.replies - before.replies, quint64(11));
+    // Una escritura, o dos si las órdenes llegaron en lecturas distintas
+    QVERIFY(after.flushes - before.flushes <= 2);
+
+    socket.disconnectFromHost();
+}
+
 void TestGestorFTP::testMultipleConnections()
 {
     QList<QTcpSocket*> sockets;
@@ -235,6 +1072,76 @@ void TestGestorFTP::testSimultaneousTransfers()
     }
 }
 
+void TestGestorFTP::testIoSchedulerPriorities()
+{
+    IoScheduler &scheduler = IoScheduler::instance();
+    scheduler.configure(1, 1000, 1000, 1000);
+
+    QMutex orderMutex;
+    QStringList order;
+    auto waitFor = [&](IoScheduler::Kind kind, const QString &name) {
+        return std::thread([&, kind, name]() {
+            IoScheduler::Ticket ticket = scheduler.acquire("prueba", kind);
+            QMutexLocker locker(&orderMutex);
+            order << name;
+        });
+    };
+    auto queuedOn = [&](int expected) {
+        for (int i = 0; i < 500; ++i) {
+            for (const IoScheduler::DeviceStats &d : scheduler.stats().devices) {
+                if (d.device == "prueba" && d.queued == expected) {
+                    return true;
+                }
+            }
+            QThread::msleep(1);
+        }
+        return false;
+    };
+
+    // Con el único turno ocupado, la lectura que llega después pasa delante de la escritura
+    // (sin QVERIFY hasta unir los hilos)
+    IoScheduler::Ticket busy = scheduler.acquire("prueba", IoScheduler::Kind::Read);
+    std::thread writer = waitFor(IoScheduler::Kind::Write, "escritura");
+    bool queued = queuedOn(1);
+    std::thread reader = waitFor(IoScheduler::Kind::Read, "lectura");
+    queued = queuedOn(2) && queued;
+    busy.release();
+    writer.join();
+    reader.join();
+    QVERIFY(queued);
+    QCOMPARE(order, QStringList() << "lectura" << "escritura");
+
+    // Una escritura con el plazo vencido pasa delante de una lectura reciente
+    scheduler.configure(1, 1000, 1000, 1);
+    order.clear();
+    busy = scheduler.acquire("prueba", IoScheduler::Kind::Read);
+    writer = waitFor(IoScheduler::Kind::Write, "escritura");
+    queued = queuedOn(1);
+    QThread::msleep(5);
+    reader = waitFor(IoScheduler::Kind::Read, "lectura");
+    queued = queuedOn(2) && queued;
+    busy.release();
+    writer.join();
+    reader.join();
+    QVERIFY(queued);
+    QCOMPARE(order, QStringList() << "escritura" << "lectura");
+
+    // Consultar las estadísticas no borra la espera máxima (la escritura esperó más de 5 ms)
+    double maxWait[2] = {};
+    for (double &value : maxWait) {
+        for (const IoScheduler::DeviceStats &d : scheduler.stats().devices) {
+            if (d.device == "prueba") {
+                value = d.maxWaitMs;
+            }
+        }
+    }
+    QVERIFY(maxWait[0] >= 4.0);
+    QCOMPARE(maxWait[1], maxWait[0]);
+
+    scheduler.configure(IoScheduler::DefaultQueueDepth, IoScheduler::DefaultReadDeadlineMs,
+                        IoScheduler::DefaultMetadataDeadlineMs, IoScheduler::DefaultWriteDeadlineMs);
+}
+
 void TestGestorFTP::testPasswordHashing()
 {
     QString password = "testpass";
@@ -288,4 +1195,582 @@ void TestGestorFTP::testPathTraversal()
     }
 }
 
+void TestGestorFTP::testBufferPool()
+{
+    BufferPool &pool = BufferPool::instance();
+    BufferPool::Stats before = pool.stats();
+
+    // Los bloques prestados están alineados a página
+    BufferPool::Buffer buffer = pool.acquire();
+    QVERIFY(!buffer.isNull());
+    QCOMPARE(reinterpret_cast<quintptr>(buffer.data()) % BufferPool::Alignment, quintptr(0));
+    QCOMPARE(pool.stats().inUse, before.inUse + 1);
+
+    // Al devolverlo, el siguiente préstamo del mismo hilo sale de la caché por hilo
+    char *first = buffer.data();
+    buffer.reset();
+    QCOMPARE(pool.stats().inUse, before.inUse);
+    BufferPool::Buffer again = pool.acquire();
+    QCOMPARE(again.data(), first);
+    QVERIFY(pool.stats().threadCacheHits > before.threadCacheHits);
+
+    // El tope global nunca se supera
+    std::vector<BufferPool::Buffer> held;
+    for (int i = 0; i < pool.stats().maxBlocks + 1; ++i) {
+        BufferPool::Buffer next = pool.acquire();
+        if (next.isNull()) {
+            break;
+        }
+        held.push_back(std::move(next));
+    }
+    QVERIFY(pool.stats().allocatedBlocks <= pool.stats().maxBlocks);
+    QVERIFY(pool.acquire().isNull());
+    QVERIFY(pool.stats().exhausted > before.exhausted);
+}
+
+void TestGestorFTP::testHotFileCache()
+{
+    HotFileCache &cache = HotFileCache::instance();
+    cache.clear();
+    cache.configure(1024 * 1024, 64 * 1024);
+
+    QString path = testDir + "/popular.txt";
+    QFile f(path);
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write("version 1");
+    f.close();
+
+    // La primera petición solo lo anota; la segunda lo carga
+    QByteArray data;
+    QVERIFY(!cache.fetch(path, data));
+    QVERIFY(cache.fetch(path, data));
+    QCOMPARE(data, QByteArray("version 1"));
+    quint64 hitsBefore = cache.stats().hits;
+    QVERIFY(cache.fetch(path, data));
+    QCOMPARE(cache.stats().hits, hitsBefore + 1);
+
+    // Un archivo modificado cambia de clave y no se sirve el contenido viejo
+    QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    f.write("version 2 más larga");
+    f.close();
+    data.clear();
+    QVERIFY(!cache.fetch(path, data));
+    QVERIFY(data.isEmpty());
+
+    QFile::remove(path);
+    cache.clear();
+    cache.configure(HotFileCache::DefaultCapacity, HotFileCache::DefaultMaxFileSize);
+}
+
+void TestGestorFTP::testSharedFileReader()
+{
+    SharedReadRegistry &registry = SharedReadRegistry::instance();
+    registry.setMinFileSize(1);
+
+    QString path = testDir + "/compartido.bin";
+    QByteArray content(2 * SharedFileReader::BlockSize + 100, 'x');
+    content[SharedFileReader::BlockSize] = 'y';
+    QFile f(path);
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write(content);
+    f.close();
+
+    const quint64 readBefore = registry.stats().storageBytes;
+    auto first = registry.subscribe(path);
+    auto second = registry.subscribe(path);
+    QVERIFY(first && second);
+    QCOMPARE(registry.stats().activeReaders, 1);
+    QCOMPARE(registry.stats().subscribers, 2);
+
+    // Ambos reciben los mismos bloques, pero el disco solo se lee una vez
+    QByteArray block;
+    for (qint64 index = 0; index < 3; ++index) {
+        QVERIFY(first->block(index, block));
+        QCOMPARE(block, content.mid(index * SharedFileReader::BlockSize, SharedFileReader::BlockSize));
+        QVERIFY(second->block(index, block));
+        QCOMPARE(block, content.mid(index * SharedFileReader::BlockSize, SharedFileReader::BlockSize));
+    }
+    QCOMPARE(registry.stats().storageBytes - readBefore, quint64(content.size()));
+
+    first.reset();
+    second.reset();
+    QCOMPARE(registry.stats().activeReaders, 0);
+
+    // Una lectura corta no se guarda: todos se desenganchan y leen por su cuenta
+    first = registry.subscribe(path);
+    second = registry.subscribe(path);
+    QVERIFY(first && second);
+    QVERIFY(QFile::resize(path, 2 * SharedFileReader::BlockSize));
+    QVERIFY(!first->block(2, block));
+    QVERIFY(!second->block(0, block));
+    first.reset();
+    second.reset();
+
+    QFile::remove(path);
+    registry.setMinFileSize(SharedReadRegistry::DefaultMinFileSize);
+}
+
+void TestGestorFTP::testReadAheadWindow()
+{
+    ReadAheadManager &manager = ReadAheadManager::instance();
+    const qint64 window = 1024 * 1024;
+    const qint64 budget = window + window / 2;
+    manager.configure(budget, window);
+    QCOMPARE(manager.stats().reservedBytes, qint64(0));
+
+    const QString path = testDir + "/lectura_anticipada.bin";
+    QFile f(path);
+    QVERIFY(f.open(QIODevice::ReadWrite));
+    QVERIFY(f.resize(16 * window));
+
+    // Empieza con la ventana mínima y crece con la velocidad del cliente, hasta la máxima
+    ReadAheadWindow fast;
+    fast.start(f.handle(), path, f.size());
+    QCOMPARE(fast.window(), ReadAheadManager::MinWindow);
+    QThread::msleep(300);
+    fast.consumed(8 * window, 8 * window);
+    QCOMPARE(fast.window(), window);
+
+    // La segunda solo obtiene lo que queda del presupuesto global
+    const quint64 limitedBefore = manager.stats().budgetLimited;
+    ReadAheadWindow second;
+    second.start(f.handle(), path, f.size());
+    QThread::msleep(300);
+    second.consumed(8 * window, 8 * window);
+    QCOMPARE(second.window(), budget - window);
+    QCOMPARE(manager.stats().reservedBytes, budget);
+    QVERIFY(manager.stats().budgetLimited > limitedBefore);
+
+    // stop() devuelve la ventana al presupuesto
+    fast.stop();
+    QCOMPARE(manager.stats().reservedBytes, budget - window);
+    QVERIFY(!fast.isActive());
+    second.stop();
+    QCOMPARE(manager.stats().reservedBytes, qint64(0));
+
+    f.close();
+    QFile::remove(path);
+    manager.configure(ReadAheadManager::DefaultBudget, ReadAheadManager::DefaultMaxWindow);
+}
+
+void TestGestorFTP::testHandshakeScheduler()
+{
+    TlsHandshakeScheduler &scheduler = TlsHandshakeScheduler::instance();
+    scheduler.configure(1, 10, 100);
+    const quint64 timedOutBefore = scheduler.stats().timedOut;
+
+    // Con un solo turno ocupado, el siguiente espera y agota el tiempo
+    quint64 first = scheduler.acquireBlocking(100);
+    QVERIFY(first != 0);
+    QCOMPARE(scheduler.acquireBlocking(100), quint64(0));
+    QCOMPARE(scheduler.stats().timedOut, timedOutBefore + 1);
+
+    // Al liberar, el turno vuelve a estar disponible
+    scheduler.release(first);
+    quint64 second = scheduler.acquireBlocking(100);
+    QVERIFY(second != 0);
+    QCOMPARE(scheduler.stats().active, 1);
+    scheduler.release(second);
+    QCOMPARE(scheduler.stats().active, 0);
+    QVERIFY(scheduler.stats().handshake.samples >= 2);
+
+    // Una conexión de datos (espera bloqueante) adelanta a los AUTH en cola
+    quint64 held = scheduler.acquireBlocking(100);
+    QObject context;
+    bool controlGranted = false;
+    quint64 control = scheduler.request(&context, [&controlGranted]() { controlGranted = true; });
+    QVERIFY(control != 0);
+    std::atomic<quint64> data{0};
+    std::thread dataThread([&scheduler, &data]() { data = scheduler.acquireBlocking(2000); });
+    QTRY_COMPARE(scheduler.stats().queued, 2);
+    scheduler.release(held);
+    dataThread.join();
+    QVERIFY(data != 0);
+    QCoreApplication::processEvents();
+    QVERIFY(!controlGranted);
+    scheduler.release(data);
+    QTRY_VERIFY(controlGranted);
+    scheduler.release(control);
+    QCOMPARE(scheduler.stats().active, 0);
+
+    scheduler.configure(0, 1000, 10000);
+}
+
+void TestGestorFTP::testTlsSessionCache()
+{
+#ifndef HAVE_SSL
+    QSKIP("Compilado sin soporte SSL");
+#else
+    TlsSessionCache &cache = TlsSessionCache::instance();
+    const QHostAddress client("127.0.0.1");
+    const QSslConfiguration negotiated = QSslConfiguration::defaultConfiguration();
+    QSslConfiguration config;
+
+    cache.storeControlSession("prueba-cache", client, negotiated, 5);
+    QVERIFY(cache.lookupForData("prueba-cache", client, config));
+    QCOMPARE(config.protocol(), negotiated.protocol());
+
+    // Otra dirección no puede usar la sesión, y una sesión desconocida no existe
+    const quint64 mismatches = cache.stats().peerMismatches;
+    QVERIFY(!cache.lookupForData("prueba-cache", QHostAddress("10.0.0.9"), config));
+    QCOMPARE(cache.stats().peerMismatches, mismatches + 1);
+    QVERIFY(!cache.lookupForData("otra-sesion", client, config));
+
+    // Con el registro lleno no se admiten sesiones nuevas, pero las vivas no se expulsan
+    cache.setCapacity(cache.stats().entries);
+    QVERIFY(!cache.hasRoom());
+    cache.storeControlSession("prueba-cache-2", client, negotiated, 5);
+    QVERIFY(cache.lookupForData("prueba-cache", client, config));
+    cache.removeSession("prueba-cache-2");
+
+    // Solo al cerrar el canal de control la entrada desaparece
+    cache.removeSession("prueba-cache");
+    QVERIFY(!cache.lookupForData("prueba-cache", client, config));
+    QVERIFY(cache.hasRoom());
+    cache.setCapacity(10000);
+#endif
+}
+
+void TestGestorFTP::testTarRoundTrip()
+{
+    // Origen: un archivo pequeño, uno grande (lectura directa) y un nombre de más de 100 bytes
+    QString source = testDir + "/tar_origen";
+    QString longName = QString("sub/") + QString(120, 'n') + ".txt";
+    QDir(source).mkpath("sub");
+    QByteArray small("contenido pequeño");
+    QByteArray large(TarBatchStream::Limits().smallFileLimit + 12345, 'x');
+    QFile f1(source + "/small.txt");
+    QVERIFY(f1.open(QIODevice::WriteOnly));
+    f1.write(small);
+    f1.close();
+    QFile f2(source + "/" + longName);
+    QVERIFY(f2.open(QIODevice::WriteOnly));
+    f2.write(large);
+    f2.close();
+
+    QList<TarBatchStream::Entry> entries;
+    for (const QString &name : {QString("small.txt"), longName}) {
+        QFileInfo info(source + "/" + name);
+        TarBatchStream::Entry entry;
+        entry.absolutePath = info.absoluteFilePath();
+        entry.archiveName = name;
+        entry.size = info.size();
+        entry.mtime = info.lastModified().toSecsSinceEpoch();
+        entry.permissions = info.permissions();
+        entries.append(entry);
+    }
+
+    // Generar el tar completo; las lecturas anticipadas avisan por el bucle de eventos
+    QObject context;
+    TarBatchStream stream(entries, TarBatchStream::Limits(), &context, []() {});
+    QByteArray archive;
+    QByteArray chunk(64 * 1024, '\0');
+    while (!stream.atEnd()) {
+        qint64 produced = stream.read(chunk.data(), chunk.size());
+        if (produced == 0) {
+            QTest::qWait(1);
+            continue;
+        }
+        archive.append(chunk.constData(), produced);
+    }
+    QCOMPARE(archive.size() % TarFormat::BlockSize, 0);
+
+    // Extraerlo en otra carpeta, en trozos irregulares como llegarían por la red
+    QString target = testDir + "/tar_destino";
+    QDir(target).mkpath(".");
+    TarExtractor extractor([target](const QString &name, bool) {
+        return name.contains("..") ? QString() : QDir::cleanPath(target + "/" + name);
+    });
+    for (qsizetype pos = 0; pos < archive.size(); pos += 7001) {
+        QVERIFY(extractor.feed(archive.constData() + pos, qMin<qsizetype>(7001, archive.size() - pos)));
+    }
+    TarExtractor::Result result = extractor.finish();
+    QVERIFY(result.complete);
+    QCOMPARE(result.files, 2);
+    QCOMPARE(result.errors, 0);
+
+    QFile r1(target + "/small.txt");
+    QVERIFY(r1.open(QIODevice::ReadOnly));
+    QCOMPARE(r1.readAll(), small);
+    QFile r2(target + "/" + longName);
+    QVERIFY(r2.open(QIODevice::ReadOnly));
+    QCOMPARE(r2.readAll(), large);
+
+    QDir(source).removeRecursively();
+    QDir(target).removeRecursively();
+}
+
 QTEST_MAIN(TestGestorFTP)
+
+void TestGestorFTP::testDirectIoRoundTrip()
+{
+    QString path = testDir + "/directo.bin";
+    QByteArray content(3 * BufferPool::instance().blockSize() + 123, Qt::Uninitialized);
+    for (int i = 0; i < content.size(); ++i) {
+        content[i] = char(i * 31 + 7);
+    }
+
+    DirectFileWriter writer(DirectIoPolicy::DefaultQueueDepth);
+    if (!writer.open(path)) {
+        QSKIP("El sistema de archivos de pruebas no admite O_DIRECT");
+    }
+    // Trozos de tamaño irregular, como llegan del socket
+    for (qint64 offset = 0; offset < content.size(); offset += 10000) {
+        QVERIFY(writer.write(content.constData() + offset, qMin<qint64>(10000, content.size() - offset)));
+    }
+    QVERIFY(writer.finish());
+
+    QFile f(path);
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QCOMPARE(f.readAll(), content); // Sin el relleno de alineación
+    f.close();
+
+    // Lectura directa, en orden aunque las lecturas terminen desordenadas
+    DirectFileReader reader(nullptr, {});
+    QVERIFY(reader.open(path, content.size()));
+    QByteArray readBack;
+    while (readBack.size() < content.size()) {
+        BufferPool::Buffer buffer;
+        qint64 length = 0;
+        DirectFileReader::Status status = reader.next(buffer, length);
+        QVERIFY(status != DirectFileReader::Status::Failed);
+        if (status == DirectFileReader::Status::Ready) {
+            readBack.append(buffer.data(), length);
+        } else {
+            QThread::msleep(1);
+        }
+    }
+    QCOMPARE(readBack, content);
+
+    // Continuar sin caché un archivo empezado con escritura normal (umbral de STOR)
+    QVERIFY(f.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    f.write(content.left(5000));
+    f.close();
+    DirectFileWriter resumed(DirectIoPolicy::DefaultQueueDepth);
+    QVERIFY(resumed.open(path, 5000));
+    QVERIFY(resumed.write(content.constData() + 5000, content.size() - 5000));
+    QVERIFY(resumed.finish());
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QCOMPARE(f.readAll(), content);
+    f.close();
+
+    QFile::remove(path);
+}
+
+void TestGestorFTP::testZeroCopySend()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("sendfile() solo se usa en Linux");
+#else
+    QTcpServer listener;
+    QVERIFY(listener.listen(QHostAddress::LocalHost));
+    QTcpSocket client;
+    client.connectToHost(QHostAddress::LocalHost, listener.serverPort());
+    QVERIFY(client.waitForConnected(3000));
+    QVERIFY(listener.waitForNewConnection(3000));
+    QTcpSocket *sender = listener.nextPendingConnection();
+    QVERIFY(sender);
+
+    QTcpSocket unconnected;
+    QVERIFY(!ZeroCopySend::canSendFileDirectly(&unconnected));
+    QVERIFY(ZeroCopySend::canSendFileDirectly(sender));
+
+    // Más grande que el buffer del socket para pasar por el caso "lleno" (0)
+    const QString path = testDir + "/sendfile.bin";
+    QByteArray content(8 * 1024 * 1024 + 321, Qt::Uninitialized);
+    for (int i = 0; i < content.size(); ++i) {
+        content[i] = char(i * 13 + 5);
+    }
+    QFile source(path);
+    QVERIFY(source.open(QIODevice::WriteOnly));
+    QCOMPARE(source.write(content), qint64(content.size()));
+    source.close();
+    QVERIFY(source.open(QIODevice::ReadOnly));
+
+    QByteArray received;
+    qint64 offset = 0;
+    bool sawFull = false;
+    QElapsedTimer timer;
+    timer.start();
+    while (received.size() < content.size() && timer.elapsed() < 10000) {
+        if (offset < content.size()) {
+            const qint64 sent = ZeroCopySend::sendFile(sender->socketDescriptor(), source.handle(),
+                                                       offset, content.size() - offset);
+            QVERIFY(sent >= 0);
+            sawFull = sawFull || sent == 0;
+            offset += sent;
+        }
+        client.waitForReadyRead(10);
+        received += client.readAll();
+    }
+    QCOMPARE(offset, qint64(content.size()));
+    QCOMPARE(received, content);
+    QVERIFY(sawFull);
+
+    source.close();
+    QFile::remove(path);
+#endif
+}
+
+void TestGestorFTP::benchmarkSmallFilesDuringBulk_data()
+{
+    QTest::addColumn<bool>("direct");
+    QTest::newRow("cache-de-paginas") << false;
+    QTest::newRow("o_direct") << true;
+}
+
+void TestGestorFTP::benchmarkSmallFilesDuringBulk()
+{
+    // Lecturas de archivos pequeños mientras otro hilo lee en bucle un archivo enorme.
+    // El tamaño se ajusta con GESTOR_BENCH_BULK_MB: el efecto se ve cuando supera la RAM libre.
+    QFETCH(bool, direct);
+    const qint64 bulkSize = qEnvironmentVariableIntValue("GESTOR_BENCH_BULK_MB") > 0
+                                ? qEnvironmentVariableIntValue("GESTOR_BENCH_BULK_MB") * 1024LL * 1024
+                                : 64LL * 1024 * 1024;
+
+    const QString bulkPath = testDir + "/bulk.bin";
+    {
+        QFile bulk(bulkPath);
+        QVERIFY(bulk.open(QIODevice::WriteOnly));
+        const QByteArray chunk(1024 * 1024, 'b');
+        for (qint64 written = 0; written < bulkSize; written += chunk.size()) {
+            bulk.write(chunk);
+        }
+    }
+    if (direct) {
+        DirectFileReader probe(nullptr, {});
+        if (!probe.open(bulkPath, bulkSize)) {
+            QFile::remove(bulkPath);
+            QSKIP("El sistema de archivos de pruebas no admite O_DIRECT");
+        }
+    }
+
+    QStringList smallFiles;
+    const QByteArray smallContent(16 * 1024, 's');
+    QDir().mkpath(testDir + "/pequenos");
+    for (int i = 0; i < 256; ++i) {
+        QString path = QString("%1/pequenos/%2.dat").arg(testDir).arg(i);
+        QFile small(path);
+        QVERIFY(small.open(QIODevice::WriteOnly));
+        small.write(smallContent);
+        smallFiles << path;
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<qint64> bulkBytes{0};
+    std::thread bulkReader([&]() {
+        while (!stop.load()) {
+            if (direct) {
+                DirectFileReader reader(nullptr, {});
+                if (!reader.open(bulkPath, bulkSize)) {
+                    return;
+                }
+                for (qint64 done = 0; done < bulkSize && !stop.load();) {
+                    BufferPool::Buffer buffer;
+                    qint64 length = 0;
+                    DirectFileReader::Status status = reader.next(buffer, length);
+                    if (status == DirectFileReader::Status::Failed) {
+                        return;
+                    }
+                    if (status == DirectFileReader::Status::Ready) {
+                        done += length;
+                        bulkBytes += length;
+                    } else {
+                        QThread::usleep(200);
+                    }
+                }
+            } else {
+                QFile bulk(bulkPath);
+                if (!bulk.open(QIODevice::ReadOnly)) {
+                    return;
+                }
+                QByteArray chunk(1024 * 1024, Qt::Uninitialized);
+                qint64 n;
+                while (!stop.load() && (n = bulk.read(chunk.data(), chunk.size())) > 0) {
+                    bulkBytes += n;
+                }
+            }
+        }
+    });
+
+    // Sin QVERIFY dentro del bucle: un retorno anticipado dejaría el hilo sin unir
+    QByteArray buffer(smallContent.size(), Qt::Uninitialized);
+    int failedReads = 0;
+    QBENCHMARK {
+        for (const QString &path : smallFiles) {
+            QFile small(path);
+            if (!small.open(QIODevice::ReadOnly) || small.read(buffer.data(), buffer.size()) != smallContent.size()) {
+                failedReads++;
+            }
+        }
+    }
+
+    stop.store(true);
+    bulkReader.join();
+    QCOMPARE(failedReads, 0);
+    qInfo() << "Lectura masiva concurrente:" << bulkBytes.load() / (1024 * 1024) << "MB"
+            << (direct ? "con O_DIRECT" : "por la caché de páginas");
+
+    QDir(testDir + "/pequenos").removeRecursively();
+    QFile::remove(bulkPath);
+}
+
+void TestGestorFTP::benchmarkCommandDispatch_data()
+{
+    QTest::addColumn<bool>("table");
+    QTest::newRow("cadenas-y-comparaciones") << false;
+    QTest::newRow("tabla-hash-perfecta") << true;
+}
+
+void TestGestorFTP::benchmarkCommandDispatch()
+{
+    // Una sesión típica de sincronización: muchas órdenes cortas con y sin argumento.
+    // Cada vuelta analiza y despacha las 16 líneas; al final se muestran órdenes por segundo.
+    QFETCH(bool, table);
+    const QList<QByteArray> lines = {
+        "CWD /proyectos/cliente\r\n", "PWD\r\n", "TYPE I\r\n", "PASV\r\n", "MLSD\r\n",
+        "SIZE informe final.pdf\r\n", "MDTM informe final.pdf\r\n", "RETR informe final.pdf\r\n",
+        "STOR nuevo.bin\r\n", "MKD carpeta\r\n", "RNFR a.txt\r\n", "RNTO b.txt\r\n",
+        "DELE b.txt\r\n", "CDUP\r\n", "NOOP\r\n", "OPTS UTF8 ON\r\n"};
+
+    // Lo que hacía processCommand antes: QString de la línea, section(), toUpper() y la cadena de if
+    static const char *const legacyVerbs[] = {
+        "USER", "PASS", "QUIT", "FEAT", "TYPE", "PWD", "CWD", "CDUP", "LIST", "NLST", "MLSD", "MLST",
+        "SIZE", "MDTM", "RETR", "STOR", "RMD", "DELE", "MKD", "XMKD", "RNFR", "RNTO", "PORT", "PASV",
+        "SYST", "AUTH", "PBSZ", "PROT", "SITE", "OPTS"};
+
+    qint64 checksum = 0;
+    qint64 dispatched = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        for (const QByteArray &raw : lines) {
+            int id = 0;
+            qsizetype argLength = 0;
+            if (table) {
+                FtpCommand::Line line;
+                FtpCommand::parse(raw.constData(), int(raw.size()), line);
+                id = int(FtpCommand::lookup(line.code).id);
+                const QString arg = line.argLength > 0 ? QString::fromUtf8(line.arg, line.argLength) : QString();
+                argLength = arg.size();
+            } else {
+                const QString text = QString::fromUtf8(raw).trimmed();
+                const QString command = text.section(' ', 0, 0).toUpper();
+                const QString arg = text.section(' ', 1);
+                for (int i = 0; i < int(sizeof(legacyVerbs) / sizeof(legacyVerbs[0])); ++i) {
+                    if (command == QLatin1String(legacyVerbs[i])) {
+                        id = i + 1;
+                        break;
+                    }
+                }
+                argLength = arg.size();
+            }
+            checksum += id + argLength;
+            ++dispatched;
+        }
+    }
+    const qint64 elapsedNs = qMax<qint64>(1, timer.nsecsElapsed());
+    QVERIFY(checksum > 0);
+    qInfo() << (table ? "Tabla hash perfecta:" : "Cadenas y comparaciones:")
+            << qint64(dispatched * 1e9 / elapsedNs) << "órdenes/s";
+}
@@ -6,6 +6,29 @@
 #include "../DatabaseManager.h"
 #include "../FtpServer.h"
 #include "../FtpClientHandler.h"
+#include "../BufferPool.h"
+#include "../TlsHandshakeScheduler.h"
+#include "../TlsSessionCache.h"
+#include "../TarBatchStream.h"
+#include "../TarExtractor.h"
+#include "../HotFileCache.h"
+#include "../SharedFileReader.h"
+#include "../ReadAheadManager.h"
+#include "../DirectIo.h"
+#include "../ZeroCopySend.h"
+#include "../IoScheduler.h"
+#include "../DirectoryCache.h"
+#include "../DirectoryLister.h"
+#include "../TreeWalker.h"
+#include "../MetadataIndex.h"
+#include "../ChangeJournal.h"
+#include "../FileNameIndex.h"
+#include "../DirSizeIndex.h"
+#include "../PathResolver.h"
+#include "../Vfs.h"
+#include "../MemoryVfsBackend.h"
+#include "../UserRules.h"
+#include "../FtpCommand.h"
 
 class TestGestorFTP : public QObject
 {
@@ -44,20 +67,56 @@ private slots:
     // Tests de manejo de archivos
     void testFileTransfer();
     void testDirectoryListing();
+    void testDirectoryCache();
+    void testDirectoryLister();
+    void testMlsdFacts();
+    void testTreeWalker();
+    void testMetadataIndex();
+    void testChangeJournal();
+    void testFileNameIndex();
+    void testDirSizeIndex();
+    void testPathResolver();
+    void testVfs();
+    void testMemoryVfs();
+    void testUserRules();
+    void testFtpCommand();
     void testPathValidation();
 
     // Tests de comandos
     void testFTPCommands();
     void testInvalidCommands();
+    void testPipelinedReplies();
 
     // Tests de concurrencia
     void testMultipleConnections();
     void testSimultaneousTransfers();
+    void testIoSchedulerPriorities();
 
     // Tests de seguridad
     void testPasswordHashing();
     void testInvalidLogin();
     void testPathTraversal();
+    void testHandshakeScheduler();
+    void testTlsSessionCache();
+
+    // Tests de gestión de memoria
+    void testBufferPool();
+    void testHotFileCache();
+    void testSharedFileReader();
+    void testReadAheadWindow();
+
+    // Tests de transferencias por lotes
+    void testTarRoundTrip();
+
+    // Tests de E/S directa
+    void testDirectIoRoundTrip();
+    void testZeroCopySend();
+    void benchmarkSmallFilesDuringBulk_data();
+    void benchmarkSmallFilesDuringBulk();
+
+    // Tests del canal de control
+    void benchmarkCommandDispatch_data();
+    void benchmarkCommandDispatch();
 };
 
 #endif // TESTGESTORFTP_H
@@ -1,4 +1,4 @@
-QT += testlib network
+QT += testlib network sql
 QT -= gui
 
 CONFIG += qt console warn_on depend_includepath testcase
@@ -6,13 +6,43 @@ CONFIG -= app_bundle
 
 TEMPLATE = app
 
+# Igual que la aplicación: con el módulo SSL se prueban también las rutas FTPS
+qtHaveModule(ssl) {
+    QT += ssl
+    DEFINES += HAVE_SSL
+}
+
 SOURCES += \
     TestGestorFTP.cpp \
     ../DatabaseManager.cpp \
     ../FtpServer.cpp \
     ../FtpClientHandler.cpp \
     ../Logger.cpp \
-    ../TransferWorker.cpp
+    ../TransferWorker.cpp \
+    ../BufferPool.cpp \
+    ../ZeroCopySend.cpp \
+    ../TlsSessionCache.cpp \
+    ../TlsHandshakeScheduler.cpp \
+    ../TarFormat.cpp \
+    ../TarBatchStream.cpp \
+    ../TarExtractor.cpp \
+    ../ReadAheadManager.cpp \
+    ../HotFileCache.cpp \
+    ../SharedFileReader.cpp \
+    ../DirectIo.cpp \
+    ../IoScheduler.cpp \
+    ../DirectoryCache.cpp \
+    ../DirectoryLister.cpp \
+    ../TreeWalker.cpp \
+    ../MetadataIndex.cpp \
+    ../ChangeJournal.cpp \
+    ../FileNameIndex.cpp \
+    ../DirSizeIndex.cpp \
+    ../PathResolver.cpp \
+    ../Vfs.cpp \
+    ../MemoryVfsBackend.cpp \
+    ../UserRules.cpp \
+    ../FtpCommand.cpp
 
 HEADERS += \
     TestGestorFTP.h \
@@ -23,7 +53,30 @@ HEADERS += \
     ../TransferWorker.h \
     ../DirectoryCache.h \
     ../SecurityPolicy.h \
-    ../SystemMonitor.h
+    ../SystemMonitor.h \
+    ../BufferPool.h \
+    ../ZeroCopySend.h \
+    ../TlsSessionCache.h \
+    ../TlsHandshakeScheduler.h \
+    ../TarFormat.h \
+    ../TarBatchStream.h \
+    ../TarExtractor.h \
+    ../ReadAheadManager.h \
+    ../HotFileCache.h \
+    ../SharedFileReader.h \
+    ../DirectIo.h \
+    ../IoScheduler.h \
+    ../DirectoryLister.h \
+    ../TreeWalker.h \
+    ../MetadataIndex.h \
+    ../ChangeJournal.h \
+    ../FileNameIndex.h \
+    ../DirSizeIndex.h \
+    ../PathResolver.h \
+    ../Vfs.h \
+    ../MemoryVfsBackend.h \
+    ../UserRules.h \
+    ../FtpCommand.h
 
 INCLUDEPATH += ..
 